@@ -0,0 +1,301 @@
+// AdvMatcher: single-pass matcher over raw BLE advertisement bytes
+// Walks the [len][type][data...] AD structures once, looks for any of a set of tenant UUIDs
+// in binary (both byte orders) and returns service data / local name as views into the
+// payload. Nothing here allocates, so it is safe to run on every advert in onResult.
+//
+// The set is indexed by a 4-byte window of each UUID (see UuidPatternSet), so every data
+// byte costs one hash probe whether it holds 1 tenant or 256.
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+// AD types we care about (Bluetooth Core Spec Supplement, Part A)
+static const uint8_t AD_TYPE_SHORT_LOCAL_NAME = 0x08;
+static const uint8_t AD_TYPE_COMPLETE_LOCAL_NAME = 0x09;
+static const uint8_t AD_TYPE_SERVICE_DATA_16 = 0x16;
+static const uint8_t AD_TYPE_SERVICE_DATA_32 = 0x20;
+static const uint8_t AD_TYPE_SERVICE_DATA_128 = 0x21;
+static const uint8_t AD_TYPE_MANUFACTURER_DATA = 0xFF;
+
+// UUID sizes we match against: 32-bit up to 128-bit (the index needs a 4-byte window)
+static const size_t ADV_UUID_MIN_BYTES = 4;
+static const size_t ADV_UUID_MAX_BYTES = 16;
+// Most UUIDs one set holds
+static const size_t ADV_MAX_PATTERNS = 256;
+
+// Non-owning view into the advertisement payload
+struct ByteView {
+  const uint8_t* data = nullptr;
+  size_t len = 0;
+  bool empty() const { return len == 0; }
+};
+
+// One tenant UUID in both byte orders, prepared once from its hex text
+struct UuidPattern {
+  uint8_t forward[ADV_UUID_MAX_BYTES];
+  uint8_t reversed[ADV_UUID_MAX_BYTES];
+  uint8_t len = 0;
+  uint16_t tenant = 0;  // reported with matches; 0 is the built-in TARGET_UUID
+};
+
+// Result of walking one advertisement
+struct AdvMatch {
+  bool matched = false;
+  uint16_t tenant = 0;       // UuidPattern::tenant of the first UUID found
+  ByteView serviceData;      // first service-data entry, UUID prefix stripped
+  ByteView localName;        // shortened or complete local name
+  ByteView manufacturerData; // first manufacturer-specific entry
+};
+
+static inline int hexNibble(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// Fill in the reversed byte order once forward/len are set
+static inline void finishUuidPattern(UuidPattern &p) {
+  for (size_t i = 0; i < p.len; ++i) p.reversed[i] = p.forward[p.len - 1 - i];
+}
+
+// Build a UuidPattern from hex text such as "D7E1A3F4" (dashes are ignored)
+static inline bool parseUuidPattern(const char* hex, UuidPattern &out) {
+  size_t n = 0;
+  int hi = -1;
+  for (const char* p = hex; *p; ++p) {
+    if (*p == '-') continue;
+    int v = hexNibble(*p);
+    if (v < 0) return false;
+    if (hi < 0) { hi = v; continue; }
+    if (n >= ADV_UUID_MAX_BYTES) return false;
+    out.forward[n++] = (uint8_t)((hi << 4) | v);
+    hi = -1;
+  }
+  if (hi >= 0 || n < ADV_UUID_MIN_BYTES) return false;
+  out.len = (uint8_t)n;
+  finishUuidPattern(out);
+  return true;
+}
+
+static inline uint32_t loadLe32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint8_t asciiLowerByte(uint8_t c) {
+  return c >= 'A' && c <= 'Z' ? (uint8_t)(c + ('a' - 'A')) : c;
+}
+
+// Several UUIDs indexed for one pass over the advert. Each pattern has three index entries,
+// keyed by a 4-byte window: the forward bytes, the reversed bytes, and the lowercase hex
+// text (for local names). The window is always the UUID's leading bytes as written, which
+// is where Bluetooth-base UUIDs differ (their trailing 12 bytes are shared), so tenants
+// rarely share a key. Almost every window misses, so a bit filter with ~32 bits per key
+// answers first: a miss costs one bit test (and no mispredicted probe loop) at any size.
+class UuidPatternSet {
+ public:
+  UuidPatternSet() {}
+  UuidPatternSet(const UuidPatternSet &) = delete;
+  UuidPatternSet &operator=(const UuidPatternSet &) = delete;
+  ~UuidPatternSet() { free(block_); }
+
+  // Replace the set with a copy of patterns[0..count). On failure (too many patterns, out
+  // of memory) the set is left unchanged.
+  bool assign(const UuidPattern* patterns, size_t count) {
+    if (count > ADV_MAX_PATTERNS) return false;
+    size_t slots = 16;
+    while (slots < count * KINDS * 2) slots *= 2;
+    size_t filterBits = slots * 16;
+    size_t filterBytes = filterBits / 8;
+    size_t patternBytes = count * sizeof(UuidPattern);
+    size_t keyBytes = slots * sizeof(uint32_t);
+    uint8_t* block = (uint8_t*)malloc(filterBytes + keyBytes + patternBytes + slots * sizeof(uint16_t));
+    if (!block) return false;
+    free(block_);
+    block_ = block;
+    filter_ = (uint32_t*)block;
+    keys_ = (uint32_t*)(block + filterBytes);
+    patterns_ = (UuidPattern*)(block + filterBytes + keyBytes);
+    refs_ = (uint16_t*)(block + filterBytes + keyBytes + patternBytes);
+    memset(filter_, 0, filterBytes);
+    memcpy(patterns_, patterns, patternBytes);
+    memset(refs_, 0, slots * sizeof(uint16_t));
+    count_ = count;
+    generation_.store(nextGeneration(), std::memory_order_relaxed);
+    bytes_ = filterBytes + keyBytes + patternBytes + slots * sizeof(uint16_t);
+    mask_ = slots - 1;
+    shift_ = 32;
+    for (size_t s = slots; s > 1; s >>= 1) shift_--;
+    filterShift_ = shift_ - 4;
+
+    for (size_t i = 0; i < count; i++) {
+      const UuidPattern &p = patterns_[i];
+      insert(loadLe32(p.forward), i, KIND_FORWARD);
+      insert(loadLe32(p.reversed + p.len - 4), i, KIND_REVERSED);
+      insert(asciiKey(p), i, KIND_ASCII);
+    }
+    return true;
+  }
+
+  size_t size() const { return count_; }
+  size_t bytes() const { return bytes_; }
+  // Changes on every assign(), across all sets, so results cached against one set's
+  // contents (AdvertCache.h) are never taken for another's. Safe to read while the set
+  // is being reassigned.
+  uint32_t generation() const { return generation_.load(std::memory_order_relaxed); }
+  const UuidPattern &at(size_t i) const { return patterns_[i]; }
+
+  // Pattern found in data[0..len), or null. With text set, also look for the hex text of
+  // each UUID, case-insensitively (local names).
+  const UuidPattern* find(const uint8_t* data, size_t len, bool text) const {
+    if (count_ == 0 || len < 4) return nullptr;
+    uint32_t window = loadLe32(data);
+    for (size_t i = 0;; i++) {
+      if (mayHold(window)) {
+        if (const UuidPattern* p = probe(window, data, len, i, false)) return p;
+      }
+      if (i + 4 >= len) break;
+      window = (window >> 8) | ((uint32_t)data[i + 4] << 24);
+    }
+    if (!text) return nullptr;
+    uint32_t lower = 0;
+    for (size_t i = 0; i < 3; i++) lower |= (uint32_t)asciiLowerByte(data[i]) << (8 * (i + 1));
+    for (size_t i = 3; i < len; i++) {
+      lower = (lower >> 8) | ((uint32_t)asciiLowerByte(data[i]) << 24);
+      if (mayHold(lower)) {
+        if (const UuidPattern* p = probe(lower, data, len, i - 3, true)) return p;
+      }
+    }
+    return nullptr;
+  }
+
+ private:
+  enum Kind : uint8_t { KIND_FORWARD, KIND_REVERSED, KIND_ASCII };
+  static const size_t KINDS = 3;
+
+  // First two bytes of the UUID as lowercase hex text
+  static uint32_t asciiKey(const UuidPattern &p) {
+    static const char hexLower[] = "0123456789abcdef";
+    uint8_t text[4] = {(uint8_t)hexLower[p.forward[0] >> 4], (uint8_t)hexLower[p.forward[0] & 0x0F],
+                       (uint8_t)hexLower[p.forward[1] >> 4], (uint8_t)hexLower[p.forward[1] & 0x0F]};
+    return loadLe32(text);
+  }
+
+  size_t slotOf(uint32_t key) const { return (size_t)((key * 2654435761u) >> shift_) & mask_; }
+  uint32_t filterBitOf(uint32_t key) const { return (key * 0x85EBCA6Bu) >> filterShift_; }
+
+  void insert(uint32_t key, size_t pattern, Kind kind) {
+    uint32_t bit = filterBitOf(key);
+    filter_[bit >> 5] |= 1u << (bit & 31);
+    size_t s = slotOf(key);
+    while (refs_[s]) s = (s + 1) & mask_;
+    keys_[s] = key;
+    refs_[s] = (uint16_t)(((pattern << 2) | kind) + 1);
+  }
+
+  static uint32_t nextGeneration() {
+    static uint32_t generation = 0;
+    return ++generation;
+  }
+
+  // Bit filter: false means no entry has this key
+  bool mayHold(uint32_t key) const {
+    uint32_t bit = filterBitOf(key);
+    return (filter_[bit >> 5] >> (bit & 31)) & 1;
+  }
+
+  // Check every entry keyed by window for a pattern starting at data + at (the window
+  // is the pattern's first bytes, or its last bytes in reversed order).
+  // Out of line: only reached for the rare window that passes the filter.
+  __attribute__((noinline)) const UuidPattern* probe(uint32_t window, const uint8_t* data, size_t len, size_t at,
+                                                     bool text) const {
+    for (size_t s = slotOf(window); refs_[s]; s = (s + 1) & mask_) {
+      if (keys_[s] != window) continue;
+      Kind kind = (Kind)((refs_[s] - 1) & 3);
+      if ((kind == KIND_ASCII) != text) continue;
+      const UuidPattern &p = patterns_[(refs_[s] - 1) >> 2];
+      if (kind == KIND_FORWARD) {
+        if (at + p.len <= len && memcmp(data + at, p.forward, p.len) == 0) return &p;
+      } else if (kind == KIND_REVERSED) {
+        size_t start = at + 4;
+        if (start >= p.len && memcmp(data + start - p.len, p.reversed, p.len) == 0) return &p;
+      } else if (at + p.len * 2 <= len && textMatches(data + at, p)) {
+        return &p;
+      }
+    }
+    return nullptr;
+  }
+
+  static bool textMatches(const uint8_t* text, const UuidPattern &p) {
+    static const char hexLower[] = "0123456789abcdef";
+    for (size_t i = 0; i < p.len; i++) {
+      if (asciiLowerByte(text[2 * i]) != hexLower[p.forward[i] >> 4] ||
+          asciiLowerByte(text[2 * i + 1]) != hexLower[p.forward[i] & 0x0F]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  uint8_t* block_ = nullptr;  // filter_, keys_, patterns_ and refs_ in one allocation
+  uint32_t* filter_ = nullptr;
+  UuidPattern* patterns_ = nullptr;
+  uint32_t* keys_ = nullptr;
+  uint16_t* refs_ = nullptr;  // (pattern << 2 | kind) + 1; 0 = empty slot
+  size_t count_ = 0;
+  std::atomic<uint32_t> generation_{0};
+  size_t bytes_ = 0;
+  size_t mask_ = 0;
+  unsigned shift_ = 32;
+  unsigned filterShift_ = 32;
+};
+
+// Walk the AD structures once. Returns true when any UUID in the set was found in any
+// entry (UUID lists, service data, manufacturer data) in either byte order, or as hex
+// text inside the local name. Views are filled even when there is no match.
+static inline bool matchAdvert(const uint8_t* payload, size_t length, const UuidPatternSet &tenants, AdvMatch &out) {
+  out = AdvMatch();
+  size_t idx = 0;
+  while (idx < length) {
+    uint8_t len = payload[idx];
+    if (len == 0) break;                  // no more AD structures
+    if (idx + len >= length) break;       // malformed/truncated
+    uint8_t type = payload[idx + 1];
+    const uint8_t* data = payload + idx + 2;
+    size_t dataLen = len - 1;             // excluding type byte
+    bool name = false;
+
+    switch (type) {
+      case AD_TYPE_SHORT_LOCAL_NAME:
+      case AD_TYPE_COMPLETE_LOCAL_NAME:
+        if (out.localName.empty()) out.localName = ByteView{data, dataLen};
+        name = true;
+        break;
+      case AD_TYPE_SERVICE_DATA_16:
+      case AD_TYPE_SERVICE_DATA_32:
+      case AD_TYPE_SERVICE_DATA_128: {
+        size_t uuidLen = type == AD_TYPE_SERVICE_DATA_16 ? 2 : (type == AD_TYPE_SERVICE_DATA_32 ? 4 : 16);
+        if (out.serviceData.empty() && dataLen > uuidLen) out.serviceData = ByteView{data + uuidLen, dataLen - uuidLen};
+        break;
+      }
+      case AD_TYPE_MANUFACTURER_DATA:
+        if (out.manufacturerData.empty()) out.manufacturerData = ByteView{data, dataLen};
+        break;
+      default:
+        break;
+    }
+
+    if (!out.matched) {
+      if (const UuidPattern* p = tenants.find(data, dataLen, name)) {
+        out.matched = true;
+        out.tenant = p->tenant;
+      }
+    }
+
+    idx += (1 + len); // length byte + len bytes
+  }
+  return out.matched;
+}
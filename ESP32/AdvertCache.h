@@ -0,0 +1,140 @@
+// AdvertCache: remembers what matchAdvert() said about recently heard adverts
+// Most adverts come from the same TVs, headphones and laptops every few hundred ms with the
+// same bytes. The cache is keyed by a hash of the advertiser's address, the payload and the
+// tenant set's generation, so a repeat is answered without walking the AD structures: a
+// non-matching advert returns straight away, a matching one gets its views back and goes on
+// to the presence update.
+//
+// A result is a function of the payload and the tenant set alone, so a hit can only be
+// wrong on a 64-bit hash collision. An advertiser that rotates its random address (or
+// changes its payload) simply gets a new key; its old entry is never hit again and frees
+// its way after ADVERT_CACHE_TTL_SECONDS. New entries only take empty or expired ways, so a
+// burst of one-off adverts (rotations, a crowd walking past) cannot flush the regulars.
+// Only the BLE callback touches the entries. Time comes from tick(), called from loop(),
+// so a lookup does not read the clock; the counters may be read from any task.
+//
+// Off by default: on the host simulator (dense-rf profile) the cache answers about half of
+// all adverts, but a lookup costs more than the single-pass matcher it saves, mostly in
+// cache misses on the table. Build with -DSCANNER_ADVERT_CACHE=1 to compare on a device,
+// where the heartbeat's "match" histogram shows the difference.
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+#include "AdvMatcher.h"
+
+#ifndef SCANNER_ADVERT_CACHE
+#define SCANNER_ADVERT_CACHE 0
+#endif
+
+// Entries are stored and expired in epochs of this many seconds
+static const uint32_t ADVERT_CACHE_EPOCH_SECONDS = 4;
+// A stored result is recomputed once it is this old, hit or not
+static const uint32_t ADVERT_CACHE_TTL_SECONDS = 32;
+
+// Key for one advert: address, payload and the tenant set that judged it
+static inline uint64_t advertCacheKey(const uint8_t addr[6], const uint8_t* payload, size_t len, uint32_t generation) {
+  static const uint64_t K = 0x9E3779B97F4A7C15ULL;
+  uint64_t h = ((uint64_t)generation << 32 | len) * K;
+  uint64_t word = 0;
+  memcpy(&word, addr, 6);
+  h = (h ^ word) * K;
+  h ^= h >> 29;
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    memcpy(&word, payload + i, 8);
+    h = (h ^ word) * K;
+    h ^= h >> 29;
+  }
+  word = 0;
+  memcpy(&word, payload + i, len - i);
+  h = (h ^ word) * K;
+  h ^= h >> 32;
+  return h ? h : 1;  // 0 marks an empty way
+}
+
+// One remembered result (16 bytes). View offsets are into the payload, 0 = absent (an AD
+// structure's data never starts at offset 0).
+struct AdvertCacheEntry {
+  uint64_t key;     // advertCacheKey(); 0 = empty
+  uint16_t tenant;  // AdvMatch::tenant
+  uint8_t epoch;    // when the result was stored (wraps)
+  uint8_t matched;
+  uint8_t serviceDataOff, serviceDataLen;
+  uint8_t localNameOff, localNameLen;
+};
+
+// Capacity is the number of entries, in 4-way sets (power of two)
+template <size_t Capacity>
+class AdvertCache {
+  static_assert(Capacity >= 4 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+ public:
+  // Advance the clock entries are aged by
+  void tick(uint32_t nowSec) { epoch_.store((uint8_t)(nowSec / ADVERT_CACHE_EPOCH_SECONDS), std::memory_order_relaxed); }
+
+  // Remembered result for key, as matchAdvert() would have returned it for payload
+  bool lookup(uint64_t key, const uint8_t* payload, AdvMatch &out) {
+    uint8_t epoch = epoch_.load(std::memory_order_relaxed);
+    AdvertCacheEntry* set = setOf(key);
+    for (size_t w = 0; w < WAYS; w++) {
+      const AdvertCacheEntry &e = set[w];
+      if (e.key != key || expired(e, epoch)) continue;
+      out = AdvMatch();
+      out.matched = e.matched;
+      out.tenant = e.tenant;
+      if (e.serviceDataOff) out.serviceData = ByteView{payload + e.serviceDataOff, e.serviceDataLen};
+      if (e.localNameOff) out.localName = ByteView{payload + e.localNameOff, e.localNameLen};
+      hits_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  // Remember matchAdvert()'s result for key. Dropped when every way of its set holds a live
+  // entry.
+  void store(uint64_t key, const uint8_t* payload, const AdvMatch &match) {
+    uint8_t epoch = epoch_.load(std::memory_order_relaxed);
+    AdvertCacheEntry* set = setOf(key);
+    for (size_t w = 0; w < WAYS; w++) {
+      AdvertCacheEntry &e = set[w];
+      if (e.key != 0 && !expired(e, epoch)) continue;
+      if (e.key == 0) used_.fetch_add(1, std::memory_order_relaxed);
+      e.key = key;
+      e.tenant = match.tenant;
+      e.epoch = epoch;
+      e.matched = match.matched;
+      e.serviceDataOff = match.serviceData.empty() ? 0 : (uint8_t)(match.serviceData.data - payload);
+      e.serviceDataLen = (uint8_t)match.serviceData.len;
+      e.localNameOff = match.localName.empty() ? 0 : (uint8_t)(match.localName.data - payload);
+      e.localNameLen = (uint8_t)match.localName.len;
+      return;
+    }
+    full_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  uint32_t hits() const { return hits_.load(std::memory_order_relaxed); }
+  uint32_t misses() const { return misses_.load(std::memory_order_relaxed); }
+  // Results not stored because their set was full of live entries
+  uint32_t full() const { return full_.load(std::memory_order_relaxed); }
+  // Entries ever filled (expired ones are reused, so this stops growing once warm)
+  uint32_t used() const { return used_.load(std::memory_order_relaxed); }
+  size_t capacity() const { return Capacity; }
+
+ private:
+  static const size_t WAYS = 4;
+  static const size_t SETS = Capacity / WAYS;
+  static const uint8_t TTL_EPOCHS = ADVERT_CACHE_TTL_SECONDS / ADVERT_CACHE_EPOCH_SECONDS;
+
+  static bool expired(const AdvertCacheEntry &e, uint8_t epoch) { return (uint8_t)(epoch - e.epoch) >= TTL_EPOCHS; }
+  AdvertCacheEntry* setOf(uint64_t key) { return &entries_[((size_t)(key >> 32) & (SETS - 1)) * WAYS]; }
+
+  alignas(64) AdvertCacheEntry entries_[Capacity] = {};  // a set per cache line
+  std::atomic<uint8_t> epoch_{0};
+  std::atomic<uint32_t> used_{0};
+  std::atomic<uint32_t> hits_{0};
+  std::atomic<uint32_t> misses_{0};
+  std::atomic<uint32_t> full_{0};
+};
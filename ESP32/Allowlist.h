@@ -0,0 +1,161 @@
+// Allowlist: payloads that can belong to an active employee, synced from the Worker
+// GET /api/esp32/allowlist publishes one 32-bit key per active employee hex value and name
+// (see allowlistKey), sorted. The scanner drops sightings whose key is not in the list
+// before they reach the presence table or the event queue, so visitors and stray beacons
+// carrying the company UUID never cost a request. Lookup is a binary search.
+// Until a list has been loaded (first boot, Worker without the endpoint) everything passes.
+//
+// Wire/file layout, little-endian:
+//   'A' 'L' | version=1 u8 | reserved u8 | count u32 | key u32 * count (ascending)
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint8_t ALLOWLIST_VERSION = 1;
+static const size_t ALLOWLIST_HEADER_LEN = 8;
+// 64 KB; a 5,000-employee roster is ~20-40 KB depending on how many names differ from hex values
+static const size_t ALLOWLIST_MAX_KEYS = 16384;
+static const size_t ALLOWLIST_ETAG_MAX = 48;
+
+static inline int allowlistHexNibble(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// FNV-1a (32-bit) of the bytes the hex string decodes to, ASCII-lowercased. One key covers
+// both Worker lookups: the exact employee_details.hex_value, and hexToString(hex) matched
+// case-insensitively against the employee name. Case folding can only add false
+// positives, never miss an employee. Returns false for anything that is not even-length hex
+// (the Worker rejects those as invalid).
+static inline bool allowlistKey(const char* hex, size_t len, uint32_t &key) {
+  if (len == 0 || (len % 2) != 0) return false;
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < len; i += 2) {
+    int hi = allowlistHexNibble(hex[i]);
+    int lo = allowlistHexNibble(hex[i + 1]);
+    if (hi < 0 || lo < 0) return false;
+    uint8_t b = (uint8_t)(hi << 4 | lo);
+    if (b >= 'A' && b <= 'Z') b += 'a' - 'A';
+    h = (h ^ b) * 16777619u;
+  }
+  key = h;
+  return true;
+}
+
+class Allowlist {
+ public:
+  Allowlist() {}
+  Allowlist(const Allowlist &) = delete;
+  Allowlist &operator=(const Allowlist &) = delete;
+  ~Allowlist() { free(body_); }
+
+  // Take ownership of a malloc'd body in the layout above (freed here if it is malformed).
+  // The keys are used in place, so a list costs its download size and nothing more.
+  bool load(uint8_t* body, size_t len) {
+    uint32_t count = 0;
+    if (len < ALLOWLIST_HEADER_LEN || body[0] != 'A' || body[1] != 'L' || body[2] != ALLOWLIST_VERSION) {
+      free(body);
+      return false;
+    }
+    memcpy(&count, body + 4, 4);
+    const uint32_t* keys = (const uint32_t*)(body + ALLOWLIST_HEADER_LEN);
+    bool ok = count <= ALLOWLIST_MAX_KEYS && len == ALLOWLIST_HEADER_LEN + count * 4u;
+    for (uint32_t i = 1; ok && i < count; i++) ok = keys[i - 1] < keys[i];
+    if (!ok) {
+      free(body);
+      return false;
+    }
+    free(body_);
+    body_ = body;
+    len_ = len;
+    keys_ = keys;
+    count_ = count;
+    return true;
+  }
+
+  void swap(Allowlist &other) {
+    uint8_t* body = body_;
+    size_t len = len_;
+    const uint32_t* keys = keys_;
+    size_t count = count_;
+    body_ = other.body_;
+    len_ = other.len_;
+    keys_ = other.keys_;
+    count_ = other.count_;
+    other.body_ = body;
+    other.len_ = len;
+    other.keys_ = keys;
+    other.count_ = count;
+  }
+
+  bool loaded() const { return body_ != nullptr; }
+  size_t size() const { return count_; }
+  size_t bytes() const { return len_; }
+
+  bool contains(uint32_t key) const {
+    size_t lo = 0, hi = count_;
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      if (keys_[mid] < key) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo < count_ && keys_[lo] == key;
+  }
+
+  // Whether a sighting of hex may belong to an active employee
+  bool admits(const char* hex, size_t len) const {
+    if (!loaded()) return true;
+    uint32_t key;
+    return allowlistKey(hex, len, key) && contains(key);
+  }
+
+  // Persist the current list with its ETag: etag length u8 | etag | body
+  bool save(const char* path, const char* etag) const {
+    if (!loaded()) return false;
+    FILE* f = fopen(path, "wb");
+    if (!f) return false;
+    uint8_t etagLen = (uint8_t)strnlen(etag, ALLOWLIST_ETAG_MAX - 1);
+    bool ok = fwrite(&etagLen, 1, 1, f) == 1 && fwrite(etag, 1, etagLen, f) == etagLen &&
+              fwrite(body_, 1, len_, f) == len_;
+    return fclose(f) == 0 && ok;
+  }
+
+  // Load a list written by save(); etag (ALLOWLIST_ETAG_MAX bytes) receives its ETag
+  bool restore(const char* path, char* etag) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    uint8_t etagLen = 0;
+    long size = 0;
+    bool ok = fread(&etagLen, 1, 1, f) == 1 && etagLen < ALLOWLIST_ETAG_MAX && fread(etag, 1, etagLen, f) == etagLen &&
+              fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) > 0;
+    size_t bodyLen = ok ? (size_t)size - 1 - etagLen : 0;
+    uint8_t* body = ok && bodyLen <= ALLOWLIST_HEADER_LEN + ALLOWLIST_MAX_KEYS * 4 ? (uint8_t*)malloc(bodyLen ? bodyLen : 1) : nullptr;
+    ok = body && fseek(f, 1 + etagLen, SEEK_SET) == 0 && fread(body, 1, bodyLen, f) == bodyLen;
+    fclose(f);
+    if (!ok) {
+      free(body);
+      etag[0] = '\0';
+      return false;
+    }
+    etag[etagLen] = '\0';
+    if (!load(body, bodyLen)) {
+      etag[0] = '\0';
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  uint8_t* body_ = nullptr;
+  size_t len_ = 0;
+  const uint32_t* keys_ = nullptr;
+  size_t count_ = 0;
+};
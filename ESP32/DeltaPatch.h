@@ -0,0 +1,163 @@
+// DeltaPatch: streaming applier for the firmware delta patches built by /api/ota/upload
+// A patch rebuilds the new image from the image we are running plus literal bytes:
+//
+//   header  "AAD1" | baseSize u32 | newSize u32 | baseSha256[32] | newSha256[32]  (LE)
+//   ops     0x01 COPY   varint baseOffset, varint length  -> base[offset, offset+length)
+//           0x02 INSERT varint length, length bytes       -> the bytes themselves
+//           0x00 END
+//
+// Bytes are fed as they arrive from the network and output is written sequentially, so
+// applying needs a few hundred bytes of RAM regardless of image size.
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+static const size_t DELTA_HEADER_LEN = 76;
+
+struct DeltaHeader {
+  uint32_t baseSize;
+  uint32_t newSize;
+  uint8_t baseSha256[32];
+  uint8_t newSha256[32];
+};
+
+static inline uint32_t readLe32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline bool parseDeltaHeader(const uint8_t* buf, size_t len, DeltaHeader &out) {
+  if (len < DELTA_HEADER_LEN || memcmp(buf, "AAD1", 4) != 0) return false;
+  out.baseSize = readLe32(buf + 4);
+  out.newSize = readLe32(buf + 8);
+  memcpy(out.baseSha256, buf + 12, 32);
+  memcpy(out.newSha256, buf + 44, 32);
+  return out.newSize > 0;
+}
+
+class DeltaApplier {
+ public:
+  // readBase fills out with base[offset, offset+len); write appends to the new image
+  typedef bool (*ReadBaseFn)(void* ctx, uint32_t offset, uint8_t* out, size_t len);
+  typedef bool (*WriteFn)(void* ctx, const uint8_t* data, size_t len);
+
+  DeltaApplier(const DeltaHeader &header, ReadBaseFn readBase, WriteFn write, void* ctx)
+      : header_(header), readBase_(readBase), write_(write), ctx_(ctx) {}
+
+  // Feed the patch body (everything after the header). Returns false once the patch is
+  // malformed or an I/O callback fails; error() says why.
+  bool feed(const uint8_t* data, size_t len) {
+    while (len > 0) {
+      if (error_) return false;
+      switch (state_) {
+        case OP:
+          op_ = *data++;
+          len--;
+          if (op_ == OP_END) {
+            state_ = FINISHED;
+          } else if (op_ == OP_COPY || op_ == OP_INSERT) {
+            state_ = op_ == OP_COPY ? COPY_OFFSET : LENGTH;
+            startVarint();
+          } else {
+            fail("unknown op");
+          }
+          break;
+        case COPY_OFFSET:
+        case LENGTH: {
+          uint8_t b = *data++;
+          len--;
+          if (!varintByte(b)) break;
+          if (state_ == COPY_OFFSET) {
+            copyOffset_ = varint_;
+            state_ = LENGTH;
+            startVarint();
+          } else if (op_ == OP_COPY) {
+            copyBase(copyOffset_, varint_);
+            state_ = OP;
+          } else {
+            remaining_ = varint_;
+            if (remaining_ > header_.newSize - produced_) fail("insert past end of image");
+            state_ = remaining_ ? INSERT_DATA : OP;
+          }
+          break;
+        }
+        case INSERT_DATA: {
+          size_t n = len < remaining_ ? len : remaining_;
+          emit(data, n);
+          data += n;
+          len -= n;
+          remaining_ -= (uint32_t)n;
+          if (remaining_ == 0) state_ = OP;
+          break;
+        }
+        case FINISHED:
+          fail("data after END");
+          break;
+      }
+    }
+    return !error_;
+  }
+
+  // END seen and exactly newSize bytes produced
+  bool done() const { return !error_ && state_ == FINISHED && produced_ == header_.newSize; }
+  uint32_t produced() const { return produced_; }
+  const char* error() const { return error_; }
+
+ private:
+  enum State : uint8_t { OP, COPY_OFFSET, LENGTH, INSERT_DATA, FINISHED };
+  static const uint8_t OP_END = 0x00;
+  static const uint8_t OP_COPY = 0x01;
+  static const uint8_t OP_INSERT = 0x02;
+
+  void fail(const char* why) {
+    if (!error_) error_ = why;
+  }
+
+  void startVarint() {
+    varint_ = 0;
+    varintShift_ = 0;
+  }
+
+  // LEB128; returns true once the value is complete
+  bool varintByte(uint8_t b) {
+    if (varintShift_ > 28) {
+      fail("varint too long");
+      return false;
+    }
+    varint_ |= (uint32_t)(b & 0x7F) << varintShift_;
+    varintShift_ += 7;
+    return (b & 0x80) == 0;
+  }
+
+  void copyBase(uint32_t offset, uint32_t len) {
+    if (offset > header_.baseSize || len > header_.baseSize - offset) return fail("copy outside base image");
+    if (len > header_.newSize - produced_) return fail("copy past end of image");
+    while (len > 0 && !error_) {
+      size_t n = len < sizeof(scratch_) ? len : sizeof(scratch_);
+      if (!readBase_(ctx_, offset, scratch_, n)) return fail("base read failed");
+      emit(scratch_, n);
+      offset += (uint32_t)n;
+      len -= (uint32_t)n;
+    }
+  }
+
+  void emit(const uint8_t* data, size_t n) {
+    if (n == 0) return;
+    if (!write_(ctx_, data, n)) return fail("image write failed");
+    produced_ += (uint32_t)n;
+  }
+
+  DeltaHeader header_;
+  ReadBaseFn readBase_;
+  WriteFn write_;
+  void* ctx_;
+  State state_ = OP;
+  uint8_t op_ = 0;
+  uint32_t varint_ = 0;
+  uint8_t varintShift_ = 0;
+  uint32_t copyOffset_ = 0;
+  uint32_t remaining_ = 0;
+  uint32_t produced_ = 0;
+  const char* error_ = nullptr;
+  uint8_t scratch_[512];
+};
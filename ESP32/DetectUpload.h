@@ -0,0 +1,142 @@
+// DetectUpload: how a detection goes over ServerConnection and how the answer is read
+// Shared by Scanner.cpp and the host fleet load generator (host/FleetLoad.cpp), so the load
+// the Worker sees in a test is byte for byte what scanners send: the same JSON body or
+// binary frame (WireFormat.h), the same reading of each answer and the same retry policy.
+//
+// Every answer is reduced to a WireStatus, whichever format carried the event:
+//   binary  the status in the ack; a non-200 answer counts for every record in the frame
+//   JSON    200 {"success":true} is WIRE_RECORDED ({"deduped":true}: WIRE_DEDUPED), a 404
+//           WIRE_NOT_FOUND, any other final 4xx WIRE_DUPLICATE for the Worker's "Duplicate
+//           check-in/checkout blocked" and WIRE_INVALID otherwise
+// WIRE_RETRY means no usable answer (transport error, 5xx, 408/429, malformed ack): resend.
+// None of these take server.mutex() or call finish(); the caller does, around the request.
+#pragma once
+#include <Arduino.h>
+#include "EventQueue.h"
+#include "ServerConnection.h"
+#include "WireFormat.h"
+
+// Attempts per event (or batch), and the pause before attempt n + 1: linear, 1 s then 2 s
+static const int DETECT_MAX_ATTEMPTS = 3;
+static inline uint32_t detectRetryBackoffMs(int attempt) { return 1000 * (uint32_t)attempt; }
+
+// Returned instead of an HTTP code when a 200 response is not a valid binary ack
+static const int WIRE_BAD_ACK = -100;
+
+// Outcome of delivering one event
+enum PostResult : uint8_t {
+  POST_OK,        // recorded or deduped by the server
+  POST_REJECTED,  // server answered and refused it for good (unknown hex, duplicate status)
+  POST_FAILED,    // never got an answer (WiFi down, transport error, 5xx)
+};
+
+// 4xx answers other than timeouts/throttling are final; retrying won't change them
+static inline bool isFinalRejection(int code) {
+  return code >= 400 && code < 500 && code != 408 && code != 429;
+}
+
+// Our Worker returns { success: true, ... } or { success: true, deduped: true }
+static inline bool wasPostSuccessful(const String &response) {
+  return response.indexOf("\"success\":true") >= 0 ||
+         response.indexOf("\"deduped\":true") >= 0;
+}
+
+// Settled answers become results; WIRE_RETRY is the caller's to resend or give up on
+static inline PostResult postResultOf(uint8_t status) {
+  if (status <= WIRE_DEDUPED) return POST_OK;
+  return status == WIRE_RETRY ? POST_FAILED : POST_REJECTED;
+}
+
+// {"hex_value":"...","action":"checkin|checkout","tenant":N,"device_id":"...","seq":N[,"observed_at_ms":N]}
+// Returns the length, or 0 if it does not fit in cap
+static inline size_t formatDetectionJson(char* out, size_t cap, const DetectionEvent &ev, const char* deviceId) {
+  int len = snprintf(out, cap, "{\"hex_value\":\"%s\",\"action\":\"%s\",\"tenant\":%u,\"device_id\":\"%s\",\"seq\":%u",
+                     ev.hex, eventActionName(ev.action), (unsigned)ev.tenant, deviceId, (unsigned)ev.seq);
+  if (ev.observedMs && len > 0 && (size_t)len < cap) {
+    len += snprintf(out + len, cap - len, ",\"observed_at_ms\":%llu", (unsigned long long)ev.observedMs);
+  }
+  if (len > 0 && (size_t)len < cap) len += snprintf(out + len, cap - len, "}");
+  return len > 0 && (size_t)len < cap ? (size_t)len : 0;
+}
+
+// {"device_id":"...","events":[{"hex_value":"...","action":"...","tenant":N,"seq":N,"age_ms":N,
+// "duration_s":N[,"observed_at_ms":N]},...]} for events[which[j]] (or events[j] when which is
+// null), sent at nowMs. Returns the length, or 0 if it does not fit in cap.
+static inline size_t formatBatchJson(char* out, size_t cap, const DetectionEvent* events, const size_t* which,
+                                     size_t n, const char* deviceId, uint32_t nowMs) {
+  int len = snprintf(out, cap, "{\"device_id\":\"%s\",\"events\":[", deviceId);
+  for (size_t j = 0; j < n && len > 0 && (size_t)len < cap; j++) {
+    const DetectionEvent &ev = events[which ? which[j] : j];
+    len += snprintf(out + len, cap - len,
+                    "%s{\"hex_value\":\"%s\",\"action\":\"%s\",\"tenant\":%u,\"seq\":%u,\"age_ms\":%u,\"duration_s\":%u",
+                    j > 0 ? "," : "", ev.hex, eventActionName(ev.action), (unsigned)ev.tenant, (unsigned)ev.seq,
+                    (unsigned)(nowMs - ev.seenAtMs), (unsigned)ev.durationSec);
+    if (ev.observedMs && (size_t)len < cap) {
+      len += snprintf(out + len, cap - len, ",\"observed_at_ms\":%llu", (unsigned long long)ev.observedMs);
+    }
+    if ((size_t)len < cap) len += snprintf(out + len, cap - len, "}");
+  }
+  if (len > 0 && (size_t)len < cap) len += snprintf(out + len, cap - len, "]}");
+  return len > 0 && (size_t)len < cap ? (size_t)len : 0;
+}
+
+// One frame holding events[which[j]] (or events[j] when which is null), sent at nowMs.
+// Returns its length, or 0 if it does not fit in cap.
+static inline size_t encodeWireFrame(uint8_t* out, size_t cap, const DetectionEvent* events, const size_t* which,
+                                     size_t n, const uint8_t device[WIRE_DEVICE_ID_LEN], uint32_t nowMs) {
+  if (n > 255 || cap < WIRE_FRAME_HEADER_LEN) return 0;
+  size_t len = encodeWireFrameHeader(out, (uint8_t)n, device);
+  for (size_t j = 0; j < n; j++) {
+    size_t record = encodeWireRecord(events[which ? which[j] : j], nowMs, out + len, cap - len);
+    if (record == 0) return 0;
+    len += record;
+  }
+  return len;
+}
+
+// POST a frame of n records and fill statuses[0..n) from the ack (every one WIRE_RETRY if
+// there is none). Returns the HTTP code, a negative transport error or WIRE_BAD_ACK.
+static inline int sendWireFrame(ServerConnection &server, const ServerConnection::Endpoint &target,
+                                const uint8_t* frame, size_t len, uint8_t* statuses, size_t n) {
+  memset(statuses, WIRE_RETRY, n);
+  int code = server.send("POST", target, WIRE_EVENTS_CONTENT_TYPE, frame, len);
+  if (code == 200) {
+    uint8_t ack[WIRE_ACK_HEADER_LEN + 255];
+    int ackLen = server.readBody(ack, sizeof(ack));
+    if (ackLen < 0 || !decodeWireAck(ack, (size_t)ackLen, statuses, n)) {
+      memset(statuses, WIRE_RETRY, n);
+      code = WIRE_BAD_ACK;
+    }
+  } else if (isFinalRejection(code)) {
+    memset(statuses, WIRE_INVALID, n);
+  }
+  return code;
+}
+
+// POST one event to target (/api/esp32/detect) in either format and set status as above.
+// response, if given, receives a JSON answer's body. Returns the HTTP code or a negative error.
+static inline int sendDetection(ServerConnection &server, const ServerConnection::Endpoint &target,
+                                const DetectionEvent &ev, bool binary, const uint8_t deviceMac[WIRE_DEVICE_ID_LEN],
+                                const char* deviceId, uint8_t &status, String* response = nullptr) {
+  status = WIRE_RETRY;
+  if (binary) {
+    uint8_t frame[WIRE_FRAME_HEADER_LEN + WIRE_RECORD_MAX];
+    size_t len = encodeWireFrame(frame, sizeof(frame), &ev, nullptr, 1, deviceMac, millis());
+    return sendWireFrame(server, target, frame, len, &status, 1);
+  }
+
+  char payload[EVENT_HEX_MAX + 160];
+  size_t len = formatDetectionJson(payload, sizeof(payload), ev, deviceId);
+  int code = server.send("POST", target, "application/json", (const uint8_t*)payload, len);
+  String body;
+  if (code > 0) body = server.http().getString();
+  if (code == 200 || code == 201) {
+    if (wasPostSuccessful(body)) status = body.indexOf("\"deduped\":true") >= 0 ? WIRE_DEDUPED : WIRE_RECORDED;
+  } else if (code == 404) {
+    status = WIRE_NOT_FOUND;
+  } else if (isFinalRejection(code)) {
+    status = body.indexOf("Duplicate") >= 0 ? WIRE_DUPLICATE : WIRE_INVALID;
+  }
+  if (response) *response = body;
+  return code;
+}
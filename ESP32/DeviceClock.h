@@ -0,0 +1,108 @@
+// DeviceClock: wall-clock time for event stamps, disciplined by SNTP
+// millis() restarts at every boot and wraps after 49 days, so on its own it can only say how
+// long ago something happened. Each SNTP sync anchors millis() to Unix time; between syncs
+// the clock extrapolates from the last anchor, corrected for the crystal's drift measured
+// across successive syncs. Events are stamped with epochMsAt() when they are queued, so the
+// time survives queuing, retries, batching and the flash journal.
+//
+// sync() is called from the SNTP client's task and the readers run on the BLE and network
+// tasks, so the anchor is guarded by a mutex (taken once per event, never per advert).
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+
+// A sync closer than this to the previous anchor only moves the anchor; drift is measured
+// over longer spans, where SNTP's ~10 ms jitter is small against what the crystal gains
+static const uint32_t CLOCK_DRIFT_MIN_SPAN_MS = 10 * 60 * 1000;
+// Measured rates beyond this are a stepped server clock, not a crystal; they are ignored
+static const int32_t CLOCK_DRIFT_MAX_PPM = 500;
+// Anything earlier than this (2024-01-01) is not a synced clock
+static const uint64_t CLOCK_MIN_VALID_EPOCH_MS = 1704067200000ULL;
+
+class DeviceClock {
+ public:
+  // SNTP says it was epochMs at millis() nowMs
+  void sync(uint64_t epochMs, uint32_t nowMs) {
+    if (epochMs < CLOCK_MIN_VALID_EPOCH_MS) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    syncs_++;
+    if (syncs_ > 1) {
+      lastErrorMs_ = (int32_t)((int64_t)epochMs - (int64_t)extrapolate(nowMs));
+      uint32_t spanMs = nowMs - anchorMs_;
+      // Keep the older anchor so the next span is long enough to measure
+      if (spanMs < CLOCK_DRIFT_MIN_SPAN_MS) return;
+      // Rate of SNTP time against millis() over the span, in ppm
+      int64_t gainedMs = (int64_t)(epochMs - anchorEpochMs_) - (int64_t)spanMs;
+      int32_t measured = (int32_t)(gainedMs * 1000000 / (int64_t)spanMs);
+      if (measured >= -CLOCK_DRIFT_MAX_PPM && measured <= CLOCK_DRIFT_MAX_PPM) {
+        driftPpm_ = driftMeasured_ ? (3 * driftPpm_ + measured) / 4 : measured;
+        driftMeasured_ = true;
+      }
+    }
+    anchorEpochMs_ = epochMs;
+    anchorMs_ = nowMs;
+  }
+
+  bool synced() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return syncs_ > 0;
+  }
+
+  // Unix time in ms at millis() atMs, or 0 before the first sync. atMs may be up to 24 days
+  // either side of the last sync.
+  uint64_t epochMsAt(uint32_t atMs) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return syncs_ > 0 ? extrapolate(atMs) : 0;
+  }
+
+  uint32_t syncs() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return syncs_;
+  }
+  // Crystal drift against SNTP time (ppm; positive: millis() runs slow)
+  int32_t driftPpm() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return driftPpm_;
+  }
+  // How far the extrapolated clock was off at the latest sync (ms)
+  int32_t lastErrorMs() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lastErrorMs_;
+  }
+
+ private:
+  uint64_t extrapolate(uint32_t atMs) const {
+    int64_t sinceMs = (int32_t)(atMs - anchorMs_);
+    return (uint64_t)((int64_t)anchorEpochMs_ + sinceMs + sinceMs * driftPpm_ / 1000000);
+  }
+
+  mutable std::mutex mutex_;
+  uint64_t anchorEpochMs_ = 0;
+  uint32_t anchorMs_ = 0;
+  uint32_t syncs_ = 0;
+  int32_t driftPpm_ = 0;
+  bool driftMeasured_ = false;
+  int32_t lastErrorMs_ = 0;
+};
+
+// Seconds since boot that keep counting across millis()'s 49.7-day wrap (uint32 seconds last
+// 136 years), for deadlines and intervals that outlive one lap of millis(): presence timers
+// (TimerWheel.h), dedupe TTLs and the network task's schedule. Readings from several tasks
+// may arrive slightly out of order; each is placed within 24 days of the newest one, so it
+// only has to be read at least that often (loop() reads it every tick).
+// seconds * 1000, truncated to 32 bits, is a millis() reading again (to the second).
+class UptimeClock {
+ public:
+  uint32_t seconds(uint32_t nowMs) {
+    uint64_t last = lastMs_.load(std::memory_order_relaxed);
+    for (;;) {
+      uint64_t now = last == 0 ? nowMs : last + (int64_t)(int32_t)(nowMs - (uint32_t)last);
+      if (now <= last) return (uint32_t)(now / 1000);  // an older reading than the newest
+      if (lastMs_.compare_exchange_weak(last, now, std::memory_order_relaxed)) return (uint32_t)(now / 1000);
+    }
+  }
+
+ private:
+  std::atomic<uint64_t> lastMs_{0};
+};
@@ -0,0 +1,309 @@
+// EventJournal: append-only ring journal of detection events in flash
+// Events that cannot be delivered (WiFi down, server errors) are appended here and
+// replayed in order once the server is reachable again, so a router reboot no longer
+// loses attendance. Storage is a fixed set of segment files written round-robin:
+// a full segment rotates to the next one (spreading erases across the partition) and
+// the oldest segment is only overwritten when the journal is completely full.
+// Uses plain stdio, so it runs on LittleFS (through the ESP32 VFS) and on a Linux file.
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "EventQueue.h"
+
+static const size_t JOURNAL_SEGMENTS = 8;
+static const size_t JOURNAL_SEGMENT_RECORDS = 128; // 12 KB per segment, 96 KB total
+
+// One event on flash; fixed size so record i of a segment lives at i * sizeof(JournalRecord).
+// Records written before observedMs was added (88 bytes) fail the CRC and are dropped on open.
+struct JournalRecord {
+  uint32_t seq;       // journal sequence number, contiguous across segments
+  uint32_t seenAtMs;  // DetectionEvent::seenAtMs (meaningless after a reboot; observedMs is not)
+  uint32_t eventSeq;  // DetectionEvent::seq
+  uint8_t action;
+  uint8_t hexLen;
+  uint16_t tenant;    // DetectionEvent::tenant
+  uint64_t observedMs;   // DetectionEvent::observedMs
+  char hex[EVENT_HEX_MAX];
+  uint32_t durationSec;  // DetectionEvent::durationSec
+  uint32_t crc;       // CRC-32 over all fields above
+};
+static_assert(sizeof(JournalRecord) == 96, "JournalRecord layout changed");
+
+// CRC-32 (IEEE 802.3), nibble table
+static inline uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t len) {
+  static const uint32_t table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+  };
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++) {
+    crc = table[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+    crc = table[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+  }
+  return ~crc;
+}
+
+class EventJournal {
+ public:
+  ~EventJournal() { close(); }
+
+  // Mount the journal in dir (created if missing) and recover its state. Records with a
+  // bad CRC at the end of a segment (power cut mid-write) are discarded; one in the middle
+  // (a flipped bit) is kept as a hole that peek() skips, so the records after it survive.
+  bool open(const char* dir) {
+    close();
+    snprintf(dir_, sizeof(dir_), "%s", dir);
+    if (mkdir(dir_, 0755) != 0 && errno != EEXIST) return false;
+
+    uint32_t newest = 0;
+    for (size_t i = 0; i < JOURNAL_SEGMENTS; i++) {
+      recoverSegment(i);
+      if (segCount_[i] > 0 && segLast(i) >= newest) {
+        newest = segLast(i);
+        head_ = i;
+      }
+    }
+    nextSeq_ = newest + 1;
+    ackedSeq_ = readAck();
+    if (ackedSeq_ >= nextSeq_) {
+      // ack.bin outlived the records it covered; left as is it would swallow the next appends
+      ackedSeq_ = nextSeq_ - 1;
+      writeAck();
+    }
+    open_ = true;
+    return true;
+  }
+
+  void close() {
+    if (headFile_) fclose(headFile_);
+    headFile_ = nullptr;
+    open_ = false;
+  }
+
+  bool isOpen() const { return open_; }
+
+  // Durably append one event. Returns false on I/O errors.
+  bool append(const DetectionEvent &ev) {
+    if (!open_) return false;
+    if (segCount_[head_] >= JOURNAL_SEGMENT_RECORDS) rotate();
+    if (segCount_[head_] == 0) segFirst_[head_] = nextSeq_;
+    if (!headFile_ && !openHead()) return false;
+
+    JournalRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.seq = nextSeq_;
+    rec.seenAtMs = ev.seenAtMs;
+    rec.eventSeq = ev.seq;
+    rec.action = ev.action;
+    rec.hexLen = (uint8_t)strnlen(ev.hex, EVENT_HEX_MAX);
+    rec.tenant = ev.tenant;
+    rec.observedMs = ev.observedMs;
+    memcpy(rec.hex, ev.hex, rec.hexLen);
+    rec.durationSec = ev.durationSec;
+    rec.crc = crc32Update(0, (const uint8_t*)&rec, offsetof(JournalRecord, crc));
+
+    if (fseek(headFile_, (long)(segCount_[head_] * sizeof(JournalRecord)), SEEK_SET) != 0 ||
+        fwrite(&rec, sizeof(rec), 1, headFile_) != 1 || fflush(headFile_) != 0) {
+      writeErrors_++;
+      fclose(headFile_);
+      headFile_ = nullptr;
+      return false;
+    }
+    fsync(fileno(headFile_));
+    segCount_[head_]++;
+    nextSeq_++;
+    appended_++;
+    return true;
+  }
+
+  // Number of records not yet acknowledged
+  uint32_t pending() const {
+    uint32_t first = firstPendingSeq();
+    return nextSeq_ > first ? nextSeq_ - first : 0;
+  }
+
+  // Read up to max of the oldest pending events, in order. lastSeq receives the sequence
+  // number to pass to ackThrough() once they are delivered (corrupt records are skipped
+  // but still covered by lastSeq).
+  size_t peek(DetectionEvent* out, size_t max, uint32_t &lastSeq) {
+    size_t n = 0;
+    lastSeq = ackedSeq_;
+    uint32_t seq = firstPendingSeq();
+    FILE* f = nullptr;
+    size_t fileSeg = JOURNAL_SEGMENTS;
+    while (n < max && seq < nextSeq_) {
+      size_t seg = segmentFor(seq);
+      if (seg == JOURNAL_SEGMENTS) {
+        // A segment lost every record: skip to the next one that has any
+        uint32_t resume = nextSegmentStart(seq);
+        if (resume == 0) break;
+        corrupt_ += resume - seq;
+        lastSeq = resume - 1;
+        seq = resume;
+        continue;
+      }
+      if (seg != fileSeg) {
+        if (f) fclose(f);
+        if (headFile_) fflush(headFile_);
+        char path[96];
+        segmentPath(seg, path, sizeof(path));
+        f = fopen(path, "rb");
+        fileSeg = seg;
+        if (!f) break;
+      }
+      JournalRecord rec;
+      bool ok = fseek(f, (long)((seq - segFirst_[seg]) * sizeof(JournalRecord)), SEEK_SET) == 0 &&
+                fread(&rec, sizeof(rec), 1, f) == 1 && validRecord(rec, seq);
+      if (ok) {
+        out[n].set(rec.hex, rec.hexLen, rec.action, rec.seenAtMs);
+        out[n].seq = rec.eventSeq;
+        out[n].tenant = rec.tenant;
+        out[n].observedMs = rec.observedMs;
+        out[n].durationSec = rec.durationSec;
+        n++;
+      } else {
+        corrupt_++;
+      }
+      lastSeq = seq;
+      seq++;
+    }
+    if (f) fclose(f);
+    return n;
+  }
+
+  // Mark everything up to and including seq as delivered (persisted)
+  void ackThrough(uint32_t seq) {
+    if (seq <= ackedSeq_ || seq >= nextSeq_) return;
+    ackedSeq_ = seq;
+    writeAck();
+  }
+
+  uint32_t nextSeq() const { return nextSeq_; }    // journal number the next append gets
+  uint32_t ackedSeq() const { return ackedSeq_; }  // everything up to here is delivered
+  uint32_t appended() const { return appended_; }
+  uint32_t overwritten() const { return overwritten_; }
+  uint32_t corrupt() const { return corrupt_; }
+  uint32_t writeErrors() const { return writeErrors_; }
+
+ private:
+  uint32_t segLast(size_t i) const { return segFirst_[i] + (uint32_t)segCount_[i] - 1; }
+
+  uint32_t firstPendingSeq() const {
+    uint32_t oldest = nextSeq_;
+    for (size_t i = 0; i < JOURNAL_SEGMENTS; i++) {
+      if (segCount_[i] > 0 && segFirst_[i] < oldest) oldest = segFirst_[i];
+    }
+    return ackedSeq_ + 1 > oldest ? ackedSeq_ + 1 : oldest;
+  }
+
+  size_t segmentFor(uint32_t seq) const {
+    for (size_t i = 0; i < JOURNAL_SEGMENTS; i++) {
+      if (segCount_[i] > 0 && seq >= segFirst_[i] && seq <= segLast(i)) return i;
+    }
+    return JOURNAL_SEGMENTS;
+  }
+
+  // First sequence number of the earliest segment starting after seq (0: none)
+  uint32_t nextSegmentStart(uint32_t seq) const {
+    uint32_t best = 0;
+    for (size_t i = 0; i < JOURNAL_SEGMENTS; i++) {
+      if (segCount_[i] > 0 && segFirst_[i] > seq && (best == 0 || segFirst_[i] < best)) best = segFirst_[i];
+    }
+    return best;
+  }
+
+  static bool validRecord(const JournalRecord &rec, uint32_t expectedSeq) {
+    return rec.seq == expectedSeq && rec.hexLen > 0 && rec.hexLen <= EVENT_HEX_MAX &&
+           rec.crc == crc32Update(0, (const uint8_t*)&rec, offsetof(JournalRecord, crc));
+  }
+
+  void segmentPath(size_t i, char* out, size_t outLen) const {
+    snprintf(out, outLen, "%s/seg%u.bin", dir_, (unsigned)i);
+  }
+
+  // Segment i runs up to its last valid record that sits where its number says it should
+  // (segFirst + position). Invalid records before that are holes; after it, a torn tail.
+  void recoverSegment(size_t i) {
+    segFirst_[i] = 0;
+    segCount_[i] = 0;
+    char path[96];
+    segmentPath(i, path, sizeof(path));
+    FILE* f = fopen(path, "rb");
+    if (!f) return;
+    JournalRecord rec;
+    for (size_t pos = 0; pos < JOURNAL_SEGMENT_RECORDS && fread(&rec, sizeof(rec), 1, f) == 1; pos++) {
+      if (rec.seq <= pos) continue;  // cannot be record pos of any segment
+      uint32_t first = segCount_[i] == 0 ? rec.seq - (uint32_t)pos : segFirst_[i];
+      if (!validRecord(rec, first + (uint32_t)pos)) continue;
+      segFirst_[i] = first;
+      segCount_[i] = pos + 1;
+    }
+    fclose(f);
+  }
+
+  bool openHead() {
+    char path[96];
+    segmentPath(head_, path, sizeof(path));
+    headFile_ = fopen(path, segCount_[head_] == 0 ? "wb" : "r+b");
+    return headFile_ != nullptr;
+  }
+
+  // Move to the next segment, truncating it. Anything still pending there is lost.
+  void rotate() {
+    if (headFile_) fclose(headFile_);
+    headFile_ = nullptr;
+    head_ = (head_ + 1) % JOURNAL_SEGMENTS;
+    if (segCount_[head_] > 0) {
+      uint32_t first = segFirst_[head_];
+      uint32_t last = segLast(head_);
+      if (last > ackedSeq_) overwritten_ += last - (first > ackedSeq_ ? first : ackedSeq_ + 1) + 1;
+    }
+    segFirst_[head_] = 0;
+    segCount_[head_] = 0;
+  }
+
+  uint32_t readAck() {
+    char path[96];
+    snprintf(path, sizeof(path), "%s/ack.bin", dir_);
+    FILE* f = fopen(path, "rb");
+    if (!f) return 0;
+    uint32_t v[2] = {0, 0};
+    size_t got = fread(v, sizeof(v), 1, f);
+    fclose(f);
+    if (got != 1 || v[1] != crc32Update(0, (const uint8_t*)&v[0], sizeof(v[0]))) return 0;
+    return v[0];
+  }
+
+  void writeAck() {
+    char path[96];
+    snprintf(path, sizeof(path), "%s/ack.bin", dir_);
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+      writeErrors_++;
+      return;
+    }
+    uint32_t v[2] = {ackedSeq_, crc32Update(0, (const uint8_t*)&ackedSeq_, sizeof(ackedSeq_))};
+    fwrite(v, sizeof(v), 1, f);
+    fflush(f);
+    fsync(fileno(f));
+    fclose(f);
+  }
+
+  char dir_[64] = {0};
+  FILE* headFile_ = nullptr;
+  bool open_ = false;
+  size_t head_ = 0;
+  uint32_t segFirst_[JOURNAL_SEGMENTS] = {};
+  size_t segCount_[JOURNAL_SEGMENTS] = {};
+  uint32_t nextSeq_ = 1;
+  uint32_t ackedSeq_ = 0;
+  uint32_t appended_ = 0;
+  uint32_t overwritten_ = 0;
+  uint32_t corrupt_ = 0;
+  uint32_t writeErrors_ = 0;
+};
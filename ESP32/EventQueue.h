@@ -0,0 +1,123 @@
+// EventQueue: fixed-size detection events and a bounded lock-free queue
+// The BLE callback and the presence sweep push events; the network task pops them.
+// Storage is a fixed array sized at compile time, so pushing never allocates and a
+// full queue is reported to the caller instead of blocking the scan path.
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+
+// Longest ASCII-hex payload we forward (32 bytes of raw data)
+static const size_t EVENT_HEX_MAX = 64;
+
+// Breaks are session segments (Sessions.h); their names are the attendance_records statuses
+enum EventAction : uint8_t {
+  EVENT_CHECKIN = 0,
+  EVENT_CHECKOUT = 1,
+  EVENT_SHORT_BREAK = 2,
+  EVENT_LUNCH_BREAK = 3,
+};
+
+static inline const char* eventActionName(uint8_t action) {
+  switch (action) {
+    case EVENT_CHECKOUT: return "checkout";
+    case EVENT_SHORT_BREAK: return "short_break";
+    case EVENT_LUNCH_BREAK: return "lunch_break";
+    default: return "checkin";
+  }
+}
+
+// One enter/exit event or session segment, copied by value through the queue
+struct DetectionEvent {
+  char hex[EVENT_HEX_MAX + 1];
+  uint8_t action;
+  uint32_t seenAtMs; // millis() when it happened (a held-back checkout or break: when the device left)
+  uint64_t observedMs = 0;  // the same moment in Unix ms from DeviceClock.h (0: clock not synced yet)
+  uint32_t seq = 0;  // device-side event number, monotonic across reboots (see WireFormat.h)
+  uint16_t tenant = 0;  // Tenants.h id of the company UUID that matched (0: TARGET_UUID)
+  uint32_t durationSec = 0;  // breaks: how long the device was away, measured on the scanner
+
+  // Returns false if the hex value does not fit
+  bool set(const char* hexValue, size_t len, uint8_t act, uint32_t nowMs) {
+    if (len == 0 || len > EVENT_HEX_MAX) return false;
+    memcpy(hex, hexValue, len);
+    hex[len] = '\0';
+    action = act;
+    seenAtMs = nowMs;
+    observedMs = 0;
+    durationSec = 0;
+    return true;
+  }
+};
+
+// Bounded multi-producer/multi-consumer queue (Vyukov). Capacity must be a power of two.
+template <typename T, size_t Capacity>
+class BoundedQueue {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+ public:
+  BoundedQueue() {
+    for (size_t i = 0; i < Capacity; ++i) cells_[i].seq.store(i, std::memory_order_relaxed);
+  }
+
+  // Returns false when the queue is full (caller decides how to back off)
+  bool push(const T &item) {
+    size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell &cell = cells_[pos & (Capacity - 1)];
+      size_t seq = cell.seq.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+      if (diff == 0) {
+        if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          cell.value = item;
+          cell.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueuePos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Returns false when the queue is empty
+  bool pop(T &out) {
+    size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell &cell = cells_[pos & (Capacity - 1)];
+      size_t seq = cell.seq.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+      if (diff == 0) {
+        if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          out = cell.value;
+          cell.seq.store(pos + Capacity, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = dequeuePos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Approximate number of queued items (exact when producers/consumers are idle)
+  size_t size() const {
+    size_t head = dequeuePos_.load(std::memory_order_relaxed);
+    size_t tail = enqueuePos_.load(std::memory_order_relaxed);
+    return tail >= head ? tail - head : 0;
+  }
+
+  static constexpr size_t capacity() { return Capacity; }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> seq;
+    T value;
+  };
+  Cell cells_[Capacity];
+  std::atomic<size_t> enqueuePos_{0};
+  std::atomic<size_t> dequeuePos_{0};
+};
@@ -0,0 +1,70 @@
+// Histogram: fixed-bucket latency histogram (1-2-5 series, milliseconds)
+// Counts are atomics so any task can record while another prints.
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <atomic>
+
+class LatencyHistogram {
+ public:
+  // Upper bounds (inclusive) of each bucket in ms; the last bucket catches everything above
+  static const size_t BUCKETS = 14;
+
+  static uint32_t bucketLimitMs(size_t i) {
+    static const uint32_t limits[BUCKETS - 1] = {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000};
+    return i < BUCKETS - 1 ? limits[i] : UINT32_MAX;
+  }
+
+  void record(uint32_t ms) {
+    size_t i = 0;
+    while (i < BUCKETS - 1 && ms > bucketLimitMs(i)) i++;
+    counts_[i].fetch_add(1, std::memory_order_relaxed);
+    total_.fetch_add(ms, std::memory_order_relaxed);
+    samples_.fetch_add(1, std::memory_order_relaxed);
+    uint32_t prev = max_.load(std::memory_order_relaxed);
+    while (ms > prev && !max_.compare_exchange_weak(prev, ms, std::memory_order_relaxed)) {}
+  }
+
+  uint32_t samples() const { return samples_.load(std::memory_order_relaxed); }
+  uint32_t count(size_t i) const { return counts_[i].load(std::memory_order_relaxed); }
+  uint32_t maxMs() const { return max_.load(std::memory_order_relaxed); }
+  uint32_t meanMs() const {
+    uint32_t n = samples();
+    return n ? (uint32_t)(total_.load(std::memory_order_relaxed) / n) : 0;
+  }
+
+  // Smallest bucket limit that covers the given fraction of samples (e.g. 0.99)
+  uint32_t percentileMs(double p) const {
+    uint32_t n = samples();
+    if (n == 0) return 0;
+    uint64_t want = (uint64_t)(p * n + 0.5);
+    if (want == 0) want = 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+      seen += count(i);
+      if (seen >= want) return i < BUCKETS - 1 ? bucketLimitMs(i) : maxMs();
+    }
+    return maxMs();
+  }
+
+  // One line summary, e.g. "connect n=12 mean=38ms p50<=50 p99<=200 max=180ms"
+  int format(char* out, size_t outLen, const char* name) const {
+    return snprintf(out, outLen, "%s n=%u mean=%ums p50<=%u p90<=%u p99<=%u max=%ums", name,
+                    (unsigned)samples(), (unsigned)meanMs(), (unsigned)percentileMs(0.50),
+                    (unsigned)percentileMs(0.90), (unsigned)percentileMs(0.99), (unsigned)maxMs());
+  }
+
+  void reset() {
+    for (size_t i = 0; i < BUCKETS; i++) counts_[i].store(0, std::memory_order_relaxed);
+    total_.store(0, std::memory_order_relaxed);
+    samples_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<uint32_t> counts_[BUCKETS] = {};
+  std::atomic<uint64_t> total_{0};
+  std::atomic<uint32_t> samples_{0};
+  std::atomic<uint32_t> max_{0};
+};
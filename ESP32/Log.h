@@ -0,0 +1,170 @@
+// Log: leveled, categorized logging through a preallocated ring buffer
+// Statements above SCANNER_LOG_LEVEL or outside SCANNER_LOG_CATEGORIES are compiled out,
+// arguments included. Enabled records are formatted into a fixed-size slot and pushed onto
+// a bounded lock-free queue; a low-priority task (see startLogTask in Scanner.cpp) writes
+// them to Serial, so the BLE callback never waits on the UART. When the queue is full the
+// record is dropped and counted instead.
+// Byte dumps (LOG_BYTES) copy the raw bytes only; hex and ASCII are rendered by the log task.
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <atomic>
+#include <Arduino.h>
+#include "EventQueue.h"
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef SCANNER_LOG_LEVEL
+#define SCANNER_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_CAT_SYS 0x01     // boot, WiFi, scheduler
+#define LOG_CAT_SCAN 0x02    // matched devices, scan period reports
+#define LOG_CAT_EVENTS 0x04  // event queue, presence, journal
+#define LOG_CAT_NET 0x08     // detection uploads, heartbeats
+#define LOG_CAT_OTA 0x10
+
+#ifndef SCANNER_LOG_CATEGORIES
+#define SCANNER_LOG_CATEGORIES 0xFF
+#endif
+
+// Constant-folds, so a disabled statement leaves no code behind
+#define LOG_ENABLED(level, cat) ((level) <= SCANNER_LOG_LEVEL && ((cat) & SCANNER_LOG_CATEGORIES) != 0)
+
+#define LOG_AT(level, cat, ...)                                       \
+  do {                                                                \
+    if (LOG_ENABLED(level, cat)) scannerLog.printf(level, cat, __VA_ARGS__); \
+  } while (0)
+
+#define LOG_ERROR(cat, ...) LOG_AT(LOG_LEVEL_ERROR, cat, __VA_ARGS__)
+#define LOG_WARN(cat, ...) LOG_AT(LOG_LEVEL_WARN, cat, __VA_ARGS__)
+#define LOG_INFO(cat, ...) LOG_AT(LOG_LEVEL_INFO, cat, __VA_ARGS__)
+#define LOG_DEBUG(cat, ...) LOG_AT(LOG_LEVEL_DEBUG, cat, __VA_ARGS__)
+
+// label must be a string literal (only the pointer is queued)
+#define LOG_BYTES(level, cat, label, data, len)                                 \
+  do {                                                                          \
+    if (LOG_ENABLED(level, cat)) scannerLog.bytes(level, cat, label, data, len); \
+  } while (0)
+
+// Longest formatted message kept per record; longer ones are cut and end in "..."
+static const size_t LOG_TEXT_MAX = 112;
+// Records buffered between drains (~8 KB)
+static const size_t LOG_RING_RECORDS = 64;
+
+struct LogRecord {
+  uint32_t ms;
+  uint8_t level;
+  uint8_t category;
+  uint8_t len;          // text length, or byte count for a dump
+  bool isBytes;
+  const char* label;    // dumps only
+  char text[LOG_TEXT_MAX];
+};
+
+class Logger {
+ public:
+  void printf(uint8_t level, uint8_t category, const char* fmt, ...) __attribute__((format(printf, 4, 5))) {
+    LogRecord r;
+    start(r, level, category);
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(r.text, sizeof(r.text), fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    if ((size_t)n >= sizeof(r.text)) {
+      n = sizeof(r.text) - 1;
+      memcpy(r.text + n - 3, "...", 3);
+    }
+    // Lines end where the record ends; trailing newlines from printf-style callers are dropped
+    while (n > 0 && r.text[n - 1] == '\n') n--;
+    r.len = (uint8_t)n;
+    push(r);
+  }
+
+  void bytes(uint8_t level, uint8_t category, const char* label, const uint8_t* data, size_t len) {
+    LogRecord r;
+    start(r, level, category);
+    r.isBytes = true;
+    r.label = label;
+    r.len = (uint8_t)(len < sizeof(r.text) ? len : sizeof(r.text));
+    memcpy(r.text, data, r.len);
+    push(r);
+  }
+
+  // Write out everything queued so far, one line per record; called from the log task
+  // (and before a restart). Returns the number of records written.
+  template <typename Out>
+  size_t drain(Out &out) {
+    char line[3 * LOG_TEXT_MAX + 64];
+    size_t n = 0;
+    LogRecord r;
+    while (ring_.pop(r)) {
+      render(r, line, sizeof(line));
+      out.print(line);
+      n++;
+    }
+    uint32_t dropped = dropped_.load(std::memory_order_relaxed);
+    uint32_t reported = reportedDropped_.exchange(dropped, std::memory_order_relaxed);
+    if (dropped != reported) {
+      snprintf(line, sizeof(line), "⚠️ Log buffer full: %u records dropped\n", (unsigned)(dropped - reported));
+      out.print(line);
+    }
+    return n;
+  }
+
+  uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+ private:
+  static void start(LogRecord &r, uint8_t level, uint8_t category) {
+    r.ms = millis();
+    r.level = level;
+    r.category = category;
+    r.isBytes = false;
+    r.label = nullptr;
+  }
+
+  void push(const LogRecord &r) {
+    if (!ring_.push(r)) dropped_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // "[seconds.ms] text", or "[seconds.ms] <label> (n bytes): 0A1B... |ascii|" for dumps.
+  // The stamp is when the record was made, not when it reached the UART.
+  static void render(const LogRecord &r, char* out, size_t outLen) {
+    int n = snprintf(out, outLen, "[%6u.%03u] ", (unsigned)(r.ms / 1000), (unsigned)(r.ms % 1000));
+    size_t pos = n > 0 ? (size_t)n : 0;
+    if (!r.isBytes) {
+      snprintf(out + pos, outLen - pos, "%.*s\n", (int)r.len, r.text);
+      return;
+    }
+    static const char* digits = "0123456789ABCDEF";
+    n = snprintf(out + pos, outLen - pos, "%s (%u bytes): ", r.label, (unsigned)r.len);
+    pos += n > 0 ? (size_t)n : 0;
+    for (size_t i = 0; i < r.len && pos + 4 < outLen; i++) {
+      out[pos++] = digits[(uint8_t)r.text[i] >> 4];
+      out[pos++] = digits[(uint8_t)r.text[i] & 0x0F];
+    }
+    if (pos + 3 < outLen) out[pos++] = ' ';
+    if (pos + 3 < outLen) out[pos++] = '|';
+    for (size_t i = 0; i < r.len && pos + 3 < outLen; i++) {
+      out[pos++] = isprint((uint8_t)r.text[i]) ? r.text[i] : '.';
+    }
+    if (pos + 2 < outLen) out[pos++] = '|';
+    out[pos++] = '\n';
+    out[pos] = '\0';
+  }
+
+  BoundedQueue<LogRecord, LOG_RING_RECORDS> ring_;
+  std::atomic<uint32_t> dropped_{0};
+  std::atomic<uint32_t> reportedDropped_{0};
+};
+
+static Logger scannerLog;
@@ -0,0 +1,195 @@
+// PresenceTable: fixed-capacity open-addressing table of tracked payloads
+// Replaces the lastSeenAt/lastSentAt maps and presentDevices set with one flat array of
+// entries keyed by a 64-bit hash of the payload. Storage is allocated statically, so the
+// table never touches the heap; when it is full an entry is evicted by policy, and the
+// owner hears about it first (setEvictHandler) so state only the entry held is not lost silently.
+// Each entry has one expiry timer on a TimerWheel, so timeouts fire without scanning the table.
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "TimerWheel.h"
+
+// Longest payload we track (matches EVENT_HEX_MAX in EventQueue.h)
+static const size_t PRESENCE_HEX_MAX = 64;
+
+// FNV-1a, 64-bit
+static inline uint64_t hashPayload(const char* data, size_t len) {
+  uint64_t h = 1469598103934665603ULL;
+  for (size_t i = 0; i < len; i++) {
+    h ^= (uint8_t)data[i];
+    h *= 1099511628211ULL;
+  }
+  return h ? h : 1; // 0 marks an empty slot
+}
+
+// Smoothed RSSI is kept in 1/16 dBm. An EMA with alpha = 1/4 damps single-advert spikes
+// while still following someone walking away within a few adverts.
+static const int RSSI_SCALE = 16;
+
+static inline int16_t smoothRssi(int16_t prev, int rssiDbm) {
+  int sample = rssiDbm * RSSI_SCALE;
+  if (prev == 0) return (int16_t)sample;  // first sample
+  return (int16_t)(prev + (sample - prev) / 4);
+}
+
+struct PresenceEntry {
+  uint64_t key;       // hashPayload(hex); 0 = empty slot
+  uint32_t lastSeen;  // seconds
+  uint32_t lastSent;  // seconds of the last queued event (dedupe)
+  uint32_t crossingSince;  // seconds; when the signal crossed the threshold we're dwelling on
+  uint32_t awaySince; // seconds; when an away entry was last seen in range
+  int16_t rssi;       // smoothRssi() state; 0 = no sample yet
+  uint16_t tenant;    // tenant of the latest sighting; its events are tagged with it
+  bool present;       // we've sent an "enter" and no "exit" yet (change via setPresent)
+  bool sent;          // lastSent is valid
+  bool crossing;      // signal is past the enter (absent) or exit (present) threshold
+  bool away;          // timed out, but its checkout is held back (Sessions.h)
+  uint8_t hexLen;
+  char hex[PRESENCE_HEX_MAX + 1];
+};
+
+// Smallest Capacity whose 3/4 load holds this many entries
+static constexpr size_t presenceSlotsFor(size_t entries, size_t slots = 4) {
+  return slots * 3 / 4 >= entries ? slots : presenceSlotsFor(entries, slots * 2);
+}
+
+// Capacity is the number of slots (power of two); at most 3/4 of them are used so
+// probe sequences stay short.
+template <size_t Capacity>
+class PresenceTable {
+  static_assert(Capacity >= 4 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+ public:
+  static const size_t MAX_ENTRIES = Capacity * 3 / 4;
+
+  // Called with the victim just before an eviction erases it (from inside upsert())
+  typedef void (*EvictHandler)(PresenceEntry &victim);
+  void setEvictHandler(EvictHandler handler) { onEvict_ = handler; }
+
+  PresenceEntry* find(const char* hex, size_t len) {
+    if (len == 0 || len > PRESENCE_HEX_MAX) return nullptr;
+    uint64_t key = hashPayload(hex, len);
+    for (size_t i = key & MASK;; i = (i + 1) & MASK) {
+      PresenceEntry &e = slots_[i];
+      if (e.key == 0) return nullptr;
+      if (e.key == key && e.hexLen == len && memcmp(e.hex, hex, len) == 0) return &e;
+    }
+  }
+
+  // Find or create the entry for a payload. Evicts when full; returns nullptr only when
+  // the payload is empty or too long to store.
+  PresenceEntry* upsert(const char* hex, size_t len, uint32_t nowSec) {
+    if (len == 0 || len > PRESENCE_HEX_MAX) return nullptr;
+    PresenceEntry* existing = find(hex, len);
+    if (existing) return existing;
+    if (count_ >= MAX_ENTRIES) evictOne();
+
+    uint64_t key = hashPayload(hex, len);
+    size_t i = key & MASK;
+    while (slots_[i].key != 0) i = (i + 1) & MASK;
+    PresenceEntry &e = slots_[i];
+    e.key = key;
+    e.lastSeen = nowSec;
+    e.lastSent = 0;
+    e.crossingSince = 0;
+    e.awaySince = 0;
+    e.rssi = 0;
+    e.tenant = 0;
+    e.present = false;
+    e.sent = false;
+    e.crossing = false;
+    e.away = false;
+    e.hexLen = (uint8_t)len;
+    memcpy(e.hex, hex, len);
+    e.hex[len] = '\0';
+    count_++;
+    return &e;
+  }
+
+  void erase(PresenceEntry* e) {
+    eraseSlot(slotOf(e));
+  }
+
+  void setPresent(PresenceEntry* e, bool present) {
+    if (e->present == present) return;
+    e->present = present;
+    if (present) present_++;
+    else present_--;
+  }
+
+  // Arm (or move) the entry's expiry timer; deadlines are in the same seconds as lastSeen
+  void scheduleExpiry(PresenceEntry* e, uint32_t deadlineSec) {
+    timers_.schedule(slotOf(e), deadlineSec);
+  }
+
+  // One entry whose timer has fired (the timer is disarmed), or nullptr once none are due.
+  // The caller re-arms or erases it before asking for the next one.
+  PresenceEntry* popExpired(uint32_t nowSec) {
+    uint16_t slot = timers_.popExpired(nowSec);
+    return slot == Timers::NONE ? nullptr : &slots_[slot];
+  }
+
+  size_t size() const { return count_; }
+  size_t presentCount() const { return present_; }
+  uint32_t evictions() const { return evictions_; }
+  uint32_t heldEvictions() const { return heldEvictions_; }  // victims that were present or away
+  static constexpr size_t capacity() { return MAX_ENTRIES; }
+
+ private:
+  static const size_t MASK = Capacity - 1;
+  typedef TimerWheel<Capacity> Timers;
+
+  size_t slotOf(const PresenceEntry* e) const { return (size_t)(e - slots_); }
+
+  // Eviction policy: the stalest entry that is only dedupe history; then the stalest away
+  // entry (the evict handler can still send its held checkout); a present entry only when
+  // every entry is present.
+  void evictOne() {
+    size_t victim = Capacity;
+    int victimRank = 3;
+    uint32_t victimSeen = UINT32_MAX;
+    for (size_t i = 0; i < Capacity; i++) {
+      const PresenceEntry &e = slots_[i];
+      if (e.key == 0) continue;
+      int rank = e.present ? 2 : e.away ? 1 : 0;
+      if (rank < victimRank || (rank == victimRank && e.lastSeen < victimSeen)) {
+        victim = i;
+        victimRank = rank;
+        victimSeen = e.lastSeen;
+      }
+    }
+    if (victim != Capacity) {
+      if (onEvict_) onEvict_(slots_[victim]);
+      if (victimRank > 0) heldEvictions_++;
+      eraseSlot(victim);
+      evictions_++;
+    }
+  }
+
+  // Linear-probing deletion with backward shift (no tombstones)
+  void eraseSlot(size_t hole) {
+    if (slots_[hole].present) present_--;
+    timers_.cancel(hole);
+    slots_[hole].key = 0;
+    count_--;
+    for (size_t j = (hole + 1) & MASK; slots_[j].key != 0; j = (j + 1) & MASK) {
+      size_t home = slots_[j].key & MASK;
+      // Move j into the hole unless its home lies cyclically in (hole, j]
+      bool stays = (hole <= j) ? (hole < home && home <= j) : (hole < home || home <= j);
+      if (stays) continue;
+      slots_[hole] = slots_[j];
+      slots_[j].key = 0;
+      timers_.move(j, hole);
+      hole = j;
+    }
+  }
+
+  PresenceEntry slots_[Capacity] = {};
+  Timers timers_;
+  size_t count_ = 0;
+  size_t present_ = 0;
+  uint32_t evictions_ = 0;
+  uint32_t heldEvictions_ = 0;
+  EvictHandler onEvict_ = nullptr;
+};
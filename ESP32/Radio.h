@@ -0,0 +1,108 @@
+// Radio: the BLE scan interface Scanner.cpp is written against, one backend per stack
+// The scanner only starts timed scan periods and receives each advert as a RadioAdvert: the
+// advertiser's address (most significant byte first, as printed), RSSI and the raw advert
+// plus scan response. The bytes belong to the stack and are only valid during the handler.
+//
+// The backend is chosen at build time:
+//   SCANNER_BLE_NIMBLE=0  Bluedroid, the ESP32 core's BLEDevice library (default). It hands
+//                         every advert to onResult() as a BLEAdvertisedDevice by value.
+//   SCANNER_BLE_NIMBLE=1  NimBLE-Arduino 1.4.x. Adverts arrive by pointer and no result list
+//                         is kept (setMaxResults(0)); the stack is much smaller in RAM and flash.
+// Both handlers and the scan-complete callback run on the stack's task.
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifndef SCANNER_BLE_NIMBLE
+#define SCANNER_BLE_NIMBLE 0
+#endif
+
+#if SCANNER_BLE_NIMBLE
+#include <NimBLEDevice.h>
+#else
+#include <BLEDevice.h>
+#endif
+
+struct RadioAdvert {
+  uint8_t address[6];
+  int rssi;
+  const uint8_t* payload;
+  size_t len;
+};
+
+class Radio {
+ public:
+  typedef void (*AdvertHandler)(const RadioAdvert &advert);
+  typedef void (*DoneHandler)();
+
+  static const char* backendName() { return SCANNER_BLE_NIMBLE ? "nimble" : "bluedroid"; }
+
+  // Bring the stack up for active scanning; onAdvert sees every advert, repeats included
+  void begin(const char* deviceName, AdvertHandler onAdvert) {
+#if SCANNER_BLE_NIMBLE
+    NimBLEDevice::init(deviceName);
+    scan_ = NimBLEDevice::getScan();
+    scan_->setMaxResults(0);  // hand each advert over and forget it
+#else
+    BLEDevice::init(deviceName);
+    scan_ = BLEDevice::getScan();
+#endif
+    callbacks_.onAdvert = onAdvert;
+    scan_->setAdvertisedDeviceCallbacks(&callbacks_, true);
+    scan_->setActiveScan(true);
+  }
+
+  // Non-blocking scan of durationSec seconds with the given duty cycle; false if the stack
+  // refused to start. onDone runs once the period ends.
+  bool startScan(uint32_t durationSec, uint16_t intervalMs, uint16_t windowMs, DoneHandler onDone) {
+    scan_->setInterval(intervalMs);
+    scan_->setWindow(windowMs);
+    scan_->clearResults();  // with duplicates on, a kept result list would otherwise keep growing
+    done_ = onDone;
+    return scan_->start(durationSec, onScanComplete, false);
+  }
+
+ private:
+#if SCANNER_BLE_NIMBLE
+  struct Callbacks : public NimBLEAdvertisedDeviceCallbacks {
+    AdvertHandler onAdvert = nullptr;
+    void onResult(NimBLEAdvertisedDevice* device) override {
+      RadioAdvert advert;
+      // NimBLE keeps addresses least significant byte first
+      NimBLEAddress address = device->getAddress();
+      const uint8_t* native = address.getNative();
+      for (int i = 0; i < 6; i++) advert.address[i] = native[5 - i];
+      advert.rssi = device->getRSSI();
+      advert.payload = device->getPayload();
+      advert.len = device->getPayloadLength();
+      onAdvert(advert);
+    }
+  };
+  static void onScanComplete(NimBLEScanResults) {
+    if (done_) done_();
+  }
+  NimBLEScan* scan_ = nullptr;
+#else
+  struct Callbacks : public BLEAdvertisedDeviceCallbacks {
+    AdvertHandler onAdvert = nullptr;
+    // The library's signature: the whole device object is copied for every advert
+    void onResult(BLEAdvertisedDevice device) override {
+      RadioAdvert advert;
+      BLEAddress address = device.getAddress();
+      memcpy(advert.address, *address.getNative(), 6);
+      advert.rssi = device.getRSSI();
+      advert.payload = device.getPayload();
+      advert.len = device.getPayloadLength();
+      onAdvert(advert);
+    }
+  };
+  static void onScanComplete(BLEScanResults) {
+    if (done_) done_();
+  }
+  BLEScan* scan_ = nullptr;
+#endif
+
+  Callbacks callbacks_;
+  static inline DoneHandler done_ = nullptr;
+};
@@ -0,0 +1,71 @@
+// ScanScheduler: picks the BLE scan duty cycle for the next scan period
+// Scanning runs back-to-back in fixed-length periods; after each one the scheduler looks
+// at what happened (arrivals, departures, matches, occupancy) and chooses a profile:
+// aggressive while people are coming and going, normal while the office is occupied and
+// stable, lean when nobody has been around for a while (nights, weekends).
+#pragma once
+#include <stdint.h>
+
+struct ScanProfile {
+  const char* name;
+  uint16_t intervalMs;
+  uint16_t windowMs;  // <= intervalMs; duty cycle = windowMs / intervalMs
+};
+
+// What happened during one scan period
+struct ScanPeriodStats {
+  uint32_t adverts;     // callbacks received
+  uint32_t matches;     // adverts carrying the target UUID
+  uint32_t arrivals;    // checkin events queued
+  uint32_t departures;  // checkout events queued
+  uint32_t present;     // payloads currently present
+};
+
+class ScanScheduler {
+ public:
+  enum Mode : uint8_t { SCAN_AGGRESSIVE = 0, SCAN_NORMAL = 1, SCAN_LEAN = 2 };
+
+  // Quiet periods before stepping down from aggressive, and before going lean
+  static const uint32_t AGGRESSIVE_HOLD_PERIODS = 6;
+  static const uint32_t LEAN_AFTER_PERIODS = 30;
+
+  static const ScanProfile &profile(Mode m) {
+    static const ScanProfile profiles[] = {
+      {"aggressive", 100, 100},  // radio always listening
+      {"normal", 100, 60},       // 60%
+      {"lean", 500, 50},         // 10%
+    };
+    return profiles[m];
+  }
+
+  Mode mode() const { return mode_; }
+
+  // Feed one finished period; returns the mode for the next period
+  Mode update(const ScanPeriodStats &s) {
+    if (s.arrivals > 0 || s.departures > 0) {
+      quietPeriods_ = 0;
+      mode_ = SCAN_AGGRESSIVE;
+      return mode_;
+    }
+    quietPeriods_++;
+    if (s.present == 0 && s.matches == 0) {
+      if (quietPeriods_ >= LEAN_AFTER_PERIODS) mode_ = SCAN_LEAN;
+      else if (mode_ == SCAN_AGGRESSIVE && quietPeriods_ >= AGGRESSIVE_HOLD_PERIODS) mode_ = SCAN_NORMAL;
+    } else {
+      // Someone is around: never stay lean, and settle to normal once things are stable
+      if (mode_ == SCAN_LEAN) mode_ = SCAN_AGGRESSIVE;
+      else if (mode_ == SCAN_AGGRESSIVE && quietPeriods_ >= AGGRESSIVE_HOLD_PERIODS) mode_ = SCAN_NORMAL;
+    }
+    return mode_;
+  }
+
+  // Duty cycle of a mode in percent
+  static uint32_t dutyPercent(Mode m) {
+    const ScanProfile &p = profile(m);
+    return (uint32_t)p.windowMs * 100 / p.intervalMs;
+  }
+
+ private:
+  Mode mode_ = SCAN_AGGRESSIVE;
+  uint32_t quietPeriods_ = 0;
+};
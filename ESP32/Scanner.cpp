@@ -1,13 +1,43 @@
 // AutoAttend ESP32 scanner: posts hex values from BLE advertisements to our Worker API
 #include <Arduino.h>
-#include <BLEDevice.h>
 #include <WiFi.h>
 #include <HTTPClient.h>
 #include <Update.h>
 #include <cstdio>
-#include <set>
-#include <algorithm>
-#include <map>
+#include <mutex>
+#include <atomic>
+#include <Preferences.h>
+#include <esp_sntp.h>
+#if defined(ESP_PLATFORM)
+#include <LittleFS.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#else
+#include <thread>
+#endif
+#include "Radio.h"
+#include "AdvMatcher.h"
+#include "AdvertCache.h"
+#include "EventQueue.h"
+#include "ServerConnection.h"
+#include "PresenceTable.h"
+#include "EventJournal.h"
+#include "ScanScheduler.h"
+#include "Sha256.h"
+#include "DeltaPatch.h"
+#include "WireFormat.h"
+#include "DetectUpload.h"
+#include "Telemetry.h"
+#include "Log.h"
+#include "Allowlist.h"
+#include "Tenants.h"
+#include "Sessions.h"
+#include "DeviceClock.h"
+#include "WifiLink.h"
+
+void checkForOtaUpdate();
+bool applyFirmware(const ServerConnection::Endpoint &download, const String &newVersion, const String &expectedSha256);
+bool applyDeltaFirmware(const ServerConnection::Endpoint &download, const String &newVersion, const String &expectedSha256);
 
 // ✅ Target UUID to search for (case-insensitive)
 const char* TARGET_UUID = "D7E1A3F4";
@@ -24,18 +54,87 @@ const char* TARGET_UUID = "D7E1A3F4";
 
 const char* WIFI_SSID = "Zoo_Studio_2.4";
 const char* WIFI_PASS = "Trh@1234";
+// Optional static address (skips DHCP on every connect); nullptr to use DHCP
+const char* WIFI_STATIC_IP = nullptr;   // e.g. "192.168.2.60"
+const char* WIFI_GATEWAY = nullptr;     // e.g. "192.168.2.1"
+const char* WIFI_SUBNET = nullptr;      // e.g. "255.255.255.0"
+const char* WIFI_DNS = nullptr;         // nullptr: the gateway
 // IMPORTANT: set this to the machine running the dev server (same network)
 // Example if your laptop's IP is 192.168.1.50 and Vite dev uses 5175:
 //   http://192.168.1.50:5175
 const char* SERVER_HOST = "http://192.168.2.177:5175"; 
 const char* SERVER_ENDPOINT = "/api/esp32/detect"; // Worker endpoint (hex only)
+const char* SERVER_BATCH_ENDPOINT = "/api/esp32/detect/batch"; // one POST per scan cycle
+// Send all events from a scan cycle in one request (0 = one POST per event; the host
+// simulator compares the two, see ESP32/host/ScannerSim.cpp)
+#ifndef SCANNER_BATCH_UPLOAD
+#define SCANNER_BATCH_UPLOAD 1
+#endif
+static const bool USE_BATCH_UPLOAD = SCANNER_BATCH_UPLOAD;
+// Upload events as compact binary frames (WireFormat.h) instead of JSON (0 = JSON only).
+// A Worker that refuses a frame (one predating the format) gets JSON for the rest of the
+// boot; see fallBackToJson
+#ifndef SCANNER_BINARY_WIRE
+#define SCANNER_BINARY_WIRE 1
+#endif
+// Sessions computed on the scanner (Sessions.h, SCANNER_EDGE_SESSIONS): checkins, break
+// segments and held-back checkouts all go to this bulk endpoint instead of the two above,
+// with break thresholds refreshed from the Worker the same way as the allowlist
+const char* SESSIONS_ENDPOINT = "/api/esp32/sessions";
+const char* SESSION_CONFIG_ENDPOINT = "/api/esp32/session-config";
+static const uint32_t SESSION_CONFIG_REFRESH_SECONDS = 300;
+static const uint32_t SESSION_CONFIG_RETRY_SECONDS = 60;
+// Wall-clock time for event stamps (DeviceClock.h); the SNTP client re-syncs on its own
+const char* NTP_SERVER = "pool.ntp.org";
+static const uint32_t SNTP_SYNC_INTERVAL_SECONDS = 3600;
 // OTA endpoints
 const char* OTA_MANIFEST_PATH = "/api/ota/manifest"; // returns JSON manifest
+// Telemetry heartbeat (counters, stage histograms, heap watermarks; see Telemetry.h)
+const char* HEARTBEAT_ENDPOINT = "/api/esp32/heartbeat";
+static const uint32_t HEARTBEAT_INTERVAL_SECONDS = 300;
+static const uint32_t HEARTBEAT_RETRY_SECONDS = 60;
+// Active-employee allowlist (see Allowlist.h): refreshed with If-None-Match, so an unchanged
+// list costs a 304
+const char* ALLOWLIST_ENDPOINT = "/api/esp32/allowlist";
+static const uint32_t ALLOWLIST_REFRESH_SECONDS = 300;
+static const uint32_t ALLOWLIST_RETRY_SECONDS = 60;
+// Tenant company UUIDs (see Tenants.h), refreshed the same way; a non-empty list from the
+// Worker replaces TARGET_UUID
+const char* TENANTS_ENDPOINT = "/api/esp32/tenants";
+static const uint32_t TENANTS_REFRESH_SECONDS = 300;
+static const uint32_t TENANTS_RETRY_SECONDS = 60;
 // Build-time firmware version of this device
 static const char* CURRENT_FIRMWARE_VERSION = "1.0.0";
 // How often to check for updates (seconds)
 static const uint32_t OTA_CHECK_INTERVAL_SECONDS = 600; // 10 minutes
 static uint32_t nextOtaCheck = 0;
+// Firmware is copied in flash-sector sized chunks; a dropped download resumes with a Range
+// request from the last byte written instead of starting over
+static const size_t OTA_CHUNK_BYTES = 4096;
+static const uint32_t OTA_READ_TIMEOUT_MS = 10000;
+static const int OTA_MAX_RESUMES = 5;
+static const uint32_t OTA_RESUME_BACKOFF_MS = 2000;
+static uint8_t otaChunk[OTA_CHUNK_BYTES];  // static: too big for the loop task's stack
+#if !defined(ESP_PLATFORM)
+// Host builds read the "running" firmware (the delta base) from this file
+static const char* RUNNING_IMAGE_PATH = "running.bin";
+#endif
+
+// Single keep-alive connection to SERVER_HOST; endpoint URLs are built once in setup()
+static ServerConnection server;
+static ServerConnection::Endpoint detectEndpoint;
+static ServerConnection::Endpoint detectBatchEndpoint;
+static ServerConnection::Endpoint otaManifestEndpoint;
+static ServerConnection::Endpoint heartbeatEndpoint;
+static ServerConnection::Endpoint allowlistEndpoint;
+static ServerConnection::Endpoint tenantsEndpoint;
+static ServerConnection::Endpoint sessionsEndpoint;
+static ServerConnection::Endpoint sessionConfigEndpoint;
+// Identifies this scanner in heartbeats and uploads: the WiFi MAC address (text and bytes)
+static char deviceId[18] = "unknown";
+static uint8_t deviceMac[WIRE_DEVICE_ID_LEN];
+// Station connection, driven from loop() (see WifiLink.h)
+static WifiLink wifiLink;
 
 // How long to ignore repeat POSTs for the same event (seconds)
 const uint32_t SEEN_TTL_SECONDS = 10;
@@ -44,25 +143,70 @@ const uint32_t SEEN_TTL_SECONDS = 10;
 // If we haven't seen a device for this many seconds, treat it as "left the office"
 const uint32_t PRESENCE_TIMEOUT_SECONDS = 30;
 
-// lastSeenAt: detection timestamp for each hex payload (seconds)
-static std::map<std::string, uint32_t> lastSeenAt; // hex -> last seen epoch seconds
+// Signal hysteresis (smoothed RSSI, see PresenceTable.h) so badges at the edge of range
+// don't flap in and out: check in only after the signal has stayed at or above
+// RSSI_ENTER_DBM for RSSI_ENTER_DWELL_SECONDS; check out after PRESENCE_TIMEOUT_SECONDS of
+// silence or after RSSI_EXIT_DWELL_SECONDS below RSSI_EXIT_DBM. The exit dwell outlasts
+// the minute-long fades of a badge at the edge of range (ScannerSim's edge-desk profile).
+const int RSSI_ENTER_DBM = -85;
+const int RSSI_EXIT_DBM = -92;
+const uint32_t RSSI_ENTER_DWELL_SECONDS = 2;
+const uint32_t RSSI_EXIT_DWELL_SECONDS = 180;
+// With SCANNER_EDGE_SESSIONS, an absence shorter than this is a signal dropout, not a
+// break: the badge is present again and nothing is sent
+const uint32_t MIN_BREAK_SECONDS = 60;
 
-// lastSentAt: last time we POSTed this hex to Strapi (seconds) used for dedupe
-static std::map<std::string, uint32_t> lastSentAt; // hex -> last POST epoch seconds
+// Build with -DSCANNER_RSSI_SMOOTHING=0 to hold each sighting's own RSSI against the
+// thresholds instead of the smoothed one (same dwells); the host sim compares the two
+#ifndef SCANNER_RSSI_SMOOTHING
+#define SCANNER_RSSI_SMOOTHING 1
+#endif
 
-// Devices currently considered present (we've sent an "enter" for them)
-static std::set<std::string> presentDevices;
+// Most payloads one scanner is expected to track at once: badges plus visitors running the
+// app when there is no allowlist to turn them away. Raise it for bigger sites.
+#ifndef SCANNER_MAX_HEADCOUNT
+#define SCANNER_MAX_HEADCOUNT 300
+#endif
 
-#define MAX_DEVICES 5  // Limit number of tracked devices to prevent memory issues
-static std::set<std::string> devicesWithTarget;
+// Tracked payloads: last seen, last sent (dedupe) and present flag in one flat table, sized
+// for SCANNER_MAX_HEADCOUNT plus a quarter for dedupe history (300 -> 512 slots, 384
+// payloads, ~58 KB allocated statically). When full, dedupe history is evicted first, then
+// away entries (their held checkout is sent), then present ones (logged: the checkout is lost).
+static const size_t PRESENCE_TABLE_SLOTS = presenceSlotsFor(SCANNER_MAX_HEADCOUNT + SCANNER_MAX_HEADCOUNT / 4);
+static PresenceTable<PRESENCE_TABLE_SLOTS> presence;
 
-// Helper: convert string to lowercase (with memory limit)
-std::string toLowerCase(const std::string &str) {
-  if (str.length() > 64) return str.substr(0, 64); // Prevent excessive memory use
-  std::string lower = str;
-  std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
-  return lower;
-}
+// Recent matchAdvert() results by address + payload, so repeats skip matching (see
+// AdvertCache.h). 1024 entries (16 KB, static) cover the regular advertisers of a busy
+// floor; with SCANNER_ADVERT_CACHE=0 only the (zero) counters are left.
+static const size_t ADVERT_CACHE_SLOTS = SCANNER_ADVERT_CACHE ? 1024 : 4;
+static AdvertCache<ADVERT_CACHE_SLOTS> advertCache;
+
+// Addresses that matched during the current scan period (only used to log each device once)
+static const size_t MAX_MATCHED_PER_SCAN = 32;
+static uint8_t matchedThisScan[MAX_MATCHED_PER_SCAN][6];
+static size_t matchedThisScanCount = 0;
+
+// BLE stack behind the scan (Radio.h; SCANNER_BLE_NIMBLE picks the backend) and the free
+// heap right after it came up, for comparing backends
+static Radio bleRadio;
+static uint32_t bleInitFreeHeap = 0;
+
+// Scanning runs continuously in back-to-back periods; between periods the scheduler picks
+// the duty cycle for the next one (see ScanScheduler.h) and the BLE result cache is cleared
+static const uint32_t SCAN_PERIOD_SECONDS = 10;
+static const uint32_t LOOP_TICK_MS = 100;
+static ScanScheduler scanScheduler;
+static std::atomic<bool> scanPeriodDone{true};  // set by the scan-complete callback
+static uint32_t scanPeriodStartMs = 0;
+static bool scanPeriodRan = false;
+
+// Per-period counters feeding the scheduler and the period report
+static std::atomic<uint32_t> periodAdverts{0};
+static std::atomic<uint32_t> periodMatches{0};
+static std::atomic<uint32_t> periodArrivals{0};
+static std::atomic<uint32_t> periodDepartures{0};
+// Detection latency: time from the start of a period to each device's first sighting in it
+static LatencyHistogram firstSightingHist;
 
 // Helper: convert binary data to HEX string
 std::string toHexString(const uint8_t* data, size_t length) {
@@ -90,528 +234,1656 @@ bool isAsciiHexString(const std::string &s) {
   return true;
 }
 
-// Helper: check if server response indicates success
-bool wasPostSuccessful(const String &response) {
-  // Our Worker returns { success: true, ... } or { success: true, deduped: true }
-  return response.indexOf("\"success\":true") >= 0 ||
-         response.indexOf("\"deduped\":true") >= 0;
+// ----------------------- Detection event pipeline -----------------------
+// Scan path (onResult, presence sweep) -> eventQueue -> network task.
+// Nothing on the scan path waits on WiFi or HTTP; a slow Worker only fills the queue.
+
+// Queue depth; when full, events are refused and retried on a later sighting/sweep
+static const size_t EVENT_QUEUE_CAPACITY = 64;
+static BoundedQueue<DetectionEvent, EVENT_QUEUE_CAPACITY> eventQueue;
+
+// When the queue is this full, the network task stops retrying so it drains faster
+static const size_t EVENT_QUEUE_SHED_RETRIES_AT = EVENT_QUEUE_CAPACITY * 3 / 4;
+
+// Network task placement: Arduino loop() runs on core 1, so keep HTTP on core 0
+static const int NETWORK_TASK_CORE = 0;
+static const uint32_t NETWORK_TASK_STACK = 8192;
+static const uint32_t NETWORK_IDLE_POLL_MS = 20;
+
+// Log task (see Log.h): drains the log ring to Serial below every other task's priority
+static const int LOG_TASK_CORE = 0;
+static const uint32_t LOG_TASK_STACK = 3072;
+static const uint32_t LOG_DRAIN_INTERVAL_MS = 20;
+
+// Batch upload: max events per request, and how long to wait for the rest of a scan
+// cycle's events once the first one arrives
+static const size_t DETECT_BATCH_MAX = 16;
+static const uint32_t DETECT_BATCH_LINGER_MS = 500;
+// Worst case request body: every event at full length plus JSON punctuation
+static const size_t DETECT_BATCH_BODY_MAX = 64 + DETECT_BATCH_MAX * (EVENT_HEX_MAX + 152);
+
+// Offline journal: undeliverable events are kept in flash and replayed in order.
+// Only the network task touches it after setup().
+#if defined(ESP_PLATFORM)
+static const char* JOURNAL_DIR = "/littlefs/journal";
+#else
+static const char* JOURNAL_DIR = "journal";
+#endif
+static const uint32_t JOURNAL_REPLAY_BACKOFF_MS = 5000;
+static EventJournal journal;
+
+// Last allowlist from the Worker, kept in flash so a reboot filters from the start.
+// The list is swapped under presenceMutex; allowlistEtag is only used by the network task.
+#if defined(ESP_PLATFORM)
+static const char* ALLOWLIST_FILE = "/littlefs/allowlist.bin";
+#else
+static const char* ALLOWLIST_FILE = "allowlist.bin";
+#endif
+static Allowlist allowlist;
+static char allowlistEtag[ALLOWLIST_ETAG_MAX];
+
+// Tenant UUIDs the BLE callback matches against. The network task indexes a new list into
+// the standby set and publishes it with one pointer store; the callback counts itself in
+// tenantMatchersBusy, so a set is only rebuilt once no callback can still be reading it.
+#if defined(ESP_PLATFORM)
+static const char* TENANTS_FILE = "/littlefs/tenants.bin";
+#else
+static const char* TENANTS_FILE = "tenants.bin";
+#endif
+static UuidPatternSet tenantSets[2];
+static std::atomic<const UuidPatternSet*> tenantMatcher{&tenantSets[0]};
+static std::atomic<uint32_t> tenantMatchersBusy{0};
+static char tenantsEtag[TENANTS_ETAG_MAX];
+
+// Break thresholds from the Worker (Sessions.h); guarded by presenceMutex
+static SessionThresholds sessionThresholds;
+static char sessionConfigEtag[SESSION_CONFIG_ETAG_MAX];
+
+// Guards the presence table and the allowlist (BLE callback, loop() and network task)
+static std::mutex presenceMutex;
+
+// Event numbers never repeat on a device, so the Worker can drop a resent event by (device,
+// seq). Blocks of EVENT_SEQ_BLOCK numbers are reserved in NVS ahead of use and a boot resumes
+// after the last reservation: one flash write per block, and a crash only skips numbers.
+static const char* EVENT_SEQ_NVS_NAMESPACE = "events";
+static const uint32_t EVENT_SEQ_BLOCK = 1024;
+static uint32_t nextEventSeq = 1;   // guarded by presenceMutex
+static uint32_t eventSeqLimit = 0;  // numbers below this are reserved; guarded by presenceMutex
+
+// Wall-clock time for event stamps, anchored by the SNTP client
+static DeviceClock deviceClock;
+
+// Seconds since boot for presence deadlines and the network task's schedule; unlike
+// millis() / 1000 it does not jump back to 0 after 49.7 days
+static UptimeClock uptimeClock;
+static uint32_t uptimeSeconds() { return uptimeClock.seconds(millis()); }
+
+// Pipeline counters, printed after each scan
+static std::atomic<uint32_t> eventsQueued{0};
+static std::atomic<uint32_t> eventsDropped{0};
+static std::atomic<uint32_t> eventsPosted{0};
+static std::atomic<uint32_t> eventsFailed{0};
+static std::atomic<uint32_t> eventsJournaled{0};
+static std::atomic<uint32_t> eventsReplayed{0};
+static std::atomic<uint32_t> weakSightings{0};   // heard, but too weak (or too briefly) to check in
+static std::atomic<uint32_t> weakDepartures{0};  // checkouts caused by a weak signal rather than silence
+static std::atomic<uint32_t> signalDropouts{0};  // absences under MIN_BREAK_SECONDS, absorbed without a row
+static std::atomic<uint32_t> unknownSightings{0}; // payloads not on the allowlist, dropped
+static std::atomic<uint32_t> sessionBreaks{0};    // break segments queued instead of a checkout and a checkin
+static std::atomic<uint32_t> checkoutsDropped{0};  // present or away entries evicted from a full presence table
+static std::atomic<uint32_t> lastScanToPostMs{0};
+static std::atomic<uint32_t> maxScanToPostMs{0};
+// Readiness after boot and after a lost link (millis(); 0: not yet)
+static std::atomic<uint32_t> firstScanMs{0};
+static std::atomic<uint32_t> firstPostMs{0};
+static std::atomic<uint32_t> lastPostMs{0};
+static std::atomic<uint32_t> recoveryMs{0};  // latest link loss -> first accepted POST after it
+
+// Stage timings, cumulative counters and heap watermarks for the heartbeat
+static Telemetry telemetry;
+
+// Queue an event for entry that happened at atMs (millis(); earlier for held-back session
+// segments). Caller holds presenceMutex. Returns false if it was refused (queue full / value
+// too long) so the caller can leave its state untouched and try again later.
+static bool queueEventLocked(PresenceEntry &entry, uint8_t action, uint32_t atMs, uint32_t durationSec) {
+  DetectionEvent ev;
+  if (!ev.set(entry.hex, entry.hexLen, action, atMs)) {
+    LOG_WARN(LOG_CAT_EVENTS, "⚠️ Hex value too long to queue (%d chars)", (int)entry.hexLen);
+    return false;
+  }
+  if ((int32_t)(eventSeqLimit - nextEventSeq) <= 0) {
+    eventsDropped++;
+    LOG_WARN(LOG_CAT_EVENTS, "⚠️ No event numbers reserved; deferring %s for %s", eventActionName(action), entry.hex);
+    return false;
+  }
+  ev.seq = nextEventSeq;
+  ev.observedMs = deviceClock.epochMsAt(atMs);
+  ev.tenant = entry.tenant;
+  ev.durationSec = durationSec;
+  if (!eventQueue.push(ev)) {
+    eventsDropped++;
+    LOG_WARN(LOG_CAT_EVENTS, "⚠️ Event queue full (%d); deferring %s for %s", (int)EVENT_QUEUE_CAPACITY, eventActionName(action), entry.hex);
+    return false;
+  }
+  nextEventSeq++;
+  entry.lastSent = uptimeSeconds();
+  entry.sent = true;
+  eventsQueued++;
+  return true;
+}
+
+// Queue an enter/exit event now. Caller holds presenceMutex.
+// Returns false if the event was refused (see queueEventLocked). Recent duplicates count as queued.
+static bool queueDetectionLocked(PresenceEntry &entry, uint8_t action) {
+  // dedupe by lastSent TTL
+  uint32_t nowSec = uptimeSeconds();
+  if (entry.sent && (nowSec - entry.lastSent) < SEEN_TTL_SECONDS) {
+    LOG_DEBUG(LOG_CAT_EVENTS, "Ignoring duplicate POST (recent): %s", entry.hex);
+    return true;
+  }
+  if (!queueEventLocked(entry, action, millis(), 0)) return false;
+  if (action == EVENT_CHECKIN) periodArrivals++;
+  else periodDepartures++;
+  return true;
 }
 
-// Internal helper to POST with action ("checkin" or "checkout")
-void sendHexToServerWithAction(const std::string &hexValue, const char* action) {
-  static const int MAX_RETRIES = 3;  // Maximum number of retry attempts
-  
-  // dedupe by lastSentAt TTL
-  uint32_t nowSec = millis() / 1000;
-  auto it = lastSentAt.find(hexValue);
-  if (it != lastSentAt.end()) {
-    if ((nowSec - it->second) < SEEN_TTL_SECONDS) {
-      Serial.println("Ignoring duplicate POST (recent): " + String(hexValue.c_str()));
-      return;
+// An away entry is back in range (since crossingSince): its absence becomes one break
+// segment, or, if it outlasted the longest break before the departure timer fired, the held
+// checkout and a fresh checkin. Caller holds presenceMutex; false if the queue refused it.
+static bool queueReturnLocked(PresenceEntry &entry) {
+  uint32_t awaySec = entry.crossingSince - entry.awaySince;
+  if (awaySec < MIN_BREAK_SECONDS) {
+    entry.away = false;
+    signalDropouts++;
+    return true;
+  }
+  uint8_t kind = classifyAbsence(awaySec, sessionThresholds);
+  if (kind != EVENT_CHECKOUT) {
+    if (!queueEventLocked(entry, kind, entry.awaySince * 1000, awaySec)) return false;
+    sessionBreaks++;
+  } else {
+    if (!queueEventLocked(entry, EVENT_CHECKOUT, entry.awaySince * 1000, 0)) return false;
+    entry.away = false;
+    if (!queueEventLocked(entry, EVENT_CHECKIN, millis(), 0)) {
+      entry.sent = false;  // so the retry on the next sighting is not taken for a duplicate
+      return false;
+    }
+  }
+  entry.away = false;
+  periodArrivals++;
+  return true;
+}
+
+// Each tracked entry has one timer: present entries time out PRESENCE_TIMEOUT_SECONDS after
+// the last sighting (sooner if the signal has been weak for RSSI_EXIT_DWELL_SECONDS), away
+// entries send their held checkout once no break is that long (up to lunchBreakMaxSec ahead,
+// which the wheel's outer level holds), the rest are forgotten once they no longer suppress
+// duplicate POSTs or dwell on a check-in.
+// Returns 0 when the entry can be forgotten now.
+static uint32_t presenceDeadlineLocked(const PresenceEntry &entry) {
+  if (entry.away) return entry.awaySince + sessionThresholds.lunchBreakMaxSec + 1;
+  if (entry.present) {
+    uint32_t deadline = entry.lastSeen + PRESENCE_TIMEOUT_SECONDS + 1;
+    if (entry.crossing && entry.crossingSince + RSSI_EXIT_DWELL_SECONDS < deadline) {
+      deadline = entry.crossingSince + RSSI_EXIT_DWELL_SECONDS;
     }
+    return deadline;
   }
-  lastSentAt[hexValue] = nowSec;
+  uint32_t deadline = 0;
+  if (entry.sent) deadline = entry.lastSent + SEEN_TTL_SECONDS;
+  if (entry.crossing && entry.lastSeen + RSSI_ENTER_DWELL_SECONDS + 1 > deadline) {
+    deadline = entry.lastSeen + RSSI_ENTER_DWELL_SECONDS + 1;
+  }
+  return deadline;
+}
+
+// The presence table was full and evicts a held entry. An away entry's checkout is queued
+// now, stamped when it left, as if no break were that long; a present entry's checkout is
+// lost. Caller holds presenceMutex (called from inside upsert()).
+static void onPresenceEvictedLocked(PresenceEntry &entry) {
+  if (entry.away && queueEventLocked(entry, EVENT_CHECKOUT, entry.awaySince * 1000, 0)) {
+    LOG_WARN(LOG_CAT_EVENTS, "⚠️ Presence table full (%u tracked): evicted away %s, checkout sent early",
+             (unsigned)presence.size(), entry.hex);
+    return;
+  }
+  if (!entry.present && !entry.away) return;
+  checkoutsDropped++;
+  LOG_WARN(LOG_CAT_EVENTS, "⚠️ Presence table full (%u tracked): evicted %s %s, its checkout is lost",
+           (unsigned)presence.size(), entry.present ? "present" : "away", entry.hex);
+}
 
+// Rescheduling is O(1), so every sighting can push the deadline out
+static void armPresenceTimerLocked(PresenceEntry &entry, uint32_t nowSec) {
+  uint32_t deadline = presenceDeadlineLocked(entry);
+  presence.scheduleExpiry(&entry, deadline ? deadline : nowSec);
+}
+
+// Backpressure: with a nearly full queue, give each event a single attempt
+static int currentMaxAttempts() {
+  return eventQueue.size() >= EVENT_QUEUE_SHED_RETRIES_AT ? 1 : DETECT_MAX_ATTEMPTS;
+}
+
+// Whether uploads still go out as binary frames (SCANNER_BINARY_WIRE); network task only
+static bool useBinaryWire = SCANNER_BINARY_WIRE;
+
+// A Worker without the binary format answers a frame with 415 (unknown Content-Type) or 400
+// (the JSON validator): switch to JSON for the rest of this boot. True if the caller should
+// resend the same events as JSON instead of taking the answer as a rejection.
+static bool fallBackToJson(int code) {
+  if (!useBinaryWire || (code != 415 && code != 400)) return false;
+  useBinaryWire = false;
+  LOG_WARN(LOG_CAT_NET, "⚠️ Worker refused a binary frame (HTTP %d); uploading JSON from now on", code);
+  return true;
+}
+
+// POST events[which[j]] (or events[j] when which is null) as one binary frame and fill
+// statuses[j] from the ack. Returns the HTTP code, a negative transport error or WIRE_BAD_ACK.
+static int postWireFrame(const ServerConnection::Endpoint &target, const DetectionEvent* events, const size_t* which,
+                         size_t n, uint8_t* statuses) {
+  static uint8_t frame[WIRE_FRAME_HEADER_LEN + DETECT_BATCH_MAX * WIRE_RECORD_MAX];
+  size_t len = encodeWireFrame(frame, sizeof(frame), events, which, n, deviceMac, millis());
+
+  std::lock_guard<std::mutex> lock(server.mutex());
+  StageTimer timer(telemetry.timed(STAGE_POST));
+  telemetry.postRequests++;
+  int code = sendWireFrame(server, target, frame, len, statuses, n);
+  server.finish();
+  return code;
+}
+
+// POST one event ("checkin" or "checkout") in the configured format (DetectUpload.h); runs
+// on the network task only
+static PostResult postDetection(const DetectionEvent &ev, int maxAttempts) {
   int retries = 0;
-  while (retries < MAX_RETRIES) {
+  while (retries < maxAttempts) {
+    if (retries > 0) telemetry.postRetries++;
     if (WiFi.status() != WL_CONNECTED) {
-      Serial.println("⚠️ WiFi not connected; waiting 2s before retry...");
-      delay(2000);
-      if (retries == MAX_RETRIES - 1) {
-        Serial.println("❌ WiFi connection failed after retries");
-        presentDevices.erase(hexValue);  // Allow future retry
-        return;
-      }
-      retries++;
-      continue;
+      LOG_WARN(LOG_CAT_NET, "⚠️ WiFi not connected; leaving the event for the journal");
+      return POST_FAILED;
     }
 
-  String url = String(SERVER_HOST) + String(SERVER_ENDPOINT);
-    HTTPClient http;
-    http.begin(url);
-    http.addHeader("Content-Type", "application/json");
-  // Build payload {"hex_value":"...", "action":"checkin|checkout"}
-  String payload = String("{\"hex_value\":\"") + String(hexValue.c_str()) + String("\",\"action\":\"") + String(action) + String("\"}");
-  Serial.printf("📡 POSTing to AutoAttend (attempt %d/%d): %s\n", retries + 1, MAX_RETRIES, payload.c_str());
-    
-    int code = http.POST(payload);
-    String resp = http.getString();
-    
-    if (code == 200 || code == 201) {
-      if (wasPostSuccessful(resp)) {
-  Serial.println("✅ Server confirmed success");
-        Serial.printf("Response: %s\n", resp.c_str());
-        http.end();
-        return;  // Success!
-      } else {
-        Serial.println("⚠️ Unexpected response format");
-        Serial.printf("Response: %s\n", resp.c_str());
-      }
-    } else {
-      Serial.printf("❌ Error: POST failed with code %d\n", code);
-      Serial.printf("Response: %s\n", resp.c_str());
+    LOG_DEBUG(LOG_CAT_NET, "📡 POSTing to AutoAttend (attempt %d/%d): %s %s #%u", retries + 1, maxAttempts,
+              eventActionName(ev.action), ev.hex, (unsigned)ev.seq);
+    uint8_t status;
+    int code;
+    String resp;
+    bool binary = useBinaryWire;
+    {
+      std::lock_guard<std::mutex> lock(server.mutex());
+      StageTimer timer(telemetry.timed(STAGE_POST));
+      telemetry.postRequests++;
+      code = sendDetection(server, detectEndpoint, ev, binary, deviceMac, deviceId, status, &resp);
+      server.finish();
+    }
+    if (resp.length() > 0) LOG_DEBUG(LOG_CAT_NET, "Response: %s", resp.c_str());
+    if (binary && fallBackToJson(code)) continue;  // the same attempt, as JSON
+
+    if (status != WIRE_RETRY) {
+      LOG_INFO(LOG_CAT_NET, "%s Server status %u (HTTP %d)", status <= WIRE_DEDUPED ? "✅" : "❌", (unsigned)status, code);
+      return postResultOf(status);
     }
-    
-    http.end();
-    
-    // If we get here, either the response wasn't successful or the status code wasn't 200/201
+    LOG_ERROR(LOG_CAT_NET, "❌ Error: POST failed with code %d", code);
+
     retries++;
-    if (retries < MAX_RETRIES) {
-      int backoff = 1000 * retries;  // Exponential backoff: 1s, 2s, 3s
-      Serial.printf("⏳ Retry %d/%d after %dms\n", retries + 1, MAX_RETRIES, backoff);
+    if (retries < maxAttempts) {
+      uint32_t backoff = detectRetryBackoffMs(retries);
+      LOG_INFO(LOG_CAT_NET, "⏳ Retry %d/%d after %ums", retries + 1, maxAttempts, (unsigned)backoff);
       delay(backoff);
     }
   }
-  
+
   // If we get here, we failed after all retries
-  Serial.printf("❌ Failed to POST after %d attempts\n", MAX_RETRIES);
-  presentDevices.erase(hexValue);  // Remove from tracking to allow future retry
-}
-
-// Send a single hex_value (ASCII hex string) as a check-in (default)
-void sendHexToServer(const std::string &hexValue) {
-  sendHexToServerWithAction(hexValue, "checkin");
-}
-
-// Minimal JSON escaper for strings we send to Strapi
-static std::string jsonEscape(const std::string &s) {
-  std::string out;
-  out.reserve(s.size() * 2);
-  for (unsigned char c : s) {
-    switch (c) {
-      case '\\': out += "\\\\"; break;
-      case '"': out += "\\\""; break;
-      case '\n': out += "\\n"; break;
-      case '\r': out += "\\r"; break;
-      case '\t': out += "\\t"; break;
-      default:
-        if (c < 0x20) {
-          char buf[7];
-          // produce unicode escape for control characters
-          snprintf(buf, sizeof(buf), "\\u%04x", c);
-          out += buf;
-        } else {
-          out += (char)c;
-        }
+  LOG_ERROR(LOG_CAT_NET, "❌ Failed to POST after %d attempts", maxAttempts);
+  return POST_FAILED;
+}
+
+// Parse an integer array such as "accepted":[0,2,5] from a response and set flags[i]
+static void parseIndexList(const String &resp, const char* key, bool* flags, size_t count) {
+  int start = resp.indexOf(key);
+  if (start < 0) return;
+  start = resp.indexOf('[', start);
+  int end = start < 0 ? -1 : resp.indexOf(']', start);
+  if (end < 0) return;
+  int value = -1;
+  for (int i = start + 1; i <= end; i++) {
+    char c = resp.c_str()[i];
+    if (c >= '0' && c <= '9') {
+      value = (value < 0 ? 0 : value * 10) + (c - '0');
+    } else {
+      if (value >= 0 && (size_t)value < count) flags[value] = true;
+      value = -1;
     }
   }
-  return out;
 }
 
-// Send service data (ASCII) to AutoAttend as {"hex_value":"..."}
-// Note: if serviceAscii is already ASCII hex, we use it as-is; otherwise we send its HEX.
-void sendServiceDataToServer(const std::string &serviceAscii) {
-  uint32_t nowSec = millis() / 1000;
-  auto it = lastSentAt.find(serviceAscii);
-  if (it != lastSentAt.end()) {
-    if ((nowSec - it->second) < SEEN_TTL_SECONDS) {
-      Serial.println("Ignoring duplicate service data (recent): " + String(serviceAscii.c_str()));
-      return;
+// Batches go to the sessions endpoint when the scanner computes sessions
+static const ServerConnection::Endpoint &batchEndpoint() {
+  return SCANNER_EDGE_SESSIONS ? sessionsEndpoint : detectBatchEndpoint;
+}
+
+// One batch request for events[sent[0..n)] in JSON; fills accepted/retry by position.
+// Returns false if the request failed as a whole.
+static bool sendBatchJson(const DetectionEvent* events, const size_t* sent, size_t n, bool* accepted, bool* retry) {
+  static char body[DETECT_BATCH_BODY_MAX];
+  size_t bodyLen = formatBatchJson(body, sizeof(body), events, sent, n, deviceId, millis());
+
+  int code;
+  String resp;
+  {
+    std::lock_guard<std::mutex> lock(server.mutex());
+    StageTimer timer(telemetry.timed(STAGE_POST));
+    telemetry.postRequests++;
+    code = server.send("POST", batchEndpoint(), "application/json", (const uint8_t*)body, bodyLen);
+    if (code > 0) resp = server.http().getString();
+    server.finish();
+  }
+  if (code != 200 || !wasPostSuccessful(resp)) {
+    LOG_ERROR(LOG_CAT_NET, "❌ Error: batch POST failed with code %d", code);
+    LOG_DEBUG(LOG_CAT_NET, "Response: %s", resp.c_str());
+    return false;
+  }
+  parseIndexList(resp, "\"accepted\"", accepted, n);
+  parseIndexList(resp, "\"retry\"", retry, n);
+  return true;
+}
+
+// The same request as one binary frame (WireFormat.h), or as JSON if the Worker refuses it
+static bool sendBatchBinary(const DetectionEvent* events, const size_t* sent, size_t n, bool* accepted, bool* retry) {
+  uint8_t statuses[DETECT_BATCH_MAX];
+  int code = postWireFrame(batchEndpoint(), events, sent, n, statuses);
+  if (fallBackToJson(code)) return sendBatchJson(events, sent, n, accepted, retry);
+  if (code != 200) {
+    LOG_ERROR(LOG_CAT_NET, "❌ Error: batch POST failed with code %d", code);
+    return false;
+  }
+  for (size_t j = 0; j < n; j++) {
+    accepted[j] = statuses[j] <= WIRE_DEDUPED;
+    retry[j] = statuses[j] == WIRE_RETRY;
+  }
+  return true;
+}
+
+// POST several events in one request and fill results[i]. Only items the server lists
+// under "retry" (or all of them, on transport errors) are resent.
+static void postDetectionBatch(const DetectionEvent* events, size_t count, PostResult* results, int maxAttempts) {
+  bool pending[DETECT_BATCH_MAX];
+  for (size_t i = 0; i < count; i++) {
+    results[i] = POST_FAILED;
+    pending[i] = true;
+  }
+  size_t remaining = count;
+
+  for (int attempt = 0; attempt < maxAttempts && remaining > 0; attempt++) {
+    if (WiFi.status() != WL_CONNECTED) {
+      LOG_WARN(LOG_CAT_NET, "⚠️ WiFi not connected; leaving %d events for the journal", (int)remaining);
+      break;
     }
+    if (attempt > 0) {
+      telemetry.postRetries++;
+      uint32_t backoff = detectRetryBackoffMs(attempt);
+      LOG_INFO(LOG_CAT_NET, "⏳ Retry %d/%d (%d events) after %ums", attempt + 1, maxAttempts, (int)remaining,
+               (unsigned)backoff);
+      delay(backoff);
+    }
+
+    size_t sent[DETECT_BATCH_MAX];
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+      if (pending[i]) sent[n++] = i;
+    }
+
+    LOG_DEBUG(LOG_CAT_NET, "📡 POSTing batch of %d to AutoAttend (attempt %d/%d)", (int)n, attempt + 1, maxAttempts);
+    bool accepted[DETECT_BATCH_MAX] = {false};
+    bool retry[DETECT_BATCH_MAX] = {false};
+    bool ok = useBinaryWire ? sendBatchBinary(events, sent, n, accepted, retry)
+                            : sendBatchJson(events, sent, n, accepted, retry);
+    if (!ok) continue;
+
+    remaining = 0;
+    for (size_t j = 0; j < n; j++) {
+      size_t i = sent[j];
+      if (retry[j]) {
+        remaining++;
+        continue;
+      }
+      // Settled either way: recorded/deduped, or rejected for good (unknown, duplicate)
+      pending[i] = false;
+      results[i] = accepted[j] ? POST_OK : POST_REJECTED;
+    }
+    LOG_INFO(LOG_CAT_NET, "✅ Batch done: %d settled, %d to retry", (int)(n - remaining), (int)remaining);
   }
-  lastSentAt[serviceAscii] = nowSec;
 
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("WiFi not connected; cannot POST service data");
-    return;
+  if (remaining > 0) {
+    LOG_ERROR(LOG_CAT_NET, "❌ %d batched events failed after %d attempts", (int)remaining, maxAttempts);
   }
+}
 
-  String url = String(SERVER_HOST) + String(SERVER_ENDPOINT);
-  HTTPClient http;
-  http.begin(url);
-  http.addHeader("Content-Type", "application/json");
- 
-  // Determine hex to send
-  String payload;
-  if (isAsciiHexString(serviceAscii)) {
-    payload = String("{\"hex_value\":\"") + String(serviceAscii.c_str()) + String("\"}");
+// Deliver events with whichever upload mode is configured (session segments only go in bulk)
+static void postDetections(const DetectionEvent* events, size_t count, PostResult* results, int maxAttempts) {
+  if (USE_BATCH_UPLOAD || SCANNER_EDGE_SESSIONS) {
+    postDetectionBatch(events, count, results, maxAttempts);
   } else {
-    std::string hexS = toHexString(serviceAscii);
-    payload = String("{\"hex_value\":\"") + String(hexS.c_str()) + String("\"}");
-  }
-  Serial.println("POSTing service data to AutoAttend: " + payload);
-  int code = http.POST(payload);
-  String resp = http.getString();
-  Serial.printf("AutoAttend service POST code=%d\n", code);
-  Serial.println("AutoAttend response: " + resp);
-  http.end();
-}
-
-// BLE Callback
-class MyAdvertisedDeviceCallbacks : public BLEAdvertisedDeviceCallbacks {
-  void onResult(BLEAdvertisedDevice advertisedDevice) override {
-    std::string addr = advertisedDevice.getAddress().toString();
-    std::string targetLower = toLowerCase(TARGET_UUID);
-    bool matches = false;
-    std::string foundUuidStr;
-
-    // 1️⃣ Check for Service UUID match
-    if (advertisedDevice.haveServiceUUID()) {
-      std::string srv = advertisedDevice.getServiceUUID().toString();
-      if (toLowerCase(srv).find(targetLower) != std::string::npos) {
-        matches = true;
-        foundUuidStr = srv;
-      }
+    for (size_t i = 0; i < count; i++) results[i] = postDetection(events[i], maxAttempts);
+  }
+}
+
+// Append an undeliverable event to the flash journal; false if it is lost
+static bool journalDetection(const DetectionEvent &ev) {
+  if (!journal.isOpen() || !journal.append(ev)) return false;
+  eventsJournaled++;
+  return true;
+}
+
+// Stamp readiness milestones after any POST the Worker accepted
+static void notePostAccepted() {
+  uint32_t now = millis();
+  uint32_t none = 0;
+  firstPostMs.compare_exchange_strong(none, now ? now : 1);
+  uint32_t down = wifiLink.downMs();
+  if (down && (int32_t)(lastPostMs.load() - down) < 0) recoveryMs = now - down;
+  lastPostMs = now;
+}
+
+// Bookkeeping once an event has been posted (or given up on)
+static void finishDetection(const DetectionEvent &ev, PostResult result) {
+  if (result == POST_OK) {
+    notePostAccepted();
+    eventsPosted++;
+    // Held-back checkouts and breaks are stamped when the badge left, not when they were queued
+    if (SCANNER_EDGE_SESSIONS && ev.action != EVENT_CHECKIN) return;
+    uint32_t latency = millis() - ev.seenAtMs;
+    lastScanToPostMs = latency;
+    if (latency > maxScanToPostMs) maxScanToPostMs = latency;
+    return;
+  }
+  // Undelivered: keep it in the journal (device stays present, replay will post it)
+  if (result == POST_FAILED && journalDetection(ev)) return;
+
+  eventsFailed++;
+  if (ev.action == EVENT_CHECKIN) {
+    std::lock_guard<std::mutex> lock(presenceMutex);
+    PresenceEntry* entry = presence.find(ev.hex, strlen(ev.hex));
+    if (entry) {
+      presence.setPresent(entry, false);  // Allow a future sighting to retry
+      armPresenceTimerLocked(*entry, uptimeSeconds());
     }
+  }
+}
 
-    // 2️⃣ Check Manufacturer Data for UUID (Android often uses this)
-    if (!matches && advertisedDevice.haveManufacturerData()) {
-      std::string mData = advertisedDevice.getManufacturerData();
-      std::string mDataHex = toHexString(mData);
-      if (toLowerCase(mDataHex).find(targetLower) != std::string::npos) {
-        matches = true;
-        foundUuidStr = TARGET_UUID;
-      }
+// Replay one batch of journaled events (oldest first). Everything is acknowledged only
+// if none of it failed, so delivery order is preserved; rejected items are settled.
+static bool drainJournal() {
+  static DetectionEvent replay[DETECT_BATCH_MAX];
+  PostResult results[DETECT_BATCH_MAX];
+  uint32_t lastSeq;
+  size_t n = journal.peek(replay, DETECT_BATCH_MAX, lastSeq);
+  if (n == 0) {
+    journal.ackThrough(lastSeq);  // only corrupt records left in this range
+    return true;
+  }
+  LOG_INFO(LOG_CAT_EVENTS, "📼 Replaying %d journaled events (%u pending)", (int)n, (unsigned)journal.pending());
+  postDetections(replay, n, results, 1);
+  for (size_t i = 0; i < n; i++) {
+    if (results[i] == POST_FAILED) return false;
+  }
+  journal.ackThrough(lastSeq);
+  for (size_t i = 0; i < n; i++) {
+    if (results[i] == POST_OK) {
+      notePostAccepted();
+      eventsReplayed++;
+    } else {
+      finishDetection(replay[i], results[i]);
     }
+  }
+  return true;
+}
 
-    // 3️⃣ Check Service Data for UUID
-    if (!matches && advertisedDevice.haveServiceData()) {
-      try {
-        std::string sData = advertisedDevice.getServiceData();
-        std::string sDataHex = toHexString(sData);
-        if (toLowerCase(sDataHex).find(targetLower) != std::string::npos) {
-          matches = true;
-          foundUuidStr = TARGET_UUID;
-        }
-      } catch (...) {
-        // ignore service data parsing errors
+// Heartbeat body: counters since boot, stage histograms (see StageHistogram for the
+// buckets) and heap watermarks
+static int formatHeartbeat(char* out, size_t len) {
+  uint32_t present, nextSeq;
+  {
+    std::lock_guard<std::mutex> lock(presenceMutex);
+    present = (uint32_t)presence.presentCount();
+    nextSeq = nextEventSeq;
+  }
+  int n = snprintf(out, len,
+                   "{\"device_id\":\"%s\",\"firmware_version\":\"%s\",\"uptime_s\":%u,\"counters\":{"
+                   "\"adverts\":%u,\"matches\":%u,\"scan_periods\":%u,\"present\":%u,\"events_queued\":%u,"
+                   "\"events_dropped\":%u,\"events_posted\":%u,\"events_failed\":%u,\"events_journaled\":%u,"
+                   "\"events_replayed\":%u,\"journal_pending\":%u,\"post_requests\":%u,\"post_retries\":%u,"
+                   "\"ota_checks\":%u,\"log_dropped\":%u,\"unknown_sightings\":%u,\"tenants\":%u,\"advert_cache_hits\":%u,"
+                   "\"advert_cache_misses\":%u,\"session_breaks\":%u},\"heap\":{\"free_min\":%u,\"free_max\":%u,\"block_min\":%u,\"block_max\":%u},"
+                   "\"wifi\":{\"attempts\":%u,\"connects\":%u,\"drops\":%u,\"connect_ms\":%u,\"first_scan_ms\":%u,"
+                   "\"first_post_ms\":%u,\"recovery_ms\":%u},\"clock\":{\"syncs\":%u,\"drift_ppm\":%d,"
+                   "\"last_error_ms\":%d,\"next_seq\":%u},\"radio\":{\"backend\":\"%s\",\"heap_after_init\":%u},"
+                   "\"hist\":{",
+                   deviceId, CURRENT_FIRMWARE_VERSION, (unsigned)uptimeSeconds(), (unsigned)telemetry.adverts,
+                   (unsigned)telemetry.matches, (unsigned)telemetry.scanPeriods, (unsigned)present,
+                   (unsigned)eventsQueued, (unsigned)eventsDropped, (unsigned)eventsPosted, (unsigned)eventsFailed,
+                   (unsigned)eventsJournaled, (unsigned)eventsReplayed, (unsigned)journal.pending(),
+                   (unsigned)telemetry.postRequests, (unsigned)telemetry.postRetries, (unsigned)telemetry.otaChecks,
+                   (unsigned)scannerLog.dropped(), (unsigned)unknownSightings, (unsigned)tenantMatcher.load()->size(),
+                   (unsigned)advertCache.hits(), (unsigned)advertCache.misses(), (unsigned)sessionBreaks,
+                   (unsigned)telemetry.freeHeapMin(), (unsigned)telemetry.freeHeapMax(),
+                   (unsigned)telemetry.largestBlockMin(), (unsigned)telemetry.largestBlockMax(),
+                   (unsigned)wifiLink.attempts(), (unsigned)wifiLink.connects(), (unsigned)wifiLink.drops(),
+                   (unsigned)wifiLink.lastConnectMs(), (unsigned)firstScanMs, (unsigned)firstPostMs, (unsigned)recoveryMs,
+                   (unsigned)deviceClock.syncs(), (int)deviceClock.driftPpm(), (int)deviceClock.lastErrorMs(),
+                   (unsigned)nextSeq, Radio::backendName(), (unsigned)bleInitFreeHeap);
+  static const char* names[STAGE_COUNT] = {"scan", "match", "post", "ota"};
+  for (int s = 0; s < STAGE_COUNT && n > 0 && (size_t)n < len; s++) {
+    n += snprintf(out + n, len - n, "%s\"%s\":", s ? "," : "", names[s]);
+    if ((size_t)n < len) n += telemetry.stage((TelemetryStage)s).formatJson(out + n, len - n);
+  }
+  if (n > 0 && (size_t)n < len) n += snprintf(out + n, len - n, "}}");
+  return n > 0 && (size_t)n < len ? n : -1;
+}
+
+// POST one heartbeat; runs on the network task. Returns false if it was not delivered.
+static bool sendHeartbeat() {
+  static char body[1536];
+  int len = formatHeartbeat(body, sizeof(body));
+  if (len < 0) return false;
+  int code;
+  {
+    std::lock_guard<std::mutex> lock(server.mutex());
+    code = server.send("POST", heartbeatEndpoint, "application/json", (const uint8_t*)body, (size_t)len);
+    server.finish();
+  }
+  if (code != 200) {
+    LOG_WARN(LOG_CAT_NET, "⚠️ Heartbeat failed with code %d", code);
+    return false;
+  }
+  telemetry.heartbeats++;
+  notePostAccepted();
+  return true;
+}
+
+// Conditional GET of the allowlist; a changed list is swapped in and saved to flash.
+// Returns false if the Worker could not be asked (or sent something unusable).
+static bool syncAllowlist() {
+  static const char* headers[] = {"ETag"};
+  uint8_t* body = nullptr;
+  int len = -1;
+  char etag[ALLOWLIST_ETAG_MAX];
+  {
+    std::lock_guard<std::mutex> lock(server.mutex());
+    HTTPClient &http = server.http();
+    http.collectHeaders(headers, 1);
+    int code = server.send("GET", allowlistEndpoint, nullptr, nullptr, 0, allowlistEtag[0] ? "If-None-Match" : nullptr,
+                           allowlistEtag);
+    if (code == 200) {
+      int size = http.getSize();
+      if (size >= 0 && (size_t)size <= ALLOWLIST_HEADER_LEN + ALLOWLIST_MAX_KEYS * 4) {
+        body = (uint8_t*)malloc(size ? size : 1);
+        if (body) len = server.readBody(body, (size_t)size);
       }
+      snprintf(etag, sizeof(etag), "%s", http.header("ETag").c_str());
+    }
+    server.finish();
+    if (code == 304) return true;
+    // Older Worker without the endpoint: keep forwarding everything, ask again next refresh
+    if (code == 404) {
+      LOG_DEBUG(LOG_CAT_NET, "Allowlist not published by the Worker");
+      return true;
     }
+    if (code != 200) {
+      LOG_WARN(LOG_CAT_NET, "⚠️ Allowlist fetch failed code=%d", code);
+      return false;
+    }
+  }
 
-    // 4️⃣ Fallback: check complete advertisement text
-    if (!matches) {
-      std::string advStr = advertisedDevice.toString();
-      if (toLowerCase(advStr).find(targetLower) != std::string::npos) {
-        matches = true;
-        foundUuidStr = TARGET_UUID;
+  Allowlist next;
+  if (len < 0 || !next.load(body, (size_t)len)) {
+    if (len < 0) free(body);
+    LOG_WARN(LOG_CAT_NET, "⚠️ Allowlist body invalid (%d bytes)", len);
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(presenceMutex);
+    allowlist.swap(next);
+  }
+  snprintf(allowlistEtag, sizeof(allowlistEtag), "%s", etag);
+  bool saved = allowlist.save(ALLOWLIST_FILE, allowlistEtag);
+  LOG_INFO(LOG_CAT_NET, "🗂️ Allowlist %s: %u keys, %u bytes%s", allowlistEtag, (unsigned)allowlist.size(),
+           (unsigned)allowlist.bytes(), saved ? "" : " (not saved)");
+  return true;
+}
+
+// Index patterns into the standby tenant set and make it the live one. Called from setup()
+// and then only from the network task.
+static bool publishTenants(const UuidPattern* patterns, size_t count) {
+  const UuidPatternSet* live = tenantMatcher.load();
+  UuidPatternSet* standby = live == &tenantSets[0] ? &tenantSets[1] : &tenantSets[0];
+  // A callback that picked up standby before the last publish may still be using it
+  while (tenantMatchersBusy.load() != 0) delay(1);
+  if (!standby->assign(patterns, count)) return false;
+  tenantMatcher.store(standby);
+  return true;
+}
+
+// Match the tenants in list, or only TARGET_UUID if it is empty
+static bool publishTenantList(const TenantList &list) {
+  if (list.size() == 0) {
+    UuidPattern target;
+    return parseUuidPattern(TARGET_UUID, target) && publishTenants(&target, 1);
+  }
+  UuidPattern* patterns = (UuidPattern*)malloc(list.size() * sizeof(UuidPattern));
+  if (!patterns) return false;
+  list.patterns(patterns);
+  bool ok = publishTenants(patterns, list.size());
+  free(patterns);
+  return ok;
+}
+
+// Conditional GET of the tenant list; a changed list is indexed, published and saved to
+// flash. Returns false if the Worker could not be asked (or sent something unusable).
+static bool syncTenants() {
+  static const char* headers[] = {"ETag"};
+  uint8_t* body = nullptr;
+  int len = -1;
+  char etag[TENANTS_ETAG_MAX];
+  {
+    std::lock_guard<std::mutex> lock(server.mutex());
+    HTTPClient &http = server.http();
+    http.collectHeaders(headers, 1);
+    int code = server.send("GET", tenantsEndpoint, nullptr, nullptr, 0, tenantsEtag[0] ? "If-None-Match" : nullptr,
+                           tenantsEtag);
+    if (code == 200) {
+      int size = http.getSize();
+      if (size >= 0 && (size_t)size <= TENANTS_MAX_BYTES) {
+        body = (uint8_t*)malloc(size ? size : 1);
+        if (body) len = server.readBody(body, (size_t)size);
       }
+      snprintf(etag, sizeof(etag), "%s", http.header("ETag").c_str());
+    }
+    server.finish();
+    if (code == 304) return true;
+    // Older Worker without the endpoint: keep matching TARGET_UUID
+    if (code == 404) {
+      LOG_DEBUG(LOG_CAT_NET, "Tenant list not published by the Worker");
+      return true;
     }
+    if (code != 200) {
+      LOG_WARN(LOG_CAT_NET, "⚠️ Tenant list fetch failed code=%d", code);
+      return false;
+    }
+  }
 
-    // 3️⃣ Process only if target UUID matches
-    if (matches) {
-      if (devicesWithTarget.insert(addr).second) {
-        Serial.println("==================================");
-  Serial.printf("📡 Device: %s\n", addr.c_str());
-  Serial.printf("  Matched UUID: %s\n", foundUuidStr.c_str());
+  TenantList next;
+  if (len < 0 || !next.load(body, (size_t)len)) {
+    if (len < 0) free(body);
+    LOG_WARN(LOG_CAT_NET, "⚠️ Tenant list body invalid (%d bytes)", len);
+    return false;
+  }
+  if (!publishTenantList(next)) {
+    LOG_WARN(LOG_CAT_NET, "⚠️ Tenant list of %u not indexed (out of memory)", (unsigned)next.size());
+    return false;
+  }
+  snprintf(tenantsEtag, sizeof(tenantsEtag), "%s", etag);
+  bool saved = next.save(TENANTS_FILE, tenantsEtag);
+  LOG_INFO(LOG_CAT_NET, "🏢 Tenants %s: %u UUIDs%s", tenantsEtag, (unsigned)next.size(), saved ? "" : " (not saved)");
+  return true;
+}
 
-        // --- Service UUID ---
-        if (advertisedDevice.haveServiceUUID()) {
-          Serial.printf("  Service UUID: %s\n", advertisedDevice.getServiceUUID().toString().c_str());
-        }
+// Conditional GET of the break thresholds (Sessions.h). They are small and the defaults
+// are usable, so they are not kept on flash. Returns false if the Worker could not be asked
+// (or sent something unusable).
+static bool syncSessionConfig() {
+  static const char* headers[] = {"ETag"};
+  uint8_t body[SESSION_CONFIG_LEN];
+  int len = -1;
+  char etag[SESSION_CONFIG_ETAG_MAX];
+  {
+    std::lock_guard<std::mutex> lock(server.mutex());
+    HTTPClient &http = server.http();
+    http.collectHeaders(headers, 1);
+    int code = server.send("GET", sessionConfigEndpoint, nullptr, nullptr, 0,
+                           sessionConfigEtag[0] ? "If-None-Match" : nullptr, sessionConfigEtag);
+    if (code == 200) {
+      if (http.getSize() == (int)sizeof(body)) len = server.readBody(body, sizeof(body));
+      snprintf(etag, sizeof(etag), "%s", http.header("ETag").c_str());
+    }
+    server.finish();
+    if (code == 304) return true;
+    // Older Worker without the endpoint: keep the defaults
+    if (code == 404) {
+      LOG_DEBUG(LOG_CAT_NET, "Session config not published by the Worker");
+      return true;
+    }
+    if (code != 200) {
+      LOG_WARN(LOG_CAT_NET, "⚠️ Session config fetch failed code=%d", code);
+      return false;
+    }
+  }
 
-        // --- Manufacturer Data ---
-        if (advertisedDevice.haveManufacturerData()) {
-          std::string mData = advertisedDevice.getManufacturerData();
-          Serial.printf("  Manufacturer Data (HEX): %s\n", toHexString(mData).c_str());
-        }
+  SessionThresholds next;
+  if (len < 0 || !parseSessionConfig(body, (size_t)len, next)) {
+    LOG_WARN(LOG_CAT_NET, "⚠️ Session config body invalid (%d bytes)", len);
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(presenceMutex);
+    sessionThresholds = next;
+  }
+  snprintf(sessionConfigEtag, sizeof(sessionConfigEtag), "%s", etag);
+  LOG_INFO(LOG_CAT_NET, "☕ Session config %s: short break up to %us, lunch up to %us", sessionConfigEtag,
+           (unsigned)next.shortBreakMaxSec, (unsigned)next.lunchBreakMaxSec);
+  return true;
+}
+
+// Reserve the next block of event numbers once half of the current one is used. Runs in
+// setup() and on the network task, keeping NVS writes off the scan path.
+static void reserveEventSeqs() {
+  uint32_t limit;
+  {
+    std::lock_guard<std::mutex> lock(presenceMutex);
+    if ((int32_t)(eventSeqLimit - nextEventSeq) > (int32_t)(EVENT_SEQ_BLOCK / 2)) return;
+    limit = nextEventSeq + EVENT_SEQ_BLOCK;
+  }
+  Preferences prefs;
+  prefs.begin(EVENT_SEQ_NVS_NAMESPACE, false);
+  bool stored = prefs.putUInt("next", limit) == sizeof(uint32_t);
+  prefs.end();
+  if (!stored) {
+    LOG_WARN(LOG_CAT_EVENTS, "⚠️ Could not reserve event numbers up to %u", (unsigned)limit);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(presenceMutex);
+  eventSeqLimit = limit;
+}
+
+// Events queued before the first SNTP sync get their wall-clock time once it is known; they
+// are from this boot, so seenAtMs still means something
+static void stampEventTime(DetectionEvent &ev) {
+  if (ev.observedMs == 0) ev.observedMs = deviceClock.epochMsAt(ev.seenAtMs);
+}
+
+// SNTP client callback (lwIP task): anchor the event clock
+static void onSntpSync(struct timeval* tv) {
+  uint32_t nowMs = millis();
+  deviceClock.sync((uint64_t)tv->tv_sec * 1000 + (uint64_t)tv->tv_usec / 1000, nowMs);
+  LOG_INFO(LOG_CAT_NET, "🕒 SNTP sync %u: drift %d ppm, clock was off by %d ms", (unsigned)deviceClock.syncs(),
+           (int)deviceClock.driftPpm(), (int)deviceClock.lastErrorMs());
+}
+
+// Drain the event queue forever; body of the network task (or host thread)
+static void networkTaskLoop() {
+  static DetectionEvent batch[DETECT_BATCH_MAX];
+  PostResult results[DETECT_BATCH_MAX];
+  uint32_t nextReplayAttempt = 0;
+  uint32_t nextHeartbeatSec = 0;  // first one as soon as we are online
+  uint32_t nextAllowlistSec = 0;
+  uint32_t nextTenantsSec = 0;
+  uint32_t nextSessionConfigSec = 0;
+  for (;;) {
+    bool online = WiFi.status() == WL_CONNECTED;
+    reserveEventSeqs();
+
+    uint32_t nowSec = uptimeSeconds();
+    if (online && nowSec >= nextHeartbeatSec) {
+      nextHeartbeatSec = nowSec + (sendHeartbeat() ? HEARTBEAT_INTERVAL_SECONDS : HEARTBEAT_RETRY_SECONDS);
+    }
+    if (online && nowSec >= nextAllowlistSec) {
+      nextAllowlistSec = nowSec + (syncAllowlist() ? ALLOWLIST_REFRESH_SECONDS : ALLOWLIST_RETRY_SECONDS);
+    }
+    if (online && nowSec >= nextTenantsSec) {
+      nextTenantsSec = nowSec + (syncTenants() ? TENANTS_REFRESH_SECONDS : TENANTS_RETRY_SECONDS);
+    }
+    if (SCANNER_EDGE_SESSIONS && online && nowSec >= nextSessionConfigSec) {
+      nextSessionConfigSec =
+          nowSec + (syncSessionConfig() ? SESSION_CONFIG_REFRESH_SECONDS : SESSION_CONFIG_RETRY_SECONDS);
+    }
+
+    // Journaled events go out first so the server sees everything in order
+    bool backlog = journal.isOpen() && journal.pending() > 0;
+    if (backlog && online && (int32_t)(millis() - nextReplayAttempt) >= 0) {
+      if (!drainJournal()) nextReplayAttempt = millis() + JOURNAL_REPLAY_BACKOFF_MS;
+      backlog = journal.pending() > 0;
+    }
+
+    if (!eventQueue.pop(batch[0])) {
+      delay(NETWORK_IDLE_POLL_MS);
+      continue;
+    }
 
-    // --- Service Data (simplified and safer) ---
-    if (advertisedDevice.haveServiceData()) {
-      try {
-        std::string sData = advertisedDevice.getServiceData(); // get service data blob
-        if (!sData.empty()) {
-          // Print hex and ASCII versions
-          std::string hexS = toHexString(sData);
-          Serial.printf("  Service Data (HEX): %s\n", hexS.c_str());
-          std::string ascii;
-          for (char c : sData) if (isprint((unsigned char)c)) ascii += c;
-          if (!ascii.empty()) Serial.printf("  Service Data (ASCII): %s\n", ascii.c_str());
-
-          // If ASCII part itself looks like a hex string (even length, hex chars), treat it as payload
-                    if (isAsciiHexString(ascii)) {
-            Serial.printf("  -> Detected ASCII-HEX payload in Service Data: %s\n", ascii.c_str());
-            // handle detection (presence logic)
-            std::string h = ascii;
-            lastSeenAt[h] = millis() / 1000;
-            if (presentDevices.find(h) == presentDevices.end()) {
-              // Not present yet -> mark present and send enter
-              presentDevices.insert(h);
-              sendHexToServer(h);
-            }
-          } else {
-            // Otherwise, if binary data exists, send its HEX form
-            if (!hexS.empty()) {
-              // Some advertisers may send the hex payload as raw bytes; send hexS
-              std::string h = hexS;
-              lastSeenAt[h] = millis() / 1000;
-              if (presentDevices.find(h) == presentDevices.end()) {
-                presentDevices.insert(h);
-                sendHexToServer(h);
-              }
-            }
-          }
+    // Coalesce the rest of this scan cycle's events into the same request
+    size_t count = 1;
+    if (USE_BATCH_UPLOAD) {
+      uint32_t lingerStart = millis();
+      while (count < DETECT_BATCH_MAX) {
+        if (eventQueue.pop(batch[count])) {
+          count++;
+          continue;
         }
-      } catch (...) {
-        // ignore service data parsing errors
+        if (millis() - lingerStart >= DETECT_BATCH_LINGER_MS) break;
+        delay(NETWORK_IDLE_POLL_MS);
       }
     }
+    for (size_t i = 0; i < count; i++) stampEventTime(batch[i]);
 
-        // --- Raw advertisement payload with parsing ---
-        uint8_t* payload = advertisedDevice.getPayload();
-        int payloadLength = advertisedDevice.getPayloadLength();
-        std::string hexData = toHexString(payload, payloadLength);
-        
-  // Raw adv data length and full hex are intentionally omitted per user request
-
-        // --- Parse AD structures to find Local Name (kCBAdvDataLocalName) ---
-        // Advertisement data is a sequence of [len][type][data...] TLV entries
-        if (payloadLength > 0) {
-          int idx = 0;
-          bool foundLocalName = false;
-          while (idx < payloadLength) {
-            uint8_t len = payload[idx];
-            if (len == 0) break; // no more AD structures
-            if (idx + len >= payloadLength) break; // malformed/truncated
-
-            uint8_t type = payload[idx + 1];
-            // 0x08 = Shortened Local Name, 0x09 = Complete Local Name
-                if (type == 0x08 || type == 0x09) {
-              int nameLen = len - 1; // excluding type byte
-              if (nameLen > 0) {
-                std::string name;
-                name.reserve(nameLen);
-                for (int j = 0; j < nameLen; ++j) {
-                  name += (char)payload[idx + 2 + j];
-                }
-                Serial.printf("  Local Name (ASCII): %s\n", name.c_str());
-                std::string nameHex = toHexString((const uint8_t*)name.data(), name.size());
-                Serial.printf("  Local Name (HEX): %s\n", nameHex.c_str());
-                // If the local name itself is an ASCII hex string, handle detection (presence)
-                if (isAsciiHexString(name)) {
-                    Serial.printf("  -> Detected Local Name ASCII-HEX payload: %s\n", name.c_str());
-                    std::string h = name;
-                    lastSeenAt[h] = millis() / 1000;
-                    if (presentDevices.find(h) == presentDevices.end()) {
-                      presentDevices.insert(h);
-                      sendHexToServer(h);
-                    }
-                }
-                foundLocalName = true;
-                // keep searching in case other entries exist
-              }
-            }
-
-            idx += (1 + len); // length byte + len bytes
-          }
-
-          if (!foundLocalName) {
-            Serial.println("  Local Name: <not present>");
-          }
-        }
-        
-        // Known parts of the advertisement:
-        // 02011A020A0B1107FB349B5F8000008000100000F4A3E1D7 (24 bytes: BLE header + UUID)
-        // Following that should be the encrypted email data
-        
-        const int MINIMUM_HEADER_SIZE = 24; // Size of BLE header + UUID
-        if (payloadLength > MINIMUM_HEADER_SIZE) {
-            // Extract just the payload part after the header
-            std::string payloadData = hexData.substr(MINIMUM_HEADER_SIZE * 2); // *2 because hex string
-            Serial.printf("  Payload Data (HEX): %s\n", payloadData.c_str());
-            Serial.printf("  Payload Length: %d bytes\n", (payloadLength - MINIMUM_HEADER_SIZE));
-            
-            // Try to decode as ASCII (might help identify the email portion)
-            std::string ascii;
-            for (int i = MINIMUM_HEADER_SIZE; i < payloadLength; i++) {
-                char c = payload[i];
-                if (isprint(c)) ascii += c;
-            }
-            if (!ascii.empty()) {
-                Serial.printf("  Payload (ASCII): %s\n", ascii.c_str());
-            }
-        } else {
-            Serial.println("  ⚠️ Basic advertisement only (no payload data)");
-        }
+    // Offline, or older events still waiting: append behind them without blocking on HTTP
+    if (journal.isOpen() && (!online || backlog)) {
+      for (size_t i = 0; i < count; i++) finishDetection(batch[i], POST_FAILED);
+      continue;
+    }
+
+    postDetections(batch, count, results, currentMaxAttempts());
+    for (size_t i = 0; i < count; i++) finishDetection(batch[i], results[i]);
+  }
+}
+
+#if defined(ESP_PLATFORM)
+static void networkTask(void*) {
+  networkTaskLoop();
+}
+#endif
+
+static void startNetworkTask() {
+#if defined(ESP_PLATFORM)
+  xTaskCreatePinnedToCore(networkTask, "net", NETWORK_TASK_STACK, nullptr, 1, nullptr, NETWORK_TASK_CORE);
+#else
+  // Host build: same pipeline on a std::thread
+  std::thread(networkTaskLoop).detach();
+#endif
+}
+
+static void logTaskLoop() {
+  for (;;) {
+    scannerLog.drain(Serial);
+    delay(LOG_DRAIN_INTERVAL_MS);
+  }
+}
+
+#if defined(ESP_PLATFORM)
+static void logTask(void*) {
+  logTaskLoop();
+}
+#endif
+
+static void startLogTask() {
+#if defined(ESP_PLATFORM)
+  xTaskCreatePinnedToCore(logTask, "log", LOG_TASK_STACK, nullptr, tskIDLE_PRIORITY, nullptr, LOG_TASK_CORE);
+#else
+  std::thread(logTaskLoop).detach();
+#endif
+}
+
+// Send service data (ASCII) to AutoAttend as {"hex_value":"..."}
+// Note: if serviceAscii is already ASCII hex, we use it as-is; otherwise we send its HEX.
+void sendServiceDataToServer(const std::string &serviceAscii) {
+  uint32_t nowSec = uptimeSeconds();
+  {
+    std::lock_guard<std::mutex> lock(presenceMutex);
+    PresenceEntry* entry = presence.upsert(serviceAscii.data(), serviceAscii.size(), nowSec);
+    if (entry && entry->sent && (nowSec - entry->lastSent) < SEEN_TTL_SECONDS) {
+      LOG_DEBUG(LOG_CAT_NET, "Ignoring duplicate service data (recent): %s", serviceAscii.c_str());
+      return;
+    }
+    if (entry) {
+      entry->lastSent = nowSec;
+      entry->sent = true;
+    }
+  }
+
+  if (WiFi.status() != WL_CONNECTED) {
+    LOG_INFO(LOG_CAT_NET, "WiFi not connected; cannot POST service data");
+    return;
+  }
+
+  // Determine hex to send
+  std::string payload = "{\"hex_value\":\"";
+  payload += isAsciiHexString(serviceAscii) ? serviceAscii : toHexString(serviceAscii);
+  payload += "\"}";
+  LOG_INFO(LOG_CAT_NET, "POSTing service data to AutoAttend: %s", payload.c_str());
+  std::lock_guard<std::mutex> lock(server.mutex());
+  int code = server.send("POST", detectEndpoint, "application/json", (const uint8_t*)payload.data(), payload.size());
+  String resp = code > 0 ? server.http().getString() : String();
+  server.finish();
+  LOG_INFO(LOG_CAT_NET, "AutoAttend service POST code=%d", code);
+  LOG_DEBUG(LOG_CAT_NET, "AutoAttend response: %s", resp.c_str());
+}
+
+// Record a sighting of an ASCII-hex payload and queue "enter" the first time
+static void notePresence(const char* hex, size_t len, int rssi, uint16_t tenant) {
+  std::lock_guard<std::mutex> lock(presenceMutex);
+  if (!allowlist.admits(hex, len)) {
+    unknownSightings++;
+    return;
+  }
+  uint32_t nowSec = uptimeSeconds();
+  PresenceEntry* entry = presence.upsert(hex, len, nowSec);
+  if (!entry) {
+    LOG_WARN(LOG_CAT_EVENTS, "⚠️ Payload too long to track (%d chars)", (int)len);
+    return;
+  }
+  // A sighting after a long gap starts a fresh average
+  if ((nowSec - entry->lastSeen) > PRESENCE_TIMEOUT_SECONDS) entry->rssi = 0;
+  entry->rssi = SCANNER_RSSI_SMOOTHING ? smoothRssi(entry->rssi, rssi) : (int16_t)(rssi * RSSI_SCALE);
+  entry->lastSeen = nowSec;
+  entry->tenant = tenant;
+  int smoothed = entry->rssi / RSSI_SCALE;
 
-        Serial.println("  ✅ Target UUID MATCH FOUND");
-        Serial.println("==================================");
+  if (!entry->present) {
+    if (smoothed < RSSI_ENTER_DBM) {
+      entry->crossing = false;
+      weakSightings++;
+    } else {
+      if (!entry->crossing) {
+        entry->crossing = true;
+        entry->crossingSince = nowSec;
+      }
+      // Strong for long enough -> queue enter; only mark present once the event is accepted
+      if ((nowSec - entry->crossingSince) < RSSI_ENTER_DWELL_SECONDS) {
+        weakSightings++;
+      } else if (entry->away ? queueReturnLocked(*entry) : queueDetectionLocked(*entry, EVENT_CHECKIN)) {
+        presence.setPresent(entry, true);
+        entry->crossing = false;
       }
     }
+  } else if (smoothed >= RSSI_EXIT_DBM) {
+    entry->crossing = false;
+  } else if (!entry->crossing) {
+    // Present but fading: start the exit dwell
+    entry->crossing = true;
+    entry->crossingSince = nowSec;
+  }
+  armPresenceTimerLocked(*entry, nowSec);
+}
+
+// "aa:bb:cc:dd:ee:ff", as BLEAddress::toString() prints it
+static void formatAddress(const uint8_t addr[6], char out[18]) {
+  snprintf(out, 18, "%02x:%02x:%02x:%02x:%02x:%02x", addr[0], addr[1], addr[2], addr[3], addr[4], addr[5]);
+}
+
+// Returns true the first time an address matches during this scan period (or when the list is full).
+// Compares raw addresses, so a repeat costs no formatting or allocation.
+static bool rememberMatch(const uint8_t addr[6]) {
+  for (size_t i = 0; i < matchedThisScanCount; i++) {
+    if (memcmp(matchedThisScan[i], addr, 6) == 0) return false;
+  }
+  if (matchedThisScanCount < MAX_MATCHED_PER_SCAN) {
+    memcpy(matchedThisScan[matchedThisScanCount++], addr, 6);
+  }
+  firstSightingHist.record(millis() - scanPeriodStartMs);
+  return true;
+}
+
+static bool isAsciiHexView(const ByteView &v) {
+  if (v.empty() || (v.len % 2) != 0) return false;
+  for (size_t i = 0; i < v.len; i++) {
+    if (!isxdigit(v.data[i])) return false;
+  }
+  return true;
+}
+
+// Per-device dump, once per scan period. Compiled out unless SCAN debug logging is on;
+// byte fields are queued raw and rendered as hex/ASCII by the log task.
+static void logMatchedDevice(const uint8_t* address, int rssi, const AdvMatch &match, const uint8_t* payload,
+                             int payloadLength) {
+  if (!LOG_ENABLED(LOG_LEVEL_DEBUG, LOG_CAT_SCAN)) return;
+  char addr[18];
+  formatAddress(address, addr);
+  LOG_DEBUG(LOG_CAT_SCAN, "📡 Device %s matched tenant %u, RSSI %d dBm", addr, (unsigned)match.tenant, rssi);
+  // First complete or incomplete list of 128-bit service UUIDs, as sent (little-endian)
+  for (int i = 0; i + 1 < payloadLength && payload[i] != 0; i += 1 + payload[i]) {
+    if ((payload[i + 1] == 0x06 || payload[i + 1] == 0x07) && payload[i] >= 17 && i + 18 <= payloadLength) {
+      LOG_BYTES(LOG_LEVEL_DEBUG, LOG_CAT_SCAN, "  Service UUID", payload + i + 2, 16);
+      break;
+    }
+  }
+  // Results from the advert cache carry no manufacturer data view; walk the payload again
+  AdvMatch full;
+  tenantMatchersBusy++;
+  matchAdvert(payload, payloadLength, *tenantMatcher.load(), full);
+  tenantMatchersBusy--;
+  if (!full.manufacturerData.empty()) {
+    LOG_BYTES(LOG_LEVEL_DEBUG, LOG_CAT_SCAN, "  Manufacturer Data", full.manufacturerData.data,
+              full.manufacturerData.len);
+  }
+  if (!match.serviceData.empty()) {
+    LOG_BYTES(LOG_LEVEL_DEBUG, LOG_CAT_SCAN, "  Service Data", match.serviceData.data, match.serviceData.len);
+  }
+  if (!match.localName.empty()) {
+    LOG_BYTES(LOG_LEVEL_DEBUG, LOG_CAT_SCAN, "  Local Name", match.localName.data, match.localName.len);
+  } else {
+    LOG_DEBUG(LOG_CAT_SCAN, "  Local Name: <not present>");
+  }
+
+  // Known parts of the advertisement:
+  // 02011A020A0B1107FB349B5F8000008000100000F4A3E1D7 (24 bytes: BLE header + UUID)
+  // Following that should be the encrypted email data
+  const int MINIMUM_HEADER_SIZE = 24; // Size of BLE header + UUID
+  if (payloadLength > MINIMUM_HEADER_SIZE) {
+    LOG_BYTES(LOG_LEVEL_DEBUG, LOG_CAT_SCAN, "  Payload Data", payload + MINIMUM_HEADER_SIZE,
+              payloadLength - MINIMUM_HEADER_SIZE);
+  } else {
+    LOG_DEBUG(LOG_CAT_SCAN, "  ⚠️ Basic advertisement only (no payload data)");
+  }
+}
+
+// BLE Callback: every advert from the radio backend, on the stack's task
+static void onAdvert(const RadioAdvert &advert) {
+  periodAdverts++;
+  bool sampled = telemetry.sampleAdvert();
+  StageTimer scanTimer(sampled ? &telemetry.stage(STAGE_SCAN) : nullptr);
+  // Single pass over the raw AD structures, or the remembered result for a repeat of
+  // the same advert; non-matching adverts return here without touching the heap
+  const uint8_t* payload = advert.payload;
+  int payloadLength = (int)advert.len;
+  AdvMatch match;
+  {
+    StageTimer matchTimer(sampled ? &telemetry.stage(STAGE_MATCH) : nullptr);
+#if SCANNER_ADVERT_CACHE
+    // A hit never touches the tenant set, so it skips the busy count as well
+    uint32_t generation = tenantMatcher.load()->generation();
+    uint64_t key = advertCacheKey(advert.address, payload, payloadLength, generation);
+    if (!advertCache.lookup(key, payload, match)) {
+      tenantMatchersBusy++;
+      const UuidPatternSet &tenants = *tenantMatcher.load();
+      matchAdvert(payload, payloadLength, tenants, match);
+      // Only remembered under the generation it was actually matched against
+      if (tenants.generation() == generation) advertCache.store(key, payload, match);
+      tenantMatchersBusy--;
+    }
+#else
+    tenantMatchersBusy++;
+    matchAdvert(payload, payloadLength, *tenantMatcher.load(), match);
+    tenantMatchersBusy--;
+#endif
+  }
+  if (!match.matched) return;
+  periodMatches++;
+
+  // Duplicates are reported, so presence is refreshed on every advert; a device is
+  // only logged the first time it is heard in a scan period
+  const uint8_t* addr = advert.address;
+  bool firstThisPeriod = rememberMatch(addr);
+  int rssi = advert.rssi;
+  if (firstThisPeriod) logMatchedDevice(addr, rssi, match, payload, payloadLength);
+
+  // --- Service Data ---
+  // Already ASCII hex (the usual case): use it in place
+  if (isAsciiHexView(match.serviceData)) {
+    notePresence((const char*)match.serviceData.data, match.serviceData.len, rssi, match.tenant);
+  } else if (!match.serviceData.empty()) {
+    const ByteView &sData = match.serviceData;
+    std::string hexS = toHexString(sData.data, sData.len);
+    std::string ascii;
+    for (size_t i = 0; i < sData.len; i++) if (isprint(sData.data[i])) ascii += (char)sData.data[i];
+
+    // If ASCII part itself looks like a hex string (even length, hex chars), treat it as payload
+    if (isAsciiHexString(ascii)) {
+      notePresence(ascii.data(), ascii.size(), rssi, match.tenant);
+    } else {
+      // Some advertisers may send the hex payload as raw bytes; send hexS
+      notePresence(hexS.data(), hexS.size(), rssi, match.tenant);
+    }
+  }
+
+  // --- Local Name (kCBAdvDataLocalName) ---
+  // If the local name itself is an ASCII hex string, handle detection (presence)
+  if (isAsciiHexView(match.localName)) {
+    notePresence((const char*)match.localName.data, match.localName.len, rssi, match.tenant);
   }
-};
+}
 
 void setup() {
   Serial.begin(115200);
-  delay(1000);
-  Serial.println("Starting BLE Scanner (only scanning for D7E1A3F4)...");
-  // Connect to WiFi
-  WiFi.begin(WIFI_SSID, WIFI_PASS);
-  Serial.print("Connecting to WiFi");
-  uint32_t start = millis();
-  while (WiFi.status() != WL_CONNECTED) {
-    Serial.print('.');
-    delay(500);
-    if ((millis() - start) > 20000) break;
-  }
-  Serial.println();
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.println("WiFi connected: " + WiFi.localIP().toString());
+  startLogTask();
+  LOG_INFO(LOG_CAT_SYS, "Starting BLE Scanner...");
+  // WiFi comes up in the background (loop() drives it); scanning does not wait for it
+  WifiLink::Config wifiConfig = {WIFI_SSID, WIFI_PASS, WIFI_STATIC_IP, WIFI_GATEWAY, WIFI_SUBNET, WIFI_DNS};
+  wifiLink.begin(wifiConfig, esp_random(), millis());
+  snprintf(deviceId, sizeof(deviceId), "%s", WiFi.macAddress().c_str());
+  unsigned mac[WIRE_DEVICE_ID_LEN];
+  if (sscanf(deviceId, "%x:%x:%x:%x:%x:%x", &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5]) == 6) {
+    for (size_t i = 0; i < WIRE_DEVICE_ID_LEN; i++) deviceMac[i] = (uint8_t)mac[i];
+  }
+  LOG_INFO(LOG_CAT_SYS, "Connecting to WiFi %s...", WIFI_SSID);
+  // Wall-clock time: the SNTP client starts asking once the link is up
+  sntp_set_time_sync_notification_cb(onSntpSync);
+  sntp_set_sync_interval(SNTP_SYNC_INTERVAL_SECONDS * 1000);
+  configTime(0, 0, NTP_SERVER);
+
+  // Event numbers resume after the last block a previous boot reserved
+  {
+    Preferences prefs;
+    prefs.begin(EVENT_SEQ_NVS_NAMESPACE, true);
+    nextEventSeq = prefs.getUInt("next", 1);
+    prefs.end();
+  }
+  reserveEventSeqs();
+  presence.setEvictHandler(onPresenceEvictedLocked);
+
+  UuidPattern target;
+  if (!parseUuidPattern(TARGET_UUID, target) || !publishTenants(&target, 1)) {
+    LOG_ERROR(LOG_CAT_SYS, "❌ TARGET_UUID is not 4-16 bytes of hex; nothing will match");
+  }
+  if (server.configure(SERVER_HOST)) {
+    detectEndpoint = server.endpoint(SERVER_ENDPOINT);
+    detectBatchEndpoint = server.endpoint(SERVER_BATCH_ENDPOINT);
+    otaManifestEndpoint = server.endpoint(OTA_MANIFEST_PATH);
+    heartbeatEndpoint = server.endpoint(HEARTBEAT_ENDPOINT);
+    allowlistEndpoint = server.endpoint(ALLOWLIST_ENDPOINT);
+    tenantsEndpoint = server.endpoint(TENANTS_ENDPOINT);
+    sessionsEndpoint = server.endpoint(SESSIONS_ENDPOINT);
+    sessionConfigEndpoint = server.endpoint(SESSION_CONFIG_ENDPOINT);
+  }
+
+  // Offline journal (format the partition on first boot)
+#if defined(ESP_PLATFORM)
+  bool fsReady = LittleFS.begin(true);
+#else
+  bool fsReady = true;
+#endif
+  if (fsReady && journal.open(JOURNAL_DIR)) {
+    LOG_INFO(LOG_CAT_SYS, "📼 Journal ready, %u events pending replay", (unsigned)journal.pending());
   } else {
-    Serial.println("WiFi not connected; will still scan but cannot POST until connected");
+    LOG_WARN(LOG_CAT_SYS, "⚠️ Journal unavailable; undeliverable events will be dropped");
+  }
+  if (fsReady && allowlist.restore(ALLOWLIST_FILE, allowlistEtag)) {
+    LOG_INFO(LOG_CAT_SYS, "🗂️ Allowlist %s restored: %u keys", allowlistEtag, (unsigned)allowlist.size());
+  }
+  TenantList tenants;
+  if (fsReady && tenants.restore(TENANTS_FILE, tenantsEtag) && publishTenantList(tenants)) {
+    LOG_INFO(LOG_CAT_SYS, "🏢 Tenants %s restored: %u UUIDs", tenantsEtag, (unsigned)tenants.size());
   }
 
-  BLEDevice::init("ESP32_BLE_Scanner");
+  bleRadio.begin("ESP32_BLE_Scanner", onAdvert);
+  bleInitFreeHeap = ESP.getFreeHeap();
+  LOG_INFO(LOG_CAT_SYS, "📻 BLE up (%s): %u bytes free heap, matching %u tenant UUID(s)", Radio::backendName(),
+           (unsigned)bleInitFreeHeap, (unsigned)tenantMatcher.load()->size());
+  startNetworkTask();
 }
 
-void loop() {
-  devicesWithTarget.clear();
+static void onScanComplete() {
+  scanPeriodDone = true;
+}
 
-  static MyAdvertisedDeviceCallbacks myCallbacks;
-  BLEScan* pBLEScan = BLEDevice::getScan();
-  pBLEScan->setAdvertisedDeviceCallbacks(&myCallbacks, false);
-  pBLEScan->setActiveScan(true);
-  pBLEScan->setInterval(100);
-  pBLEScan->setWindow(99);
+// Report the period that just ended and let the scheduler pick the next duty cycle
+static void finishScanPeriod() {
+  uint32_t elapsedMs = millis() - scanPeriodStartMs;
+  ScanPeriodStats stats;
+  stats.adverts = periodAdverts.exchange(0);
+  stats.matches = periodMatches.exchange(0);
+  stats.arrivals = periodArrivals.exchange(0);
+  stats.departures = periodDepartures.exchange(0);
+  telemetry.adverts += stats.adverts;
+  telemetry.matches += stats.matches;
+  telemetry.scanPeriods++;
+  {
+    std::lock_guard<std::mutex> lock(presenceMutex);
+    stats.present = (uint32_t)presence.presentCount();
+  }
 
-  int scanTime = 2;  // scan for 2 seconds (reduced from 3 to make total cycle closer to 5-6 seconds)
-  Serial.println("\n🔍 Scanning for BLE devices advertising D7E1A3F4...");
-  pBLEScan->start(scanTime, false);
-  pBLEScan->stop();
+  ScanScheduler::Mode mode = scanScheduler.mode();
+  // Effective duty cycle also counts the gap while the scan is restarted
+  uint32_t duty = elapsedMs ? ScanScheduler::dutyPercent(mode) * SCAN_PERIOD_SECONDS * 1000 / elapsedMs : 0;
+  if (duty > ScanScheduler::dutyPercent(mode)) duty = ScanScheduler::dutyPercent(mode);
+  LOG_INFO(LOG_CAT_SCAN, "✅ Scan period complete (%s, %u%% duty): %u adverts (%u/s), %u matched, %d device(s)",
+           ScanScheduler::profile(mode).name, (unsigned)duty, (unsigned)stats.adverts,
+           (unsigned)(elapsedMs ? stats.adverts * 1000ULL / elapsedMs : 0), (unsigned)stats.matches,
+           (int)matchedThisScanCount);
+  for (size_t i = 0; i < matchedThisScanCount; i++) {
+    char addr[18];
+    formatAddress(matchedThisScan[i], addr);
+    LOG_INFO(LOG_CAT_SCAN, "   - %s", addr);
+  }
+  char line[160];
+  firstSightingHist.format(line, sizeof(line), "⏱️ First sighting");
+  LOG_INFO(LOG_CAT_SCAN, "%s", line);
+  LOG_INFO(LOG_CAT_SCAN, "📬 Events: queued=%u (breaks=%u) dropped=%u posted=%u failed=%u depth=%u scan->POST last=%ums "
+           "max=%ums",
+           (unsigned)eventsQueued, (unsigned)sessionBreaks, (unsigned)eventsDropped, (unsigned)eventsPosted,
+           (unsigned)eventsFailed, (unsigned)eventQueue.size(), (unsigned)lastScanToPostMs, (unsigned)maxScanToPostMs);
+  LOG_INFO(LOG_CAT_SCAN, "📼 Journal: journaled=%u replayed=%u pending=%u overwritten=%u corrupt=%u",
+           (unsigned)eventsJournaled, (unsigned)eventsReplayed, (unsigned)journal.pending(),
+           (unsigned)journal.overwritten(), (unsigned)journal.corrupt());
+  server.printStats();
+  LOG_INFO(LOG_CAT_SCAN, "👥 Presence table: %d/%d tracked, %u present, %u evicted (%u held, %u checkouts dropped), "
+           "weak sightings=%u departures=%u dropouts=%u unknown=%u",
+           (int)presence.size(), (int)presence.capacity(), (unsigned)stats.present,
+           (unsigned)presence.evictions(), (unsigned)presence.heldEvictions(), (unsigned)checkoutsDropped,
+           (unsigned)weakSightings, (unsigned)weakDepartures, (unsigned)signalDropouts,
+           (unsigned)unknownSightings);
+  LOG_INFO(LOG_CAT_SCAN, "🧠 Advert cache: %u hits, %u misses, %u/%u used, %u not stored (set full)",
+           (unsigned)advertCache.hits(), (unsigned)advertCache.misses(), (unsigned)advertCache.used(),
+           (unsigned)advertCache.capacity(), (unsigned)advertCache.full());
 
-  Serial.printf("\n✅ Scan complete. Found %d matching device(s):\n", (int)devicesWithTarget.size());
-  for (auto &mac : devicesWithTarget) {
-    Serial.printf("   - %s\n", mac.c_str());
+  ScanScheduler::Mode next = scanScheduler.update(stats);
+  if (next != mode) {
+    LOG_INFO(LOG_CAT_SCAN, "📶 Scan mode %s -> %s (%u%% duty)", ScanScheduler::profile(mode).name,
+             ScanScheduler::profile(next).name, (unsigned)ScanScheduler::dutyPercent(next));
   }
-  // After scanning, check for devices that have timed out (left the office)
-  uint32_t nowSec = millis() / 1000;
-  std::vector<std::string> toRemove;
-  for (const auto &h : presentDevices) {
-    auto it = lastSeenAt.find(h);
-    if (it == lastSeenAt.end()) continue;
-    if ((nowSec - it->second) > PRESENCE_TIMEOUT_SECONDS) {
-      // Device considered departed: POST a checkout event
-      Serial.printf("Device %s timed out (no longer seen). Posting checkout...\n", h.c_str());
-      sendHexToServerWithAction(h, "checkout");
-      toRemove.push_back(h);
+}
+
+// Start the next scan period; results arrive through the callbacks while loop() keeps running
+static void startScanPeriod() {
+  const ScanProfile &profile = ScanScheduler::profile(scanScheduler.mode());
+  matchedThisScanCount = 0;
+
+  scanPeriodDone = false;
+  scanPeriodStartMs = millis();
+  if (!bleRadio.startScan(SCAN_PERIOD_SECONDS, profile.intervalMs, profile.windowMs, onScanComplete)) {
+    LOG_WARN(LOG_CAT_SCAN, "⚠️ BLE scan failed to start; retrying");
+    scanPeriodDone = true;
+    return;
+  }
+  if (!scanPeriodRan) firstScanMs = millis();
+  scanPeriodRan = true;
+}
+
+// Fire presence timers that are due: departures for present devices, held checkouts for
+// away ones, and forgetting entries that no longer suppress duplicate POSTs. Only due
+// entries are visited.
+static void expirePresence() {
+  uint32_t nowSec = uptimeSeconds();
+  std::lock_guard<std::mutex> lock(presenceMutex);
+  while (PresenceEntry* entry = presence.popExpired(nowSec)) {
+    if (entry->present) {
+      bool silent = (nowSec - entry->lastSeen) > PRESENCE_TIMEOUT_SECONDS;
+      bool weak = entry->crossing && (nowSec - entry->crossingSince) >= RSSI_EXIT_DWELL_SECONDS;
+      if (!silent && !weak) {
+        armPresenceTimerLocked(*entry, nowSec);
+        continue;
+      }
+      if (SCANNER_EDGE_SESSIONS) {
+        // Device out of range: hold the checkout back until we know whether this is a break
+        LOG_DEBUG(LOG_CAT_SCAN, "Device %s %s. Holding checkout...", entry->hex,
+                  silent ? "timed out (no longer seen)" : "signal stayed weak");
+        entry->away = true;
+        entry->awaySince = silent ? entry->lastSeen : entry->crossingSince;
+        periodDepartures++;
+      } else {
+        // Device considered departed: queue a checkout event
+        LOG_INFO(LOG_CAT_SCAN, "Device %s %s. Queueing checkout...", entry->hex,
+                 silent ? "timed out (no longer seen)" : "signal stayed weak");
+        if (!queueDetectionLocked(*entry, EVENT_CHECKOUT)) {
+          presence.scheduleExpiry(entry, nowSec + 1);  // queue full: retry next second
+          continue;
+        }
+      }
+      if (!silent) weakDepartures++;
+      presence.setPresent(entry, false);
+      entry->crossing = false;
+    } else if (entry->away && nowSec - entry->awaySince > sessionThresholds.lunchBreakMaxSec) {
+      // Not back within the longest break: it went home; the checkout is stamped when it left
+      LOG_INFO(LOG_CAT_SCAN, "Device %s away for %us. Queueing checkout...", entry->hex,
+               (unsigned)(nowSec - entry->awaySince));
+      if (!queueEventLocked(*entry, EVENT_CHECKOUT, entry->awaySince * 1000, 0)) {
+        presence.scheduleExpiry(entry, nowSec + 1);  // queue full: retry next second
+        continue;
+      }
+      entry->away = false;
     }
+    uint32_t deadline = presenceDeadlineLocked(*entry);
+    if (deadline != 0 && (int32_t)(deadline - nowSec) > 0) {
+      presence.scheduleExpiry(entry, deadline);
+    } else {
+      presence.erase(entry);
+    }
+  }
+}
+
+void loop() {
+  wifiLink.poll(millis());
+  if (!scanPeriodRan) {
+    LOG_INFO(LOG_CAT_SCAN, "🔍 Scanning continuously for BLE devices advertising %u tenant UUID(s)...",
+             (unsigned)tenantMatcher.load()->size());
   }
-  for (const auto &r : toRemove) {
-    presentDevices.erase(r);
-    lastSeenAt.erase(r);
+
+  if (scanPeriodDone) {
+    if (scanPeriodRan) finishScanPeriod();
+    startScanPeriod();
   }
 
-  Serial.println("⏳ Waiting 4 seconds before next scan...\n");
-  delay(4000);  // 4 second delay + 2 second scan = ~6 second total cycle
+  expirePresence();
+  advertCache.tick(uptimeSeconds());
+  telemetry.sampleHeap(ESP.getFreeHeap(), ESP.getMaxAllocHeap());
 
   // OTA periodic check
-  uint32_t nowSec = millis() / 1000;
+  uint32_t nowSec = uptimeSeconds();
   if (WiFi.status() == WL_CONNECTED && nowSec >= nextOtaCheck) {
     nextOtaCheck = nowSec + OTA_CHECK_INTERVAL_SECONDS;
+    StageTimer timer(telemetry.timed(STAGE_OTA));
+    telemetry.otaChecks++;
     checkForOtaUpdate();
   }
+
+  delay(LOOP_TICK_MS);
 }
 
 // ----------------------- OTA Support -----------------------
-void checkForOtaUpdate() {
-  Serial.println("\n🔄 Checking OTA manifest...");
-  String url = String(SERVER_HOST) + String(OTA_MANIFEST_PATH);
-  HTTPClient http;
-  http.begin(url);
-  int code = http.GET();
-  if (code != 200) {
-    Serial.printf("⚠️ OTA manifest fetch failed code=%d\n", code);
-    http.end();
-    return;
-  }
-  String json = http.getString();
-  http.end();
-  // Very minimal JSON parsing (avoid full parser): look for "version":"X"
-  int vIdx = json.indexOf("\"version\"");
-  if (vIdx < 0) { Serial.println("⚠️ Manifest missing version field"); return; }
-  int colon = json.indexOf(':', vIdx);
+// Very minimal JSON parsing (avoid full parser): value of a "name":"value" string field
+static String manifestField(const String &json, const char* name) {
+  String quoted = String("\"") + name + "\"";
+  int idx = json.indexOf(quoted.c_str());
+  if (idx < 0) return String();
+  int colon = json.indexOf(':', idx + quoted.length());
+  if (colon < 0) return String();
   int quoteStart = json.indexOf('"', colon + 1);
+  if (quoteStart < 0) return String();
   int quoteEnd = json.indexOf('"', quoteStart + 1);
-  if (quoteStart < 0 || quoteEnd < 0) { Serial.println("⚠️ Unable to parse version"); return; }
-  String remoteVersion = json.substring(quoteStart + 1, quoteEnd);
-  if (remoteVersion.length() == 0) { Serial.println("⚠️ Empty remote version"); return; }
-  Serial.printf("Manifest version=%s current=%s\n", remoteVersion.c_str(), CURRENT_FIRMWARE_VERSION);
+  if (quoteEnd < 0) return String();
+  return json.substring(quoteStart + 1, quoteEnd);
+}
+
+void checkForOtaUpdate() {
+  LOG_INFO(LOG_CAT_OTA, "🔄 Checking OTA manifest...");
+  String json;
+  {
+    std::lock_guard<std::mutex> lock(server.mutex());
+    int code = server.send("GET", otaManifestEndpoint);
+    if (code != 200) {
+      LOG_WARN(LOG_CAT_OTA, "⚠️ OTA manifest fetch failed code=%d", code);
+      server.finish();
+      return;
+    }
+    json = server.http().getString();
+    server.finish();
+  }
+  if (json.indexOf("\"version\"") < 0) { LOG_WARN(LOG_CAT_OTA, "⚠️ Manifest missing version field"); return; }
+  String remoteVersion = manifestField(json, "version");
+  if (remoteVersion.length() == 0) { LOG_WARN(LOG_CAT_OTA, "⚠️ Unable to parse version"); return; }
+  LOG_INFO(LOG_CAT_OTA, "Manifest version=%s current=%s", remoteVersion.c_str(), CURRENT_FIRMWARE_VERSION);
   if (remoteVersion == CURRENT_FIRMWARE_VERSION) {
-    Serial.println("✅ Firmware up to date");
+    LOG_INFO(LOG_CAT_OTA, "✅ Firmware up to date");
     return;
   }
-  Serial.println("⬆️ New firmware available, starting download...");
+  LOG_INFO(LOG_CAT_OTA, "⬆️ New firmware available, starting download...");
   // Parse key field for download path
-  int kIdx = json.indexOf("\"key\"");
-  String key;
-  if (kIdx >= 0) {
-    int kColon = json.indexOf(':', kIdx);
-    int kQuoteStart = json.indexOf('"', kColon + 1);
-    int kQuoteEnd = json.indexOf('"', kQuoteStart + 1);
-    if (kQuoteStart > 0 && kQuoteEnd > kQuoteStart) {
-      key = json.substring(kQuoteStart + 1, kQuoteEnd);
-    }
-  }
-  String downloadUrl;
+  String key = manifestField(json, "key");
+  String downloadPath;
   if (key.length() > 0) {
-    downloadUrl = String(SERVER_HOST) + String("/api/ota/download?key=") + key;
+    downloadPath = String("/api/ota/download?key=") + key;
   } else {
     // fallback to manifest-based download (no key param)
-    downloadUrl = String(SERVER_HOST) + String("/api/ota/download");
+    downloadPath = "/api/ota/download";
+  }
+  String expectedSha256 = manifestField(json, "sha256");
+  // A delta only applies on top of the exact image it was built from; anything else
+  // (other base version, patch failure) falls back to the full image
+  String deltaKey = manifestField(json, "delta_key");
+  if (deltaKey.length() > 0 && manifestField(json, "delta_base_version") == CURRENT_FIRMWARE_VERSION) {
+    String deltaPath = String("/api/ota/download?key=") + deltaKey;
+    if (applyDeltaFirmware(server.endpoint(deltaPath.c_str()), remoteVersion, expectedSha256)) return;
+    LOG_INFO(LOG_CAT_OTA, "↩️ Delta update not applied; downloading the full image");
   }
-  applyFirmware(downloadUrl, remoteVersion);
+  applyFirmware(server.endpoint(downloadPath.c_str()), remoteVersion, expectedSha256);
 }
 
-bool applyFirmware(const String &url, const String &newVersion) {
-  Serial.printf("📥 Downloading firmware from %s\n", url.c_str());
-  HTTPClient http;
-  http.begin(url);
-  int code = http.GET();
-  if (code != 200) {
-    Serial.printf("❌ Firmware download failed code=%d\n", code);
-    http.end();
-    return false;
+// Parse "bytes start-end/total" from a 206 response
+static bool parseContentRange(const String &value, size_t &start, size_t &total) {
+  unsigned long first = 0, last = 0, size = 0;
+  if (sscanf(value.c_str(), "bytes %lu-%lu/%lu", &first, &last, &size) != 3) return false;
+  start = first;
+  total = size;
+  return true;
+}
+
+// Read whatever the socket has (up to len), waiting up to OTA_READ_TIMEOUT_MS for data.
+// Returns 0 once the connection has closed or stalled.
+static size_t readFirmwareStream(WiFiClient* stream, uint8_t* buf, size_t len) {
+  uint32_t started = millis();
+  for (;;) {
+    int got = stream->read(buf, len);
+    if (got > 0) return (size_t)got;
+    if (!stream->connected() && !stream->available()) return 0;
+    if ((millis() - started) > OTA_READ_TIMEOUT_MS) return 0;
+    delay(1);  // socket drained: let the WiFi stack refill it
+  }
+}
+
+// Copy one response body into the update partition, hashing it on the way. skip bytes are
+// discarded first (a server that ignored our Range header resends from 0). Returns false
+// only on a flash write error; a dropped or stalled connection just ends the body early.
+static bool streamFirmwareBody(WiFiClient* stream, size_t skip, size_t total, size_t &written, Sha256 &sha) {
+  size_t fill = 0;
+  while (written + fill < total) {
+    size_t want = sizeof(otaChunk) - fill;
+    if (want > total - written - fill + skip) want = total - written - fill + skip;
+    size_t got = readFirmwareStream(stream, otaChunk + fill, want);
+    if (got == 0) break;
+    if (skip > 0) {
+      size_t dropped = got < skip ? got : skip;
+      memmove(otaChunk + fill, otaChunk + fill + dropped, got - dropped);
+      skip -= dropped;
+      got -= dropped;
+    }
+    fill += got;
+    // Write whole chunks; the final partial one goes out when the body is complete
+    if (fill == sizeof(otaChunk) || written + fill == total) {
+      if (Update.write(otaChunk, fill) != fill) return false;
+      sha.update(otaChunk, fill);
+      written += fill;
+      fill = 0;
+    }
+  }
+  if (fill > 0) {
+    // Keep what arrived before the drop so the resume starts right after it
+    if (Update.write(otaChunk, fill) != fill) return false;
+    sha.update(otaChunk, fill);
+    written += fill;
   }
-  int contentLength = http.getSize();
-  WiFiClient * stream = http.getStreamPtr();
-  if (contentLength <= 0) {
-    Serial.println("❌ Invalid content length for firmware");
-    http.end();
+  return true;
+}
+
+// Commit a fully written and verified image and reboot into it
+static bool installFirmware(const String &newVersion, const char* digestHex, const char* how, size_t downloaded,
+                            uint32_t downloadMs, uint32_t startedMs) {
+  if (!Update.end()) {
+    LOG_ERROR(LOG_CAT_OTA, "❌ Update.end failed error=%d", Update.getError());
     return false;
   }
-  Serial.printf("Firmware size: %d bytes\n", contentLength);
-  if (!Update.begin(contentLength)) { // allocate space
-    Serial.println("❌ Update.begin failed");
-    http.end();
+  if (!Update.isFinished()) {
+    LOG_ERROR(LOG_CAT_OTA, "❌ Update not finished");
     return false;
   }
+  LOG_INFO(LOG_CAT_OTA, "✅ Firmware %s verified (sha256 %s): %s, %u bytes in %ums (%u KB/s), time to flash %ums. Rebooting...",
+           newVersion.c_str(), digestHex, how, (unsigned)downloaded, (unsigned)downloadMs,
+           (unsigned)(downloadMs ? downloaded / downloadMs : 0), (unsigned)(millis() - startedMs));
+  delay(1000);
+  scannerLog.drain(Serial);  // anything the log task has not written yet
+  ESP.restart();
+  return true;
+}
+
+bool applyFirmware(const ServerConnection::Endpoint &download, const String &newVersion, const String &expectedSha256) {
+  LOG_INFO(LOG_CAT_OTA, "📥 Downloading firmware %s from %s", newVersion.c_str(), download.url.c_str());
+  if (expectedSha256.length() != Sha256::DIGEST_LEN * 2) {
+    LOG_WARN(LOG_CAT_OTA, "⚠️ Manifest has no sha256; the image will not be verified");
+  }
+  // Holds the shared connection for the whole download; detections queue up meanwhile
+  std::lock_guard<std::mutex> lock(server.mutex());
+  HTTPClient &http = server.http();
+  static const char* otaHeaders[] = {"Content-Range"};
+  http.collectHeaders(otaHeaders, 1);
+
+  uint32_t startedMs = millis();
+  Sha256 sha;
+  size_t total = 0;
   size_t written = 0;
-  uint8_t buff[1024];
-  while (http.connected() && (written < (size_t)contentLength)) {
-    size_t avail = stream->available();
-    if (avail) {
-      if (avail > sizeof(buff)) avail = sizeof(buff);
-      int readLen = stream->readBytes(buff, avail);
-      if (readLen > 0) {
-        if (Update.write(buff, readLen) != (size_t)readLen) {
-          Serial.println("❌ Update write failed");
-          Update.abort();
-          http.end();
+  int resumes = 0;
+  for (;;) {
+    char range[32];
+    bool resuming = written > 0;
+    snprintf(range, sizeof(range), "bytes=%u-", (unsigned)written);
+    int code = server.send("GET", download, nullptr, nullptr, 0, resuming ? "Range" : nullptr, resuming ? range : nullptr);
+
+    size_t skip = 0;
+    bool usable = false;
+    if (code == 200) {
+      int contentLength = http.getSize();
+      if (total == 0) {
+        if (contentLength <= 0) {
+          LOG_ERROR(LOG_CAT_OTA, "❌ Invalid content length for firmware");
+          server.finish();
+          return false;
+        }
+        total = (size_t)contentLength;
+        LOG_INFO(LOG_CAT_OTA, "Firmware size: %u bytes", (unsigned)total);
+        if (!Update.begin(total)) { // allocate space
+          LOG_ERROR(LOG_CAT_OTA, "❌ Update.begin failed");
+          server.finish();
           return false;
         }
-        written += readLen;
       }
+      skip = written;  // no Range support: skip what we already have
+      usable = (size_t)contentLength == total;
+    } else if (code == 206 && resuming) {
+      size_t start = 0, size = 0;
+      usable = parseContentRange(http.header("Content-Range"), start, size) && start == written && size == total;
+    }
+
+    bool flashOk = true;
+    if (usable) flashOk = streamFirmwareBody(http.getStreamPtr(), skip, total, written, sha);
+    server.finish();
+    if (!flashOk) {
+      LOG_ERROR(LOG_CAT_OTA, "❌ Update write failed");
+      Update.abort();
+      return false;
+    }
+    if (total > 0 && written == total) break;
+    if (total == 0) {
+      LOG_ERROR(LOG_CAT_OTA, "❌ Firmware download failed code=%d", code);
+      return false;
+    }
+    if (++resumes > OTA_MAX_RESUMES) {
+      LOG_ERROR(LOG_CAT_OTA, "❌ Firmware download stalled at %u/%u bytes (code=%d)", (unsigned)written, (unsigned)total, code);
+      Update.abort();
+      return false;
     }
-    delay(1);
+    LOG_WARN(LOG_CAT_OTA, "⚠️ Firmware download interrupted at %u/%u bytes (code=%d); resuming %d/%d",
+             (unsigned)written, (unsigned)total, code, resumes, OTA_MAX_RESUMES);
+    server.reset();
+    delay(OTA_RESUME_BACKOFF_MS);
   }
-  if (written != (size_t)contentLength) {
-    Serial.printf("❌ Written %d bytes but expected %d\n", (int)written, contentLength);
+
+  // Reject the image before it can become the boot partition
+  uint8_t digest[Sha256::DIGEST_LEN];
+  char digestHex[Sha256::DIGEST_LEN * 2 + 1];
+  sha.finish(digest);
+  Sha256::toHex(digest, digestHex);
+  if (expectedSha256.length() == Sha256::DIGEST_LEN * 2 && strcasecmp(digestHex, expectedSha256.c_str()) != 0) {
+    LOG_ERROR(LOG_CAT_OTA, "❌ Firmware sha256 mismatch: got %s expected %s", digestHex, expectedSha256.c_str());
     Update.abort();
-    http.end();
     return false;
   }
-  if (!Update.end()) {
-    Serial.printf("❌ Update.end failed error=%d\n", Update.getError());
-    http.end();
+  char how[32];
+  snprintf(how, sizeof(how), "full image, %d resume(s)", resumes);
+  return installFirmware(newVersion, digestHex, how, total, millis() - startedMs, startedMs);
+}
+
+// ----------------------- Delta OTA -----------------------
+// Patches from /api/ota/upload rebuild the new image from the running one (DeltaPatch.h)
+#if defined(ESP_PLATFORM)
+static bool readRunningImage(void*, uint32_t offset, uint8_t* out, size_t len) {
+  const esp_partition_t* running = esp_ota_get_running_partition();
+  return running && esp_partition_read(running, offset, out, len) == ESP_OK;
+}
+#else
+static bool readRunningImage(void*, uint32_t offset, uint8_t* out, size_t len) {
+  FILE* f = fopen(RUNNING_IMAGE_PATH, "rb");
+  if (!f) return false;
+  bool ok = fseek(f, (long)offset, SEEK_SET) == 0 && fread(out, 1, len, f) == len;
+  fclose(f);
+  return ok;
+}
+#endif
+
+// The first size bytes of the running partition must be exactly the delta's base image
+static bool runningImageMatches(uint32_t size, const uint8_t expected[Sha256::DIGEST_LEN]) {
+  Sha256 sha;
+  for (uint32_t offset = 0; offset < size;) {
+    size_t n = size - offset < sizeof(otaChunk) ? size - offset : sizeof(otaChunk);
+    if (!readRunningImage(nullptr, offset, otaChunk, n)) return false;
+    sha.update(otaChunk, n);
+    offset += (uint32_t)n;
+  }
+  uint8_t digest[Sha256::DIGEST_LEN];
+  sha.finish(digest);
+  return memcmp(digest, expected, sizeof(digest)) == 0;
+}
+
+static bool writeDeltaOutput(void* ctx, const uint8_t* data, size_t len) {
+  if (Update.write(const_cast<uint8_t*>(data), len) != len) return false;
+  static_cast<Sha256*>(ctx)->update(data, len);
+  return true;
+}
+
+// Returns false (aborting any partial update) when the patch does not fit this device or
+// cannot be applied, so the caller can fall back to the full image
+bool applyDeltaFirmware(const ServerConnection::Endpoint &download, const String &newVersion, const String &expectedSha256) {
+  LOG_INFO(LOG_CAT_OTA, "📥 Downloading delta for %s from %s", newVersion.c_str(), download.url.c_str());
+  std::lock_guard<std::mutex> lock(server.mutex());
+  uint32_t startedMs = millis();
+  int code = server.send("GET", download);
+  int patchLen = server.http().getSize();
+  if (code != 200 || patchLen <= (int)DELTA_HEADER_LEN) {
+    LOG_WARN(LOG_CAT_OTA, "⚠️ Delta download failed code=%d size=%d", code, patchLen);
+    server.finish();
     return false;
   }
-  if (!Update.isFinished()) {
-    Serial.println("❌ Update not finished");
-    http.end();
+  WiFiClient* stream = server.http().getStreamPtr();
+
+  // The header names the base and result images; check both before writing anything
+  size_t have = 0;
+  while (have < DELTA_HEADER_LEN) {
+    size_t n = readFirmwareStream(stream, otaChunk + have, DELTA_HEADER_LEN - have);
+    if (n == 0) break;
+    have += n;
+  }
+  DeltaHeader header;
+  if (!parseDeltaHeader(otaChunk, have, header)) {
+    LOG_WARN(LOG_CAT_OTA, "⚠️ Delta header invalid");
+    server.finish();
     return false;
   }
-  Serial.println("✅ Firmware updated successfully. Rebooting...");
-  http.end();
-  delay(1000);
-  ESP.restart();
-  return true;
-}
\ No newline at end of file
+  char digestHex[Sha256::DIGEST_LEN * 2 + 1];
+  Sha256::toHex(header.newSha256, digestHex);
+  if (expectedSha256.length() == Sha256::DIGEST_LEN * 2 && strcasecmp(digestHex, expectedSha256.c_str()) != 0) {
+    LOG_WARN(LOG_CAT_OTA, "⚠️ Delta builds a different image than the manifest");
+    server.finish();
+    return false;
+  }
+  if (!runningImageMatches(header.baseSize, header.baseSha256)) {
+    LOG_WARN(LOG_CAT_OTA, "⚠️ Running image is not the delta's base");
+    server.finish();
+    return false;
+  }
+  if (!Update.begin(header.newSize)) {
+    LOG_ERROR(LOG_CAT_OTA, "❌ Update.begin failed");
+    server.finish();
+    return false;
+  }
+
+  Sha256 sha;
+  DeltaApplier applier(header, readRunningImage, writeDeltaOutput, &sha);
+  size_t received = have;
+  while (received < (size_t)patchLen) {
+    size_t want = (size_t)patchLen - received < sizeof(otaChunk) ? (size_t)patchLen - received : sizeof(otaChunk);
+    size_t n = readFirmwareStream(stream, otaChunk, want);
+    if (n == 0 || !applier.feed(otaChunk, n)) break;
+    received += n;
+  }
+  server.finish();
+  if (!applier.done()) {
+    LOG_WARN(LOG_CAT_OTA, "⚠️ Delta not applied after %u/%d bytes: %s", (unsigned)received, patchLen,
+             applier.error() ? applier.error() : "download interrupted");
+    Update.abort();
+    return false;
+  }
+
+  uint8_t digest[Sha256::DIGEST_LEN];
+  sha.finish(digest);
+  if (memcmp(digest, header.newSha256, sizeof(digest)) != 0) {
+    LOG_ERROR(LOG_CAT_OTA, "❌ Delta output sha256 mismatch");
+    Update.abort();
+    return false;
+  }
+  char how[48];
+  snprintf(how, sizeof(how), "delta from %s, %u byte image", CURRENT_FIRMWARE_VERSION, (unsigned)header.newSize);
+  return installFirmware(newVersion, digestHex, how, received, millis() - startedMs, startedMs);
+}
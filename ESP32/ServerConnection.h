@@ -0,0 +1,157 @@
+// ServerConnection: one keep-alive HTTP connection to SERVER_HOST shared by every request
+// Detections, manifest checks, firmware downloads and retries all go through the same
+// socket instead of paying a TCP handshake per call. A socket that turns out to be stale
+// (server closed it, AP roamed) is dropped and the request is retried once on a fresh one.
+#pragma once
+#include <Arduino.h>
+#include <WiFi.h>
+#include <HTTPClient.h>
+#include <mutex>
+#include "Histogram.h"
+#include "Log.h"
+
+class ServerConnection {
+ public:
+  // A request target whose full URL is built once (at startup) and reused
+  struct Endpoint {
+    String url;
+  };
+
+  // baseUrl: "http://host[:port]" (no trailing slash)
+  bool configure(const char* baseUrl) {
+    base_ = baseUrl;
+    const char* p = baseUrl;
+    if (strncmp(p, "http://", 7) == 0) {
+      p += 7;
+      port_ = 80;
+    } else {
+      LOG_WARN(LOG_CAT_NET, "⚠️ ServerConnection only supports http:// hosts (got %s)", baseUrl);
+      return false;
+    }
+    const char* end = p;
+    while (*end && *end != ':' && *end != '/') end++;
+    size_t hostLen = (size_t)(end - p);
+    if (hostLen == 0 || hostLen >= sizeof(host_)) return false;
+    memcpy(host_, p, hostLen);
+    host_[hostLen] = '\0';
+    if (*end == ':') port_ = (uint16_t)atoi(end + 1);
+    http_.setReuse(true);
+    configured_ = true;
+    return true;
+  }
+
+  Endpoint endpoint(const char* path) const {
+    Endpoint e;
+    e.url = base_ + String(path);
+    return e;
+  }
+
+  // Requests from different tasks are serialized; hold this for a whole send()..finish()
+  std::mutex &mutex() { return mutex_; }
+
+  // Send a request and read the status line + headers. Returns the HTTP status code or a
+  // negative HTTPClient error. The caller reads the body through http() and must call finish().
+  int send(const char* method, const Endpoint &target, const char* contentType = nullptr,
+           const uint8_t* body = nullptr, size_t bodyLen = 0, const char* extraHeaderName = nullptr,
+           const char* extraHeaderValue = nullptr) {
+    if (!configured_) return HTTPC_ERROR_CONNECTION_REFUSED;
+    for (int attempt = 0; attempt < 2; attempt++) {
+      bool reused = false;
+      if (!ensureConnected(reused)) return HTTPC_ERROR_CONNECTION_REFUSED;
+
+      uint32_t started = millis();
+      http_.begin(client_, target.url);
+      if (contentType) http_.addHeader("Content-Type", contentType);
+      if (extraHeaderName) http_.addHeader(extraHeaderName, extraHeaderValue);
+      int code = http_.sendRequest(method, const_cast<uint8_t*>(body), bodyLen);
+      requestHist_.record(millis() - started);
+      requests_++;
+
+      // A reused socket that fails before we get a response was stale: reconnect once
+      if (code < 0 && reused && isTransportError(code)) {
+        staleReconnects_++;
+        http_.end();
+        client_.stop();
+        continue;
+      }
+      return code;
+    }
+    return HTTPC_ERROR_CONNECTION_LOST;
+  }
+
+  HTTPClient &http() { return http_; }
+
+  // Read a small response body (after send()) into out without building a String.
+  // Returns its length, or -1 if it is missing, chunked, larger than cap or cut short.
+  int readBody(uint8_t* out, size_t cap) {
+    int len = http_.getSize();
+    if (len < 0 || (size_t)len > cap) return -1;
+    WiFiClient* stream = http_.getStreamPtr();
+    size_t got = 0;
+    while (got < (size_t)len) {
+      size_t n = stream->readBytes(out + got, (size_t)len - got);
+      if (n == 0) return -1;
+      got += n;
+    }
+    return len;
+  }
+
+  // Done with the response; keeps the socket open when the server allows keep-alive
+  void finish() {
+    http_.end();
+  }
+
+  // Force the next request onto a new socket (e.g. after WiFi reconnects)
+  void reset() {
+    http_.end();
+    client_.stop();
+  }
+
+  const LatencyHistogram &connectHistogram() const { return connectHist_; }
+  const LatencyHistogram &requestHistogram() const { return requestHist_; }
+
+  void printStats() const {
+    char line[160];
+    LOG_INFO(LOG_CAT_NET, "🔌 Server connection: requests=%u connects=%u stale=%u", (unsigned)requests_,
+             (unsigned)connects_, (unsigned)staleReconnects_);
+    connectHist_.format(line, sizeof(line), "   connect");
+    LOG_INFO(LOG_CAT_NET, "%s", line);
+    requestHist_.format(line, sizeof(line), "   request");
+    LOG_INFO(LOG_CAT_NET, "%s", line);
+  }
+
+ private:
+  static bool isTransportError(int code) {
+    return code == HTTPC_ERROR_SEND_HEADER_FAILED || code == HTTPC_ERROR_SEND_PAYLOAD_FAILED ||
+           code == HTTPC_ERROR_NOT_CONNECTED || code == HTTPC_ERROR_CONNECTION_LOST ||
+           code == HTTPC_ERROR_NO_HTTP_SERVER || code == HTTPC_ERROR_READ_TIMEOUT;
+  }
+
+  bool ensureConnected(bool &reused) {
+    if (client_.connected()) {
+      reused = true;
+      return true;
+    }
+    reused = false;
+    uint32_t started = millis();
+    bool ok = client_.connect(host_, port_, CONNECT_TIMEOUT_MS);
+    connectHist_.record(millis() - started);
+    if (ok) connects_++;
+    return ok;
+  }
+
+  static const int32_t CONNECT_TIMEOUT_MS = 3000;
+
+  WiFiClient client_;
+  HTTPClient http_;
+  std::mutex mutex_;
+  String base_;
+  char host_[64] = {0};
+  uint16_t port_ = 80;
+  bool configured_ = false;
+  uint32_t requests_ = 0;
+  uint32_t connects_ = 0;
+  uint32_t staleReconnects_ = 0;
+  LatencyHistogram connectHist_;
+  LatencyHistogram requestHist_;
+};
@@ -0,0 +1,51 @@
+// Sessions: attendance sessions computed on the scanner (edge sessionization)
+// In raw mode every absence longer than PRESENCE_TIMEOUT_SECONDS costs a checkout and a
+// checkin, each its own request, its own lookups on the Worker and its own row. With
+// sessions on, a badge that times out is only marked away and its checkout is held back:
+//   - back within shortBreakMaxSec   -> one short_break segment
+//   - back within lunchBreakMaxSec   -> one lunch_break segment
+//   - not back by then               -> the held checkout, stamped when the badge left
+// A break segment starts when the badge left and carries its length as measured by the
+// scanner, so it lands as a single attendance_records row (status short_break/lunch_break,
+// break_duration_seconds). Segments are uploaded in bulk to /api/esp32/sessions.
+//
+// The thresholds come from GET /api/esp32/session-config (conditional on its ETag); until
+// the first fetch after boot the defaults below apply. Wire layout, little-endian:
+//   'S' 'C' | version=1 u8 | reserved u8 | shortBreakMaxSec u32 | lunchBreakMaxSec u32
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "EventQueue.h"
+
+#ifndef SCANNER_EDGE_SESSIONS
+#define SCANNER_EDGE_SESSIONS 1
+#endif
+
+static const uint8_t SESSION_CONFIG_VERSION = 1;
+static const size_t SESSION_CONFIG_LEN = 12;
+static const size_t SESSION_CONFIG_ETAG_MAX = 48;
+
+struct SessionThresholds {
+  uint32_t shortBreakMaxSec = 10 * 60;   // the Attendance page calls 10 min and up lunch
+  uint32_t lunchBreakMaxSec = 2 * 3600;  // away longer: the badge went home
+};
+
+// What an absence of awaySec seconds becomes: EVENT_SHORT_BREAK, EVENT_LUNCH_BREAK or
+// EVENT_CHECKOUT (a departure)
+static inline uint8_t classifyAbsence(uint32_t awaySec, const SessionThresholds &t) {
+  if (awaySec <= t.shortBreakMaxSec) return EVENT_SHORT_BREAK;
+  if (awaySec <= t.lunchBreakMaxSec) return EVENT_LUNCH_BREAK;
+  return EVENT_CHECKOUT;
+}
+
+// Parse a session-config body; false (out untouched) if it is malformed
+static inline bool parseSessionConfig(const uint8_t* body, size_t len, SessionThresholds &out) {
+  if (len != SESSION_CONFIG_LEN || body[0] != 'S' || body[1] != 'C' || body[2] != SESSION_CONFIG_VERSION) return false;
+  SessionThresholds t;
+  memcpy(&t.shortBreakMaxSec, body + 4, 4);
+  memcpy(&t.lunchBreakMaxSec, body + 8, 4);
+  if (t.shortBreakMaxSec == 0 || t.lunchBreakMaxSec < t.shortBreakMaxSec) return false;
+  out = t;
+  return true;
+}
@@ -0,0 +1,163 @@
+// Telemetry: always-on performance counters for the scanner, sent in the heartbeat
+// Stage latencies go into fixed power-of-two histograms of relaxed atomics, so any task can
+// record while the network task reads. Timing uses the CPU cycle counter, and on the
+// per-advert path only one advert in TELEMETRY_SAMPLE_EVERY is timed, which keeps the
+// instrumentation well under 1% of onResult (measure with ESP32/host/ScannerSim.cpp).
+// Build with -DSCANNER_TELEMETRY=0 to compile the timing out for comparison.
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <atomic>
+#if defined(ESP_PLATFORM)
+#include <Arduino.h>
+#else
+#include <chrono>
+#endif
+
+#ifndef SCANNER_TELEMETRY
+#define SCANNER_TELEMETRY 1
+#endif
+
+// Time one advert in this many on the scan path
+static const uint32_t TELEMETRY_SAMPLE_EVERY = 128;
+
+// Stage clock: CPU cycles on the ESP32, nanoseconds on the host (wraps; only differences matter)
+static inline uint32_t telemetryTicks() {
+#if defined(ESP_PLATFORM)
+  return ESP.getCycleCount();
+#else
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static inline uint32_t telemetryTicksPerUs() {
+#if defined(ESP_PLATFORM)
+  return ESP.getCpuFreqMHz();
+#else
+  return 1000;
+#endif
+}
+
+// Bucket 0 counts samples under 1 us, bucket i samples in [2^(i-1), 2^i) us; the last
+// bucket holds everything from ~4 s up
+class StageHistogram {
+ public:
+  static const size_t BUCKETS = 24;
+
+  void recordUs(uint32_t us) {
+    size_t i = us == 0 ? 0 : 32 - __builtin_clz(us);
+    if (i >= BUCKETS) i = BUCKETS - 1;
+    counts_[i].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void recordTicks(uint32_t ticks) { recordUs(ticks / telemetryTicksPerUs()); }
+
+  uint32_t count(size_t i) const { return counts_[i].load(std::memory_order_relaxed); }
+
+  // Counts as a JSON array with trailing empty buckets trimmed, e.g. [0,3,120,4]
+  int formatJson(char* out, size_t len) const {
+    size_t n = BUCKETS;
+    while (n > 0 && count(n - 1) == 0) n--;
+    int written = snprintf(out, len, "[");
+    for (size_t i = 0; i < n && written > 0 && (size_t)written < len; i++) {
+      written += snprintf(out + written, len - written, "%s%u", i ? "," : "", (unsigned)count(i));
+    }
+    if (written > 0 && (size_t)written < len) written += snprintf(out + written, len - written, "]");
+    return written;
+  }
+
+ private:
+  std::atomic<uint32_t> counts_[BUCKETS] = {};
+};
+
+enum TelemetryStage : uint8_t {
+  STAGE_SCAN,   // one onResult call (sampled)
+  STAGE_MATCH,  // matchAdvert within it (sampled)
+  STAGE_POST,   // one detection upload request
+  STAGE_OTA,    // one manifest check, including any download
+  STAGE_COUNT,
+};
+
+// Records the time from construction to destruction into h (nothing when h is null)
+class StageTimer {
+ public:
+  explicit StageTimer(StageHistogram* h) : hist_(h), started_(h ? telemetryTicks() : 0) {}
+  ~StageTimer() {
+    if (hist_) hist_->recordTicks(telemetryTicks() - started_);
+  }
+  StageTimer(const StageTimer &) = delete;
+  StageTimer &operator=(const StageTimer &) = delete;
+
+ private:
+  StageHistogram* hist_;
+  uint32_t started_;
+};
+
+class Telemetry {
+ public:
+  StageHistogram &stage(TelemetryStage s) { return stages_[s]; }
+  const StageHistogram &stage(TelemetryStage s) const { return stages_[s]; }
+
+  // Whether to time the current advert. Only called from the BLE callback, so the plain
+  // counter is safe.
+  bool sampleAdvert() {
+#if SCANNER_TELEMETRY
+    if (++advertTick_ < TELEMETRY_SAMPLE_EVERY) return false;
+    advertTick_ = 0;
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  // Always-timed stages (network task and loop(), rare compared to adverts)
+  StageHistogram* timed(TelemetryStage s) {
+#if SCANNER_TELEMETRY
+    return &stages_[s];
+#else
+    (void)s;
+    return nullptr;
+#endif
+  }
+
+  // Free heap and largest allocatable block, sampled from loop(); keeps low/high-water marks
+  void sampleHeap(uint32_t freeHeap, uint32_t largestBlock) {
+    lowerTo(freeMin_, freeHeap);
+    raiseTo(freeMax_, freeHeap);
+    lowerTo(blockMin_, largestBlock);
+    raiseTo(blockMax_, largestBlock);
+  }
+
+  uint32_t freeHeapMin() const { return freeMin_.load(std::memory_order_relaxed); }
+  uint32_t freeHeapMax() const { return freeMax_.load(std::memory_order_relaxed); }
+  uint32_t largestBlockMin() const { return blockMin_.load(std::memory_order_relaxed); }
+  uint32_t largestBlockMax() const { return blockMax_.load(std::memory_order_relaxed); }
+
+  // Cumulative since boot; adverts and matches are folded in once per scan period so the
+  // callback does not pay for a second counter
+  std::atomic<uint32_t> adverts{0};
+  std::atomic<uint32_t> matches{0};
+  std::atomic<uint32_t> scanPeriods{0};
+  std::atomic<uint32_t> postRequests{0};
+  std::atomic<uint32_t> postRetries{0};
+  std::atomic<uint32_t> otaChecks{0};
+  std::atomic<uint32_t> heartbeats{0};
+
+ private:
+  // Single writer (loop()), so a load/store pair is enough
+  static void lowerTo(std::atomic<uint32_t> &mark, uint32_t v) {
+    if (v < mark.load(std::memory_order_relaxed)) mark.store(v, std::memory_order_relaxed);
+  }
+  static void raiseTo(std::atomic<uint32_t> &mark, uint32_t v) {
+    if (v > mark.load(std::memory_order_relaxed)) mark.store(v, std::memory_order_relaxed);
+  }
+
+  StageHistogram stages_[STAGE_COUNT];
+  uint32_t advertTick_ = 0;
+  std::atomic<uint32_t> freeMin_{UINT32_MAX};
+  std::atomic<uint32_t> freeMax_{0};
+  std::atomic<uint32_t> blockMin_{UINT32_MAX};
+  std::atomic<uint32_t> blockMax_{0};
+};
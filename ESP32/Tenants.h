@@ -0,0 +1,123 @@
+// Tenants: the company UUIDs this scanner matches, synced from the Worker
+// GET /api/esp32/tenants lists every active tenant with a small id; the scanner indexes the
+// UUIDs into one UuidPatternSet (AdvMatcher.h) and tags each detection with the id of the
+// tenant it matched, so one scanner per floor can serve several companies. Until a list
+// has been loaded (first boot, Worker without the endpoint) only TARGET_UUID is matched.
+//
+// Wire/file layout, little-endian:
+//   'T' 'N' | version=1 u8 | reserved u8 | count u32 | entry * count
+//   entry   tenant u16 | len u8 | uuid[len]   (4-16 bytes; tenant 0 is reserved)
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "AdvMatcher.h"
+
+static const uint8_t TENANTS_VERSION = 1;
+static const size_t TENANTS_HEADER_LEN = 8;
+static const size_t TENANTS_MAX_BYTES = TENANTS_HEADER_LEN + ADV_MAX_PATTERNS * (3 + ADV_UUID_MAX_BYTES);
+static const size_t TENANTS_ETAG_MAX = 48;
+
+class TenantList {
+ public:
+  TenantList() {}
+  TenantList(const TenantList &) = delete;
+  TenantList &operator=(const TenantList &) = delete;
+  ~TenantList() { free(body_); }
+
+  // Take ownership of a malloc'd body in the layout above (freed here if it is malformed)
+  bool load(uint8_t* body, size_t len) {
+    uint32_t count = 0;
+    bool ok = len >= TENANTS_HEADER_LEN && len <= TENANTS_MAX_BYTES && body[0] == 'T' && body[1] == 'N' &&
+              body[2] == TENANTS_VERSION;
+    if (ok) memcpy(&count, body + 4, 4);
+    ok = ok && count <= ADV_MAX_PATTERNS;
+    size_t pos = TENANTS_HEADER_LEN;
+    for (uint32_t i = 0; ok && i < count; i++) {
+      ok = pos + 3 <= len;
+      uint8_t uuidLen = ok ? body[pos + 2] : 0;
+      ok = ok && (body[pos] | body[pos + 1]) != 0 && uuidLen >= ADV_UUID_MIN_BYTES && uuidLen <= ADV_UUID_MAX_BYTES;
+      pos += 3 + uuidLen;
+    }
+    if (!ok || pos != len) {
+      free(body);
+      return false;
+    }
+    free(body_);
+    body_ = body;
+    len_ = len;
+    count_ = count;
+    return true;
+  }
+
+  void swap(TenantList &other) {
+    uint8_t* body = body_;
+    size_t len = len_;
+    size_t count = count_;
+    body_ = other.body_;
+    len_ = other.len_;
+    count_ = other.count_;
+    other.body_ = body;
+    other.len_ = len;
+    other.count_ = count;
+  }
+
+  bool loaded() const { return body_ != nullptr; }
+  size_t size() const { return count_; }
+
+  // Fill out[0..size()) with the tenants' patterns
+  void patterns(UuidPattern* out) const {
+    size_t pos = TENANTS_HEADER_LEN;
+    for (size_t i = 0; i < count_; i++) {
+      UuidPattern &p = out[i];
+      p.tenant = (uint16_t)(body_[pos] | (body_[pos + 1] << 8));
+      p.len = body_[pos + 2];
+      memcpy(p.forward, body_ + pos + 3, p.len);
+      finishUuidPattern(p);
+      pos += 3 + p.len;
+    }
+  }
+
+  // Persist the current list with its ETag: etag length u8 | etag | body
+  bool save(const char* path, const char* etag) const {
+    if (!loaded()) return false;
+    FILE* f = fopen(path, "wb");
+    if (!f) return false;
+    uint8_t etagLen = (uint8_t)strnlen(etag, TENANTS_ETAG_MAX - 1);
+    bool ok = fwrite(&etagLen, 1, 1, f) == 1 && fwrite(etag, 1, etagLen, f) == etagLen &&
+              fwrite(body_, 1, len_, f) == len_;
+    return fclose(f) == 0 && ok;
+  }
+
+  // Load a list written by save(); etag (TENANTS_ETAG_MAX bytes) receives its ETag
+  bool restore(const char* path, char* etag) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    uint8_t etagLen = 0;
+    long size = 0;
+    bool ok = fread(&etagLen, 1, 1, f) == 1 && etagLen < TENANTS_ETAG_MAX && fread(etag, 1, etagLen, f) == etagLen &&
+              fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) > 0;
+    size_t bodyLen = ok ? (size_t)size - 1 - etagLen : 0;
+    uint8_t* body = ok && bodyLen <= TENANTS_MAX_BYTES ? (uint8_t*)malloc(bodyLen ? bodyLen : 1) : nullptr;
+    ok = body && fseek(f, 1 + etagLen, SEEK_SET) == 0 && fread(body, 1, bodyLen, f) == bodyLen;
+    fclose(f);
+    if (!ok) {
+      free(body);
+      etag[0] = '\0';
+      return false;
+    }
+    etag[etagLen] = '\0';
+    if (!load(body, bodyLen)) {
+      etag[0] = '\0';
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  uint8_t* body_ = nullptr;
+  size_t len_ = 0;
+  size_t count_ = 0;
+};
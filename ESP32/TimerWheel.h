@@ -0,0 +1,154 @@
+// TimerWheel: two-level hashed timing wheel with one-second ticks over a fixed set of slots
+// Each slot (e.g. a PresenceTable slot) has at most one timer. Scheduling, rescheduling
+// and cancelling are O(1) list operations, and expiring only looks at the bucket of the
+// current tick, so nothing ever walks every tracked device.
+// The inner level holds the current round of Buckets seconds; later deadlines wait on the
+// outer level (OuterBuckets rounds, 8192 s by default) and are relinked into the inner
+// level once, when their round starts. Only a deadline beyond the outer span is looked at
+// again, once per lap, so hour-long timers (lunch breaks) cost the same as 30 s ones.
+// Ticks are compared as (int32_t)(a - b), so the tick count may wrap; deadlines must stay
+// within 2^31 s of the clock. A clock that steps backwards rebases the wheel, keeping each
+// timer's remaining time.
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+template <size_t Slots, size_t Buckets = 64, size_t OuterBuckets = 128>
+class TimerWheel {
+  static_assert(Slots < 0xFFFF, "slot index must fit in 16 bits");
+  static_assert(Buckets + OuterBuckets <= 0xFF, "bucket index must fit in 8 bits");
+
+ public:
+  static const uint16_t NONE = 0xFFFF;
+
+  TimerWheel() {
+    for (size_t i = 0; i < Buckets + OuterBuckets; i++) heads_[i] = NONE;
+    for (size_t i = 0; i < Slots; i++) next_[i] = prev_[i] = NONE;
+  }
+
+  bool armed(size_t slot) const { return armed_[slot]; }
+  uint32_t deadline(size_t slot) const { return deadline_[slot]; }
+
+  // (Re)arm slot to fire once the clock reaches deadline (a past deadline fires on the next tick)
+  void schedule(size_t slot, uint32_t deadline) {
+    if (before(deadline, tick_)) deadline = tick_;
+    if (armed_[slot]) {
+      if (deadline_[slot] == deadline) return;  // repeat sighting within the same second
+      unlink(slot);
+    } else {
+      armed_[slot] = true;
+      armedCount_++;
+    }
+    deadline_[slot] = deadline;
+    place(slot);
+  }
+
+  void cancel(size_t slot) {
+    if (!armed_[slot]) return;
+    unlink(slot);
+    armed_[slot] = false;
+    armedCount_--;
+  }
+
+  // The owner moved slot from -> to (to must be unarmed); keeps the timer with it
+  void move(size_t from, size_t to) {
+    if (!armed_[from]) return;
+    next_[to] = next_[from];
+    prev_[to] = prev_[from];
+    deadline_[to] = deadline_[from];
+    bucket_[to] = bucket_[from];
+    armed_[to] = true;
+    if (prev_[to] != NONE) next_[prev_[to]] = (uint16_t)to;
+    else heads_[bucket_[to]] = (uint16_t)to;
+    if (next_[to] != NONE) prev_[next_[to]] = (uint16_t)to;
+    next_[from] = prev_[from] = NONE;
+    armed_[from] = false;
+  }
+
+  // Disarm and return one slot whose deadline is <= now, or NONE. Call repeatedly until
+  // NONE; the caller may schedule, cancel or move slots between calls.
+  uint16_t popExpired(uint32_t now) {
+    int32_t behind = (int32_t)(now - tick_);
+    if (behind < 0) rebase(now);  // the clock stepped back
+    else if ((uint32_t)behind > Buckets * OuterBuckets) rebuild(now);  // after a long stall: one pass, not one per tick
+    for (;;) {
+      // The inner bucket of the current tick only ever holds deadlines equal to it
+      uint16_t s = heads_[tick_ % Buckets];
+      if (s != NONE && !before(now, tick_)) {
+        cancel(s);
+        return s;
+      }
+      if (!before(tick_, now)) return NONE;
+      tick_++;
+      if (tick_ % Buckets == 0) cascade();
+    }
+  }
+
+  size_t armedCount() const { return armedCount_; }
+
+ private:
+  // a is earlier than b, across a wrap of the tick count
+  static bool before(uint32_t a, uint32_t b) { return (int32_t)(a - b) < 0; }
+
+  // Inner bucket if the deadline falls in the current round, else its round's outer bucket
+  void place(size_t slot) {
+    uint32_t round = deadline_[slot] / Buckets;
+    if (round == tick_ / Buckets) link(slot, deadline_[slot] % Buckets);
+    else link(slot, Buckets + round % OuterBuckets);
+  }
+
+  // A new round started: pull its deadlines down to the inner level
+  void cascade() {
+    size_t bucket = Buckets + (tick_ / Buckets) % OuterBuckets;
+    uint16_t s = heads_[bucket];
+    heads_[bucket] = NONE;
+    while (s != NONE) {
+      uint16_t next = next_[s];
+      place(s);  // a deadline a full lap or more away goes back where it was
+      s = next;
+    }
+  }
+
+  void rebuild(uint32_t now) {
+    tick_ = now;
+    for (size_t i = 0; i < Buckets + OuterBuckets; i++) heads_[i] = NONE;
+    for (size_t i = 0; i < Slots; i++) {
+      if (!armed_[i]) continue;
+      if (before(deadline_[i], tick_)) deadline_[i] = tick_;
+      place(i);
+    }
+  }
+
+  // Move every deadline back with the clock, so each still fires as far ahead as it was
+  void rebase(uint32_t now) {
+    uint32_t shift = tick_ - now;
+    for (size_t i = 0; i < Slots; i++) {
+      if (armed_[i]) deadline_[i] -= shift;
+    }
+    rebuild(now);
+  }
+
+  void link(size_t slot, size_t bucket) {
+    bucket_[slot] = (uint8_t)bucket;
+    prev_[slot] = NONE;
+    next_[slot] = heads_[bucket];
+    if (heads_[bucket] != NONE) prev_[heads_[bucket]] = (uint16_t)slot;
+    heads_[bucket] = (uint16_t)slot;
+  }
+
+  void unlink(size_t slot) {
+    if (prev_[slot] != NONE) next_[prev_[slot]] = next_[slot];
+    else heads_[bucket_[slot]] = next_[slot];
+    if (next_[slot] != NONE) prev_[next_[slot]] = prev_[slot];
+    next_[slot] = prev_[slot] = NONE;
+  }
+
+  uint16_t heads_[Buckets + OuterBuckets];
+  uint16_t next_[Slots];
+  uint16_t prev_[Slots];
+  uint32_t deadline_[Slots] = {};
+  uint8_t bucket_[Slots] = {};
+  bool armed_[Slots] = {};
+  uint32_t tick_ = 0;  // every tick before this one has been drained
+  size_t armedCount_ = 0;
+};
@@ -0,0 +1,202 @@
+// WifiLink: non-blocking WiFi bring-up and reconnection, advanced from loop()
+// Nothing waits for the network: BLE scanning starts at once, uploads are journaled while
+// the link is down, and poll() moves this state machine on status changes and timers:
+//   CONNECTING --joined--> CONNECTED --lost--> BACKOFF --timer--> CONNECTING
+//   CONNECTING --failed/timed out--> BACKOFF
+// The BSSID and channel of the last AP are kept in NVS, so reconnects and reboots join it
+// directly instead of scanning every channel; a static IP (Config::staticIp) skips DHCP.
+// A full scan is used when the cached AP fails before the first connect after boot (it may
+// have been replaced), and every WIFI_SCAN_EVERY_FAILURES failures after that.
+// Retry delays double up to WIFI_BACKOFF_MAX_MS with per-device random jitter, so a
+// building's worth of scanners does not hit the AP in lockstep after a power cut.
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <WiFi.h>
+#include <Preferences.h>
+#include "Log.h"
+
+enum WifiLinkState : uint8_t { WIFI_LINK_CONNECTING, WIFI_LINK_CONNECTED, WIFI_LINK_BACKOFF };
+
+static const uint32_t WIFI_FAST_CONNECT_TIMEOUT_MS = 4000;  // cached BSSID and channel
+static const uint32_t WIFI_CONNECT_TIMEOUT_MS = 15000;      // full scan, association, DHCP
+static const uint32_t WIFI_BACKOFF_BASE_MS = 250;
+static const uint32_t WIFI_BACKOFF_MAX_MS = 4000;
+static const uint32_t WIFI_SCAN_EVERY_FAILURES = 4;
+// First retry after losing a working link: anywhere in [0, this)
+static const uint32_t WIFI_RECONNECT_SPREAD_MS = 1000;
+static const char* WIFI_NVS_NAMESPACE = "wifi";
+
+class WifiLink {
+ public:
+  struct Config {
+    const char* ssid;
+    const char* pass;
+    const char* staticIp;  // nullptr: DHCP
+    const char* gateway;
+    const char* subnet;
+    const char* dns;       // nullptr: the gateway
+  };
+
+  // Start the first attempt and return; seed makes the jitter differ between devices
+  void begin(const Config &config, uint32_t seed, uint32_t nowMs) {
+    config_ = config;
+    rng_ = seed ? seed : 1;
+    WiFi.persistent(false);        // the cache below is ours; don't rewrite flash on every begin()
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(false);  // reconnection is paced here instead
+    if (config.staticIp) {
+      IPAddress ip, gateway, subnet, dns;
+      if (ip.fromString(config.staticIp) && gateway.fromString(config.gateway) && subnet.fromString(config.subnet)) {
+        if (!dns.fromString(config.dns ? config.dns : config.gateway)) dns = gateway;
+        WiFi.config(ip, gateway, subnet, dns);
+      } else {
+        LOG_WARN(LOG_CAT_SYS, "⚠️ Static IP settings invalid; using DHCP");
+      }
+    }
+    loadCache();
+    startAttempt(nowMs);
+  }
+
+  // Cheap; call every loop()
+  void poll(uint32_t nowMs) {
+    wl_status_t status = WiFi.status();
+    switch (state_) {
+      case WIFI_LINK_CONNECTING:
+        if (status == WL_CONNECTED) {
+          connected(nowMs);
+        } else if (status == WL_NO_SSID_AVAIL || status == WL_CONNECT_FAILED ||
+                   nowMs - attemptStartMs_ >= (fast_ ? WIFI_FAST_CONNECT_TIMEOUT_MS : WIFI_CONNECT_TIMEOUT_MS)) {
+          attemptFailed(nowMs, status);
+        }
+        break;
+      case WIFI_LINK_CONNECTED:
+        if (status != WL_CONNECTED) {
+          drops_++;
+          downMs_.store(nowMs ? nowMs : 1, std::memory_order_relaxed);
+          failures_ = 0;
+          uint32_t wait = nextRandom() % WIFI_RECONNECT_SPREAD_MS;
+          LOG_WARN(LOG_CAT_SYS, "📶 WiFi lost (status %d); reconnecting in %ums", (int)status, (unsigned)wait);
+          backoff(nowMs, wait);
+        }
+        break;
+      case WIFI_LINK_BACKOFF:
+        if ((int32_t)(nowMs - retryAtMs_) >= 0) startAttempt(nowMs);
+        break;
+    }
+  }
+
+  bool up() const { return state_ == WIFI_LINK_CONNECTED; }
+  WifiLinkState state() const { return state_; }
+
+  // Safe to read from other tasks
+  uint32_t attempts() const { return attempts_; }
+  uint32_t connects() const { return connects_; }
+  uint32_t drops() const { return drops_; }
+  // How long the latest successful attempt took, ms
+  uint32_t lastConnectMs() const { return lastConnectMs_; }
+  // millis() of the latest link-up and link-loss (0: never)
+  uint32_t upMs() const { return upMs_.load(std::memory_order_relaxed); }
+  uint32_t downMs() const { return downMs_.load(std::memory_order_relaxed); }
+
+ private:
+  void startAttempt(uint32_t nowMs) {
+    state_ = WIFI_LINK_CONNECTING;
+    attempts_++;
+    attemptStartMs_ = nowMs;
+    fast_ = haveCache_;
+    WiFi.disconnect();
+    if (fast_) {
+      WiFi.begin(config_.ssid, config_.pass, channel_, bssid_);
+    } else {
+      WiFi.begin(config_.ssid, config_.pass);
+    }
+  }
+
+  void connected(uint32_t nowMs) {
+    state_ = WIFI_LINK_CONNECTED;
+    connects_++;
+    failures_ = 0;
+    lastConnectMs_ = nowMs - attemptStartMs_;
+    upMs_.store(nowMs ? nowMs : 1, std::memory_order_relaxed);
+    LOG_INFO(LOG_CAT_SYS, "📶 WiFi connected in %ums (%s), IP %s", (unsigned)lastConnectMs_,
+             fast_ ? "cached AP" : "scan", WiFi.localIP().toString().c_str());
+    saveCache();
+  }
+
+  void attemptFailed(uint32_t nowMs, wl_status_t status) {
+    if (fast_ && connects_ == 0) {
+      // Cached from an earlier boot and not answering: scan right away (the NVS copy is
+      // only replaced once a scan finds a different AP)
+      haveCache_ = false;
+      LOG_WARN(LOG_CAT_SYS, "⚠️ Cached AP did not answer (status %d); scanning", (int)status);
+      startAttempt(nowMs);
+      return;
+    }
+    failures_++;
+    uint32_t ceiling = WIFI_BACKOFF_BASE_MS << (failures_ < 6 ? failures_ - 1 : 5);
+    if (ceiling > WIFI_BACKOFF_MAX_MS) ceiling = WIFI_BACKOFF_MAX_MS;
+    uint32_t wait = ceiling / 2 + nextRandom() % (ceiling / 2);
+    LOG_WARN(LOG_CAT_SYS, "⚠️ WiFi attempt %u failed (status %d); retry in %ums", (unsigned)attempts_, (int)status,
+             (unsigned)wait);
+    backoff(nowMs, wait);
+    haveCache_ = cacheStored_ && failures_ % WIFI_SCAN_EVERY_FAILURES != 0;
+  }
+
+  void backoff(uint32_t nowMs, uint32_t waitMs) {
+    state_ = WIFI_LINK_BACKOFF;
+    retryAtMs_ = nowMs + waitMs;
+  }
+
+  void loadCache() {
+    Preferences prefs;
+    prefs.begin(WIFI_NVS_NAMESPACE, true);
+    cacheStored_ = prefs.getBytes("bssid", bssid_, sizeof(bssid_)) == sizeof(bssid_);
+    channel_ = prefs.getUChar("channel", 0);
+    prefs.end();
+    cacheStored_ = cacheStored_ && channel_ > 0;
+    haveCache_ = cacheStored_;
+  }
+
+  // Written only when the AP changed, to spare the flash
+  void saveCache() {
+    const uint8_t* bssid = WiFi.BSSID();
+    int32_t channel = WiFi.channel();
+    if (!bssid || channel <= 0) return;
+    haveCache_ = true;
+    if (cacheStored_ && memcmp(bssid, bssid_, sizeof(bssid_)) == 0 && channel == channel_) return;
+    memcpy(bssid_, bssid, sizeof(bssid_));
+    channel_ = (uint8_t)channel;
+    Preferences prefs;
+    prefs.begin(WIFI_NVS_NAMESPACE, false);
+    cacheStored_ = prefs.putBytes("bssid", bssid_, sizeof(bssid_)) == sizeof(bssid_) && prefs.putUChar("channel", channel_) == 1;
+    prefs.end();
+  }
+
+  // xorshift32; only needs to differ between devices, not be unpredictable
+  uint32_t nextRandom() {
+    rng_ ^= rng_ << 13;
+    rng_ ^= rng_ >> 17;
+    rng_ ^= rng_ << 5;
+    return rng_;
+  }
+
+  Config config_ = {};
+  WifiLinkState state_ = WIFI_LINK_BACKOFF;
+  bool fast_ = false;
+  bool haveCache_ = false;    // try the cached AP on the next attempt
+  bool cacheStored_ = false;  // bssid_/channel_ match what is in NVS
+  uint8_t bssid_[6] = {};
+  uint8_t channel_ = 0;
+  uint32_t rng_ = 1;
+  uint32_t attemptStartMs_ = 0;
+  uint32_t retryAtMs_ = 0;
+  uint32_t failures_ = 0;
+  std::atomic<uint32_t> attempts_{0};
+  std::atomic<uint32_t> connects_{0};
+  std::atomic<uint32_t> drops_{0};
+  std::atomic<uint32_t> lastConnectMs_{0};
+  std::atomic<uint32_t> upMs_{0};
+  std::atomic<uint32_t> downMs_{0};
+};
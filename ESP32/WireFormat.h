@@ -0,0 +1,122 @@
+// WireFormat: compact binary framing for detection uploads (alternative to JSON)
+// Sent with Content-Type WIRE_EVENTS_CONTENT_TYPE to /api/esp32/detect (one record),
+// /api/esp32/detect/batch or /api/esp32/sessions; the Worker answers with an
+// application/vnd.autoattend.ack body. All integers are little-endian.
+//
+//   frame   'A' 'E' | version u8 | count u8 | device u8[6] | record * count
+//   record  seq u32 | ageMs u32 | observedMs u64 | action u8 | encoding u8 | tenant u16 | durationSec u32 |
+//           len u8 | payload[len]
+//   ack     'A' 'K' | version u8 | count u8 | status u8 * count
+//
+// A hex value travels as its raw bytes (half the size of the ASCII); encoding tells the
+// server how to turn them back into the exact string the JSON format would have carried.
+// device is the scanner's WiFi MAC and seq its event number, which never repeats on a device
+// (not even across reboots), so the Worker can drop a resent event by (device, seq).
+// observedMs is when the event happened in Unix ms by the SNTP-synced clock (DeviceClock.h),
+// 0 if the clock was not synced yet; ageMs is how long before the request it happened (a
+// held-back checkout or break can be hours old) and durationSec the length of a break
+// (Sessions.h), both by the scanner's own clock.
+// Version 2 added tenant (Tenants.h), version 3 replaced seenAtMs with ageMs and added
+// durationSec, version 4 added device and observedMs; the Worker still accepts the older
+// frames.
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "EventQueue.h"
+
+static const char WIRE_EVENTS_CONTENT_TYPE[] = "application/vnd.autoattend.events";
+static const uint8_t WIRE_VERSION = 4;
+static const size_t WIRE_DEVICE_ID_LEN = 6;
+static const size_t WIRE_FRAME_HEADER_LEN = 4 + WIRE_DEVICE_ID_LEN;
+static const size_t WIRE_ACK_HEADER_LEN = 4;
+static const size_t WIRE_RECORD_HEADER_LEN = 25;
+
+enum WireEncoding : uint8_t {
+  WIRE_HEX_UPPER = 0,  // payload bytes, server re-encodes as uppercase hex
+  WIRE_HEX_LOWER = 1,  // payload bytes, lowercase hex
+  WIRE_TEXT = 2,       // the value verbatim (mixed-case hex)
+};
+
+// Per-record result in the ack
+enum WireStatus : uint8_t {
+  WIRE_RECORDED = 0,
+  WIRE_DEDUPED = 1,
+  WIRE_DUPLICATE = 2,
+  WIRE_NOT_FOUND = 3,
+  WIRE_INVALID = 4,
+  WIRE_RETRY = 5,  // server-side error; resend
+};
+
+// Largest encoded record
+static const size_t WIRE_RECORD_MAX = WIRE_RECORD_HEADER_LEN + EVENT_HEX_MAX;
+
+static inline void putLe32(uint8_t* p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+static inline int wireHexNibble(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// Append one event, sent at nowMs, to out (capacity cap); returns bytes written, or 0 if it
+// does not fit
+static inline size_t encodeWireRecord(const DetectionEvent &ev, uint32_t nowMs, uint8_t* out, size_t cap) {
+  size_t hexLen = strnlen(ev.hex, EVENT_HEX_MAX);
+  bool upper = false, lower = false, hex = (hexLen % 2) == 0;
+  for (size_t i = 0; i < hexLen && hex; i++) {
+    char c = ev.hex[i];
+    if (wireHexNibble(c) < 0) hex = false;
+    else if (c >= 'a' && c <= 'f') lower = true;
+    else if (c >= 'A' && c <= 'F') upper = true;
+  }
+  uint8_t encoding = !hex || (upper && lower) ? WIRE_TEXT : (lower ? WIRE_HEX_LOWER : WIRE_HEX_UPPER);
+  size_t len = encoding == WIRE_TEXT ? hexLen : hexLen / 2;
+  if (cap < WIRE_RECORD_HEADER_LEN + len) return 0;
+
+  putLe32(out, ev.seq);
+  putLe32(out + 4, nowMs - ev.seenAtMs);
+  putLe32(out + 8, (uint32_t)ev.observedMs);
+  putLe32(out + 12, (uint32_t)(ev.observedMs >> 32));
+  out[16] = ev.action;
+  out[17] = encoding;
+  out[18] = (uint8_t)ev.tenant;
+  out[19] = (uint8_t)(ev.tenant >> 8);
+  putLe32(out + 20, ev.durationSec);
+  out[24] = (uint8_t)len;
+  uint8_t* p = out + WIRE_RECORD_HEADER_LEN;
+  if (encoding == WIRE_TEXT) {
+    memcpy(p, ev.hex, len);
+  } else {
+    for (size_t i = 0; i < len; i++) {
+      p[i] = (uint8_t)((wireHexNibble(ev.hex[2 * i]) << 4) | wireHexNibble(ev.hex[2 * i + 1]));
+    }
+  }
+  return WIRE_RECORD_HEADER_LEN + len;
+}
+
+// Frame header for a frame of count records from device
+static inline size_t encodeWireFrameHeader(uint8_t* out, uint8_t count, const uint8_t device[WIRE_DEVICE_ID_LEN]) {
+  out[0] = 'A';
+  out[1] = 'E';
+  out[2] = WIRE_VERSION;
+  out[3] = count;
+  memcpy(out + 4, device, WIRE_DEVICE_ID_LEN);
+  return WIRE_FRAME_HEADER_LEN;
+}
+
+// Parse an ack for count records into statuses; false if malformed
+static inline bool decodeWireAck(const uint8_t* body, size_t len, uint8_t* statuses, size_t count) {
+  if (len != WIRE_ACK_HEADER_LEN + count || body[0] != 'A' || body[1] != 'K' || body[2] != WIRE_VERSION ||
+      body[3] != count) {
+    return false;
+  }
+  memcpy(statuses, body + WIRE_ACK_HEADER_LEN, count);
+  return true;
+}
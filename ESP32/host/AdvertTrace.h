@@ -0,0 +1,354 @@
+// AdvertTrace: advertisement traces for the host simulator, read from a CSV recording or
+// generated from a named reference profile.
+//
+// CSV format, one advert per line in time order ('#' lines are comments):
+//   t_us,aa:bb:cc:dd:ee:ff,rssi,payload_hex
+//
+// The reference profiles are deterministic (fixed seed), so a profile name identifies the
+// same trace on every machine and commit; --write-trace dumps one to CSV.
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <queue>
+#include <vector>
+
+struct TraceAdvert {
+  uint64_t atUs = 0;  // since the start of the trace
+  uint8_t addr[6] = {0};
+  int8_t rssi = 0;
+  uint8_t len = 0;
+  uint8_t payload[62] = {0};
+};
+
+class AdvertSource {
+ public:
+  virtual ~AdvertSource() {}
+  // Next advert in time order; false at the end of the trace
+  virtual bool next(TraceAdvert &out) = 0;
+};
+
+class CsvTrace : public AdvertSource {
+ public:
+  ~CsvTrace() override {
+    if (file_) fclose(file_);
+  }
+
+  bool open(const char* path) {
+    file_ = fopen(path, "r");
+    return file_ != nullptr;
+  }
+
+  bool next(TraceAdvert &out) override {
+    char line[256];
+    while (file_ && fgets(line, sizeof(line), file_)) {
+      lineNo_++;
+      if (line[0] == '#' || line[0] == '\n') continue;
+      unsigned long long at;
+      unsigned a[6];
+      int rssi;
+      char hex[2 * sizeof(out.payload) + 2];
+      if (sscanf(line, "%llu,%x:%x:%x:%x:%x:%x,%d,%125s", &at, &a[0], &a[1], &a[2], &a[3], &a[4], &a[5], &rssi, hex) != 9 ||
+          !parseHex(hex, out)) {
+        fprintf(stderr, "trace line %u is malformed; skipped\n", lineNo_);
+        continue;
+      }
+      out.atUs = at;
+      for (int i = 0; i < 6; i++) out.addr[i] = (uint8_t)a[i];
+      out.rssi = (int8_t)rssi;
+      return true;
+    }
+    return false;
+  }
+
+ private:
+  static bool parseHex(const char* hex, TraceAdvert &out) {
+    size_t n = strlen(hex);
+    if (n % 2 != 0 || n / 2 > sizeof(out.payload)) return false;
+    for (size_t i = 0; i < n / 2; i++) {
+      unsigned b;
+      if (sscanf(hex + 2 * i, "%2x", &b) != 1) return false;
+      out.payload[i] = (uint8_t)b;
+    }
+    out.len = (uint8_t)(n / 2);
+    return true;
+  }
+
+  FILE* file_ = nullptr;
+  unsigned lineNo_ = 0;
+};
+
+// A synthetic scene: badges (phones running the AutoAttend app) walking in among
+// background BLE devices that never match. Visitors run the app too, but their hex
+// values (A0000000, ...) belong to nobody on the roster (MockWorker's B0000000, ...).
+struct TraceProfile {
+  const char* name;
+  const char* description;
+  uint32_t durationSec;
+  uint32_t backgroundDevices;
+  uint32_t backgroundIntervalMs;
+  uint32_t badges;
+  uint32_t visitors;          // app adverts outside the roster; arrive alongside the badges
+  uint32_t badgeIntervalMs;
+  uint32_t arrivalStartSec;   // badges arrive spread evenly over [start, start + spread)
+  uint32_t arrivalSpreadSec;
+  uint32_t staySec;           // 0: stay until the end of the trace
+  uint32_t edgePercent;       // badges that settle near the RSSI thresholds
+  double defaultSpeed;        // simulated seconds per real second
+  uint32_t rotatePercent;     // devices (badges included) that rotate a private address
+  uint32_t rotateSec;         // every this many seconds; background devices change payload too
+  uint32_t shortBreaks;       // per badge, 1-8 minutes each, spread over its stay
+  uint32_t lunchSec;          // one lunch of about this long (+-1/3) mid-stay; 0: none
+  uint32_t edgeFadeSec;       // edge badges fade +-12 dB over about this period, unheard below
+                              // the radio's sensitivity; 0: steady
+};
+
+// Weakest advert the scanner's radio still hears (only fading badges get this weak)
+static const int TRACE_SENSITIVITY_DBM = -96;
+
+static const TraceProfile TRACE_PROFILES[] = {
+  {"lobby-rush", "150 badges arrive within 2 minutes among 2000 background devices (~20k adverts/s)",
+   240, 2000, 100, 150, 0, 250, 10, 120, 0, 10, 1.0, 0, 0, 0, 0, 0},
+  {"idle-night", "8 hours with 25 background devices and two 2-minute security rounds",
+   8 * 3600, 25, 1000, 2, 0, 250, 2 * 3600, 3 * 3600, 120, 0, 240.0, 0, 0, 0, 0, 0},
+  {"front-desk", "100 badges and 200 visitors with the app arrive over 5 minutes among 300 background devices",
+   600, 300, 1000, 100, 200, 250, 10, 300, 0, 5, 4.0, 0, 0, 0, 0, 0},
+  {"dense-rf", "150 badges arrive among 1500 background devices; 40% of all devices rotate their address every 30 s",
+   240, 1500, 100, 150, 0, 250, 10, 120, 0, 10, 1.0, 40, 30, 0, 0, 0},
+  {"office-day", "180 badges arrive over 90 minutes, take 3 short breaks and a lunch each and leave 8 hours later",
+   13 * 3600, 50, 1000, 180, 0, 1000, 1800, 5400, 8 * 3600, 0, 240.0, 0, 0, 3, 2700, 0},
+  {"edge-desk", "60 badges at their desks for 4 hours; a third sit at the edge of range and fade in and out for minutes",
+   4 * 3600 + 900, 50, 1000, 60, 0, 1000, 60, 300, 4 * 3600, 33, 120.0, 0, 0, 0, 0, 120},
+};
+
+static inline const TraceProfile* findTraceProfile(const char* name) {
+  for (const TraceProfile &p : TRACE_PROFILES) {
+    if (strcmp(p.name, name) == 0) return &p;
+  }
+  return nullptr;
+}
+
+class SyntheticTrace : public AdvertSource {
+ public:
+  explicit SyntheticTrace(const TraceProfile &profile) : profile_(profile) {
+    for (uint32_t i = 0; i < profile.backgroundDevices; i++) {
+      Device d;
+      randomAddr(d.addr);
+      d.baseRssi = -50 - (int)(rand32() % 46);
+      d.intervalUs = profile.backgroundIntervalMs * 1000ULL;
+      d.fromUs = 0;
+      d.untilUs = durationUs();
+      d.len = backgroundPayload(d.payload);
+      setRotation(d);
+      add(d, rand32() % d.intervalUs);
+    }
+    addBadges(profile.badges, 0xB0000000u);
+    addBadges(profile.visitors, 0xA0000000u);
+  }
+
+  uint64_t durationUs() const { return profile_.durationSec * 1000000ULL; }
+
+  // Absences planned into the badges' days (the ground truth for sessions)
+  uint32_t plannedShortBreaks() const { return plannedShort_; }
+  uint32_t plannedLunches() const { return plannedLunch_; }
+  uint64_t plannedBreakSec() const { return plannedBreakSec_; }
+
+  bool next(TraceAdvert &out) override {
+    while (!due_.empty()) {
+      Due top = due_.top();
+      due_.pop();
+      Device &d = devices_[top.device];
+      if (top.atUs >= d.untilUs || top.atUs >= durationUs()) continue;
+      while (d.nextGap < d.gaps.size() && top.atUs >= d.gaps[d.nextGap].untilUs) d.nextGap++;
+      if (d.nextGap < d.gaps.size() && top.atUs >= d.gaps[d.nextGap].fromUs) {
+        due_.push(Due{d.gaps[d.nextGap].untilUs, top.device});  // out of range until it is back
+        continue;
+      }
+      if (d.rotateUs && top.atUs >= d.nextRotateUs) {
+        privateAddr(d.addr);
+        if (!d.badge) d.len = backgroundPayload(d.payload);
+        d.nextRotateUs += d.rotateUs;
+      }
+
+      int rssi = rssiAt(d, top.atUs);
+      // Advertising interval plus the 0-10 ms random advDelay every advertiser adds
+      due_.push(Due{top.atUs + d.intervalUs + rand32() % 10000, top.device});
+      if (d.fadeUs && rssi < TRACE_SENSITIVITY_DBM) continue;  // faded out: nobody hears it
+      out.atUs = top.atUs;
+      memcpy(out.addr, d.addr, sizeof(out.addr));
+      out.rssi = (int8_t)rssi;
+      out.len = d.len;
+      memcpy(out.payload, d.payload, d.len);
+      return true;
+    }
+    return false;
+  }
+
+ private:
+  struct Gap {
+    uint64_t fromUs;
+    uint64_t untilUs;
+  };
+
+  struct Device {
+    uint8_t addr[6];
+    uint8_t payload[32];  // 31 + the terminator snprintf writes
+    uint8_t len;
+    bool badge = false;
+    bool edge = false;
+    int baseRssi;
+    uint64_t intervalUs;
+    uint64_t fromUs;
+    uint64_t untilUs;
+    uint64_t rotateUs = 0;  // 0: fixed address
+    uint64_t nextRotateUs = 0;
+    uint64_t fadeUs = 0;      // fade period; 0: steady
+    uint64_t fadePhaseUs = 0;
+    std::vector<Gap> gaps;  // breaks, in time order
+    size_t nextGap = 0;
+  };
+
+  struct Due {
+    uint64_t atUs;
+    uint32_t device;
+    bool operator>(const Due &o) const { return atUs > o.atUs; }
+  };
+
+  void addBadges(uint32_t count, uint32_t hexBase) {
+    for (uint32_t i = 0; i < count; i++) {
+      Device d;
+      randomAddr(d.addr);
+      d.badge = true;
+      d.edge = profile_.edgePercent && rand32() % 100 < profile_.edgePercent;
+      d.baseRssi = d.edge ? -86 : -60 - (int)(rand32() % 19);
+      if (d.edge && profile_.edgeFadeSec) {
+        // Periods of 1/2 to 3/2 edgeFadeSec, so the badges do not fade in step
+        d.fadeUs = profile_.edgeFadeSec * (500000ULL + rand32() % 1000000);
+        d.fadePhaseUs = rand32() % d.fadeUs;
+        d.baseRssi = -84 - (int)(rand32() % 9);  // -84..-92: some mostly in range, some mostly out
+      }
+      d.intervalUs = profile_.badgeIntervalMs * 1000ULL;
+      uint64_t spreadUs = profile_.arrivalSpreadSec * 1000000ULL;
+      d.fromUs = profile_.arrivalStartSec * 1000000ULL + (count > 1 ? spreadUs * i / (count - 1) : 0);
+      d.untilUs = profile_.staySec ? d.fromUs + profile_.staySec * 1000000ULL : durationUs();
+      d.len = badgePayload(hexBase + i, d.payload);
+      setRotation(d);
+      planBreaks(d);
+      add(d, d.fromUs);
+    }
+  }
+
+  // Short breaks and a lunch, one per equal slice of the stay (lunch in the middle slice),
+  // clear of the first and last 10 minutes
+  void planBreaks(Device &d) {
+    uint32_t count = profile_.shortBreaks + (profile_.lunchSec ? 1 : 0);
+    uint64_t marginUs = 600 * 1000000ULL;
+    if (count == 0 || d.untilUs < d.fromUs + 2 * marginUs) return;
+    uint64_t sliceUs = (d.untilUs - d.fromUs - 2 * marginUs) / count;
+    for (uint32_t k = 0; k < count; k++) {
+      bool lunch = profile_.lunchSec && k == count / 2;
+      uint32_t sec = lunch ? profile_.lunchSec * 2 / 3 + rand32() % (profile_.lunchSec * 2 / 3 + 1)
+                           : 60 + rand32() % 421;
+      uint64_t lenUs = sec * 1000000ULL;
+      if (lenUs >= sliceUs) continue;
+      uint64_t fromUs = d.fromUs + marginUs + k * sliceUs + rand32() % (sliceUs - lenUs);
+      d.gaps.push_back(Gap{fromUs, fromUs + lenUs});
+      if (lunch) plannedLunch_++;
+      else plannedShort_++;
+      plannedBreakSec_ += sec;
+    }
+  }
+
+  void add(const Device &d, uint64_t firstUs) {
+    devices_.push_back(d);
+    due_.push(Due{firstUs, (uint32_t)(devices_.size() - 1)});
+  }
+
+  // xorshift32: fixed seed, so every run of a profile replays the same trace
+  uint32_t rand32() {
+    seed_ ^= seed_ << 13;
+    seed_ ^= seed_ >> 17;
+    seed_ ^= seed_ << 5;
+    return seed_;
+  }
+
+  void randomAddr(uint8_t addr[6]) {
+    for (int i = 0; i < 6; i++) addr[i] = (uint8_t)rand32();
+    addr[0] |= 0xC0;  // random static address
+  }
+
+  // Rotating devices start on a resolvable private address, first rotation staggered
+  void setRotation(Device &d) {
+    if (!profile_.rotatePercent || rand32() % 100 >= profile_.rotatePercent) return;
+    d.rotateUs = profile_.rotateSec * 1000000ULL;
+    d.nextRotateUs = d.fromUs + rand32() % d.rotateUs;
+    privateAddr(d.addr);
+  }
+
+  void privateAddr(uint8_t addr[6]) {
+    for (int i = 0; i < 6; i++) addr[i] = (uint8_t)rand32();
+    addr[0] = (uint8_t)((addr[0] & 0x3F) | 0x40);  // resolvable private address
+  }
+
+  // Badges walk in from out of range over ~5 s; fading edge badges swing +-12 dB on a
+  // triangle wave; every advert gets +-4 dB of fading
+  int rssiAt(const Device &d, uint64_t atUs) {
+    int rssi = d.baseRssi;
+    uint64_t sinceArrival = atUs - d.fromUs;
+    if (d.badge && !d.edge && sinceArrival < 5000000ULL) {
+      rssi = -100 + (int)((rssi + 100) * sinceArrival / 5000000ULL);
+    }
+    if (d.fadeUs) {
+      int64_t pos = (int64_t)((atUs + d.fadePhaseUs) % d.fadeUs);
+      int64_t half = (int64_t)d.fadeUs / 2;
+      rssi += (int)(12 - 24 * (pos > half ? pos - half : half - pos) / half);
+    }
+    return rssi + (int)(rand32() % 9) - 4;
+  }
+
+  // Same layout as the app's adverts: flags, 128-bit service UUID carrying D7E1A3F4,
+  // and an ASCII-hex local name that the scanner reports
+  static uint8_t badgePayload(uint32_t hex, uint8_t* out) {
+    static const uint8_t header[] = {0x02, 0x01, 0x1A, 0x11, 0x07, 0xFB, 0x34, 0x9B, 0x5F, 0x80, 0x00,
+                                     0x00, 0x80, 0x00, 0x10, 0x00, 0x00, 0xF4, 0xA3, 0xE1, 0xD7};
+    memcpy(out, header, sizeof(header));
+    uint8_t len = sizeof(header);
+    out[len++] = 9;
+    out[len++] = 0x09;
+    snprintf((char*)out + len, 9, "%08X", (unsigned)hex);
+    return (uint8_t)(len + 8);
+  }
+
+  // Manufacturer-specific data, the most common thing phones and wearables advertise
+  uint8_t backgroundPayload(uint8_t* out) {
+    uint8_t len = 0;
+    out[len++] = 0x02;
+    out[len++] = 0x01;
+    out[len++] = 0x06;
+    uint8_t dataLen = (uint8_t)(8 + rand32() % 17);
+    out[len++] = (uint8_t)(dataLen + 1);
+    out[len++] = 0xFF;
+    for (uint8_t i = 0; i < dataLen; i++) out[len++] = (uint8_t)rand32();
+    return len;
+  }
+
+  TraceProfile profile_;
+  std::vector<Device> devices_;
+  std::priority_queue<Due, std::vector<Due>, std::greater<Due>> due_;
+  uint32_t seed_ = 0x5EED1234;
+  uint32_t plannedShort_ = 0;
+  uint32_t plannedLunch_ = 0;
+  uint64_t plannedBreakSec_ = 0;
+};
+
+static inline void writeTraceCsv(AdvertSource &source, FILE* out) {
+  fprintf(out, "# t_us,address,rssi,payload_hex\n");
+  TraceAdvert adv;
+  while (source.next(adv)) {
+    fprintf(out, "%llu,%02x:%02x:%02x:%02x:%02x:%02x,%d,", (unsigned long long)adv.atUs, adv.addr[0], adv.addr[1],
+            adv.addr[2], adv.addr[3], adv.addr[4], adv.addr[5], adv.rssi);
+    for (uint8_t i = 0; i < adv.len; i++) fprintf(out, "%02X", adv.payload[i]);
+    fputc('\n', out);
+  }
+}
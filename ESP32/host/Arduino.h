@@ -0,0 +1,195 @@
+// Host stand-in for the Arduino core: just enough of String, Serial, ESP and the clock for
+// Scanner.cpp to build and run on Linux (see ScannerSim.cpp).
+// The clock runs hostsim::timeScale() times faster than real time so hours of trace can be
+// replayed in minutes; delay() sleeps the scaled-down amount.
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <string.h>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+
+namespace hostsim {
+
+// Simulated milliseconds per real millisecond; set once, before anything reads the clock
+inline double &timeScale() {
+  static double scale = 1.0;
+  return scale;
+}
+
+inline std::chrono::steady_clock::time_point clockOrigin() {
+  static const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+  return origin;
+}
+
+// Simulated microseconds since the clock origin
+inline uint64_t nowUs() {
+  double real = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - clockOrigin()).count();
+  return (uint64_t)(real * timeScale());
+}
+
+// Real time at which the simulated clock reads simUs
+inline std::chrono::steady_clock::time_point realTimeOf(uint64_t simUs) {
+  return clockOrigin() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                             std::chrono::duration<double, std::micro>(simUs / timeScale()));
+}
+
+// Serial output is dropped unless enabled (the sim prints its own report)
+inline std::atomic<bool> &serialEnabled() {
+  static std::atomic<bool> enabled{false};
+  return enabled;
+}
+
+// ESP.restart() calls so far. Unless restartReturns() is set it also ends the process, as a
+// reboot ends the firmware; ScannerSim's --ota runs count installs instead.
+inline std::atomic<uint32_t> &restarts() {
+  static std::atomic<uint32_t> count{0};
+  return count;
+}
+
+inline std::atomic<bool> &restartReturns() {
+  static std::atomic<bool> returns{false};
+  return returns;
+}
+
+// What millis() reads at simulated time 0, so a run can cross its 49.7-day wrap (--boot-millis).
+// The sim's own bookkeeping uses simMs(), which always starts at 0.
+inline uint32_t &bootMillis() {
+  static uint32_t ms = 0;
+  return ms;
+}
+
+inline uint32_t simMs() { return (uint32_t)(nowUs() / 1000); }
+
+}  // namespace hostsim
+
+// Fixed-seed stand-in for the hardware RNG, so runs are repeatable
+inline uint32_t esp_random() {
+  static std::mutex mutex;
+  static uint32_t state = 0x2545F491;
+  std::lock_guard<std::mutex> lock(mutex);
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+inline uint32_t millis() { return hostsim::simMs() + hostsim::bootMillis(); }
+inline uint32_t micros() { return (uint32_t)hostsim::nowUs(); }
+inline void delay(uint32_t ms) { std::this_thread::sleep_until(hostsim::realTimeOf(hostsim::nowUs() + ms * 1000ULL)); }
+
+class String {
+ public:
+  String() {}
+  String(const char* s) : s_(s ? s : "") {}
+  String(const std::string &s) : s_(s) {}
+  String(char c) : s_(1, c) {}
+  String(int v) : s_(std::to_string(v)) {}
+  String(unsigned v) : s_(std::to_string(v)) {}
+  String(long v) : s_(std::to_string(v)) {}
+  String(unsigned long v) : s_(std::to_string(v)) {}
+
+  const char* c_str() const { return s_.c_str(); }
+  unsigned length() const { return (unsigned)s_.size(); }
+  void reserve(unsigned n) { s_.reserve(n); }
+  int toInt() const { return atoi(s_.c_str()); }
+  char operator[](unsigned i) const { return i < s_.size() ? s_[i] : '\0'; }
+
+  int indexOf(const char* needle, unsigned from = 0) const { return found(s_.find(needle, from)); }
+  int indexOf(const String &needle, unsigned from = 0) const { return found(s_.find(needle.s_, from)); }
+  int indexOf(char c, unsigned from = 0) const { return found(s_.find(c, from)); }
+  String substring(unsigned from) const { return from < s_.size() ? String(s_.substr(from)) : String(); }
+  String substring(unsigned from, unsigned to) const {
+    return from < to && from < s_.size() ? String(s_.substr(from, to - from)) : String();
+  }
+
+  String &operator+=(const String &o) { s_ += o.s_; return *this; }
+  String &operator+=(const char* o) { s_ += o; return *this; }
+  String &operator+=(const std::string &o) { s_ += o; return *this; }
+  String &operator+=(char c) { s_ += c; return *this; }
+  friend String operator+(const String &a, const String &b) { return String(a.s_ + b.s_); }
+  friend String operator+(const String &a, const char* b) { return String(a.s_ + b); }
+  friend String operator+(const char* a, const String &b) { return String(a + b.s_); }
+  bool operator==(const String &o) const { return s_ == o.s_; }
+  bool operator==(const char* o) const { return s_ == o; }
+  bool operator!=(const String &o) const { return s_ != o.s_; }
+  bool operator!=(const char* o) const { return s_ != o; }
+
+ private:
+  static int found(size_t pos) { return pos == std::string::npos ? -1 : (int)pos; }
+  std::string s_;
+};
+
+// When enabled, writes are paced like the ESP32 UART: once the 128-byte TX FIFO is full
+// the caller waits for bytes to go out at the configured baud rate, so printing from a hot
+// path costs about what it would on the device
+class HardwareSerial {
+ public:
+  void begin(unsigned long baud) { usPerByte_ = baud ? 10e6 / baud : 0; }
+
+  size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+    if (!hostsim::serialEnabled()) return 0;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vprintf(fmt, ap);
+    va_end(ap);
+    if (n > 0) pace((size_t)n);
+    return n < 0 ? 0 : (size_t)n;
+  }
+  size_t print(const char* s) {
+    if (!hostsim::serialEnabled()) return 0;
+    size_t n = strlen(s);
+    fwrite(s, 1, n, stdout);
+    pace(n);
+    return n;
+  }
+  size_t print(const String &s) { return print(s.c_str()); }
+  size_t print(char c) {
+    char s[2] = {c, '\0'};
+    return print(s);
+  }
+  size_t println(const char* s = "") { return print(s) + print('\n'); }
+  size_t println(const String &s) { return println(s.c_str()); }
+
+ private:
+  static const size_t TX_FIFO_BYTES = 128;
+
+  void pace(size_t bytes) {
+    if (usPerByte_ <= 0) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    double now = (double)hostsim::nowUs();
+    if (drainedAtUs_ < now) drainedAtUs_ = now;
+    drainedAtUs_ += bytes * usPerByte_;
+    double fifoUs = TX_FIFO_BYTES * usPerByte_;
+    if (drainedAtUs_ - now > fifoUs) std::this_thread::sleep_until(hostsim::realTimeOf((uint64_t)(drainedAtUs_ - fifoUs)));
+  }
+
+  double usPerByte_ = 0;
+  double drainedAtUs_ = 0;  // simulated time the last queued byte leaves the wire
+  std::mutex mutex_;
+};
+
+inline HardwareSerial Serial;
+
+class EspClass {
+ public:
+  void restart() {
+    hostsim::restarts()++;
+    if (hostsim::restartReturns()) return;
+    fprintf(stderr, "ESP.restart() called; exiting\n");
+    fflush(stdout);
+    _Exit(3);
+  }
+  // No heap limit on the host; fixed figures keep the heartbeat format exercised
+  uint32_t getFreeHeap() { return 200 * 1024; }
+  uint32_t getMaxAllocHeap() { return 110 * 1024; }
+};
+
+inline EspClass ESP;
@@ -0,0 +1,133 @@
+// Host stand-in for the ESP32 core's Bluedroid BLE library (BLEDevice/BLEScan/
+// BLEAdvertisedDevice), the Radio.h backend built with SCANNER_BLE_NIMBLE=0. Scan timing
+// comes from SimScan.h; the library's own costs (result cache, parsing into std::strings)
+// are not modelled.
+#pragma once
+#include <Arduino.h>
+#include <mutex>
+#include "SimScan.h"
+
+class BLEAddress {
+ public:
+  BLEAddress() {}
+  explicit BLEAddress(const uint8_t addr[6]) { memcpy(addr_, addr, sizeof(addr_)); }
+
+  std::string toString() const {
+    char s[18];
+    snprintf(s, sizeof(s), "%02x:%02x:%02x:%02x:%02x:%02x", addr_[0], addr_[1], addr_[2], addr_[3], addr_[4], addr_[5]);
+    return s;
+  }
+  uint8_t (*getNative())[6] { return &addr_; }
+
+ private:
+  uint8_t addr_[6] = {0};
+};
+
+class BLEUUID {
+ public:
+  BLEUUID() {}
+  explicit BLEUUID(const std::string &text) : text_(text) {}
+  std::string toString() const { return text_; }
+
+ private:
+  std::string text_;
+};
+
+class BLEAdvertisedDevice {
+ public:
+  static const size_t PAYLOAD_MAX = 62;  // advert + scan response
+
+  BLEAdvertisedDevice() {}
+  BLEAdvertisedDevice(const uint8_t addr[6], int rssi, const uint8_t* payload, size_t len)
+      : address_(addr), rssi_(rssi), len_(len < PAYLOAD_MAX ? len : PAYLOAD_MAX) {
+    memcpy(payload_, payload, len_);
+  }
+
+  BLEAddress getAddress() { return address_; }
+  int getRSSI() { return rssi_; }
+  uint8_t* getPayload() { return payload_; }
+  size_t getPayloadLength() { return len_; }
+
+  // First 128-bit service UUID (AD types 0x06/0x07), printed like the real library
+  bool haveServiceUUID() { return findUuid128() != nullptr; }
+  BLEUUID getServiceUUID() {
+    const uint8_t* u = findUuid128();
+    if (!u) return BLEUUID();
+    char s[37];
+    int n = 0;
+    for (int i = 15; i >= 0; i--) {
+      n += snprintf(s + n, sizeof(s) - n, "%02x", u[i]);
+      if (i == 12 || i == 10 || i == 8 || i == 6) s[n++] = '-';
+    }
+    s[n] = '\0';
+    return BLEUUID(s);
+  }
+
+ private:
+  const uint8_t* findUuid128() const {
+    for (size_t i = 0; i + 1 < len_ && payload_[i] != 0; i += 1 + payload_[i]) {
+      uint8_t type = payload_[i + 1];
+      if ((type == 0x06 || type == 0x07) && payload_[i] >= 17 && i + 18 <= len_) return payload_ + i + 2;
+    }
+    return nullptr;
+  }
+
+  BLEAddress address_;
+  int rssi_ = 0;
+  uint8_t payload_[PAYLOAD_MAX] = {0};
+  size_t len_ = 0;
+};
+
+class BLEAdvertisedDeviceCallbacks {
+ public:
+  virtual ~BLEAdvertisedDeviceCallbacks() {}
+  virtual void onResult(BLEAdvertisedDevice advertisedDevice) = 0;
+};
+
+class BLEScanResults {
+ public:
+  int getCount() { return 0; }
+};
+
+class BLEScan : public hostsim::SimScan {
+ public:
+  void setAdvertisedDeviceCallbacks(BLEAdvertisedDeviceCallbacks* callbacks, bool /*wantDuplicates*/ = false,
+                                    bool /*shouldParse*/ = true) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    callbacks_ = callbacks;  // every advert is delivered, as with wantDuplicates = true
+  }
+  void setActiveScan(bool) {}
+
+  bool start(uint32_t duration, void (*onComplete)(BLEScanResults), bool = false) {
+    return startFor(duration, [onComplete] { if (onComplete) onComplete(BLEScanResults()); });
+  }
+
+  void clearResults() {}
+
+  bool prepare(const uint8_t addr[6], int rssi, const uint8_t* payload, size_t len) override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      prepared_ = callbacks_;
+    }
+    if (!prepared_) return false;
+    device_ = BLEAdvertisedDevice(addr, rssi, payload, len);
+    return true;
+  }
+
+  // onResult() takes the device by value, so every advert is copied into the call
+  void dispatch() override { prepared_->onResult(device_); }
+
+ private:
+  BLEAdvertisedDeviceCallbacks* callbacks_ = nullptr;
+  BLEAdvertisedDeviceCallbacks* prepared_ = nullptr;
+  BLEAdvertisedDevice device_;
+};
+
+class BLEDevice {
+ public:
+  static void init(const std::string &) { hostsim::activeScan() = getScan(); }
+  static BLEScan* getScan() {
+    static BLEScan scan;
+    return &scan;
+  }
+};
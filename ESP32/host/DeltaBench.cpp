@@ -0,0 +1,251 @@
+// DeltaBench: OTA delta patches between two firmware builds, built the way the Worker
+// builds them and applied the way the scanner applies them.
+// buildDeltaPatch() below is a line-for-line port of src/worker/otaDelta.ts (same block
+// size, rolling hash and match growing, so the same bytes come out); the patch is then fed
+// to DeltaApplier (DeltaPatch.h) in OTA_CHUNK_BYTES pieces with the base read on demand, as
+// applyDeltaFirmware() does from the running partition, and the result is checked against
+// the new image and its sha256.
+// Reports the patch size against the full image, how long building and applying take, and
+// peak RAM: the builder's heap high-water mark (what the Worker needs) and the applier's
+// state plus receive buffer (what the scanner needs; it allocates nothing).
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -Wall -Wextra -IESP32/host ESP32/host/DeltaBench.cpp -o delta-bench
+//   ./delta-bench old.bin new.bin    # e.g. two builds of the firmware (build/*.ino.bin)
+// Without a board toolchain, two builds of the simulator stand in (Scanner.cpp is all of it):
+//   git worktree add /tmp/prev HEAD~1
+//   g++ -std=c++17 -O2 -pthread -I/tmp/prev/ESP32/host /tmp/prev/ESP32/host/ScannerSim.cpp -o old.bin
+//   g++ -std=c++17 -O2 -pthread -IESP32/host ESP32/host/ScannerSim.cpp -o new.bin
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <new>
+#include <unordered_map>
+#include <vector>
+#include "../DeltaPatch.h"
+#include "../Sha256.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static const size_t OTA_CHUNK_BYTES = 4096;  // Scanner.cpp's otaChunk
+
+// ----------------------- Heap accounting -----------------------
+// Each block carries its size, so frees can be subtracted and the high-water mark kept
+static size_t heapNow = 0;
+static size_t heapPeak = 0;
+static size_t heapAllocs = 0;
+static const size_t HEAP_HEADER = 16;
+
+void* operator new(size_t size) {
+  uint8_t* p = (uint8_t*)malloc(size + HEAP_HEADER);
+  if (!p) throw std::bad_alloc();
+  memcpy(p, &size, sizeof(size));
+  heapAllocs++;
+  heapNow += size;
+  if (heapNow > heapPeak) heapPeak = heapNow;
+  return p + HEAP_HEADER;
+}
+
+// Out of line so GCC does not pair the inlined free() with a new-expression and warn
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+  if (!p) return;
+  uint8_t* block = (uint8_t*)p - HEAP_HEADER;
+  size_t size;
+  memcpy(&size, block, sizeof(size));
+  heapNow -= size;
+  free(block);
+}
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { operator delete(p); }
+
+// ----------------------- Patch builder (port of otaDelta.ts) -----------------------
+static const size_t DELTA_BLOCK = 32;
+static const uint32_t HASH_MULT = 257;
+
+static uint32_t hashOut() {
+  uint32_t p = 1;
+  for (size_t i = 0; i < DELTA_BLOCK - 1; i++) p *= HASH_MULT;
+  return p;
+}
+
+static uint32_t blockHash(const uint8_t* data, size_t start) {
+  uint32_t h = 0;
+  for (size_t i = 0; i < DELTA_BLOCK; i++) h = h * HASH_MULT + data[start + i];
+  return h;
+}
+
+static void putVarint(std::vector<uint8_t> &out, uint32_t v) {
+  while (v >= 0x80) {
+    out.push_back((uint8_t)((v & 0x7F) | 0x80));
+    v >>= 7;
+  }
+  out.push_back((uint8_t)v);
+}
+
+static void putLe32(std::vector<uint8_t> &out, uint32_t v) {
+  for (int i = 0; i < 4; i++) out.push_back((uint8_t)(v >> (8 * i)));
+}
+
+static std::vector<uint8_t> buildDeltaPatch(const std::vector<uint8_t> &base, const std::vector<uint8_t> &target,
+                                            const uint8_t baseSha256[32], const uint8_t targetSha256[32]) {
+  std::vector<uint8_t> out;
+  out.insert(out.end(), {'A', 'A', 'D', '1'});
+  putLe32(out, (uint32_t)base.size());
+  putLe32(out, (uint32_t)target.size());
+  out.insert(out.end(), baseSha256, baseSha256 + 32);
+  out.insert(out.end(), targetSha256, targetSha256 + 32);
+
+  // First base offset for each block hash (collisions are verified byte by byte)
+  std::unordered_map<uint32_t, uint32_t> index;
+  for (size_t off = 0; off + DELTA_BLOCK <= base.size(); off += DELTA_BLOCK) {
+    index.emplace(blockHash(base.data(), off), (uint32_t)off);
+  }
+
+  const uint32_t out1 = hashOut();
+  size_t literalStart = 0;
+  auto emitLiteral = [&](size_t end) {
+    if (end <= literalStart) return;
+    out.push_back(0x02);
+    putVarint(out, (uint32_t)(end - literalStart));
+    out.insert(out.end(), target.begin() + literalStart, target.begin() + end);
+  };
+
+  size_t i = 0;
+  uint32_t h = target.size() >= DELTA_BLOCK ? blockHash(target.data(), 0) : 0;
+  while (i + DELTA_BLOCK <= target.size()) {
+    auto hit = index.find(h);
+    if (hit != index.end() && memcmp(&base[hit->second], &target[i], DELTA_BLOCK) == 0) {
+      // Grow the match forwards, then backwards into the pending literal
+      size_t end = i + DELTA_BLOCK;
+      size_t baseEnd = hit->second + DELTA_BLOCK;
+      while (end < target.size() && baseEnd < base.size() && target[end] == base[baseEnd]) {
+        end++;
+        baseEnd++;
+      }
+      size_t start = i;
+      size_t baseStart = hit->second;
+      while (start > literalStart && baseStart > 0 && target[start - 1] == base[baseStart - 1]) {
+        start--;
+        baseStart--;
+      }
+      emitLiteral(start);
+      out.push_back(0x01);
+      putVarint(out, (uint32_t)baseStart);
+      putVarint(out, (uint32_t)(end - start));
+      literalStart = end;
+      i = end;
+      if (i + DELTA_BLOCK <= target.size()) h = blockHash(target.data(), i);
+      continue;
+    }
+    if (i + DELTA_BLOCK >= target.size()) break;
+    h = (h - target[i] * out1) * HASH_MULT + target[i + DELTA_BLOCK];
+    i++;
+  }
+  emitLiteral(target.size());
+  out.push_back(0x00);
+  return out;
+}
+
+// ----------------------- Applying, as the scanner does -----------------------
+struct ApplyContext {
+  const std::vector<uint8_t>* base;
+  uint8_t* out;
+  size_t written;
+  Sha256 sha;
+  uint32_t baseReads;
+};
+
+static bool readBase(void* ctx, uint32_t offset, uint8_t* out, size_t len) {
+  ApplyContext* c = static_cast<ApplyContext*>(ctx);
+  if (offset + len > c->base->size()) return false;
+  memcpy(out, c->base->data() + offset, len);
+  c->baseReads++;
+  return true;
+}
+
+static bool writeOut(void* ctx, const uint8_t* data, size_t len) {
+  ApplyContext* c = static_cast<ApplyContext*>(ctx);
+  memcpy(c->out + c->written, data, len);
+  c->written += len;
+  c->sha.update(data, len);
+  return true;
+}
+
+static bool readFile(const char* path, std::vector<uint8_t> &out) {
+  FILE* f = fopen(path, "rb");
+  if (!f) return false;
+  uint8_t buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.insert(out.end(), buf, buf + n);
+  fclose(f);
+  return !out.empty();
+}
+
+static void sha256Of(const std::vector<uint8_t> &data, uint8_t out[32]) {
+  Sha256 sha;
+  sha.update(data.data(), data.size());
+  sha.finish(out);
+}
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    fprintf(stderr, "usage: delta-bench OLD_IMAGE NEW_IMAGE\n");
+    return 2;
+  }
+  std::vector<uint8_t> base, target;
+  if (!readFile(argv[1], base) || !readFile(argv[2], target)) {
+    fprintf(stderr, "cannot read %s or %s\n", argv[1], argv[2]);
+    return 1;
+  }
+  uint8_t baseSha[32], targetSha[32];
+  sha256Of(base, baseSha);
+  sha256Of(target, targetSha);
+
+  size_t heapBefore = heapNow;
+  heapPeak = heapNow;
+  Clock::time_point t0 = Clock::now();
+  std::vector<uint8_t> patch = buildDeltaPatch(base, target, baseSha, targetSha);
+  double buildMs = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+  size_t builderPeak = heapPeak - heapBefore;
+
+  DeltaHeader header;
+  if (!parseDeltaHeader(patch.data(), patch.size(), header)) {
+    fprintf(stderr, "built an invalid header\n");
+    return 1;
+  }
+  // The output stands in for the OTA partition; it is not part of the applier's RAM
+  std::vector<uint8_t> image(header.newSize);
+  ApplyContext ctx{&base, image.data(), 0, Sha256(), 0};
+  size_t allocsBefore = heapAllocs;
+  uint8_t chunk[OTA_CHUNK_BYTES];
+  t0 = Clock::now();
+  DeltaApplier applier(header, readBase, writeOut, &ctx);
+  bool fed = true;
+  for (size_t pos = DELTA_HEADER_LEN; pos < patch.size() && fed; pos += OTA_CHUNK_BYTES) {
+    size_t n = patch.size() - pos < OTA_CHUNK_BYTES ? patch.size() - pos : OTA_CHUNK_BYTES;
+    memcpy(chunk, patch.data() + pos, n);  // as it arrives from the network
+    fed = applier.feed(chunk, n);
+  }
+  uint8_t digest[32];
+  ctx.sha.finish(digest);
+  double applyMs = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+  size_t applyAllocs = heapAllocs - allocsBefore;
+
+  bool ok = fed && applier.done() && image == target && memcmp(digest, targetSha, 32) == 0;
+  printf("Images:    old %zu B, new %zu B\n", base.size(), target.size());
+  printf("Patch:     %zu B, %.1f%% of the new image (the Worker publishes it under 50%%)\n", patch.size(),
+         100.0 * patch.size() / target.size());
+  printf("Build:     %.1f ms, builder heap peak %zu B (%.1fx the two images)\n", buildMs, builderPeak,
+         (double)builderPeak / (base.size() + target.size()));
+  printf("Apply:     %.1f ms, %.1f MB/s of image, %u base reads; RAM %zu B applier + %zu B receive buffer, "
+         "%zu heap allocations\n",
+         applyMs, target.size() / applyMs / 1000.0, (unsigned)ctx.baseReads, sizeof(DeltaApplier), OTA_CHUNK_BYTES,
+         applyAllocs);
+  printf("Result:    %s\n", ok ? "image and sha256 match" : applier.error() ? applier.error() : "image differs");
+  printf("RESULT old_bytes=%zu new_bytes=%zu patch_bytes=%zu patch_pct=%.1f build_ms=%.1f builder_peak_bytes=%zu "
+         "apply_ms=%.1f applier_bytes=%zu apply_allocs=%zu ok=%d\n",
+         base.size(), target.size(), patch.size(), 100.0 * patch.size() / target.size(), buildMs, builderPeak, applyMs,
+         sizeof(DeltaApplier), applyAllocs, ok ? 1 : 0);
+  return ok ? 0 : 1;
+}
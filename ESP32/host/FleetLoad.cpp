@@ -0,0 +1,647 @@
+// FleetLoad: a fleet of virtual scanners against a Worker, to see how /api/esp32/detect (or
+// /api/esp32/sessions) and the R2-backed OTA endpoints hold up when hundreds of devices hit
+// them at once.
+// Each virtual scanner is a thread with its own keep-alive ServerConnection, MAC and event
+// sequence, and uploads through DetectUpload.h exactly as Scanner.cpp does: the same JSON
+// body or binary frame, the same reading of the answer, the same retries and backoff.
+//
+// Scenarios:
+//   day  badges arrive (09:00 rush), go to lunch (about two thirds of them) and leave
+//        (17:30), with a share of unknown visitors; each movement is seen by --overlap
+//        scanners at the badge's site, so the Worker also has to turn away the copies.
+//        The 07:00-19:00 day is compressed into --day-seconds of real time. With
+//        --sessions a lunch is one lunch_break, sent on return to /api/esp32/sessions.
+//   ota  a rollout storm: every scanner fetches /api/ota/manifest within --ota-spread
+//        seconds, then downloads the image it names in 4 KB reads.
+//   all  day, then ota.
+// The report gives throughput, latency percentiles (p50/p99/p99.9), answers by status and
+// the D1 round trips per request, which the Worker reports in X-D1-Round-Trips and
+// X-D1-Statements when run with D1_QUERY_STATS=1.
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -Wall -Wextra -pthread -IESP32/host ESP32/host/FleetLoad.cpp -o fleet-load
+//
+// Against a local Worker (wrangler dev with the migrations applied):
+//   ./fleet-load --badges 2000 --seed-sql load-roster.sql
+//   npx wrangler d1 execute autoattend-db --local --file load-roster.sql
+//   npx wrangler dev --var D1_QUERY_STATS:1
+//   ./fleet-load --worker 127.0.0.1:8787 --scanners 200 --sites 4 --badges 2000
+//   ./fleet-load --worker 127.0.0.1:8787 --scanners 200 --sites 4 --badges 2000 --sessions --batch 8
+//   ./fleet-load --worker 127.0.0.1:8787 --scenario ota --scanners 300
+// Or check the tool itself against the in-process mock Worker:
+//   ./fleet-load --mock --scenario all
+#include <Arduino.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../DetectUpload.h"
+#include "MockWorker.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static const double DAY_SECONDS = 12 * 3600.0;  // 07:00-19:00
+static const uint32_t OTA_READ_BYTES = 4096;    // Scanner.cpp's OTA_CHUNK_BYTES
+
+struct LoadOptions {
+  const char* workerAddr = nullptr;
+  bool mock = false;
+  const char* scenario = "day";
+  uint32_t scanners = 50;
+  uint32_t sites = 1;
+  uint32_t badges = 500;
+  uint32_t overlap = 2;
+  double unknownRate = 0.02;
+  double daySeconds = 300;
+  bool json = false;
+  uint32_t batch = 1;
+  bool sessions = false;
+  double otaSpreadSec = 10;
+  uint32_t mockOtaBytes = 256 * 1024;
+  const char* seedSqlPath = nullptr;
+  uint32_t seed = 1;
+};
+
+static void usage() {
+  printf("usage: fleet-load [options]\n"
+         "  --worker HOST:PORT     Worker to load (e.g. wrangler dev on 127.0.0.1:8787)\n"
+         "  --mock                 load the in-process mock Worker instead (checks the tool)\n"
+         "  --scenario NAME        day, ota or all (default day)\n"
+         "  --scanners N           virtual scanners (default 50)\n"
+         "  --sites N              sites the scanners and badges are spread over (default 1)\n"
+         "  --badges N             employees' badges, B0000000 upwards (default 500)\n"
+         "  --overlap N            scanners at a site that see each movement (default 2)\n"
+         "  --unknown P            extra sightings from unknown badges, as a share of movements (default 0.02)\n"
+         "  --day-seconds S        real seconds the 07:00-19:00 day takes (default 300)\n"
+         "  --json                 upload JSON instead of binary frames\n"
+         "  --batch N              up to N due events per request to /api/esp32/detect/batch (binary)\n"
+         "  --sessions             upload session segments to /api/esp32/sessions (binary), a lunch as one lunch_break\n"
+         "  --ota-spread S         seconds over which the scanners start their OTA check (default 10)\n"
+         "  --mock-ota-bytes N     size of the mock Worker's firmware image (default 262144)\n"
+         "  --seed-sql FILE        write SQL adding the badges as employees, then exit\n"
+         "  --seed N               random seed for the day plan (default 1)\n");
+}
+
+static bool parseArgs(int argc, char** argv, LoadOptions &o) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+    bool takesValue = arg != "--mock" && arg != "--json" && arg != "--sessions" && arg != "--help";
+    if (takesValue && !value) return false;
+    if (arg == "--worker") o.workerAddr = value;
+    else if (arg == "--mock") o.mock = true;
+    else if (arg == "--scenario") o.scenario = value;
+    else if (arg == "--scanners") o.scanners = (uint32_t)atoi(value);
+    else if (arg == "--sites") o.sites = (uint32_t)atoi(value);
+    else if (arg == "--badges") o.badges = (uint32_t)atoi(value);
+    else if (arg == "--overlap") o.overlap = (uint32_t)atoi(value);
+    else if (arg == "--unknown") o.unknownRate = atof(value);
+    else if (arg == "--day-seconds") o.daySeconds = atof(value);
+    else if (arg == "--json") o.json = true;
+    else if (arg == "--batch") o.batch = (uint32_t)atoi(value);
+    else if (arg == "--sessions") o.sessions = true;
+    else if (arg == "--ota-spread") o.otaSpreadSec = atof(value);
+    else if (arg == "--mock-ota-bytes") o.mockOtaBytes = (uint32_t)atoi(value);
+    else if (arg == "--seed-sql") o.seedSqlPath = value;
+    else if (arg == "--seed") o.seed = (uint32_t)atoi(value);
+    else return false;
+    if (takesValue) i++;
+  }
+  std::string scenario = o.scenario;
+  if (scenario != "day" && scenario != "ota" && scenario != "all") return false;
+  if (o.scanners == 0 || o.sites == 0 || o.sites > o.scanners || o.overlap == 0) return false;
+  if (o.batch == 0 || o.batch > 64 || ((o.batch > 1 || o.sessions) && o.json)) return false;
+  return o.seedSqlPath || o.mock != (o.workerAddr != nullptr);
+}
+
+// Badge i's hex value (MockWorker's roster uses the same ones)
+static std::string badgeHex(uint32_t i) {
+  char hex[9];
+  snprintf(hex, sizeof(hex), "%08X", (unsigned)(0xB0000000u + i));
+  return hex;
+}
+
+// Idempotent SQL adding every badge as an active employee with its hex value
+static bool writeSeedSql(const LoadOptions &o) {
+  FILE* out = fopen(o.seedSqlPath, "w");
+  if (!out) return false;
+  fprintf(out, "-- fleet-load roster: %u badges\n", (unsigned)o.badges);
+  for (uint32_t i = 0; i < o.badges; i++) {
+    std::string hex = badgeHex(i);
+    fprintf(out,
+            "INSERT INTO employees (name, uuid, hex_value) SELECT 'Load Badge %05u', 'D7E1A3F4', '%s' "
+            "WHERE NOT EXISTS (SELECT 1 FROM employees WHERE hex_value = '%s');\n"
+            "INSERT OR IGNORE INTO employee_details (employee_id, hex_value, department, emp_id) "
+            "SELECT id, hex_value, 'Load test', 'LOAD-%05u' FROM employees WHERE hex_value = '%s';\n",
+            (unsigned)i, hex.c_str(), hex.c_str(), (unsigned)i, hex.c_str());
+  }
+  fclose(out);
+  return true;
+}
+
+// ----------------------- Day plan -----------------------
+struct PlannedEvent {
+  double atSec;  // real seconds after the start
+  std::string hex;
+  uint8_t action;
+  bool unknown;
+  double awayDaySec;  // a break: its length in day seconds (sent on return, stamped when the badge left)
+};
+
+// Day seconds (since 07:00) from a clock time in hours
+static double dayAt(double hours) { return (hours - 7.0) * 3600.0; }
+
+// Each scanner's events in time order; movements returns how many badge movements were planned
+static std::vector<std::vector<PlannedEvent>> planDay(const LoadOptions &o, uint32_t &movements, uint32_t &unknownSightings) {
+  std::vector<std::vector<PlannedEvent>> plan(o.scanners);
+  std::mt19937 rng(o.seed);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  std::normal_distribution<double> arrive(dayAt(9.0), 25 * 60.0);
+  std::normal_distribution<double> lunchOut(dayAt(12.5), 20 * 60.0);
+  std::normal_distribution<double> leave(dayAt(17.5), 40 * 60.0);
+  double scale = o.daySeconds / DAY_SECONDS;
+
+  // Scanners of site s are s, s + sites, s + 2 * sites, ...; a badge uses one door (overlap
+  // neighbouring scanners of its site), and each of them sees the movement within 5 s
+  auto seenBy = [&](uint32_t door, double atDaySec, const std::string &hex, uint8_t action, bool unknown,
+                    double awayDaySec = 0) {
+    uint32_t site = door % o.sites;
+    uint32_t atSite = (o.scanners - site + o.sites - 1) / o.sites;
+    uint32_t first = door / o.sites;
+    for (uint32_t k = 0; k < std::min(o.overlap, atSite); k++) {
+      uint32_t scanner = site + ((first + k) % atSite) * o.sites;
+      double at = std::min(std::max(atDaySec + unit(rng) * 5.0, 0.0), DAY_SECONDS);
+      plan[scanner].push_back(PlannedEvent{at * scale, hex, action, unknown, awayDaySec});
+    }
+  };
+
+  movements = 0;
+  for (uint32_t b = 0; b < o.badges; b++) {
+    std::string hex = badgeHex(b);
+    uint32_t door = (uint32_t)(unit(rng) * o.scanners);
+    double in = std::min(std::max(arrive(rng), 0.0), dayAt(11.0));
+    double out = std::min(std::max(leave(rng), in + 1800.0), DAY_SECONDS - 60.0);
+    seenBy(door, in, hex, EVENT_CHECKIN, false);
+    movements++;
+    if (unit(rng) < 0.65) {
+      double lunch = std::min(std::max(lunchOut(rng), in + 600.0), out - 5400.0);
+      if (lunch > in) {
+        double back = lunch + 1800.0 + unit(rng) * 1800.0;
+        if (o.sessions) {
+          seenBy(door, back, hex, EVENT_LUNCH_BREAK, false, back - lunch);
+        } else {
+          seenBy(door, lunch, hex, EVENT_CHECKOUT, false);
+          seenBy(door, back, hex, EVENT_CHECKIN, false);
+        }
+        movements += 2;
+      }
+    }
+    seenBy(door, out, hex, EVENT_CHECKOUT, false);
+    movements++;
+  }
+  // Visitors: badges nobody has on file, arriving over the day
+  unknownSightings = (uint32_t)(movements * o.unknownRate + 0.5);
+  for (uint32_t v = 0; v < unknownSightings; v++) {
+    uint32_t door = (uint32_t)(unit(rng) * o.scanners);
+    seenBy(door, dayAt(8.0) + unit(rng) * 9 * 3600.0, badgeHex(o.badges + v), EVENT_CHECKIN, true);
+  }
+  for (std::vector<PlannedEvent> &events : plan) {
+    std::sort(events.begin(), events.end(),
+              [](const PlannedEvent &a, const PlannedEvent &b) { return a.atSec < b.atSec; });
+  }
+  return plan;
+}
+
+// ----------------------- Measurements -----------------------
+// Every request to one endpoint; latencies are kept whole so the tail percentiles are exact
+class EndpointStats {
+ public:
+  explicit EndpointStats(const char* name) : name_(name) {}
+
+  void record(int code, uint32_t latencyUs, double doneSec, const String &roundTrips, const String &statements) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    latencyUs_.push_back(latencyUs);
+    doneSec_.push_back(doneSec);
+    if (code < 0) transport_++;
+    else if (code < 300) ok_++;
+    else if (code < 500) client_++;
+    else server_++;
+    if (roundTrips.length() > 0) {
+      d1Reported_++;
+      uint32_t trips = (uint32_t)roundTrips.toInt();
+      d1RoundTrips_ += trips;
+      d1Statements_ += (uint32_t)statements.toInt();
+      d1MaxRoundTrips_ = std::max(d1MaxRoundTrips_, trips);
+    }
+  }
+
+  size_t requests() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return latencyUs_.size();
+  }
+  uint64_t d1RoundTrips() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return d1RoundTrips_;
+  }
+  uint32_t d1Reported() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return d1Reported_;
+  }
+  uint32_t errors() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return transport_ + server_;
+  }
+
+  // Latency at quantile q in ms, over every request
+  double percentileMs(double q) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sortLocked();
+    if (sorted_.empty()) return 0;
+    size_t i = (size_t)std::ceil(q * sorted_.size());
+    return sorted_[std::min(sorted_.size() - 1, i ? i - 1 : 0)] / 1000.0;
+  }
+
+  void print(double wallSec) {
+    double p50 = percentileMs(0.50), p99 = percentileMs(0.99), p999 = percentileMs(0.999);
+    std::lock_guard<std::mutex> lock(mutex_);
+    sortLocked();
+    size_t n = latencyUs_.size();
+    if (n == 0) {
+      printf("%-10s no requests\n", name_);
+      return;
+    }
+    // Busiest second
+    std::vector<uint32_t> perSecond((size_t)wallSec + 2, 0);
+    for (double s : doneSec_) perSecond[std::min(perSecond.size() - 1, (size_t)s)]++;
+    uint32_t peak = *std::max_element(perSecond.begin(), perSecond.end());
+    printf("%-10s n=%zu 2xx=%u 4xx=%u 5xx=%u transport=%u; %.1f req/s (peak %u/s); "
+           "p50=%.1fms p99=%.1fms p99.9=%.1fms max=%.1fms\n",
+           name_, n, ok_, client_, server_, transport_, n / wallSec, peak, p50, p99, p999, sorted_.back() / 1000.0);
+    if (d1Reported_) {
+      printf("%-10s D1 round trips per request mean=%.2f max=%u, statements per request %.2f (%u of %zu reported)\n", "",
+             (double)d1RoundTrips_ / d1Reported_, d1MaxRoundTrips_, (double)d1Statements_ / d1Reported_, d1Reported_, n);
+    }
+  }
+
+ private:
+  void sortLocked() {
+    if (sorted_.size() == latencyUs_.size()) return;
+    sorted_ = latencyUs_;
+    std::sort(sorted_.begin(), sorted_.end());
+  }
+
+  const char* name_;
+  std::mutex mutex_;
+  std::vector<uint32_t> latencyUs_;
+  std::vector<uint32_t> sorted_;
+  std::vector<double> doneSec_;
+  uint32_t ok_ = 0, client_ = 0, server_ = 0, transport_ = 0;
+  uint32_t d1Reported_ = 0, d1MaxRoundTrips_ = 0;
+  uint64_t d1RoundTrips_ = 0, d1Statements_ = 0;
+};
+
+// What became of each planned event
+struct Outcomes {
+  std::mutex mutex;
+  uint32_t byStatus[WIRE_RETRY + 1] = {0};  // WIRE_RETRY: given up after DETECT_MAX_ATTEMPTS
+  uint32_t rosterNotFound = 0;  // not_found for a badge that should be on file (roster not seeded)
+  uint32_t retries = 0;
+  std::vector<uint32_t> settleMs;  // due -> settled (queueing behind the scanner's own uploads included)
+};
+
+static const char* RESPONSE_HEADERS[] = {"X-D1-Round-Trips", "X-D1-Statements"};
+
+// ----------------------- Virtual scanners -----------------------
+struct VirtualScanner {
+  uint32_t index;
+  uint8_t mac[WIRE_DEVICE_ID_LEN];
+  char deviceId[18];
+  uint32_t seq = 0;
+  ServerConnection server;
+
+  void setUp(uint32_t i, uint16_t runId, const char* baseUrl) {
+    index = i;
+    uint8_t m[WIRE_DEVICE_ID_LEN] = {0x02, 0x4C, (uint8_t)(runId >> 8), (uint8_t)runId, (uint8_t)(i >> 8), (uint8_t)i};
+    memcpy(mac, m, sizeof(mac));
+    snprintf(deviceId, sizeof(deviceId), "%02X:%02X:%02X:%02X:%02X:%02X", m[0], m[1], m[2], m[3], m[4], m[5]);
+    server.configure(baseUrl);
+    server.http().collectHeaders(RESPONSE_HEADERS, 2);
+  }
+};
+
+static uint64_t epochMsNow() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// One scanner's day: wait for each event to come due, then deliver it (and any others due
+// by then, up to --batch) with the scanner's retry policy
+static void runScannerDay(VirtualScanner &vs, const std::vector<PlannedEvent> &events, const LoadOptions &o,
+                          Clock::time_point start, EndpointStats &stats, Outcomes &outcomes) {
+  bool frames = o.batch > 1 || o.sessions;
+  ServerConnection::Endpoint target = vs.server.endpoint(
+      o.sessions ? "/api/esp32/sessions" : o.batch > 1 ? "/api/esp32/detect/batch" : "/api/esp32/detect");
+  double scale = o.daySeconds / DAY_SECONDS;
+  std::vector<DetectionEvent> pending;
+  std::vector<double> dueSec;
+  std::vector<bool> unknown;
+  size_t next = 0;
+  while (next < events.size()) {
+    std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(
+                                              std::chrono::duration<double>(events[next].atSec)));
+    pending.clear();
+    dueSec.clear();
+    unknown.clear();
+    double now = secondsSince(start);
+    while (next < events.size() && pending.size() < o.batch && (pending.empty() || events[next].atSec <= now)) {
+      const PlannedEvent &p = events[next++];
+      DetectionEvent ev;
+      // A break is stamped when the badge left, that many real seconds ago
+      uint32_t awayMs = (uint32_t)(p.awayDaySec * scale * 1000);
+      ev.set(p.hex.data(), p.hex.size(), p.action, millis() - awayMs);
+      ev.seq = ++vs.seq;
+      ev.observedMs = epochMsNow() - awayMs;
+      ev.durationSec = (uint32_t)p.awayDaySec;
+      pending.push_back(ev);
+      dueSec.push_back(p.atSec);
+      unknown.push_back(p.unknown);
+    }
+
+    std::vector<uint8_t> statuses(pending.size(), WIRE_RETRY);
+    std::vector<size_t> open(pending.size());
+    for (size_t j = 0; j < open.size(); j++) open[j] = j;
+    for (int attempt = 0; attempt < DETECT_MAX_ATTEMPTS && !open.empty(); attempt++) {
+      if (attempt > 0) {
+        std::lock_guard<std::mutex> lock(outcomes.mutex);
+        outcomes.retries++;
+      }
+      if (attempt > 0) delay(detectRetryBackoffMs(attempt));
+      uint8_t got[64];
+      Clock::time_point sent = Clock::now();
+      int code;
+      if (frames) {
+        uint8_t frame[WIRE_FRAME_HEADER_LEN + 64 * WIRE_RECORD_MAX];
+        size_t len = encodeWireFrame(frame, sizeof(frame), pending.data(), open.data(), open.size(), vs.mac, millis());
+        code = sendWireFrame(vs.server, target, frame, len, got, open.size());
+      } else {
+        code = sendDetection(vs.server, target, pending[0], !o.json, vs.mac, vs.deviceId, got[0]);
+      }
+      uint32_t latencyUs = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - sent).count();
+      stats.record(code, latencyUs, secondsSince(start), vs.server.http().header(RESPONSE_HEADERS[0]),
+                   vs.server.http().header(RESPONSE_HEADERS[1]));
+      vs.server.finish();
+
+      std::vector<size_t> still;
+      for (size_t j = 0; j < open.size(); j++) {
+        statuses[open[j]] = got[j];
+        if (got[j] == WIRE_RETRY) still.push_back(open[j]);
+      }
+      open.swap(still);
+    }
+
+    double settled = secondsSince(start);
+    std::lock_guard<std::mutex> lock(outcomes.mutex);
+    for (size_t j = 0; j < pending.size(); j++) {
+      outcomes.byStatus[statuses[j]]++;
+      if (statuses[j] == WIRE_NOT_FOUND && !unknown[j]) outcomes.rosterNotFound++;
+      outcomes.settleMs.push_back((uint32_t)((settled - dueSec[j]) * 1000));
+    }
+  }
+}
+
+// Value of a string field in a small JSON object (as Scanner.cpp's manifestField)
+static String jsonStringField(const String &json, const char* name) {
+  String quoted = String("\"") + name + "\"";
+  int idx = json.indexOf(quoted.c_str());
+  int colon = idx < 0 ? -1 : json.indexOf(':', idx + quoted.length());
+  int open = colon < 0 ? -1 : json.indexOf('"', colon + 1);
+  int close = open < 0 ? -1 : json.indexOf('"', open + 1);
+  return close < 0 ? String() : json.substring(open + 1, close);
+}
+
+struct OtaTotals {
+  std::mutex mutex;
+  uint64_t bytes = 0;
+  uint32_t complete = 0;
+  uint32_t failed = 0;
+  std::vector<uint32_t> firstByteUs;
+};
+
+// One scanner noticing the rollout: manifest, then the whole image in OTA_READ_BYTES reads
+static void runScannerOta(VirtualScanner &vs, double atSec, Clock::time_point start, EndpointStats &manifestStats,
+                          EndpointStats &downloadStats, OtaTotals &totals) {
+  std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(atSec)));
+  Clock::time_point sent = Clock::now();
+  int code = vs.server.send("GET", vs.server.endpoint("/api/ota/manifest"));
+  String manifest = code == 200 ? vs.server.http().getString() : String();
+  manifestStats.record(code, (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - sent).count(),
+                       secondsSince(start), vs.server.http().header(RESPONSE_HEADERS[0]),
+                       vs.server.http().header(RESPONSE_HEADERS[1]));
+  vs.server.finish();
+  String key = jsonStringField(manifest, "key");
+  if (code != 200 || key.length() == 0) {
+    std::lock_guard<std::mutex> lock(totals.mutex);
+    totals.failed++;
+    return;
+  }
+
+  String path = String("/api/ota/download?key=") + key;
+  sent = Clock::now();
+  code = vs.server.send("GET", vs.server.endpoint(path.c_str()));
+  uint32_t firstByteUs = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - sent).count();
+  int size = vs.server.http().getSize();
+  uint64_t got = 0;
+  if (code == 200 && size > 0) {
+    static thread_local uint8_t buf[OTA_READ_BYTES];
+    WiFiClient* stream = vs.server.http().getStreamPtr();
+    while (got < (uint64_t)size) {
+      size_t n = stream->readBytes(buf, std::min<uint64_t>(sizeof(buf), (uint64_t)size - got));
+      if (n == 0) break;
+      got += n;
+    }
+  }
+  bool complete = code == 200 && size > 0 && got == (uint64_t)size;
+  downloadStats.record(complete ? code : (code == 200 ? HTTPC_ERROR_CONNECTION_LOST : code),
+                       (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - sent).count(),
+                       secondsSince(start), vs.server.http().header(RESPONSE_HEADERS[0]),
+                       vs.server.http().header(RESPONSE_HEADERS[1]));
+  if (!complete) vs.server.reset();  // unread image bytes would poison the keep-alive socket
+  vs.server.finish();
+  std::lock_guard<std::mutex> lock(totals.mutex);
+  totals.bytes += got;
+  totals.firstByteUs.push_back(firstByteUs);
+  if (complete) totals.complete++;
+  else totals.failed++;
+}
+
+static uint32_t percentileOf(std::vector<uint32_t> v, double q) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  size_t i = (size_t)std::ceil(q * v.size());
+  return v[std::min(v.size() - 1, i ? i - 1 : 0)];
+}
+
+// ----------------------- Scenarios -----------------------
+static std::string runDay(std::vector<VirtualScanner> &fleet, const LoadOptions &o) {
+  uint32_t movements = 0, unknownSightings = 0;
+  std::vector<std::vector<PlannedEvent>> plan = planDay(o, movements, unknownSightings);
+  size_t planned = 0;
+  std::vector<uint32_t> perSecond((size_t)o.daySeconds + 2, 0);
+  for (const std::vector<PlannedEvent> &events : plan) {
+    planned += events.size();
+    for (const PlannedEvent &p : events) perSecond[std::min(perSecond.size() - 1, (size_t)p.atSec)]++;
+  }
+  printf("\n== Fleet load: day, %u scanners at %u site%s, %u badges, %s%s, %u event%s/request, %.0f s day ==\n",
+         (unsigned)o.scanners, (unsigned)o.sites, o.sites == 1 ? "" : "s", (unsigned)o.badges, o.json ? "JSON" : "binary",
+         o.sessions ? " sessions" : "", (unsigned)o.batch, o.batch == 1 ? "" : "s", o.daySeconds);
+  printf("Plan:      %u movements + %u unknown sightings, each seen by %u scanners: %zu events, peak %u/s due\n",
+         (unsigned)movements, (unsigned)unknownSightings, (unsigned)o.overlap, planned,
+         *std::max_element(perSecond.begin(), perSecond.end()));
+  fflush(stdout);
+
+  EndpointStats stats(o.sessions ? "sessions:" : o.batch > 1 ? "batch:" : "detect:");
+  Outcomes outcomes;
+  Clock::time_point start = Clock::now() + std::chrono::milliseconds(500);
+  std::vector<std::thread> threads;
+  for (uint32_t i = 0; i < o.scanners; i++) {
+    threads.emplace_back([&, i] { runScannerDay(fleet[i], plan[i], o, start, stats, outcomes); });
+  }
+  for (std::thread &t : threads) t.join();
+  double wallSec = secondsSince(start);
+
+  stats.print(wallSec);
+  uint32_t* s = outcomes.byStatus;
+  uint32_t settled = s[WIRE_RECORDED] + s[WIRE_DEDUPED] + s[WIRE_DUPLICATE] + s[WIRE_NOT_FOUND] + s[WIRE_INVALID];
+  double dedupeRate = settled ? 100.0 * (s[WIRE_DEDUPED] + s[WIRE_DUPLICATE]) / settled : 0;
+  printf("Outcomes:  recorded=%u deduped=%u duplicate=%u not_found=%u invalid=%u gave_up=%u retries=%u; "
+         "%.1f%% of answers turned a copy away\n",
+         s[WIRE_RECORDED], s[WIRE_DEDUPED], s[WIRE_DUPLICATE], s[WIRE_NOT_FOUND], s[WIRE_INVALID], s[WIRE_RETRY],
+         outcomes.retries, dedupeRate);
+  if (outcomes.rosterNotFound) {
+    printf("Roster:    %u answers not_found for badges on the roster; seed the database (--seed-sql)\n",
+           outcomes.rosterNotFound);
+  }
+  printf("Delivery:  due -> settled p50=%ums p99=%ums max=%ums\n", percentileOf(outcomes.settleMs, 0.50),
+         percentileOf(outcomes.settleMs, 0.99), percentileOf(outcomes.settleMs, 1.0));
+  size_t events = outcomes.settleMs.size();
+  double tripsPerEvent = stats.d1Reported() && events ? (double)stats.d1RoundTrips() / events : -1;
+  if (tripsPerEvent >= 0) {
+    printf("D1:        %.2f round trips per event\n", tripsPerEvent);
+  } else {
+    printf("D1:        not reported (start the Worker with D1_QUERY_STATS=1)\n");
+  }
+
+  char result[512];
+  snprintf(result, sizeof(result),
+           " endpoint=%s day_requests=%zu day_rps=%.1f detect_p50_ms=%.1f detect_p99_ms=%.1f detect_p999_ms=%.1f errors=%u "
+           "recorded=%u dedupe_pct=%.1f gave_up=%u d1_rt_per_event=%.2f",
+           o.sessions ? "sessions" : o.batch > 1 ? "batch" : "detect", stats.requests(), stats.requests() / wallSec,
+           stats.percentileMs(0.50), stats.percentileMs(0.99),
+           stats.percentileMs(0.999), stats.errors(), s[WIRE_RECORDED], dedupeRate, s[WIRE_RETRY], tripsPerEvent);
+  return result;
+}
+
+static std::string runOta(std::vector<VirtualScanner> &fleet, const LoadOptions &o) {
+  printf("\n== Fleet load: OTA rollout, %u scanners within %.0f s ==\n", (unsigned)o.scanners, o.otaSpreadSec);
+  fflush(stdout);
+  EndpointStats manifestStats("manifest:");
+  EndpointStats downloadStats("download:");
+  OtaTotals totals;
+  std::mt19937 rng(o.seed + 1);
+  std::uniform_real_distribution<double> spread(0.0, o.otaSpreadSec);
+  Clock::time_point start = Clock::now() + std::chrono::milliseconds(500);
+  std::vector<std::thread> threads;
+  for (uint32_t i = 0; i < o.scanners; i++) {
+    double at = spread(rng);
+    threads.emplace_back([&, i, at] { runScannerOta(fleet[i], at, start, manifestStats, downloadStats, totals); });
+  }
+  for (std::thread &t : threads) t.join();
+  double wallSec = secondsSince(start);
+
+  manifestStats.print(wallSec);
+  downloadStats.print(wallSec);
+  printf("Images:    %u complete, %u failed; %.1f MB served at %.1f MB/s; first byte p50=%.1fms p99=%.1fms\n",
+         totals.complete, totals.failed, totals.bytes / 1e6, totals.bytes / 1e6 / wallSec,
+         percentileOf(totals.firstByteUs, 0.50) / 1000.0, percentileOf(totals.firstByteUs, 0.99) / 1000.0);
+
+  char result[320];
+  snprintf(result, sizeof(result),
+           " ota_complete=%u ota_failed=%u manifest_p99_ms=%.1f download_p50_ms=%.1f download_p99_ms=%.1f "
+           "ota_mb_per_s=%.1f",
+           totals.complete, totals.failed, manifestStats.percentileMs(0.99), downloadStats.percentileMs(0.50),
+           downloadStats.percentileMs(0.99), totals.bytes / 1e6 / wallSec);
+  return result;
+}
+
+int main(int argc, char** argv) {
+  LoadOptions opts;
+  if (!parseArgs(argc, argv, opts)) {
+    usage();
+    return 2;
+  }
+  if (opts.seedSqlPath) {
+    if (!writeSeedSql(opts)) {
+      fprintf(stderr, "cannot write %s\n", opts.seedSqlPath);
+      return 1;
+    }
+    printf("Wrote %u employees to %s\n", (unsigned)opts.badges, opts.seedSqlPath);
+    return 0;
+  }
+
+  // Real time throughout; the stand-in WiFi is simply up
+  hostsim::associated() = true;
+  hostsim::ServerAddress &target = hostsim::serverAddress();
+  MockWorker* worker = nullptr;
+  if (opts.mock) {
+    MockWorker::Options mockOptions;
+    mockOptions.roster = opts.badges;
+    mockOptions.otaImageBytes = opts.mockOtaBytes;
+    worker = new MockWorker();
+    if (!worker->start(mockOptions)) {
+      fprintf(stderr, "mock Worker failed to start\n");
+      return 1;
+    }
+    target.port = worker->port();
+  } else {
+    unsigned port = 0;
+    if (sscanf(opts.workerAddr, "%63[^:]:%u", target.host, &port) != 2) {
+      usage();
+      return 2;
+    }
+    target.port = (uint16_t)port;
+  }
+  char baseUrl[96];
+  snprintf(baseUrl, sizeof(baseUrl), "http://%s:%u", target.host, (unsigned)target.port);
+  printf("Loading %s with %u virtual scanners\n", opts.mock ? "the mock Worker" : baseUrl, (unsigned)opts.scanners);
+
+  // A fresh run id keeps (device, seq) pairs from colliding with earlier runs on the same database
+  uint16_t runId = (uint16_t)(epochMsNow() / 1000);
+  std::vector<VirtualScanner> fleet(opts.scanners);
+  for (uint32_t i = 0; i < opts.scanners; i++) fleet[i].setUp(i, runId, baseUrl);
+
+  std::string scenario = opts.scenario;
+  std::string result = "RESULT scenario=" + scenario + " scanners=" + std::to_string(opts.scanners);
+  if (scenario != "ota") result += runDay(fleet, opts);
+  if (scenario != "day") result += runOta(fleet, opts);
+
+  uint32_t connects = 0, requests = 0;
+  for (VirtualScanner &vs : fleet) {
+    connects += vs.server.connectHistogram().samples();
+    requests += vs.server.requestHistogram().samples();
+  }
+  printf("\nSockets:   %u connects for %u requests (keep-alive, as on the scanner)\n", connects, requests);
+  if (worker) {
+    MockWorker::Stats s = worker->stats();
+    printf("Mock:      %u requests, %u events recorded, %u resends deduped, %u not_found, %u manifests, %u downloads\n",
+           s.requests, s.events, s.duplicates, s.notFound, s.otaManifests, s.otaDownloads);
+  }
+  printf("%s\n", result.c_str());
+  return 0;
+}
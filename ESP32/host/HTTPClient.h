@@ -0,0 +1,161 @@
+// Host stand-in for the Arduino HTTPClient: HTTP/1.1 over the caller's WiFiClient with
+// keep-alive, Content-Length bodies and collected response headers, which is all
+// ServerConnection and the OTA code use.
+#pragma once
+#include <Arduino.h>
+#include <WiFi.h>
+#include <strings.h>
+#include <vector>
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_NO_STREAM (-6)
+#define HTTPC_ERROR_NO_HTTP_SERVER (-7)
+#define HTTPC_ERROR_TOO_LESS_RAM (-8)
+#define HTTPC_ERROR_ENCODING (-9)
+#define HTTPC_ERROR_STREAM_WRITE (-10)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+class HTTPClient {
+ public:
+  void setReuse(bool reuse) { reuse_ = reuse; }
+  void setTimeout(uint32_t ms) { timeoutMs_ = ms; }
+
+  bool begin(WiFiClient &client, const String &url) {
+    client_ = &client;
+    requestHeaders_.clear();
+    size_ = -1;
+    const char* p = url.c_str();
+    if (strncmp(p, "http://", 7) != 0) return false;
+    p += 7;
+    const char* hostEnd = p;
+    while (*hostEnd && *hostEnd != ':' && *hostEnd != '/') hostEnd++;
+    host_.assign(p, hostEnd);
+    port_ = *hostEnd == ':' ? (uint16_t)atoi(hostEnd + 1) : 80;
+    const char* path = strchr(hostEnd, '/');
+    path_ = path ? path : "/";
+    return true;
+  }
+
+  void addHeader(const String &name, const String &value) {
+    requestHeaders_ += std::string(name.c_str()) + ": " + value.c_str() + "\r\n";
+  }
+
+  void collectHeaders(const char* keys[], size_t count) {
+    collected_.assign(count, Header());
+    for (size_t i = 0; i < count; i++) collected_[i].name = keys[i];
+  }
+
+  String header(const char* name) {
+    for (const Header &h : collected_) {
+      if (strcasecmp(h.name.c_str(), name) == 0) return String(h.value);
+    }
+    return String();
+  }
+
+  int sendRequest(const char* method, uint8_t* payload = nullptr, size_t size = 0) {
+    if (!client_) return HTTPC_ERROR_NOT_CONNECTED;
+    if (!client_->connected() && !client_->connect(host_.c_str(), port_, (int32_t)timeoutMs_)) {
+      return HTTPC_ERROR_CONNECTION_REFUSED;
+    }
+    client_->setTimeout(timeoutMs_);
+
+    std::string head = std::string(method) + " " + path_ + " HTTP/1.1\r\nHost: " + host_ +
+                       "\r\nUser-Agent: ESP32HTTPClient\r\nConnection: " + (reuse_ ? "keep-alive" : "close") +
+                       "\r\nContent-Length: " + std::to_string(size) + "\r\n" + requestHeaders_ + "\r\n";
+    if (client_->write((const uint8_t*)head.data(), head.size()) != head.size()) return HTTPC_ERROR_SEND_HEADER_FAILED;
+    if (size > 0 && client_->write(payload, size) != size) return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+    return readResponseHead();
+  }
+
+  int getSize() { return size_; }
+  WiFiClient* getStreamPtr() { return client_; }
+  WiFiClient &getStream() { return *client_; }
+  bool connected() { return client_ && client_->connected(); }
+
+  String getString() {
+    if (!client_ || size_ == 0) return String();
+    std::string body;
+    if (size_ > 0) {
+      body.resize((size_t)size_);
+      body.resize(client_->readBytes((uint8_t*)&body[0], (size_t)size_));
+    } else {
+      uint8_t buf[512];
+      size_t n;
+      while ((n = client_->readBytes(buf, sizeof(buf))) > 0) body.append((const char*)buf, n);
+    }
+    return String(body);
+  }
+
+  // Like the real client: unread body bytes are discarded, and the socket is kept only when
+  // both sides agreed on keep-alive
+  void end() {
+    if (!client_) return;
+    uint8_t sink[512];
+    while (client_->available() > 0 && client_->read(sink, sizeof(sink)) > 0) {
+    }
+    if (!reuse_ || !canReuse_) client_->stop();
+  }
+
+ private:
+  struct Header {
+    std::string name;
+    std::string value;
+  };
+
+  // Status line and headers; the body is left in the socket for getString()/getStreamPtr()
+  int readResponseHead() {
+    std::string head;
+    uint8_t c;
+    uint64_t deadline = hostsim::nowUs() + timeoutMs_ * 1000ULL;
+    while (head.size() < 4 || head.compare(head.size() - 4, 4, "\r\n\r\n") != 0) {
+      if (client_->readBytes(&c, 1) == 1) {
+        head += (char)c;
+        if (head.size() > 16384) return HTTPC_ERROR_NO_HTTP_SERVER;
+        continue;
+      }
+      if (!client_->connected()) return HTTPC_ERROR_CONNECTION_LOST;
+      if (hostsim::nowUs() >= deadline) return HTTPC_ERROR_READ_TIMEOUT;
+    }
+
+    if (head.compare(0, 5, "HTTP/") != 0) return HTTPC_ERROR_NO_HTTP_SERVER;
+    size_t space = head.find(' ');
+    int code = space == std::string::npos ? 0 : atoi(head.c_str() + space + 1);
+    if (code <= 0) return HTTPC_ERROR_NO_HTTP_SERVER;
+
+    size_ = -1;
+    canReuse_ = true;
+    for (Header &h : collected_) h.value.clear();
+    size_t line = head.find("\r\n") + 2;
+    while (line < head.size()) {
+      size_t end = head.find("\r\n", line);
+      size_t colon = head.find(':', line);
+      if (end == line || colon == std::string::npos || colon > end) break;
+      std::string name = head.substr(line, colon - line);
+      size_t valueStart = colon + 1;
+      while (valueStart < end && head[valueStart] == ' ') valueStart++;
+      std::string value = head.substr(valueStart, end - valueStart);
+      if (strcasecmp(name.c_str(), "Content-Length") == 0) size_ = atoi(value.c_str());
+      if (strcasecmp(name.c_str(), "Connection") == 0 && strcasecmp(value.c_str(), "close") == 0) canReuse_ = false;
+      for (Header &h : collected_) {
+        if (strcasecmp(h.name.c_str(), name.c_str()) == 0) h.value = value;
+      }
+      line = end + 2;
+    }
+    return code;
+  }
+
+  WiFiClient* client_ = nullptr;
+  std::string host_;
+  std::string path_;
+  uint16_t port_ = 80;
+  std::string requestHeaders_;
+  std::vector<Header> collected_;
+  int size_ = -1;
+  bool reuse_ = false;
+  bool canReuse_ = true;
+  uint32_t timeoutMs_ = 5000;
+};
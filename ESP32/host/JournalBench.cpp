@@ -0,0 +1,318 @@
+// JournalBench: crash recovery checks and throughput for EventJournal.h on a Linux file
+// system (the same stdio code runs on LittleFS on the board). Each check writes a journal,
+// damages it the way a power cut or a flash fault would, reopens it and compares what
+// open() recovered (nextSeq, ackedSeq) and what replay reads back with the events that
+// should have survived:
+//   - a record cut off mid-write at the end of the head segment (partial record);
+//   - the last record truncated;
+//   - a flipped bit in the middle of a segment (bad CRC): only that record is lost;
+//   - a whole segment gone: replay skips it instead of stalling;
+//   - ack.bin torn, older than the journal, or newer than the journal.
+// Then it reports appends/s (each one fsync'ed, as on the device) and replay events/s
+// (batches of DETECT_BATCH_MAX, acknowledged after each, as replayJournal() does).
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -Wall -Wextra -IESP32/host ESP32/host/JournalBench.cpp -o journal-bench
+//   ./journal-bench [DIR]    # scratch journals go under DIR (default /tmp); exits non-zero on a failed check
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "../EventJournal.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static const size_t REPLAY_BATCH = 16;  // Scanner.cpp's DETECT_BATCH_MAX
+
+static const char* scratchRoot = "/tmp";
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+  printf("  %-4s %s\n", ok ? "ok" : "FAIL", what);
+  if (!ok) failures++;
+}
+
+// Event i of a run; eventSeq i + 1000 tells replayed events apart from journal numbers
+static DetectionEvent makeEvent(uint32_t i) {
+  char hex[9];
+  snprintf(hex, sizeof(hex), "%08X", 0xB0000000 + i);
+  DetectionEvent ev;
+  ev.set(hex, 8, i % 2 ? EVENT_CHECKOUT : EVENT_CHECKIN, i * 1000);
+  ev.seq = 1000 + i;
+  ev.tenant = (uint16_t)(i % 3);
+  ev.observedMs = 1760000000000ULL + i;
+  ev.durationSec = i % 5;
+  return ev;
+}
+
+static std::string freshDir() {
+  std::string tmpl = std::string(scratchRoot) + "/journal-bench-XXXXXX";
+  std::vector<char> buf(tmpl.begin(), tmpl.end());
+  buf.push_back('\0');
+  if (!mkdtemp(buf.data())) {
+    perror("mkdtemp");
+    exit(1);
+  }
+  return std::string(buf.data()) + "/journal";
+}
+
+static void removeDir(const std::string &dir) {
+  std::string cmd = "rm -rf '" + dir.substr(0, dir.rfind('/')) + "'";
+  if (system(cmd.c_str()) != 0) fprintf(stderr, "could not remove %s\n", dir.c_str());
+}
+
+static std::string segPath(const std::string &dir, size_t seg) { return dir + "/seg" + std::to_string(seg) + ".bin"; }
+
+static void appendRange(EventJournal &j, uint32_t from, uint32_t to) {
+  for (uint32_t i = from; i <= to; i++) {
+    if (!j.append(makeEvent(i))) {
+      printf("append %u failed\n", i);
+      exit(1);
+    }
+  }
+}
+
+// Replay everything pending the way replayJournal() does; returns the events' indexes
+static std::vector<uint32_t> drain(EventJournal &j) {
+  std::vector<uint32_t> got;
+  DetectionEvent batch[REPLAY_BATCH];
+  for (;;) {
+    uint32_t lastSeq;
+    size_t n = j.peek(batch, REPLAY_BATCH, lastSeq);
+    for (size_t k = 0; k < n; k++) {
+      uint32_t i = batch[k].seq - 1000;
+      DetectionEvent want = makeEvent(i);
+      bool same = strcmp(batch[k].hex, want.hex) == 0 && batch[k].action == want.action &&
+                  batch[k].tenant == want.tenant && batch[k].observedMs == want.observedMs &&
+                  batch[k].durationSec == want.durationSec;
+      got.push_back(same ? i : 0);
+    }
+    if (lastSeq == j.ackedSeq()) break;  // nothing left to read or skip
+    j.ackThrough(lastSeq);
+  }
+  return got;
+}
+
+static std::vector<uint32_t> range(uint32_t from, uint32_t to, std::vector<uint32_t> skip = {}) {
+  std::vector<uint32_t> out;
+  for (uint32_t i = from; i <= to; i++) {
+    bool skipped = false;
+    for (uint32_t s : skip) skipped = skipped || s == i;
+    if (!skipped) out.push_back(i);
+  }
+  return out;
+}
+
+static void truncateFile(const std::string &path, long size) {
+  if (truncate(path.c_str(), size) != 0) perror(path.c_str());
+}
+
+static void appendBytes(const std::string &path, const void* data, size_t len) {
+  FILE* f = fopen(path.c_str(), "ab");
+  if (!f) return;
+  fwrite(data, 1, len, f);
+  fclose(f);
+}
+
+// Flip one bit in record pos of a segment file
+static void flipBit(const std::string &path, size_t pos) {
+  FILE* f = fopen(path.c_str(), "r+b");
+  if (!f) return;
+  long at = (long)(pos * sizeof(JournalRecord) + offsetof(JournalRecord, hex) + 2);
+  fseek(f, at, SEEK_SET);
+  int c = fgetc(f);
+  fseek(f, at, SEEK_SET);
+  fputc(c ^ 0x10, f);
+  fclose(f);
+}
+
+static std::string readFile(const std::string &path) {
+  std::string out;
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) return out;
+  char buf[64];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.append(buf, n);
+  fclose(f);
+  return out;
+}
+
+static void writeFile(const std::string &path, const std::string &data) {
+  FILE* f = fopen(path.c_str(), "wb");
+  if (!f) return;
+  fwrite(data.data(), 1, data.size(), f);
+  fclose(f);
+}
+
+// ----------------------- Recovery checks -----------------------
+static void checkCleanReopen() {
+  printf("Clean reopen (300 events over 3 segments, 100 acknowledged)\n");
+  std::string dir = freshDir();
+  {
+    EventJournal j;
+    j.open(dir.c_str());
+    appendRange(j, 1, 300);
+    j.ackThrough(100);
+  }
+  EventJournal j;
+  check(j.open(dir.c_str()) && j.nextSeq() == 301 && j.ackedSeq() == 100 && j.pending() == 200,
+        "open() recovers nextSeq 301 and ackedSeq 100");
+  check(drain(j) == range(101, 300), "replay returns events 101-300 intact and in order");
+  removeDir(dir);
+}
+
+static void checkPartialRecord() {
+  printf("Partial record at the tail (power cut 40 bytes into record 201)\n");
+  std::string dir = freshDir();
+  {
+    EventJournal j;
+    j.open(dir.c_str());
+    appendRange(j, 1, 200);
+  }
+  JournalRecord torn;
+  memset(&torn, 0xA5, sizeof(torn));
+  torn.seq = 201;
+  appendBytes(segPath(dir, 1), &torn, 40);
+  EventJournal j;
+  check(j.open(dir.c_str()) && j.nextSeq() == 201 && j.ackedSeq() == 0, "open() recovers nextSeq 201");
+  check(drain(j) == range(1, 200), "replay returns events 1-200");
+  appendRange(j, 201, 201);
+  j.close();
+  check(j.open(dir.c_str()) && j.nextSeq() == 202 && drain(j) == range(201, 201),
+        "the next append overwrites the partial record and survives a reopen");
+  removeDir(dir);
+}
+
+static void checkTruncatedRecord() {
+  printf("Last record truncated (record 200 cut to 50 of 96 bytes)\n");
+  std::string dir = freshDir();
+  {
+    EventJournal j;
+    j.open(dir.c_str());
+    appendRange(j, 1, 200);
+  }
+  truncateFile(segPath(dir, 1), 71 * (long)sizeof(JournalRecord) + 50);
+  EventJournal j;
+  check(j.open(dir.c_str()) && j.nextSeq() == 200, "open() recovers nextSeq 200");
+  check(drain(j) == range(1, 199), "replay returns events 1-199");
+  removeDir(dir);
+}
+
+static void checkBadCrc() {
+  printf("Bad CRC mid-segment (records 40 and 267 have a flipped bit)\n");
+  std::string dir = freshDir();
+  {
+    EventJournal j;
+    j.open(dir.c_str());
+    appendRange(j, 1, 300);
+  }
+  flipBit(segPath(dir, 0), 39);
+  flipBit(segPath(dir, 2), 10);
+  EventJournal j;
+  check(j.open(dir.c_str()) && j.nextSeq() == 301 && j.pending() == 300, "open() keeps the records after each hole");
+  check(drain(j) == range(1, 300, {40, 267}), "replay returns every event but 40 and 267");
+  check(j.corrupt() == 2 && j.pending() == 0, "both holes are counted as corrupt and acknowledged");
+  appendRange(j, 301, 310);
+  j.close();
+  check(j.open(dir.c_str()) && j.nextSeq() == 311 && drain(j) == range(301, 310), "appends continue after the holes");
+  removeDir(dir);
+}
+
+static void checkLostSegment() {
+  printf("Segment lost (segment 1, events 129-256, deleted)\n");
+  std::string dir = freshDir();
+  {
+    EventJournal j;
+    j.open(dir.c_str());
+    appendRange(j, 1, 300);
+  }
+  remove(segPath(dir, 1).c_str());
+  EventJournal j;
+  check(j.open(dir.c_str()) && j.nextSeq() == 301, "open() recovers nextSeq 301");
+  check(drain(j) == range(1, 300, range(129, 256)), "replay skips the gap instead of stalling");
+  check(j.pending() == 0, "nothing is left pending");
+  removeDir(dir);
+}
+
+static void checkStaleAck() {
+  printf("ack.bin torn, older or newer than the journal (100 events, 60 acknowledged)\n");
+  std::string dir = freshDir();
+  std::string ackPath;
+  std::string olderAck;
+  {
+    EventJournal j;
+    j.open(dir.c_str());
+    appendRange(j, 1, 100);
+    ackPath = dir + "/ack.bin";
+    j.ackThrough(30);
+    olderAck = readFile(ackPath);
+    j.ackThrough(60);
+  }
+  std::string currentAck = readFile(ackPath);
+  EventJournal j;
+  check(j.open(dir.c_str()) && j.ackedSeq() == 60 && j.pending() == 40, "open() recovers ackedSeq 60");
+  j.close();
+
+  writeFile(ackPath, currentAck.substr(0, 4));
+  check(j.open(dir.c_str()) && j.ackedSeq() == 0 && drain(j) == range(1, 100),
+        "a torn ack.bin replays everything (the Worker drops what it has by seq)");
+  j.close();
+
+  writeFile(ackPath, olderAck);
+  check(j.open(dir.c_str()) && j.ackedSeq() == 30 && drain(j) == range(31, 100), "an older ack.bin replays from it");
+  j.close();
+
+  // ack.bin that outlived its journal (segments erased, ack kept) must not hide new events
+  for (size_t i = 0; i < JOURNAL_SEGMENTS; i++) remove(segPath(dir, i).c_str());
+  writeFile(ackPath, currentAck);
+  check(j.open(dir.c_str()) && j.nextSeq() == 1 && j.ackedSeq() == 0, "a newer ack.bin is clamped to the journal");
+  appendRange(j, 1, 5);
+  j.close();
+  check(j.open(dir.c_str()) && j.pending() == 5 && drain(j) == range(1, 5),
+        "new events after it are replayed, also after a reboot before the first replay");
+  removeDir(dir);
+}
+
+// ----------------------- Throughput -----------------------
+static void bench() {
+  const uint32_t n = (uint32_t)(JOURNAL_SEGMENTS * JOURNAL_SEGMENT_RECORDS);
+  std::string dir = freshDir();
+  EventJournal j;
+  j.open(dir.c_str());
+  Clock::time_point t0 = Clock::now();
+  appendRange(j, 1, n);
+  double appendSec = std::chrono::duration<double>(Clock::now() - t0).count();
+  j.close();
+
+  t0 = Clock::now();
+  j.open(dir.c_str());
+  double openMs = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+
+  t0 = Clock::now();
+  size_t replayed = drain(j).size();
+  double replaySec = std::chrono::duration<double>(Clock::now() - t0).count();
+
+  printf("Append:    %u events in %.2f s, %.0f events/s (fsync after each)\n", n, appendSec, n / appendSec);
+  printf("Open:      %.2f ms to recover %u records in %u segments\n", openMs, n, (unsigned)JOURNAL_SEGMENTS);
+  printf("Replay:    %zu events in %.3f s, %.0f events/s (batches of %zu, ack.bin written after each)\n", replayed,
+         replaySec, replayed / replaySec, REPLAY_BATCH);
+  printf("RESULT appends_per_s=%.0f open_ms=%.2f replay_per_s=%.0f checks_failed=%d\n", n / appendSec, openMs,
+         replayed / replaySec, failures);
+  removeDir(dir);
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1) scratchRoot = argv[1];
+  checkCleanReopen();
+  checkPartialRecord();
+  checkTruncatedRecord();
+  checkBadCrc();
+  checkLostSegment();
+  checkStaleAck();
+  printf("Checks: %s\n", failures ? "FAILED" : "passed");
+  bench();
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,621 @@
+// MockWorker: in-process stand-in for the AutoAttend Worker's ESP32 endpoints, so the host
+// simulator can post detections without wrangler or D1.
+// Serves /api/esp32/detect, /api/esp32/detect/batch and /api/esp32/sessions in both JSON and
+// the binary wire format (WireFormat.h), publishes the default break thresholds on
+// /api/esp32/session-config (Sessions.h) and takes /api/esp32/heartbeat (kept, not parsed).
+// With an OTA image size it also publishes a manifest (with the image's sha256) and serves a
+// made-up image of that many bytes from /api/ota/download, for FleetLoad.cpp's rollout storm
+// and ScannerSim's --ota runs; otherwise those and everything else are a 404. Downloads honour
+// "Range: bytes=N-" with a 206 unless told to ignore it, and can be paced, cut off mid-body or
+// served with a corrupted byte, to exercise the scanner's resume and verification paths.
+// Every recorded event stands for one attendance_records row.
+// With a roster, only its hex values are employees: other events are answered not_found
+// and /api/esp32/allowlist publishes the roster (Allowlist.h), honouring If-None-Match. Every event is
+// recorded; a repeated (device, sequence number) is answered as deduped, as the Worker does.
+// Each recorded event's device time is checked against hostsim::trueEpochMs() at the moment
+// the scanner saw it (esp_sntp.h), and its age gives the delay an arrival stamp would carry.
+// With tenants, /api/esp32/tenants publishes that many company UUIDs (Tenants.h): tenant 1
+// is the scanner's TARGET_UUID, the rest are made up (syntheticTenant) and never advertised.
+// Failures, lost acks (recorded, then the connection drops before the answer) and server
+// latency can be injected to exercise retries, the journal and dedupe.
+#pragma once
+#include <Arduino.h>
+#include <WiFi.h>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include "../WireFormat.h"
+#include "../Allowlist.h"
+#include "../Tenants.h"
+#include "../Sessions.h"
+#include "../Sha256.h"
+#include "esp_sntp.h"
+
+// UUID of made-up tenant i (i > 0): alternately a 32-bit value in the Bluetooth base UUID,
+// which all share their last 12 bytes, and a random 128-bit UUID. Tenant 0 is D7E1A3F4.
+static inline void syntheticTenant(uint32_t i, UuidPattern &out) {
+  if (i == 0) {
+    parseUuidPattern("D7E1A3F4", out);
+    return;
+  }
+  static const uint8_t base[12] = {0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0x80, 0x5F, 0x9B, 0x34, 0xFB};
+  uint32_t v = 0xC0DE0000u + i;
+  out.len = ADV_UUID_MAX_BYTES;
+  if (i % 2) {
+    for (int k = 0; k < 4; k++) out.forward[k] = (uint8_t)(v >> (24 - 8 * k));
+    memcpy(out.forward + 4, base, sizeof(base));
+  } else {
+    for (size_t k = 0; k < ADV_UUID_MAX_BYTES; k++) {
+      v ^= v << 13;
+      v ^= v >> 17;
+      v ^= v << 5;
+      out.forward[k] = (uint8_t)v;
+    }
+  }
+  finishUuidPattern(out);
+}
+
+class MockWorker {
+ public:
+  struct Options {
+    double failRate = 0;       // fraction of requests answered 503
+    double loseAcks = 0;       // fraction of accepted posts whose answer is lost
+    uint32_t latencyMs = 0;    // simulated time before each answer
+    uint32_t roster = 0;       // employees B0000000, B0000001, ...; 0: every hex value is one
+    bool allowlist = true;     // serve the roster's allowlist (false: 404, as an older Worker)
+    bool binary = true;        // take binary frames (false: 415, as a Worker predating WireFormat.h)
+    uint32_t tenants = 0;      // company UUIDs to publish; 0: 404, as an older Worker
+    uint32_t otaImageBytes = 0;  // firmware image to serve; 0: no OTA endpoints
+    bool otaRange = true;        // answer Range with 206 (false: 200 from byte 0, like a proxy that drops it)
+    uint32_t otaBytesPerSec = 0; // download pace in simulated time; 0: as fast as the socket takes it
+    uint32_t otaDrops = 0;       // downloads cut off (connection closed) ...
+    uint32_t otaDropAfter = 0;   // ... after this many body bytes
+    bool otaWrongImage = false;  // serve the image with one byte flipped (the manifest's sha256 no longer matches)
+  };
+
+  struct Stats {
+    uint32_t requests = 0;
+    uint32_t injectedFailures = 0;
+    uint32_t binaryRefused = 0;  // frames answered 415 (Options::binary off)
+    uint32_t events = 0;       // recorded (first delivery)
+    uint32_t checkins = 0;
+    uint32_t checkouts = 0;
+    uint32_t shortBreaks = 0;
+    uint32_t lunchBreaks = 0;
+    uint64_t breakSeconds = 0;  // sum of the scanner-measured break durations
+    uint32_t duplicates = 0;   // same (device, sequence number) delivered again
+    uint32_t lostAcks = 0;
+    uint32_t stamped = 0;      // recorded events carrying a device time
+    std::vector<int64_t> clockErrorMs;  // device time - true time of the sighting, per stamped event
+    std::vector<uint32_t> checkinAgeMs; // sighting -> arrival, per checkin (what an arrival stamp is off by)
+    uint64_t bodyBytes = 0;
+    uint32_t heartbeats = 0;
+    uint32_t notFound = 0;            // events for hex values outside the roster
+    uint32_t allowlistFetches = 0;
+    uint32_t allowlistNotModified = 0;
+    uint32_t tenantFetches = 0;
+    uint32_t sessionConfigFetches = 0;
+    uint32_t untagged = 0;            // recorded events with tenant 0 (no tenant list loaded)
+    uint32_t otaManifests = 0;
+    uint32_t otaDownloads = 0;
+    uint32_t otaRanged = 0;           // downloads answered 206 from a Range offset
+    uint32_t otaDropped = 0;          // downloads cut off mid-body
+    uint64_t otaBodyBytes = 0;        // image bytes sent, across all downloads
+  };
+
+  bool start(const Options &options) {
+    options_ = options;
+    buildAllowlist();
+    buildTenants();
+    buildOtaImage();
+    listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd_ < 0) return false;
+    int one = 1;
+    setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(listenFd_, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listenFd_, SOMAXCONN) != 0 ||
+        getsockname(listenFd_, (sockaddr*)&addr, &len) != 0) {
+      return false;
+    }
+    port_ = ntohs(addr.sin_port);
+    std::thread([this] { acceptLoop(); }).detach();
+    return true;
+  }
+
+  uint16_t port() const { return port_; }
+  const Options &options() const { return options_; }
+
+  // Whether hex belongs to an employee (every value does without --roster); fixed after start()
+  bool knows(const std::string &hex) const { return !options_.roster || roster_.count(hex) != 0; }
+
+  // The image /api/ota/download is meant to serve (what the manifest's sha256 is for)
+  const std::string &otaImage() const { return otaImage_; }
+
+  // Simulated time of the first POST answered 200 at or after fromMs (0: none)
+  uint32_t firstPostOkAfter(uint32_t fromMs) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (uint32_t ms : postOkMs_) {
+      if (ms >= fromMs) return ms;
+    }
+    return 0;
+  }
+
+  Stats stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+  std::string lastHeartbeat() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lastHeartbeat_;
+  }
+
+  // Simulated time (ms) each hex value was first checked in
+  std::map<std::string, uint32_t> firstCheckins() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return firstCheckin_;
+  }
+
+  // Where and when an event comes from
+  struct Stamp {
+    std::string device;
+    uint32_t seq = 0;
+    uint32_t ageMs = 0;
+    uint64_t observedMs = 0;
+  };
+
+  // One event of a request body, as the Worker reads it
+  struct Event {
+    std::string hex;
+    uint8_t action = EVENT_CHECKIN;
+    uint16_t tenant = 0;
+    uint32_t durationSec = 0;
+    Stamp stamp;
+  };
+
+  // The records of a binary frame (WireFormat.h) appended to events; false if malformed
+  static bool decodeWire(const std::string &frame, std::vector<Event> &events) {
+    const uint8_t* p = (const uint8_t*)frame.data();
+    size_t len = frame.size();
+    if (len < WIRE_FRAME_HEADER_LEN || p[0] != 'A' || p[1] != 'E' || p[2] != WIRE_VERSION) return false;
+    uint8_t count = p[3];
+    char device[18];
+    snprintf(device, sizeof(device), "%02X:%02X:%02X:%02X:%02X:%02X", p[4], p[5], p[6], p[7], p[8], p[9]);
+    size_t pos = WIRE_FRAME_HEADER_LEN;
+    for (uint8_t i = 0; i < count; i++) {
+      if (pos + WIRE_RECORD_HEADER_LEN > len) return false;
+      const uint8_t* r = p + pos;
+      uint8_t encoding = r[17], valueLen = r[24];
+      if (pos + WIRE_RECORD_HEADER_LEN + valueLen > len) return false;
+      events.emplace_back();
+      Event &ev = events.back();
+      ev.stamp.device = device;
+      ev.stamp.seq = le32(r);
+      ev.stamp.ageMs = le32(r + 4);
+      ev.stamp.observedMs = le32(r + 8) | (uint64_t)le32(r + 12) << 32;
+      ev.action = r[16];
+      ev.tenant = (uint16_t)(r[18] | (r[19] << 8));
+      ev.durationSec = le32(r + 20);
+      static const char* upper = "0123456789ABCDEF";
+      static const char* lower = "0123456789abcdef";
+      for (uint8_t k = 0; k < valueLen; k++) {
+        uint8_t b = r[WIRE_RECORD_HEADER_LEN + k];
+        if (encoding == WIRE_TEXT) {
+          ev.hex += (char)b;
+        } else {
+          const char* digits = encoding == WIRE_HEX_LOWER ? lower : upper;
+          ev.hex += digits[b >> 4];
+          ev.hex += digits[b & 0x0F];
+        }
+      }
+      pos += WIRE_RECORD_HEADER_LEN + valueLen;
+    }
+    return true;
+  }
+
+  // {"hex_value":"..","action":"..",...} or {"device_id":"..","events":[...]} appended to events;
+  // pairs are picked out in order. False if a value is cut off.
+  static bool decodeJson(const std::string &json, std::vector<Event> &events) {
+    std::string device;
+    size_t deviceAt = json.find("\"device_id\"");
+    if (deviceAt != std::string::npos) {
+      size_t open = json.find('"', json.find(':', deviceAt) + 1);
+      device = json.substr(open + 1, json.find('"', open + 1) - open - 1);
+    }
+    for (size_t at = json.find("\"hex_value\""); at != std::string::npos; at = json.find("\"hex_value\"", at + 1)) {
+      size_t open = json.find('"', json.find(':', at) + 1);
+      size_t close = json.find('"', open + 1);
+      size_t actionAt = json.find("\"action\"", at);
+      if (open == std::string::npos || close == std::string::npos) return false;
+      size_t next = json.find("\"hex_value\"", at + 1);
+      events.emplace_back();
+      Event &ev = events.back();
+      for (uint8_t a = EVENT_CHECKOUT; a <= EVENT_LUNCH_BREAK && actionAt < next; a++) {
+        std::string quoted = std::string("\"") + eventActionName(a) + "\"";
+        if (json.compare(json.find(':', actionAt) + 1, quoted.size(), quoted) == 0) ev.action = a;
+      }
+      ev.hex = json.substr(open + 1, close - open - 1);
+      ev.tenant = (uint16_t)jsonNumber(json, "\"tenant\"", at, next);
+      ev.durationSec = (uint32_t)jsonNumber(json, "\"duration_s\"", at, next);
+      ev.stamp.device = device;
+      ev.stamp.seq = (uint32_t)jsonNumber(json, "\"seq\"", at, next);
+      ev.stamp.ageMs = (uint32_t)jsonNumber(json, "\"age_ms\"", at, next);
+      ev.stamp.observedMs = jsonNumber(json, "\"observed_at_ms\"", at, next);
+    }
+    return true;
+  }
+
+ private:
+  struct Request {
+    std::string method;
+    std::string path;
+    std::string contentType;
+    std::string ifNoneMatch;
+    std::string range;
+    std::string body;
+  };
+
+  static std::string rosterHex(uint32_t i) {
+    char hex[9];
+    snprintf(hex, sizeof(hex), "%08X", (unsigned)(0xB0000000u + i));
+    return hex;
+  }
+
+  void buildAllowlist() {
+    std::set<uint32_t> keys;
+    for (uint32_t i = 0; i < options_.roster; i++) {
+      std::string hex = rosterHex(i);
+      roster_.insert(hex);
+      uint32_t key;
+      if (allowlistKey(hex.data(), hex.size(), key)) keys.insert(key);
+    }
+    uint32_t count = (uint32_t)keys.size();
+    allowlistBody_.assign({'A', 'L', (char)ALLOWLIST_VERSION, 0});
+    allowlistBody_.append((const char*)&count, 4);
+    for (uint32_t key : keys) allowlistBody_.append((const char*)&key, 4);
+    char etag[32];
+    snprintf(etag, sizeof(etag), "\"al-%u\"", (unsigned)count);
+    allowlistEtag_ = etag;
+  }
+
+  void buildTenants() {
+    uint32_t count = options_.tenants;
+    tenantsBody_.assign({'T', 'N', (char)TENANTS_VERSION, 0});
+    tenantsBody_.append((const char*)&count, 4);
+    for (uint32_t i = 0; i < count; i++) {
+      UuidPattern p;
+      syntheticTenant(i, p);
+      uint16_t id = (uint16_t)(i + 1);
+      tenantsBody_.append((const char*)&id, 2);
+      tenantsBody_ += (char)p.len;
+      tenantsBody_.append((const char*)p.forward, p.len);
+    }
+  }
+
+  void buildOtaImage() {
+    otaImage_.resize(options_.otaImageBytes);
+    for (uint32_t i = 0; i < options_.otaImageBytes; i++) otaImage_[i] = (char)(i * 31 + 7);
+    uint8_t digest[Sha256::DIGEST_LEN];
+    Sha256 sha;
+    sha.update((const uint8_t*)otaImage_.data(), otaImage_.size());
+    sha.finish(digest);
+    char hex[Sha256::DIGEST_LEN * 2 + 1];
+    Sha256::toHex(digest, hex);
+    otaSha256_ = hex;
+    otaServed_ = otaImage_;
+    if (options_.otaWrongImage && !otaServed_.empty()) otaServed_[otaServed_.size() / 2] ^= 0x01;
+  }
+
+  void acceptLoop() {
+    for (;;) {
+      int fd = accept(listenFd_, nullptr, nullptr);
+      if (fd < 0) continue;
+      int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      std::thread([this, fd] { serve(fd); }).detach();
+    }
+  }
+
+  // One keep-alive connection: requests until the scanner closes it
+  void serve(int fd) {
+    std::string buffered;
+    Request req;
+    while (readRequest(fd, buffered, req)) {
+      if (options_.latencyMs) delay(options_.latencyMs);
+      if (options_.otaImageBytes && req.method == "GET" && req.path.compare(0, 17, "/api/ota/download") == 0) {
+        if (!serveOtaDownload(fd, req)) break;
+        continue;
+      }
+      std::string contentType = "application/json";
+      std::string body;
+      std::string etag;
+      int status = handle(req, contentType, body, etag);
+      if (status == 200 && req.method == "POST") {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (req.path != "/api/esp32/heartbeat" && options_.loseAcks > 0 && failDist_(rng_) < options_.loseAcks) {
+          stats_.lostAcks++;
+          break;  // recorded, but the scanner never hears back
+        }
+        postOkMs_.push_back(hostsim::simMs());
+      }
+      char head[256];
+      int n = snprintf(head, sizeof(head),
+                       "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %u\r\n%s%s%sConnection: keep-alive\r\n\r\n",
+                       status, status == 200 ? "OK" : "Error", contentType.c_str(), (unsigned)body.size(),
+                       etag.empty() ? "" : "ETag: ", etag.c_str(), etag.empty() ? "" : "\r\n");
+      std::string out(head, (size_t)n);
+      out += body;
+      if (send(fd, out.data(), out.size(), MSG_NOSIGNAL) != (ssize_t)out.size()) break;
+    }
+    ::close(fd);
+  }
+
+  // One image download, from the Range offset (206) or from byte 0 (200), written in pieces
+  // paced to otaBytesPerSec. Returns false once the connection has to close: the first
+  // otaDrops downloads stop otaDropAfter bytes into the body, as a dropped link would.
+  bool serveOtaDownload(int fd, const Request &req) {
+    static const size_t PIECE_BYTES = 1024;
+    unsigned long from = 0;
+    bool ranged = options_.otaRange && sscanf(req.range.c_str(), "bytes=%lu-", &from) == 1 && from < otaServed_.size();
+    size_t start = ranged ? (size_t)from : 0;
+    size_t end = otaServed_.size();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stats_.requests++;
+      stats_.otaDownloads++;
+      if (ranged) stats_.otaRanged++;
+      if (stats_.otaDropped < options_.otaDrops && start + options_.otaDropAfter < end) {
+        stats_.otaDropped++;
+        end = start + options_.otaDropAfter;
+      }
+    }
+    char head[256];
+    int n = ranged ? snprintf(head, sizeof(head),
+                              "HTTP/1.1 206 Partial Content\r\nContent-Type: application/octet-stream\r\n"
+                              "Content-Length: %u\r\nContent-Range: bytes %u-%u/%u\r\nConnection: keep-alive\r\n\r\n",
+                              (unsigned)(otaServed_.size() - start), (unsigned)start, (unsigned)(otaServed_.size() - 1),
+                              (unsigned)otaServed_.size())
+                   : snprintf(head, sizeof(head),
+                              "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: %u\r\n"
+                              "Connection: keep-alive\r\n\r\n",
+                              (unsigned)otaServed_.size());
+    if (send(fd, head, (size_t)n, MSG_NOSIGNAL) != n) return false;
+    uint64_t startedUs = hostsim::nowUs();
+    size_t pos = start;
+    while (pos < end) {
+      size_t piece = end - pos < PIECE_BYTES ? end - pos : PIECE_BYTES;
+      if (send(fd, otaServed_.data() + pos, piece, MSG_NOSIGNAL) != (ssize_t)piece) break;
+      pos += piece;
+      if (options_.otaBytesPerSec) {
+        std::this_thread::sleep_until(
+            hostsim::realTimeOf(startedUs + (uint64_t)(pos - start) * 1000000ULL / options_.otaBytesPerSec));
+      }
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.otaBodyBytes += pos - start;
+    return pos == otaServed_.size();
+  }
+
+  static bool readRequest(int fd, std::string &buffered, Request &req) {
+    size_t headEnd;
+    while ((headEnd = buffered.find("\r\n\r\n")) == std::string::npos) {
+      if (!fill(fd, buffered)) return false;
+    }
+    std::string head = buffered.substr(0, headEnd + 2);
+    size_t sp1 = head.find(' ');
+    size_t sp2 = head.find(' ', sp1 + 1);
+    if (sp1 == std::string::npos || sp2 == std::string::npos) return false;
+    req.method = head.substr(0, sp1);
+    req.path = head.substr(sp1 + 1, sp2 - sp1 - 1);
+    req.contentType = headerValue(head, "content-type");
+    req.ifNoneMatch = headerValue(head, "if-none-match");
+    req.range = headerValue(head, "range");
+    size_t length = (size_t)atoi(headerValue(head, "content-length").c_str());
+    while (buffered.size() < headEnd + 4 + length) {
+      if (!fill(fd, buffered)) return false;
+    }
+    req.body = buffered.substr(headEnd + 4, length);
+    buffered.erase(0, headEnd + 4 + length);
+    return true;
+  }
+
+  static bool fill(int fd, std::string &buffered) {
+    char buf[4096];
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0) return false;
+    buffered.append(buf, (size_t)n);
+    return true;
+  }
+
+  static std::string headerValue(const std::string &head, const char* lowerName) {
+    for (size_t line = head.find("\r\n"); line != std::string::npos; line = head.find("\r\n", line + 2)) {
+      size_t colon = head.find(':', line + 2);
+      size_t end = head.find("\r\n", line + 2);
+      if (colon == std::string::npos || end == std::string::npos || colon > end) continue;
+      if (strcasecmp(head.substr(line + 2, colon - line - 2).c_str(), lowerName) != 0) continue;
+      size_t value = colon + 1;
+      while (value < end && head[value] == ' ') value++;
+      return head.substr(value, end - value);
+    }
+    return std::string();
+  }
+
+  int handle(const Request &req, std::string &contentType, std::string &body, std::string &etag) {
+    bool detect = req.path == "/api/esp32/detect";
+    bool batch = req.path == "/api/esp32/detect/batch" || req.path == "/api/esp32/sessions";
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stats_.requests++;
+      stats_.bodyBytes += req.body.size();
+      if ((detect || batch) && options_.failRate > 0 && failDist_(rng_) < options_.failRate) {
+        stats_.injectedFailures++;
+        body = "{\"success\":false,\"error\":\"injected failure\"}";
+        return 503;
+      }
+    }
+    if (req.method == "POST" && req.path == "/api/esp32/heartbeat") {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stats_.heartbeats++;
+      lastHeartbeat_ = req.body;
+      body = "{\"success\":true}";
+      return 200;
+    }
+    if (req.method == "GET" && req.path == "/api/esp32/allowlist" && options_.roster && options_.allowlist) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stats_.allowlistFetches++;
+      etag = allowlistEtag_;
+      if (req.ifNoneMatch == allowlistEtag_) {
+        stats_.allowlistNotModified++;
+        return 304;
+      }
+      contentType = "application/vnd.autoattend.allowlist";
+      body = allowlistBody_;
+      return 200;
+    }
+    if (req.method == "GET" && req.path == "/api/esp32/tenants" && options_.tenants) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stats_.tenantFetches++;
+      etag = "\"tn-1\"";
+      if (req.ifNoneMatch == etag) return 304;
+      contentType = "application/vnd.autoattend.tenants";
+      body = tenantsBody_;
+      return 200;
+    }
+    if (req.method == "GET" && req.path == "/api/esp32/session-config") {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stats_.sessionConfigFetches++;
+      SessionThresholds t;
+      char tag[48];
+      snprintf(tag, sizeof(tag), "\"sc-%u-%u\"", (unsigned)t.shortBreakMaxSec, (unsigned)t.lunchBreakMaxSec);
+      etag = tag;
+      if (req.ifNoneMatch == etag) return 304;
+      contentType = "application/vnd.autoattend.session-config";
+      body.assign({'S', 'C', (char)SESSION_CONFIG_VERSION, 0});
+      body.append((const char*)&t.shortBreakMaxSec, 4);
+      body.append((const char*)&t.lunchBreakMaxSec, 4);
+      return 200;
+    }
+    if (req.method == "GET" && options_.otaImageBytes && req.path == "/api/ota/manifest") {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stats_.otaManifests++;
+      body = "{\"version\":\"mock-ota\",\"key\":\"ota/mock.bin\",\"size\":" +
+             std::to_string(options_.otaImageBytes) + ",\"sha256\":\"" + otaSha256_ +
+             "\",\"download_url\":\"/api/ota/download?key=ota%2Fmock.bin\"}";
+      return 200;
+    }
+    if (req.method != "POST" || (!detect && !batch)) {
+      body = "{\"error\":\"Not found\"}";
+      return 404;
+    }
+
+    if (req.contentType.compare(0, strlen(WIRE_EVENTS_CONTENT_TYPE), WIRE_EVENTS_CONTENT_TYPE) == 0) {
+      if (!options_.binary) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.binaryRefused++;
+        body = "{\"error\":\"Unsupported Media Type\"}";
+        return 415;
+      }
+      contentType = "application/vnd.autoattend.ack";
+      return handleWire(req.body, body) ? 200 : 400;
+    }
+    return handleJson(req.body, batch, body);
+  }
+
+  static uint32_t le32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+  }
+
+  // Value of a numeric "key": in json[at, next), 0 if absent
+  static uint64_t jsonNumber(const std::string &json, const char* key, size_t at, size_t next) {
+    size_t keyAt = json.find(key, at);
+    return keyAt < next ? strtoull(json.c_str() + json.find(':', keyAt) + 1, nullptr, 10) : 0;
+  }
+
+  bool handleWire(const std::string &frame, std::string &ack) {
+    std::vector<Event> events;
+    if (!decodeWire(frame, events)) return false;
+    ack.assign({'A', 'K', (char)WIRE_VERSION, (char)events.size()});
+    for (const Event &ev : events) ack += (char)record(ev.hex, ev.action, ev.stamp, ev.tenant, ev.durationSec);
+    return true;
+  }
+
+  // Returns the HTTP status: a single unknown event is a 404, as from the Worker
+  int handleJson(const std::string &json, bool batch, std::string &out) {
+    std::vector<Event> events;
+    if (!decodeJson(json, events) || events.empty()) return 400;
+    uint8_t last = WIRE_RECORDED;
+    std::string accepted;
+    for (size_t i = 0; i < events.size(); i++) {
+      const Event &ev = events[i];
+      uint8_t status = last = record(ev.hex, ev.action, ev.stamp, ev.tenant, ev.durationSec);
+      if (status <= WIRE_DEDUPED) accepted += (accepted.empty() ? "" : ",") + std::to_string(i);
+    }
+    if (!batch) {
+      if (last == WIRE_NOT_FOUND) {
+        out = "{\"error\":\"Employee not found\"}";
+        return 404;
+      }
+      out = last == WIRE_DEDUPED ? "{\"success\":true,\"deduped\":true}" : "{\"success\":true}";
+      return 200;
+    }
+    out = "{\"success\":true,\"accepted\":[" + accepted + "],\"retry\":[]}";
+    return 200;
+  }
+
+  uint8_t record(const std::string &hex, uint8_t action, const Stamp &stamp, uint16_t tenant, uint32_t durationSec) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stamp.seq && !seen_.emplace(stamp.device, stamp.seq).second) {
+      stats_.duplicates++;
+      return WIRE_DEDUPED;
+    }
+    if (options_.roster && !roster_.count(hex)) {
+      stats_.notFound++;
+      return WIRE_NOT_FOUND;
+    }
+    stats_.events++;
+    if (tenant == 0) stats_.untagged++;
+    uint32_t nowMs = hostsim::simMs();
+    if (stamp.observedMs) {
+      stats_.stamped++;
+      int64_t trueMs = (int64_t)hostsim::trueEpochMs((uint64_t)(nowMs - stamp.ageMs) * 1000);
+      stats_.clockErrorMs.push_back((int64_t)stamp.observedMs - trueMs);
+    }
+    if (action == EVENT_CHECKIN) stats_.checkinAgeMs.push_back(stamp.ageMs);
+    if (action == EVENT_CHECKIN) {
+      stats_.checkins++;
+      firstCheckin_.emplace(hex, nowMs);
+    } else if (action == EVENT_CHECKOUT) {
+      stats_.checkouts++;
+    } else {
+      if (action == EVENT_SHORT_BREAK) stats_.shortBreaks++;
+      else stats_.lunchBreaks++;
+      stats_.breakSeconds += durationSec;
+    }
+    return WIRE_RECORDED;
+  }
+
+  Options options_;
+  int listenFd_ = -1;
+  uint16_t port_ = 0;
+  std::mutex mutex_;
+  Stats stats_;
+  std::string lastHeartbeat_;
+  std::vector<uint32_t> postOkMs_;
+  std::set<std::string> roster_;
+  std::string allowlistBody_;
+  std::string allowlistEtag_;
+  std::string tenantsBody_;
+  std::string otaImage_;
+  std::string otaServed_;   // otaImage_, or a corrupted copy with otaWrongImage
+  std::string otaSha256_;
+  std::set<std::pair<std::string, uint32_t>> seen_;
+  std::map<std::string, uint32_t> firstCheckin_;
+  std::mt19937 rng_{42};
+  std::uniform_real_distribution<double> failDist_{0.0, 1.0};
+};
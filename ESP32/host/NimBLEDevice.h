@@ -0,0 +1,104 @@
+// Host stand-in for NimBLE-Arduino 1.4.x (NimBLEDevice/NimBLEScan/NimBLEAdvertisedDevice), the
+// Radio.h backend built with SCANNER_BLE_NIMBLE=1. Scan timing comes from SimScan.h. Adverts
+// reach onResult() by pointer, as in the library; the library's own allocation of the device
+// object (freed after the callback with setMaxResults(0)) is not modelled.
+#pragma once
+#include <Arduino.h>
+#include <mutex>
+#include "SimScan.h"
+
+class NimBLEAddress {
+ public:
+  NimBLEAddress() {}
+  // addr as printed; NimBLE keeps it least significant byte first
+  explicit NimBLEAddress(const uint8_t addr[6]) {
+    for (int i = 0; i < 6; i++) addr_[i] = addr[5 - i];
+  }
+
+  std::string toString() const {
+    char s[18];
+    snprintf(s, sizeof(s), "%02x:%02x:%02x:%02x:%02x:%02x", addr_[5], addr_[4], addr_[3], addr_[2], addr_[1], addr_[0]);
+    return s;
+  }
+  const uint8_t* getNative() const { return addr_; }
+
+ private:
+  uint8_t addr_[6] = {0};
+};
+
+class NimBLEAdvertisedDevice {
+ public:
+  static const size_t PAYLOAD_MAX = 62;  // advert + scan response
+
+  NimBLEAdvertisedDevice() {}
+  void set(const uint8_t addr[6], int rssi, const uint8_t* payload, size_t len) {
+    address_ = NimBLEAddress(addr);
+    rssi_ = rssi;
+    len_ = len < PAYLOAD_MAX ? len : PAYLOAD_MAX;
+    memcpy(payload_, payload, len_);
+  }
+
+  NimBLEAddress getAddress() { return address_; }
+  int getRSSI() { return rssi_; }
+  uint8_t* getPayload() { return payload_; }
+  size_t getPayloadLength() { return len_; }
+
+ private:
+  NimBLEAddress address_;
+  int rssi_ = 0;
+  uint8_t payload_[PAYLOAD_MAX] = {0};
+  size_t len_ = 0;
+};
+
+class NimBLEAdvertisedDeviceCallbacks {
+ public:
+  virtual ~NimBLEAdvertisedDeviceCallbacks() {}
+  virtual void onResult(NimBLEAdvertisedDevice* advertisedDevice) = 0;
+};
+
+class NimBLEScanResults {
+ public:
+  int getCount() { return 0; }
+};
+
+class NimBLEScan : public hostsim::SimScan {
+ public:
+  void setAdvertisedDeviceCallbacks(NimBLEAdvertisedDeviceCallbacks* callbacks, bool /*wantDuplicates*/ = false) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    callbacks_ = callbacks;  // every advert is delivered, as with wantDuplicates = true
+  }
+  void setActiveScan(bool) {}
+  void setMaxResults(uint8_t) {}
+
+  bool start(uint32_t duration, void (*onComplete)(NimBLEScanResults), bool = false) {
+    return startFor(duration, [onComplete] { if (onComplete) onComplete(NimBLEScanResults()); });
+  }
+
+  void clearResults() {}
+
+  bool prepare(const uint8_t addr[6], int rssi, const uint8_t* payload, size_t len) override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      prepared_ = callbacks_;
+    }
+    if (!prepared_) return false;
+    device_.set(addr, rssi, payload, len);
+    return true;
+  }
+
+  void dispatch() override { prepared_->onResult(&device_); }
+
+ private:
+  NimBLEAdvertisedDeviceCallbacks* callbacks_ = nullptr;
+  NimBLEAdvertisedDeviceCallbacks* prepared_ = nullptr;
+  NimBLEAdvertisedDevice device_;
+};
+
+class NimBLEDevice {
+ public:
+  static void init(const std::string &) { hostsim::activeScan() = getScan(); }
+  static NimBLEScan* getScan() {
+    static NimBLEScan scan;
+    return &scan;
+  }
+};
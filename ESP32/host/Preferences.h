@@ -0,0 +1,65 @@
+// Host stand-in for the ESP32 Preferences (NVS) library: namespaced key/value pairs kept in
+// memory for the life of the process. ScannerSim.cpp can seed them to simulate a warm boot.
+#pragma once
+#include <Arduino.h>
+#include <map>
+#include <string>
+
+namespace hostsim {
+
+inline std::map<std::string, std::string> &nvs() {
+  static std::map<std::string, std::string> store;
+  return store;
+}
+
+inline std::mutex &nvsMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+}  // namespace hostsim
+
+class Preferences {
+ public:
+  bool begin(const char* name, bool readOnly = false) {
+    ns_ = std::string(name) + "/";
+    readOnly_ = readOnly;
+    return true;
+  }
+  void end() { ns_.clear(); }
+
+  size_t getBytes(const char* key, void* buf, size_t maxLen) {
+    std::lock_guard<std::mutex> lock(hostsim::nvsMutex());
+    auto it = hostsim::nvs().find(ns_ + key);
+    if (it == hostsim::nvs().end() || it->second.size() > maxLen) return 0;
+    memcpy(buf, it->second.data(), it->second.size());
+    return it->second.size();
+  }
+  size_t putBytes(const char* key, const void* value, size_t len) {
+    if (readOnly_) return 0;
+    std::lock_guard<std::mutex> lock(hostsim::nvsMutex());
+    hostsim::nvs()[ns_ + key].assign((const char*)value, len);
+    return len;
+  }
+
+  uint8_t getUChar(const char* key, uint8_t defaultValue = 0) {
+    uint8_t v;
+    return getBytes(key, &v, 1) == 1 ? v : defaultValue;
+  }
+  size_t putUChar(const char* key, uint8_t value) { return putBytes(key, &value, 1); }
+  uint32_t getUInt(const char* key, uint32_t defaultValue = 0) {
+    uint32_t v;
+    return getBytes(key, &v, sizeof(v)) == sizeof(v) ? v : defaultValue;
+  }
+  size_t putUInt(const char* key, uint32_t value) { return putBytes(key, &value, sizeof(value)); }
+
+  bool remove(const char* key) {
+    if (readOnly_) return false;
+    std::lock_guard<std::mutex> lock(hostsim::nvsMutex());
+    return hostsim::nvs().erase(ns_ + key) > 0;
+  }
+
+ private:
+  std::string ns_;
+  bool readOnly_ = false;
+};
@@ -0,0 +1,302 @@
+// PresenceBench: checks and a soak benchmark for PresenceTable.h
+// The checks cover what the scanner relies on: upsert creating and then finding an entry,
+// backward-shift deletion keeping colliding entries reachable (also across the wrap), the
+// eviction order (dedupe history, then away, then present) and handler, and an entry's timer following it when a deletion shifts it.
+// The soak then keeps 10, 500 and 5,000 payloads in tables sized as Scanner.cpp sizes
+// them (presenceSlotsFor(n + n/4)), replays sightings with churn (departures forgotten,
+// new arrivals tracked), and reports the table's static size, heap allocations during the
+// soak and the cost of a lookup. The std::map/std::set bookkeeping the table replaced runs
+// the same workload for comparison.
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -Wall -Wextra -IESP32/host ESP32/host/PresenceBench.cpp -o presence-bench
+//   ./presence-bench    # exits non-zero if a check fails
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include "../PresenceTable.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// ----------------------- Heap accounting -----------------------
+static size_t heapAllocs = 0;
+static size_t heapBytes = 0;
+
+void* operator new(size_t size) {
+  heapAllocs++;
+  heapBytes += size;
+  void* p = malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+// Out of line so GCC does not pair the inlined free() with a new-expression and warn
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { free(p); }
+
+// ----------------------- Checks -----------------------
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+  if (!ok) {
+    printf("FAIL: %s\n", what);
+    failures++;
+  }
+}
+
+// Badge-like payload: 8 hex chars, as badgePayload() in AdvertTrace.h advertises
+static void payloadOf(uint32_t i, char out[9]) { snprintf(out, 9, "%08X", i); }
+
+// n payloads whose home slot in a Capacity-slot table is home
+template <size_t Capacity>
+static std::vector<std::string> collidingPayloads(size_t home, size_t n) {
+  std::vector<std::string> out;
+  char hex[9];
+  for (uint32_t i = 0xB0000000; out.size() < n; i++) {
+    payloadOf(i, hex);
+    if ((hashPayload(hex, 8) & (Capacity - 1)) == home) out.push_back(hex);
+  }
+  return out;
+}
+
+static void checkUpsert() {
+  std::unique_ptr<PresenceTable<16>> t(new PresenceTable<16>());
+  PresenceEntry* a = t->upsert("B0000001", 8, 100);
+  check(a && a->lastSeen == 100 && !a->present && !a->sent && !a->away && a->rssi == 0, "upsert initialises a new entry");
+  check(a && strcmp(a->hex, "B0000001") == 0 && a->hexLen == 8, "upsert stores the payload");
+  a->lastSeen = 150;
+  check(t->upsert("B0000001", 8, 200) == a && a->lastSeen == 150, "upsert finds an existing entry unchanged");
+  check(t->find("B0000001", 8) == a && t->find("B0000002", 8) == nullptr, "find");
+  check(t->find("B000000", 7) == nullptr, "find compares lengths");
+  check(t->size() == 1, "size counts entries");
+  char tooLong[PRESENCE_HEX_MAX + 2];
+  memset(tooLong, 'A', sizeof(tooLong));
+  check(t->upsert(tooLong, PRESENCE_HEX_MAX + 1, 0) == nullptr && t->upsert("", 0, 0) == nullptr,
+        "upsert refuses empty and over-long payloads");
+  t->setPresent(a, true);
+  t->setPresent(a, true);
+  check(t->presentCount() == 1, "setPresent counts once");
+  t->erase(a);
+  check(t->size() == 0 && t->presentCount() == 0 && t->find("B0000001", 8) == nullptr, "erase forgets a present entry");
+}
+
+// Three payloads share a home slot (they land at home, home+1, home+2) and a fourth's home is
+// home+1 (so it lands at home+3); erasing the first must shift each of them back one slot
+template <size_t Capacity>
+static void checkBackwardShift(size_t home, const char* what) {
+  std::unique_ptr<PresenceTable<Capacity>> t(new PresenceTable<Capacity>());
+  std::vector<std::string> same = collidingPayloads<Capacity>(home, 3);
+  std::string next = collidingPayloads<Capacity>((home + 1) & (Capacity - 1), 1)[0];
+  PresenceEntry* slot[4];
+  for (int i = 0; i < 3; i++) slot[i] = t->upsert(same[i].data(), 8, i);
+  slot[3] = t->upsert(next.data(), 8, 3);
+  t->erase(slot[0]);
+  bool ok = t->size() == 3 && t->find(same[0].data(), 8) == nullptr;
+  ok = ok && t->find(same[1].data(), 8) == slot[0] && t->find(same[2].data(), 8) == slot[1];
+  ok = ok && t->find(next.data(), 8) == slot[2];
+  check(ok, what);
+  // Erasing from the middle of the run again leaves everything reachable
+  t->erase(t->find(same[2].data(), 8));
+  check(t->find(same[1].data(), 8) && t->find(next.data(), 8) && t->size() == 2, what);
+}
+
+static std::string lastVictimHex;
+
+static void recordVictim(PresenceEntry &victim) { lastVictimHex = victim.hex; }
+
+static void checkEviction() {
+  std::unique_ptr<PresenceTable<8>> t(new PresenceTable<8>());  // holds 6
+  t->setEvictHandler(recordVictim);
+  char hex[9];
+  for (uint32_t i = 0; i < 6; i++) {
+    payloadOf(0xB0000000 + i, hex);
+    PresenceEntry* e = t->upsert(hex, 8, 100 + i);
+    if (i < 4) t->setPresent(e, true);  // 0-3 present, 4 and 5 only dedupe history
+  }
+  t->upsert("C0000000", 8, 200);
+  check(lastVictimHex == "B0000004" && t->evictions() == 1 && t->heldEvictions() == 0,
+        "eviction takes the stalest entry that is not held");
+  check(t->size() == 6 && t->find("B0000004", 8) == nullptr && t->find("C0000000", 8), "eviction makes room");
+
+  // Everything held: the one not seen for the longest goes, and it is counted
+  t->setPresent(t->find("B0000005", 8), true);
+  t->setPresent(t->find("C0000000", 8), true);
+  t->find("B0000000", 8)->lastSeen = 300;
+  t->upsert("C0000001", 8, 300);
+  check(lastVictimHex == "B0000001" && t->heldEvictions() == 1, "with everything held, the stalest held entry goes");
+  check(t->presentCount() == 5, "evicting a present entry updates the present count");
+
+  // An away entry (its checkout can still be sent) goes before any present one, even a staler one
+  t->setPresent(t->find("C0000001", 8), true);
+  PresenceEntry* away = t->find("C0000000", 8);
+  t->setPresent(away, false);
+  away->away = true;
+  away->lastSeen = 400;
+  t->upsert("C0000002", 8, 400);
+  check(lastVictimHex == "C0000000" && t->heldEvictions() == 2, "away entries are evicted before present ones");
+}
+
+// A deletion shifts an entry into the hole; its timer has to move with it, and the timer
+// of the erased entry must not fire
+static void checkTimerMove() {
+  std::unique_ptr<PresenceTable<16>> t(new PresenceTable<16>());
+  std::vector<std::string> same = collidingPayloads<16>(15, 2);  // second one wraps to slot 0
+  PresenceEntry* a = t->upsert(same[0].data(), 8, 0);
+  PresenceEntry* b = t->upsert(same[1].data(), 8, 0);
+  t->scheduleExpiry(a, 50);
+  t->scheduleExpiry(b, 100);
+  t->erase(a);
+  PresenceEntry* moved = t->find(same[1].data(), 8);
+  check(moved == a && moved != b, "erase shifts the wrapped entry back to its home slot");
+  check(t->popExpired(99) == nullptr, "the erased entry's timer is cancelled");
+  check(t->popExpired(100) == moved && t->popExpired(100) == nullptr, "the timer fires for the moved entry");
+}
+
+// ----------------------- Soak -----------------------
+// The bookkeeping PresenceTable replaced: three containers keyed by the payload string
+struct MapBookkeeping {
+  std::map<std::string, uint32_t> lastSeenAt;
+  std::map<std::string, uint32_t> lastSentAt;
+  std::set<std::string> presentDevices;
+
+  void sighting(const char* hex, uint32_t nowSec) {
+    std::string key(hex);
+    lastSeenAt[key] = nowSec;
+    if (presentDevices.insert(key).second) lastSentAt[key] = nowSec;
+  }
+  void forget(const char* hex) {
+    std::string key(hex);
+    lastSeenAt.erase(key);
+    lastSentAt.erase(key);
+    presentDevices.erase(key);
+  }
+  bool contains(const char* hex) { return lastSeenAt.find(hex) != lastSeenAt.end(); }
+};
+
+struct SoakResult {
+  double sightingNs;
+  double missNs;
+  size_t heapAllocs;
+  size_t heapBytes;
+  size_t tracked;
+};
+
+static volatile bool benchSink;  // keeps the miss lookups from being optimised away
+
+// n payloads stay tracked; each round one in ten leaves (forgotten) and is replaced by a new
+// payload, then every one is sighted once in random order. Payload text is formatted up
+// front so the timings are the tracker's alone.
+template <typename Tracker>
+static SoakResult soak(Tracker &tracker, uint32_t n, uint32_t rounds) {
+  std::mt19937 rng(1);
+  uint32_t churn = n / 10 + 1;
+  std::vector<char> text((size_t)(n + rounds * churn + n) * 9);
+  auto hexOf = [&](uint32_t i) { return &text[(size_t)i * 9]; };
+  uint32_t total = n + rounds * churn;
+  for (uint32_t i = 0; i < total; i++) payloadOf(0xB0000000 + i, hexOf(i));
+  for (uint32_t i = 0; i < n; i++) payloadOf(0xA0000000 + i, hexOf(total + i));  // never tracked
+  std::vector<uint32_t> ids(n);
+  for (uint32_t i = 0; i < n; i++) {
+    ids[i] = i;
+    tracker.sighting(hexOf(i), 0);
+  }
+  uint32_t nextId = n;
+  size_t allocs0 = heapAllocs, bytes0 = heapBytes;
+  uint64_t sightings = 0, misses = 0;
+  double sightingNs = 0, missNs = 0;
+  for (uint32_t r = 1; r <= rounds; r++) {
+    for (uint32_t i = 0; i < churn; i++) {
+      uint32_t &id = ids[rng() % n];
+      tracker.forget(hexOf(id));
+      id = nextId++;
+    }
+    for (uint32_t i = n; i > 1; i--) std::swap(ids[i - 1], ids[rng() % i]);
+    Clock::time_point t0 = Clock::now();
+    for (uint32_t id : ids) tracker.sighting(hexOf(id), r);
+    Clock::time_point t1 = Clock::now();
+    bool found = false;
+    for (uint32_t i = 0; i < n; i++) found = tracker.contains(hexOf(total + i)) || found;
+    Clock::time_point t2 = Clock::now();
+    benchSink = found;
+    sightingNs += std::chrono::duration<double, std::nano>(t1 - t0).count();
+    missNs += std::chrono::duration<double, std::nano>(t2 - t1).count();
+    sightings += n;
+    misses += n;
+  }
+  return {sightingNs / sightings, missNs / misses, heapAllocs - allocs0, heapBytes - bytes0, 0};
+}
+
+template <size_t Capacity>
+struct TableTracker {
+  std::unique_ptr<PresenceTable<Capacity>> table{new PresenceTable<Capacity>()};
+
+  void sighting(const char* hex, uint32_t nowSec) {
+    PresenceEntry* e = table->upsert(hex, 8, nowSec);
+    e->lastSeen = nowSec;
+    if (!e->present) {
+      table->setPresent(e, true);
+      e->lastSent = nowSec;
+      e->sent = true;
+    }
+    table->scheduleExpiry(e, nowSec + 31);  // as armPresenceTimerLocked() does per sighting
+  }
+  void forget(const char* hex) {
+    if (PresenceEntry* e = table->find(hex, 8)) table->erase(e);
+  }
+  bool contains(const char* hex) { return table->find(hex, 8) != nullptr; }
+};
+
+// Heap the map bookkeeping holds with n payloads tracked
+static size_t mapHeapBytes(uint32_t n) {
+  size_t before = heapBytes;
+  std::unique_ptr<MapBookkeeping> m(new MapBookkeeping());
+  char hex[9];
+  for (uint32_t i = 0; i < n; i++) {
+    payloadOf(0xB0000000 + i, hex);
+    m->sighting(hex, 0);
+  }
+  return heapBytes - before;
+}
+
+template <size_t Capacity>
+static void runSoak(uint32_t n, uint32_t rounds) {
+  std::unique_ptr<TableTracker<Capacity>> table(new TableTracker<Capacity>());
+  SoakResult t = soak(*table, n, rounds);
+  t.tracked = table->table->size();
+  std::unique_ptr<MapBookkeeping> maps(new MapBookkeeping());
+  SoakResult m = soak(*maps, n, rounds);
+  check(t.heapAllocs == 0, "the table does not allocate while tracking");
+  check(t.tracked == n && table->table->evictions() == 0, "the soak keeps every payload tracked");
+  printf("Payloads %5u: table %5zu slots, %7zu B static, %zu heap allocs during soak; sighting %5.1f ns, miss %5.1f ns\n",
+         n, Capacity, sizeof(PresenceTable<Capacity>), t.heapAllocs, t.sightingNs, t.missNs);
+  printf("                maps  %7zu B heap for %u payloads, %zu allocs (%zu B) during soak; sighting %5.1f ns, miss %5.1f ns\n",
+         mapHeapBytes(n), n, m.heapAllocs, m.heapBytes, m.sightingNs, m.missNs);
+  printf("RESULT payloads=%u slots=%zu table_bytes=%zu table_heap_allocs=%zu table_sighting_ns=%.1f table_miss_ns=%.1f "
+         "map_heap_bytes=%zu map_sighting_ns=%.1f map_miss_ns=%.1f\n",
+         n, Capacity, sizeof(PresenceTable<Capacity>), t.heapAllocs, t.sightingNs, t.missNs, mapHeapBytes(n), m.sightingNs,
+         m.missNs);
+}
+
+int main() {
+  checkUpsert();
+  checkBackwardShift<16>(3, "backward-shift erase keeps colliding entries reachable");
+  checkBackwardShift<16>(14, "backward-shift erase across the wrap");
+  checkEviction();
+  checkTimerMove();
+  printf("Checks: %s\n", failures ? "FAILED" : "passed");
+
+  // Tables sized the way Scanner.cpp sizes its own (presenceSlotsFor(headcount + headcount / 4))
+  runSoak<presenceSlotsFor(10 + 10 / 4)>(10, 20000);
+  runSoak<presenceSlotsFor(500 + 500 / 4)>(500, 2000);
+  runSoak<presenceSlotsFor(5000 + 5000 / 4)>(5000, 200);
+  if (failures) printf("%d check(s) failed\n", failures);
+  return failures ? 1 : 0;
+}
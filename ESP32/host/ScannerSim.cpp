@@ -0,0 +1,1066 @@
+// ScannerSim: runs the real Scanner.cpp on Linux against the stand-ins in this directory,
+// replays an advert trace into its BLE callback and posts to an in-process mock Worker.
+// Reports callback latency percentiles, heap allocations per advert, events posted and
+// lost, how long each badge took from its first advert to its check-in, and how far the
+// scanner's event stamps are from the true time of each sighting.
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -Wall -Wextra -pthread -IESP32/host ESP32/host/ScannerSim.cpp -o scanner-sim
+//
+// Run a reference trace, or replay a recording:
+//   ./scanner-sim --profile lobby-rush
+//   ./scanner-sim --profile idle-night
+//   ./scanner-sim --profile front-desk --roster 5000 [--no-allowlist]
+//   ./scanner-sim --profile dense-rf       # address rotation; build with -DSCANNER_ADVERT_CACHE=1 to compare
+//   ./scanner-sim --profile office-day     # breaks; build with -DSCANNER_EDGE_SESSIONS=0 for raw enter/exit
+//   ./scanner-sim --profile lobby-rush     # with -DSCANNER_EDGE_SESSIONS=0, and -DSCANNER_BATCH_UPLOAD=0 for one POST per event
+//   ./scanner-sim --profile lobby-rush --clock-drift 40 --lose-acks 0.1 --outage 60:120
+//                                          # delayed delivery and replays; stamps should stay exact
+//   ./scanner-sim --trace capture.csv --speed 4
+//   ./scanner-sim --bench-matcher          # matchAdvert cost for 1..256 tenant UUIDs, and the old string matcher
+//   ./scanner-sim --bench-wire --profile office-day   # upload bytes and encode/decode cost, JSON vs binary
+//   ./scanner-sim --ota                    # firmware downloads with drops, no Range support and a wrong image
+// Build with -DSCANNER_BLE_NIMBLE=1 to run the NimBLE radio backend instead of Bluedroid.
+// See --help for failure injection, WiFi outages and pointing at a real Worker.
+#include "../Scanner.cpp"
+#include <algorithm>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+#include "AdvertTrace.h"
+#include "BLEDevice.h"  // the baseline matcher's device type, whichever backend is built
+#include "MockWorker.h"
+
+// ----------------------- Allocation counting -----------------------
+// Only allocations made inside the BLE callback (on the radio thread) are counted
+static thread_local bool countAllocations = false;
+static thread_local uint64_t callbackAllocations = 0;
+
+void* operator new(size_t size) {
+  if (countAllocations) callbackAllocations++;
+  if (void* p = malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+// Out of line so GCC does not pair the inlined free() with a new-expression and warn
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { free(p); }
+
+// ----------------------- Callback latency -----------------------
+// Log-linear histogram of nanoseconds: 16 sub-buckets per power of two (<7% error)
+class NanosHistogram {
+ public:
+  void record(uint64_t ns) {
+    count_++;
+    sum_ += ns;
+    if (ns > max_) max_ = ns;
+    counts_[bucketOf(ns)]++;
+  }
+
+  uint64_t count() const { return count_; }
+  uint64_t max() const { return max_; }
+  double mean() const { return count_ ? (double)sum_ / count_ : 0; }
+
+  // Upper bound of the bucket holding the p-th percentile
+  uint64_t percentile(double p) const {
+    if (count_ == 0) return 0;
+    uint64_t rank = (uint64_t)(p / 100.0 * (count_ - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t b = 0; b < BUCKETS; b++) {
+      seen += counts_[b];
+      if (seen >= rank) return std::min(upperOf(b), max_);
+    }
+    return max_;
+  }
+
+ private:
+  static const size_t SUB = 16;
+  static const size_t BUCKETS = 64 * SUB;
+
+  static size_t bucketOf(uint64_t ns) {
+    if (ns < SUB) return (size_t)ns;
+    int msb = 63 - __builtin_clzll(ns);
+    size_t sub = (size_t)(ns >> (msb - 4)) & (SUB - 1);
+    return (size_t)(msb - 3) * SUB + sub;
+  }
+
+  static uint64_t upperOf(size_t bucket) {
+    if (bucket < SUB) return bucket;
+    int msb = (int)(bucket / SUB) + 3;
+    uint64_t sub = bucket % SUB;
+    return ((SUB + sub + 1) << (msb - 4)) - 1;
+  }
+
+  uint64_t counts_[BUCKETS] = {};
+  uint64_t count_ = 0;
+  uint64_t sum_ = 0;
+  uint64_t max_ = 0;
+};
+
+// ----------------------- Simulated radio -----------------------
+struct RadioStats {
+  uint64_t adverts = 0;         // in the trace
+  uint64_t delivered = 0;       // heard and handed to the callback
+  uint64_t missedWindow = 0;    // scan running, but outside the scan window
+  uint64_t missedIdle = 0;      // between scan periods
+  uint64_t matched = 0;         // delivered adverts that carry the target UUID
+  uint64_t allocsMatched = 0;
+  uint64_t allocsOther = 0;
+  uint64_t maxLagUs = 0;        // furthest the replay fell behind the trace
+  NanosHistogram callbackNs;
+  std::map<std::string, uint32_t> firstAdvertMs;  // badge hex -> first advert in the trace
+};
+
+static RadioStats radio;
+
+// ----------------------- Raw-RSSI presence -----------------------
+// Presence as it was before the RSSI hysteresis: any sighting checks a badge in and
+// PRESENCE_TIMEOUT_SECONDS of silence checks it out, absences becoming break rows as the
+// scanner's do (SCANNER_EDGE_SESSIONS). Fed the same sightings as the scanner, it counts the
+// attendance rows that logic would have written, for the Presence line.
+class RawPresenceModel {
+ public:
+  void sighting(const std::string &hex, uint32_t nowSec) {
+    Badge &b = badges_[hex];
+    settle(b, nowSec);
+    if (!b.present) {
+      rows_++;  // a break row when back in time, otherwise a checkin
+      b.present = true;
+      b.away = false;
+    }
+    b.lastSeen = nowSec;
+  }
+
+  // Rows written by endSec, departures due by then included
+  uint32_t rows(uint32_t endSec) {
+    for (auto &badge : badges_) settle(badge.second, endSec);
+    return rows_;
+  }
+
+ private:
+  struct Badge {
+    uint32_t lastSeen = 0;
+    uint32_t awaySince = 0;
+    bool present = false;
+    bool away = false;
+  };
+
+  void settle(Badge &b, uint32_t nowSec) {
+    if (b.present && nowSec - b.lastSeen > PRESENCE_TIMEOUT_SECONDS) {
+      b.present = false;
+      b.away = SCANNER_EDGE_SESSIONS;
+      b.awaySince = b.lastSeen;
+      if (!b.away) rows_++;  // checkout
+    }
+    if (b.away && nowSec - b.awaySince > thresholds_.lunchBreakMaxSec) {
+      b.away = false;
+      rows_++;  // went home: checkout
+    }
+  }
+
+  std::map<std::string, Badge> badges_;
+  SessionThresholds thresholds_;
+  uint32_t rows_ = 0;
+};
+
+static RawPresenceModel rawPresence;  // radio thread only until the report
+static std::atomic<bool> traceDone{false};
+static std::atomic<bool> radioStop{false};
+
+// Badge hex the scanner would report for a matching advert (local name or service data)
+static std::string badgeHex(const uint8_t* payload, size_t len) {
+  AdvMatch match;
+  if (!matchAdvert(payload, len, *tenantMatcher.load(), match)) return std::string();
+  if (!match.localName.empty() && isAsciiHexView(match.localName)) {
+    return std::string((const char*)match.localName.data, match.localName.len);
+  }
+  if (!match.serviceData.empty()) return toHexString(match.serviceData.data, match.serviceData.len);
+  return std::string();
+}
+
+static void sleepUntilSim(uint64_t simUs) {
+  if (hostsim::nowUs() < simUs) std::this_thread::sleep_until(hostsim::realTimeOf(simUs));
+}
+
+// Replays source (trace time 0 = originUs) into the scan, then keeps finishing scan
+// periods until told to stop so loop() can drain
+static void radioLoop(AdvertSource* source, uint64_t originUs) {
+  hostsim::SimScan* scan = hostsim::activeScan();
+  TraceAdvert adv;
+  bool have = source->next(adv);
+  while (have) {
+    uint64_t due = originUs + adv.atUs;
+    uint64_t scanEnd = scan->endUs();
+    if (scanEnd && scanEnd <= due) {
+      sleepUntilSim(scanEnd);
+      scan->expire(hostsim::nowUs());
+      continue;
+    }
+    sleepUntilSim(due);
+    uint64_t now = hostsim::nowUs();
+    if (now - due > radio.maxLagUs) radio.maxLagUs = now - due;
+
+    radio.adverts++;
+    std::string hex = badgeHex(adv.payload, adv.len);
+    if (!hex.empty()) radio.firstAdvertMs.emplace(hex, (uint32_t)(due / 1000));
+
+    bool inScan = false;
+    if (scan->hears(due, inScan) && scan->prepare(adv.addr, adv.rssi, adv.payload, adv.len)) {
+      callbackAllocations = 0;
+      countAllocations = true;
+      auto started = std::chrono::steady_clock::now();
+      scan->dispatch();
+      auto elapsed = std::chrono::steady_clock::now() - started;
+      countAllocations = false;
+      radio.callbackNs.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+      radio.delivered++;
+      if (!hex.empty()) {
+        if (allowlist.admits(hex.data(), hex.size())) rawPresence.sighting(hex, (uint32_t)(due / 1000000));
+        radio.matched++;
+        radio.allocsMatched += callbackAllocations;
+      } else {
+        radio.allocsOther += callbackAllocations;
+      }
+    } else if (inScan) {
+      radio.missedWindow++;
+    } else {
+      radio.missedIdle++;
+    }
+    have = source->next(adv);
+  }
+  traceDone = true;
+
+  while (!radioStop) {
+    uint64_t scanEnd = scan->endUs();
+    if (scanEnd) {
+      sleepUntilSim(scanEnd);
+      scan->expire(hostsim::nowUs());
+    } else {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+}
+
+// ----------------------- Driver -----------------------
+struct SimOptions {
+  const char* profile = "lobby-rush";
+  const char* tracePath = nullptr;
+  const char* writeTracePath = nullptr;
+  const char* workerAddr = nullptr;
+  double speed = 0;  // 0: the profile's default
+  uint32_t badges = 0;  // 0: the profile's count
+  uint32_t drainSec = 45;
+  uint32_t outageStartSec = 0;
+  uint32_t outageSec = 0;
+  MockWorker::Options worker;
+  double clockDriftPpm = 0;
+  uint32_t bootMillis = 0;
+  bool noSntp = false;
+  bool warmBoot = false;
+  bool staticIp = false;
+  bool benchMatcher = false;
+  bool benchWire = false;
+  bool ota = false;
+  bool verbose = false;
+};
+
+static void usage() {
+  printf("usage: scanner-sim [options]\n"
+         "  --profile NAME         reference trace:");
+  for (const TraceProfile &p : TRACE_PROFILES) printf(" %s", p.name);
+  printf("\n"
+         "  --trace FILE           replay a CSV trace instead (t_us,address,rssi,payload_hex)\n"
+         "  --write-trace FILE     write the selected profile as CSV and exit\n"
+         "  --speed X              simulated seconds per real second\n"
+         "  --badges N             replay the profile with N badges instead of its own count\n"
+         "  --drain SECONDS        keep running after the trace ends (default 45)\n"
+         "  --fail-rate P          mock Worker answers this fraction of posts with 503\n"
+         "  --worker-latency MS    mock Worker delay before each answer\n"
+         "  --lose-acks P          mock Worker records this fraction of posts, then drops the connection\n"
+         "  --clock-drift PPM      real time runs this much faster than the scanner's crystal\n"
+         "  --boot-millis MS       millis() starts here (e.g. 4294000000 wraps it 16 minutes in)\n"
+         "  --no-sntp              the time server never answers (events go out unstamped)\n"
+         "  --roster N             mock Worker knows only the first N badges (0: every hex value)\n"
+         "  --no-allowlist         mock Worker does not serve /api/esp32/allowlist\n"
+         "  --no-binary            mock Worker answers binary frames with 415 (the scanner falls back to JSON)\n"
+         "  --tenants N            mock Worker publishes N company UUIDs (the first is TARGET_UUID)\n"
+         "  --outage START:SECONDS WiFi drops START seconds into the trace\n"
+         "  --worker HOST:PORT     post to a running Worker instead of the mock\n"
+         "  --warm-boot            NVS already holds the AP from a previous boot\n"
+         "  --static-ip            configure a static address (no DHCP)\n"
+         "  --bench-matcher        time matchAdvert over the profile's adverts for 1..256 tenants (and the\n"
+         "                         string matcher it replaced) and exit\n"
+         "  --bench-wire           encode the profile's uploads as JSON and as binary frames, time encoding,\n"
+         "                         decoding and reading the answer, compare bytes on the wire and exit\n"
+         "  --ota                  run firmware updates against mock Workers that drop the download,\n"
+         "                         ignore Range or serve a wrong image, check what got installed and exit\n"
+         "  --verbose              show the scanner's serial output\n");
+  for (const TraceProfile &p : TRACE_PROFILES) printf("\n  %-12s %s", p.name, p.description);
+  printf("\n");
+}
+
+static bool parseArgs(int argc, char** argv, SimOptions &o) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+    bool takesValue = arg != "--verbose" && arg != "--help" && arg != "--no-allowlist" && arg != "--warm-boot" &&
+                      arg != "--static-ip" && arg != "--bench-matcher" && arg != "--no-sntp" &&
+                      arg != "--ota" && arg != "--bench-wire" && arg != "--no-binary";
+    if (takesValue && !value) return false;
+    if (arg == "--profile") o.profile = value;
+    else if (arg == "--trace") o.tracePath = value;
+    else if (arg == "--write-trace") o.writeTracePath = value;
+    else if (arg == "--speed") o.speed = atof(value);
+    else if (arg == "--badges") o.badges = (uint32_t)atoi(value);
+    else if (arg == "--drain") o.drainSec = (uint32_t)atoi(value);
+    else if (arg == "--fail-rate") o.worker.failRate = atof(value);
+    else if (arg == "--worker-latency") o.worker.latencyMs = (uint32_t)atoi(value);
+    else if (arg == "--lose-acks") o.worker.loseAcks = atof(value);
+    else if (arg == "--clock-drift") o.clockDriftPpm = atof(value);
+    else if (arg == "--boot-millis") o.bootMillis = (uint32_t)strtoul(value, nullptr, 10);
+    else if (arg == "--no-sntp") o.noSntp = true;
+    else if (arg == "--roster") o.worker.roster = (uint32_t)atoi(value);
+    else if (arg == "--no-allowlist") o.worker.allowlist = false;
+    else if (arg == "--no-binary") o.worker.binary = false;
+    else if (arg == "--tenants") o.worker.tenants = (uint32_t)atoi(value);
+    else if (arg == "--bench-matcher") o.benchMatcher = true;
+    else if (arg == "--bench-wire") o.benchWire = true;
+    else if (arg == "--ota") o.ota = true;
+    else if (arg == "--warm-boot") o.warmBoot = true;
+    else if (arg == "--static-ip") o.staticIp = true;
+    else if (arg == "--worker") o.workerAddr = value;
+    else if (arg == "--outage") {
+      if (sscanf(value, "%u:%u", &o.outageStartSec, &o.outageSec) != 2) return false;
+    } else if (arg == "--verbose") o.verbose = true;
+    else return false;
+    if (takesValue) i++;
+  }
+  return true;
+}
+
+template <typename T>
+static T percentileOf(std::vector<T> &values, double p) {
+  if (values.empty()) return 0;
+  std::sort(values.begin(), values.end());
+  return values[(size_t)(p / 100.0 * (values.size() - 1))];
+}
+
+// Boot -> first scan and first accepted POST, and AP back -> first accepted POST after an outage
+static void reportBringUp(const SimOptions &opts, uint32_t bootMs, uint64_t originUs, MockWorker* worker,
+                          uint32_t &firstScanMs, uint32_t &firstPostMs, uint32_t &outagePostMs) {
+  uint64_t scanUs = hostsim::activeScan()->firstStartUs();
+  firstScanMs = scanUs ? (uint32_t)(scanUs / 1000) - bootMs : 0;
+  firstPostMs = 0;
+  outagePostMs = 0;
+  if (!worker) return;
+  uint32_t post = worker->firstPostOkAfter(bootMs);
+  firstPostMs = post ? post - bootMs : 0;
+  printf("Bring-up:  boot -> first scan %ums, first accepted POST %ums\n", firstScanMs, firstPostMs);
+  if (!opts.outageSec) return;
+  uint32_t apBackMs = (uint32_t)(originUs / 1000) + (opts.outageStartSec + opts.outageSec) * 1000;
+  post = worker->firstPostOkAfter(apBackMs);
+  outagePostMs = post ? post - apBackMs : 0;
+  printf("Outage:    AP back -> first accepted POST %ums\n", outagePostMs);
+}
+
+static void report(const char* traceName, double speed, uint64_t traceUs, MockWorker* worker,
+                   const SimOptions &opts, uint32_t bootMs, uint64_t originUs, const SyntheticTrace* synthetic) {
+  double traceSec = traceUs / 1e6;
+  printf("\n== Scanner simulation: %s (%.0f s of trace at %.1fx) ==\n", traceName, traceSec, speed);
+  printf("Adverts:   %llu in trace (%.0f/s), %llu delivered, missed %llu outside the scan window, %llu between periods\n",
+         (unsigned long long)radio.adverts, traceSec > 0 ? radio.adverts / traceSec : 0.0,
+         (unsigned long long)radio.delivered, (unsigned long long)radio.missedWindow,
+         (unsigned long long)radio.missedIdle);
+  const NanosHistogram &h = radio.callbackNs;
+  printf("Callback:  mean=%.1fns p50=%lluns p90=%lluns p99=%lluns p99.9=%lluns max=%lluns\n", h.mean(),
+         (unsigned long long)h.percentile(50), (unsigned long long)h.percentile(90),
+         (unsigned long long)h.percentile(99), (unsigned long long)h.percentile(99.9), (unsigned long long)h.max());
+  uint64_t other = radio.delivered - radio.matched;
+  double allocsOther = other ? (double)radio.allocsOther / other : 0;
+  double allocsMatched = radio.matched ? (double)radio.allocsMatched / radio.matched : 0;
+  double allocsAll = radio.delivered ? (double)(radio.allocsOther + radio.allocsMatched) / radio.delivered : 0;
+  printf("Allocs:    %.3f per advert (%.3f per non-matching, %.2f per matching; %llu matching)\n", allocsAll,
+         allocsOther, allocsMatched, (unsigned long long)radio.matched);
+  printf("Replay:    fell behind the trace by up to %.1f ms\n", radio.maxLagUs / 1000.0);
+  // What the callback alone (library delivery included) could keep up with on this host
+  printf("Radio:     %s backend, callback capacity %.0f adverts/s\n", Radio::backendName(),
+         h.mean() > 0 ? 1e9 / h.mean() : 0.0);
+
+  uint32_t lost = eventsFailed + journal.overwritten();
+  printf("Scanner:   queued=%u posted=%u replayed=%u failed=%u journaled=%u pending=%u overwritten=%u "
+         "queue-full refusals=%u\n",
+         (unsigned)eventsQueued, (unsigned)eventsPosted, (unsigned)eventsReplayed, (unsigned)eventsFailed,
+         (unsigned)eventsJournaled, (unsigned)(journal.pending() + eventQueue.size()), (unsigned)journal.overwritten(),
+         (unsigned)eventsDropped);
+
+  uint32_t badges = (uint32_t)radio.firstAdvertMs.size();
+  uint32_t checkedIn = 0;
+  uint32_t neverCheckedIn = 0;  // badges on the roster that never got a check-in
+  uint32_t offRoster = 0;       // badges the Worker does not know, expected never to check in
+  uint32_t received = 0;
+  uint32_t requests = 0;
+  uint32_t notFound = 0;
+  uint32_t breaks = 0;
+  uint32_t duplicates = 0;
+  uint64_t bodyBytes = 0;
+  uint32_t clockErrMaxMs = 0;
+  uint32_t checkinAgeMaxMs = 0;
+  std::vector<uint32_t> latencies;
+  if (worker) {
+    MockWorker::Stats s = worker->stats();
+    received = s.events;
+    requests = s.requests;
+    notFound = s.notFound;
+    breaks = s.shortBreaks + s.lunchBreaks;
+    duplicates = s.duplicates;
+    bodyBytes = s.bodyBytes;
+    printf("Worker:    requests=%u events=%u (checkin=%u checkout=%u short_break=%u lunch_break=%u) duplicates=%u "
+           "injected failures=%u binary refused=%u body=%llu B\n",
+           s.requests, s.events, s.checkins, s.checkouts, s.shortBreaks, s.lunchBreaks, s.duplicates,
+           s.injectedFailures, s.binaryRefused, (unsigned long long)s.bodyBytes);
+    // Planned absences against what reached the Worker: with sessions each should be one
+    // break row, in raw mode a checkout and a checkin
+    if (synthetic && (synthetic->plannedShortBreaks() || synthetic->plannedLunches())) {
+      uint32_t planned = synthetic->plannedShortBreaks() + synthetic->plannedLunches();
+      printf("Sessions:  planned %u short breaks, %u lunches (mean %.0f s); recorded %u short, %u lunch (mean %.0f s), "
+             "%u rows for %u badges (SCANNER_EDGE_SESSIONS=%d, %u config fetches)\n",
+             synthetic->plannedShortBreaks(), synthetic->plannedLunches(),
+             (double)synthetic->plannedBreakSec() / planned, s.shortBreaks, s.lunchBreaks,
+             breaks ? (double)s.breakSeconds / breaks : 0.0, s.events, (unsigned)radio.firstAdvertMs.size(),
+             SCANNER_EDGE_SESSIONS, s.sessionConfigFetches);
+    }
+    std::map<std::string, uint32_t> checkins = worker->firstCheckins();
+    for (const auto &badge : radio.firstAdvertMs) {
+      auto it = checkins.find(badge.first);
+      if (it == checkins.end()) {
+        if (worker->knows(badge.first)) neverCheckedIn++;
+        else offRoster++;
+        continue;
+      }
+      checkedIn++;
+      latencies.push_back(it->second - badge.second);
+    }
+    uint32_t p50 = percentileOf(latencies, 50), p90 = percentileOf(latencies, 90);
+    uint32_t worst = latencies.empty() ? 0 : latencies.back();
+    printf("Badges:    %u in trace, %u checked in; first advert -> check-in p50=%ums p90=%ums max=%ums\n", badges,
+           checkedIn, p50, p90, worst);
+    printf("Roster:    not_found=%u allowlist fetches=%u (%u not modified)\n", s.notFound, s.allowlistFetches,
+           s.allowlistNotModified);
+    printf("Tenants:   matching %u UUIDs (%u published, %u fetches); %u events recorded untagged\n",
+           (unsigned)tenantMatcher.load()->size(), opts.worker.tenants, s.tenantFetches, s.untagged);
+    // Device stamps against the true time of each sighting; the check-in age is what
+    // stamping on arrival would have been off by
+    std::vector<uint32_t> clockErr;
+    for (int64_t e : s.clockErrorMs) clockErr.push_back((uint32_t)(e < 0 ? -e : e));
+    clockErrMaxMs = percentileOf(clockErr, 100);
+    checkinAgeMaxMs = percentileOf(s.checkinAgeMs, 100);
+    printf("Clock:     %u SNTP syncs, drift %d ppm measured (%.0f actual); %u/%u events stamped, |error| p50=%ums "
+           "max=%ums; check-in age p50=%ums max=%ums; %u lost acks, %u replays deduped by seq\n",
+           (unsigned)deviceClock.syncs(), (int)deviceClock.driftPpm(), opts.clockDriftPpm, s.stamped, s.events,
+           percentileOf(clockErr, 50), clockErrMaxMs, percentileOf(s.checkinAgeMs, 50), checkinAgeMaxMs, s.lostAcks,
+           s.duplicates);
+  }
+  // Empirical false-positive rate: random hex values that belong to nobody on the roster
+  uint32_t falsePositives = 0, probes = 0;
+  if (allowlist.loaded()) {
+    uint32_t roster = worker ? worker->options().roster : 0;
+    uint32_t x = 0x9E3779B9;
+    char hex[9];
+    while (probes < 100000) {
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+      if (x - 0xB0000000u < roster) continue;
+      snprintf(hex, sizeof(hex), "%08X", (unsigned)x);
+      probes++;
+      if (allowlist.admits(hex, 8)) falsePositives++;
+    }
+  }
+  // Batched against per-event posting (SCANNER_BATCH_UPLOAD; sessions always go in bulk)
+  if (worker) {
+    printf("Uploads:   %u requests for %u events (%.2f events/request, %.1f B/event), scan->POST max %ums "
+           "(SCANNER_BATCH_UPLOAD=%d)\n",
+           requests, received, requests ? (double)received / requests : 0.0, received ? (double)bodyBytes / received : 0.0,
+           (unsigned)maxScanToPostMs, SCANNER_BATCH_UPLOAD);
+  }
+  printf("Allowlist: %s, %u keys, %u bytes; %u unknown sightings dropped; false positives %u/%u\n",
+         allowlist.loaded() ? "loaded" : "none", (unsigned)allowlist.size(), (unsigned)allowlist.bytes(),
+         (unsigned)unknownSightings, falsePositives, probes);
+  uint32_t cacheLookups = advertCache.hits() + advertCache.misses();
+  double cacheHitPct = cacheLookups ? 100.0 * advertCache.hits() / cacheLookups : 0;
+  printf("AdvCache:  %.1f%% of adverts answered from the cache (%u hits, %u misses), %u/%u entries used, "
+         "%u not stored (set full) (SCANNER_ADVERT_CACHE=%d)\n",
+         cacheHitPct, (unsigned)advertCache.hits(), (unsigned)advertCache.misses(), (unsigned)advertCache.used(),
+         (unsigned)advertCache.capacity(), (unsigned)advertCache.full(), SCANNER_ADVERT_CACHE);
+  printf("Telemetry: %u periods, %u post requests (%u retries), %u heartbeats sent (SCANNER_TELEMETRY=%d)\n",
+         (unsigned)telemetry.scanPeriods, (unsigned)telemetry.postRequests, (unsigned)telemetry.postRetries,
+         (unsigned)telemetry.heartbeats, SCANNER_TELEMETRY);
+  if (worker && hostsim::serialEnabled()) printf("Heartbeat: %s\n", worker->lastHeartbeat().c_str());
+  printf("Lost:      %u events (failed for good or overwritten in the journal); %u badges in the trace never "
+         "checked in (%u more off the roster); presence table %u/%u, %u evicted (%u present or away), "
+         "%u checkouts dropped\n",
+         lost, neverCheckedIn, offRoster, (unsigned)presence.size(), (unsigned)presence.capacity(),
+         (unsigned)presence.evictions(), (unsigned)presence.heldEvictions(), (unsigned)checkoutsDropped);
+  // Attendance rows per hour against what raw-RSSI presence would have written
+  double hours = traceSec / 3600;
+  uint32_t rawRows = rawPresence.rows(hostsim::simMs() / 1000);
+  double rowsPerHour = hours > 0 ? received / hours : 0;
+  double rawRowsPerHour = hours > 0 ? rawRows / hours : 0;
+  if (worker) {
+    printf("Presence:  %u rows (%.1f/hour); raw RSSI presence (any sighting in, %us of silence out) would write %u "
+           "(%.1f/hour): %d writes avoided; %u weak-signal departures, %u dropouts absorbed (SCANNER_RSSI_SMOOTHING=%d)\n",
+           received, rowsPerHour, (unsigned)PRESENCE_TIMEOUT_SECONDS, rawRows, rawRowsPerHour,
+           (int)rawRows - (int)received, (unsigned)weakDepartures, (unsigned)signalDropouts, SCANNER_RSSI_SMOOTHING);
+  }
+  uint32_t firstScanMs, firstPostMs, outagePostMs;
+  reportBringUp(opts, bootMs, originUs, worker, firstScanMs, firstPostMs, outagePostMs);
+
+  // One line per run, for comparing commits
+  printf("RESULT trace=%s radio=%s adverts=%llu delivered=%llu cb_mean_ns=%.1f cb_p50_ns=%llu cb_p99_ns=%llu cb_max_ns=%llu "
+         "allocs_per_advert=%.3f cache_hit_pct=%.1f queued=%u posted=%u received=%u lost=%u badges=%u checked_in=%u "
+         "never_checked_in=%u checkin_p90_ms=%u requests=%u body_bytes=%llu breaks=%u not_found=%u duplicates=%u "
+         "clock_err_max_ms=%u checkin_age_max_ms=%u first_scan_ms=%u first_post_ms=%u outage_post_ms=%u evicted_held=%u checkouts_dropped=%u "
+         "rows_per_hour=%.1f raw_rows_per_hour=%.1f\n",
+         traceName, Radio::backendName(), (unsigned long long)radio.adverts, (unsigned long long)radio.delivered, h.mean(),
+         (unsigned long long)h.percentile(50), (unsigned long long)h.percentile(99), (unsigned long long)h.max(),
+         allocsAll, cacheHitPct, (unsigned)eventsQueued, (unsigned)(eventsPosted + eventsReplayed), received, lost, badges, checkedIn,
+         neverCheckedIn, percentileOf(latencies, 90), requests, (unsigned long long)bodyBytes, breaks, notFound, duplicates,
+         clockErrMaxMs, checkinAgeMaxMs, firstScanMs, firstPostMs, outagePostMs, (unsigned)presence.heldEvictions(),
+         (unsigned)checkoutsDropped, rowsPerHour, rawRowsPerHour);
+}
+
+// ----------------------- Baseline matcher -----------------------
+// What onResult did with every advert before AdvMatcher.h, kept only to benchmark against:
+// lowercase hex copies of the service UUID, manufacturer data, service data and, failing
+// those, the whole device's toString(), each searched for TARGET_UUID. The library parses
+// the fields itself; here they are pulled out of the payload the same way.
+static std::string baselineLower(std::string s) {
+  for (char &c : s) c = (char)tolower((unsigned char)c);
+  return s;
+}
+
+// Data of the first AD structure of one of the given types, as the library returns it
+static std::string baselineField(const uint8_t* payload, size_t len, uint8_t typeA, uint8_t typeB = 0) {
+  for (size_t i = 0; i + 1 < len && payload[i] != 0; i += 1 + payload[i]) {
+    uint8_t type = payload[i + 1];
+    if ((type == typeA || (typeB && type == typeB)) && i + 1 + payload[i] <= len) {
+      return std::string((const char*)payload + i + 2, payload[i] - 1);
+    }
+  }
+  return std::string();
+}
+
+static bool baselineMatch(BLEAdvertisedDevice advertisedDevice) {
+  std::string addr = advertisedDevice.getAddress().toString();
+  std::string targetLower = baselineLower(TARGET_UUID);
+  const uint8_t* payload = advertisedDevice.getPayload();
+  size_t len = advertisedDevice.getPayloadLength();
+  if (advertisedDevice.haveServiceUUID()) {
+    std::string srv = advertisedDevice.getServiceUUID().toString();
+    if (baselineLower(srv).find(targetLower) != std::string::npos) return true;
+  }
+  std::string mData = baselineField(payload, len, AD_TYPE_MANUFACTURER_DATA);
+  if (!mData.empty() && baselineLower(toHexString(mData)).find(targetLower) != std::string::npos) return true;
+  std::string sData = baselineField(payload, len, AD_TYPE_SERVICE_DATA_16, AD_TYPE_SERVICE_DATA_128);
+  if (!sData.empty() && baselineLower(toHexString(sData)).find(targetLower) != std::string::npos) return true;
+  std::string advStr = "Name: " + baselineField(payload, len, AD_TYPE_COMPLETE_LOCAL_NAME, AD_TYPE_SHORT_LOCAL_NAME) +
+                       ", Address: " + addr;
+  if (!mData.empty()) advStr += ", manufacturer data: " + toHexString(mData);
+  if (advertisedDevice.haveServiceUUID()) advStr += ", serviceUUID: " + advertisedDevice.getServiceUUID().toString();
+  return baselineLower(advStr).find(targetLower) != std::string::npos;
+}
+
+// matchAdvert alone over BENCH_ADVERTS adverts of a trace from skipUs on, against tenant
+// sets of growing size (syntheticTenant: half share the Bluetooth base UUID's trailing bytes),
+// after the baseline string pipeline on the same adverts with TARGET_UUID alone
+static void benchMatcher(AdvertSource &source, const char* traceName, uint64_t skipUs) {
+  static const size_t BENCH_ADVERTS = 200000;
+  static const int BENCH_PASSES = 5;
+  static const size_t COUNTS[] = {1, 4, 16, 64, 256};
+  std::vector<TraceAdvert> adverts;
+  TraceAdvert adv;
+  while (adverts.size() < BENCH_ADVERTS && source.next(adv)) {
+    if (adv.atUs >= skipUs) adverts.push_back(adv);
+  }
+
+  printf("\n== Matcher benchmark: %s, %u adverts x %d passes ==\n", traceName, (unsigned)adverts.size(), BENCH_PASSES);
+  std::vector<BLEAdvertisedDevice> devices;
+  for (const TraceAdvert &a : adverts) devices.emplace_back(a.addr, a.rssi, a.payload, a.len);
+  uint64_t baselineMatched = 0;
+  callbackAllocations = 0;
+  countAllocations = true;
+  auto baselineStarted = std::chrono::steady_clock::now();
+  for (int pass = 0; pass < BENCH_PASSES; pass++) {
+    for (const BLEAdvertisedDevice &d : devices) baselineMatched += baselineMatch(d);
+  }
+  auto baselineElapsed = std::chrono::steady_clock::now() - baselineStarted;
+  countAllocations = false;
+  double calls = (double)adverts.size() * BENCH_PASSES;
+  double baselineNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(baselineElapsed).count() / calls;
+  double baselineAllocs = callbackAllocations / calls;
+  printf("Baseline:    %6.1f ns/advert, %llu matched, %.1f allocs/advert (string pipeline before AdvMatcher.h)\n",
+         baselineNs, (unsigned long long)(baselineMatched / BENCH_PASSES), baselineAllocs);
+  char baselineField[64];
+  snprintf(baselineField, sizeof(baselineField), " baseline_ns=%.1f baseline_allocs=%.1f", baselineNs, baselineAllocs);
+  std::string result = baselineField;
+  for (size_t count : COUNTS) {
+    std::vector<UuidPattern> patterns(count);
+    for (size_t i = 0; i < count; i++) syntheticTenant((uint32_t)i, patterns[i]);
+    UuidPatternSet set;
+    set.assign(patterns.data(), count);
+    uint64_t matched = 0;
+    AdvMatch match;
+    callbackAllocations = 0;
+    countAllocations = true;
+    auto started = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < BENCH_PASSES; pass++) {
+      for (const TraceAdvert &a : adverts) matched += matchAdvert(a.payload, a.len, set, match);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - started;
+    countAllocations = false;
+    double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() /
+                ((double)adverts.size() * BENCH_PASSES);
+    printf("Tenants %3u: %6.1f ns/advert, %llu matched, %.1f allocs/advert, index %u bytes\n", (unsigned)count, ns,
+           (unsigned long long)(matched / BENCH_PASSES), callbackAllocations / calls, (unsigned)set.bytes());
+    char field[32];
+    snprintf(field, sizeof(field), " t%u_ns=%.1f", (unsigned)count, ns);
+    result += field;
+  }
+  printf("RESULT bench=matcher trace=%s%s\n", traceName, result.c_str());
+}
+
+// ----------------------- Upload formats -----------------------
+static const uint64_t BENCH_EPOCH_MS = 1767225600000ULL;  // 2026-01-01, where the synced clock puts the trace
+
+// The uploads a trace turns into, from raw sightings of the TARGET_UUID badges: a checkin on a
+// badge's first sighting, a break when it is back after more than PRESENCE_TIMEOUT_SECONDS (a
+// checkout and a new checkin once the absence is longer than a lunch break, or without
+// SCANNER_EDGE_SESSIONS) and a checkout after its last sighting; in time order, numbered and
+// stamped as the scanner numbers and stamps them
+static std::vector<DetectionEvent> traceEvents(AdvertSource &source) {
+  struct Badge {
+    uint32_t firstMs;
+    uint32_t lastMs;
+  };
+  UuidPattern target;
+  syntheticTenant(0, target);
+  tenantSets[0].assign(&target, 1);
+  SessionThresholds thresholds;
+  std::map<std::string, Badge> badges;
+  std::vector<DetectionEvent> events;
+  auto add = [&events](const std::string &hex, uint8_t action, uint32_t atMs, uint32_t durationSec) {
+    DetectionEvent ev;
+    if (!ev.set(hex.data(), hex.size(), action, atMs)) return;
+    ev.durationSec = durationSec;
+    events.push_back(ev);
+  };
+  TraceAdvert adv;
+  while (source.next(adv)) {
+    std::string hex = badgeHex(adv.payload, adv.len);
+    if (hex.empty()) continue;
+    uint32_t nowMs = (uint32_t)(adv.atUs / 1000);
+    auto seen = badges.emplace(hex, Badge{nowMs, nowMs});
+    Badge &b = seen.first->second;
+    uint32_t awaySec = (nowMs - b.lastMs) / 1000;
+    if (seen.second) {
+      add(hex, EVENT_CHECKIN, nowMs, 0);
+    } else if (awaySec > PRESENCE_TIMEOUT_SECONDS) {
+      uint8_t action = SCANNER_EDGE_SESSIONS ? classifyAbsence(awaySec, thresholds) : (uint8_t)EVENT_CHECKOUT;
+      if (action == EVENT_CHECKOUT) {
+        add(hex, EVENT_CHECKOUT, b.lastMs, 0);
+        add(hex, EVENT_CHECKIN, nowMs, 0);
+      } else {
+        add(hex, action, nowMs, awaySec);
+      }
+    }
+    b.lastMs = nowMs;
+  }
+  for (const auto &badge : badges) add(badge.first, EVENT_CHECKOUT, badge.second.lastMs, 0);
+  std::stable_sort(events.begin(), events.end(),
+                   [](const DetectionEvent &a, const DetectionEvent &b) { return a.seenAtMs < b.seenAtMs; });
+  for (size_t i = 0; i < events.size(); i++) {
+    events[i].seq = (uint32_t)i + 1;
+    events[i].observedMs = BENCH_EPOCH_MS + events[i].seenAtMs;
+  }
+  return events;
+}
+
+// Whether a decoded request carries events[from, from + n) as sent at nowMs by device
+static bool decodedMatches(const std::vector<MockWorker::Event> &decoded, const DetectionEvent* events, size_t n,
+                           uint32_t nowMs, const char* device) {
+  if (decoded.size() != n) return false;
+  for (size_t j = 0; j < n; j++) {
+    const MockWorker::Event &d = decoded[j];
+    const DetectionEvent &ev = events[j];
+    if (d.hex != ev.hex || d.action != ev.action || d.tenant != ev.tenant || d.durationSec != ev.durationSec ||
+        d.stamp.seq != ev.seq || d.stamp.ageMs != nowMs - ev.seenAtMs || d.stamp.observedMs != ev.observedMs ||
+        d.stamp.device != device) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// A trace's uploads in DETECT_BATCH_MAX batches as the JSON body (formatBatchJson) and as a
+// binary frame (encodeWireFrame): what encoding costs the scanner, what decoding costs the
+// mock Worker's parsers (a stand-in for the Worker's), what reading the answer costs the
+// scanner (parseIndexList vs decodeWireAck) and the bytes each way. Both decodes are checked
+// against the events. Returns false if either format does not round-trip.
+static bool benchWire(AdvertSource &source, const char* traceName) {
+  static const size_t BENCH_EVENTS = 200000;
+  static const uint8_t BENCH_MAC[WIRE_DEVICE_ID_LEN] = {0x24, 0x6F, 0x28, 0x0A, 0x1B, 0x2C};
+  static const char BENCH_DEVICE[] = "24:6F:28:0A:1B:2C";
+  std::vector<DetectionEvent> events = traceEvents(source);
+  size_t actions[EVENT_LUNCH_BREAK + 1] = {0};
+  for (const DetectionEvent &ev : events) actions[ev.action]++;
+
+  // Each batch goes out a second after its newest event
+  struct Batch {
+    size_t from;
+    size_t n;
+    uint32_t nowMs;
+  };
+  std::vector<Batch> batches;
+  for (size_t from = 0; from < events.size(); from += DETECT_BATCH_MAX) {
+    size_t n = std::min(DETECT_BATCH_MAX, events.size() - from);
+    batches.push_back({from, n, events[from + n - 1].seenAtMs + 1000});
+  }
+  int passes = events.empty() ? 1 : (int)((BENCH_EVENTS + events.size() - 1) / events.size());
+  printf("\n== Upload format benchmark: %s, %u events (%u checkins, %u checkouts, %u short breaks, %u lunch breaks) "
+         "in %u batches x %d passes ==\n",
+         traceName, (unsigned)events.size(), (unsigned)actions[EVENT_CHECKIN], (unsigned)actions[EVENT_CHECKOUT],
+         (unsigned)actions[EVENT_SHORT_BREAK], (unsigned)actions[EVENT_LUNCH_BREAK], (unsigned)batches.size(), passes);
+  if (events.empty()) {
+    printf("RESULT bench=wire trace=%s events=0 roundtrip=0\n", traceName);
+    return false;
+  }
+
+  // Request bodies, and the answers the mock Worker gives when it accepts all of them
+  std::vector<std::string> jsonBodies, frames;
+  std::vector<String> jsonAcks;
+  std::vector<std::string> wireAcks;
+  static char jsonBody[DETECT_BATCH_BODY_MAX];
+  static uint8_t frame[WIRE_FRAME_HEADER_LEN + DETECT_BATCH_MAX * WIRE_RECORD_MAX];
+  uint64_t jsonBytes = 0, wireBytes = 0, jsonAckBytes = 0, wireAckBytes = 0;
+  bool roundTrip = true;
+  for (const Batch &b : batches) {
+    size_t jsonLen = formatBatchJson(jsonBody, sizeof(jsonBody), &events[b.from], nullptr, b.n, BENCH_DEVICE, b.nowMs);
+    size_t frameLen = encodeWireFrame(frame, sizeof(frame), &events[b.from], nullptr, b.n, BENCH_MAC, b.nowMs);
+    jsonBodies.emplace_back(jsonBody, jsonLen);
+    frames.emplace_back((const char*)frame, frameLen);
+    std::string accepted;
+    for (size_t j = 0; j < b.n; j++) accepted += (j ? "," : "") + std::to_string(j);
+    jsonAcks.push_back(String("{\"success\":true,\"accepted\":[" + accepted + "],\"retry\":[]}"));
+    std::string ack = {'A', 'K', (char)WIRE_VERSION, (char)b.n};
+    wireAcks.push_back(ack.append(b.n, (char)WIRE_RECORDED));
+    jsonBytes += jsonLen;
+    wireBytes += frameLen;
+    jsonAckBytes += jsonAcks.back().length();
+    wireAckBytes += wireAcks.back().size();
+
+    std::vector<MockWorker::Event> decoded;
+    roundTrip = roundTrip && jsonLen > 0 && MockWorker::decodeJson(jsonBodies.back(), decoded) &&
+                decodedMatches(decoded, &events[b.from], b.n, b.nowMs, BENCH_DEVICE);
+    decoded.clear();
+    roundTrip = roundTrip && frameLen > 0 && MockWorker::decodeWire(frames.back(), decoded) &&
+                decodedMatches(decoded, &events[b.from], b.n, b.nowMs, BENCH_DEVICE);
+  }
+  // One event per request (SCANNER_BATCH_UPLOAD=0)
+  uint64_t jsonSingleBytes = 0, wireSingleBytes = 0;
+  for (const DetectionEvent &ev : events) {
+    char payload[EVENT_HEX_MAX + 160];
+    jsonSingleBytes += formatDetectionJson(payload, sizeof(payload), ev, BENCH_DEVICE);
+    wireSingleBytes += encodeWireFrame(frame, sizeof(frame), &ev, nullptr, 1, BENCH_MAC, ev.seenAtMs + 1000);
+  }
+
+  // ns per event over all passes, and heap allocations per event
+  double calls = (double)events.size() * passes;
+  auto timed = [&](double &allocs, auto &&body) {
+    size_t sink = 0;
+    callbackAllocations = 0;
+    countAllocations = true;
+    auto started = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; pass++) {
+      for (size_t i = 0; i < batches.size(); i++) sink += body(batches[i], i);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - started;
+    countAllocations = false;
+    allocs = callbackAllocations / calls;
+    if (sink == 0) printf("(nothing encoded)\n");
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / calls;
+  };
+  double jsonEncodeAllocs, wireEncodeAllocs, jsonDecodeAllocs, wireDecodeAllocs, jsonAckAllocs, wireAckAllocs;
+  double jsonEncodeNs = timed(jsonEncodeAllocs, [&](const Batch &b, size_t) {
+    return formatBatchJson(jsonBody, sizeof(jsonBody), &events[b.from], nullptr, b.n, BENCH_DEVICE, b.nowMs);
+  });
+  double wireEncodeNs = timed(wireEncodeAllocs, [&](const Batch &b, size_t) {
+    return encodeWireFrame(frame, sizeof(frame), &events[b.from], nullptr, b.n, BENCH_MAC, b.nowMs);
+  });
+  std::vector<MockWorker::Event> decoded;
+  double jsonDecodeNs = timed(jsonDecodeAllocs, [&](const Batch &, size_t i) {
+    decoded.clear();
+    MockWorker::decodeJson(jsonBodies[i], decoded);
+    return decoded.size();
+  });
+  double wireDecodeNs = timed(wireDecodeAllocs, [&](const Batch &, size_t i) {
+    decoded.clear();
+    MockWorker::decodeWire(frames[i], decoded);
+    return decoded.size();
+  });
+  double jsonAckNs = timed(jsonAckAllocs, [&](const Batch &b, size_t i) {
+    bool accepted[DETECT_BATCH_MAX] = {false};
+    bool retry[DETECT_BATCH_MAX] = {false};
+    if (!wasPostSuccessful(jsonAcks[i])) return (size_t)0;
+    parseIndexList(jsonAcks[i], "\"accepted\"", accepted, b.n);
+    parseIndexList(jsonAcks[i], "\"retry\"", retry, b.n);
+    return (size_t)accepted[b.n - 1];
+  });
+  double wireAckNs = timed(wireAckAllocs, [&](const Batch &b, size_t i) {
+    uint8_t statuses[DETECT_BATCH_MAX];
+    const std::string &ack = wireAcks[i];
+    if (!decodeWireAck((const uint8_t*)ack.data(), ack.size(), statuses, b.n)) return (size_t)0;
+    return (size_t)(statuses[b.n - 1] <= WIRE_DEDUPED);
+  });
+
+  double n = (double)events.size();
+  printf("JSON:    request %5.1f B/event (%5.1f one per request), ack %4.1f B/event; encode %6.1f ns/event "
+         "(%.1f allocs), decode %6.1f ns/event, ack %5.1f ns/event (%.1f allocs)\n",
+         jsonBytes / n, jsonSingleBytes / n, jsonAckBytes / n, jsonEncodeNs, jsonEncodeAllocs, jsonDecodeNs, jsonAckNs,
+         jsonAckAllocs);
+  printf("Binary:  request %5.1f B/event (%5.1f one per request), ack %4.1f B/event; encode %6.1f ns/event "
+         "(%.1f allocs), decode %6.1f ns/event, ack %5.1f ns/event (%.1f allocs)\n",
+         wireBytes / n, wireSingleBytes / n, wireAckBytes / n, wireEncodeNs, wireEncodeAllocs, wireDecodeNs, wireAckNs,
+         wireAckAllocs);
+  printf("Binary vs JSON: %.0f%% of the request bytes, %.0f%% of the ack bytes, encode %.1fx, decode %.1fx faster "
+         "(decode: the mock Worker's parsers, %.1f vs %.1f allocs/event)\n",
+         100.0 * wireBytes / jsonBytes, 100.0 * wireAckBytes / jsonAckBytes, jsonEncodeNs / wireEncodeNs,
+         jsonDecodeNs / wireDecodeNs, jsonDecodeAllocs, wireDecodeAllocs);
+  printf("Round trip: %s\n", roundTrip ? "every event decodes as sent in both formats" : "MISMATCH");
+  printf("RESULT bench=wire trace=%s events=%u json_bytes=%.1f wire_bytes=%.1f json_ack_bytes=%.1f wire_ack_bytes=%.1f "
+         "json_encode_ns=%.1f wire_encode_ns=%.1f json_decode_ns=%.1f wire_decode_ns=%.1f json_ack_ns=%.1f "
+         "wire_ack_ns=%.1f roundtrip=%d\n",
+         traceName, (unsigned)events.size(), jsonBytes / n, wireBytes / n, jsonAckBytes / n, wireAckBytes / n,
+         jsonEncodeNs, wireEncodeNs, jsonDecodeNs, wireDecodeNs, jsonAckNs, wireAckNs, roundTrip ? 1 : 0);
+  return roundTrip;
+}
+
+// ----------------------- OTA -----------------------
+static const uint32_t OTA_SIM_IMAGE_BYTES = 256 * 1024;
+static const double OTA_SIM_SPEED = 20;  // resume backoffs and paced downloads in simulated time
+
+struct OtaCase {
+  const char* name;
+  bool range;            // mock Worker honours Range
+  uint32_t bytesPerSec;  // download pace (0: unlimited)
+  uint32_t drops;        // downloads cut off ...
+  uint32_t dropAfter;    // ... this many bytes into the body
+  bool wrongImage;       // served image differs from the manifest's sha256
+  bool installs;         // expected outcome
+  uint32_t downloads;    // expected download requests
+  uint64_t servedBytes;  // expected image bytes sent over all of them
+};
+
+static bool fileEquals(const char* path, const std::string &expected) {
+  FILE* f = fopen(path, "rb");
+  if (!f) return false;
+  std::string data;
+  char buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) data.append(buf, n);
+  fclose(f);
+  return data == expected;
+}
+
+// Each case runs the scanner's own checkForOtaUpdate() -> applyFirmware() against a fresh mock
+// Worker serving a new version, then checks whether it installed (ESP.restart()), that an
+// installed update.bin is byte for byte the published image, and how many download requests
+// and image bytes it took. Returns the number of failed cases.
+static int runOtaCases(const SimOptions &opts) {
+  const uint32_t size = OTA_SIM_IMAGE_BYTES;
+  const OtaCase CASES[] = {
+      {"clean", true, 0, 0, 0, false, true, 1, size},
+      // Range resumes: each retry picks up where the last one stopped
+      {"drops", true, 64 * 1024, 3, 48 * 1024, false, true, 4, size},
+      // No Range support: every retry resends from byte 0 and the scanner skips what it has
+      {"no-range", false, 64 * 1024, 2, 100000, false, true, 3, size + 2 * 100000ULL},
+      // One flipped byte past the resume point: the sha256 covers the resumed body too
+      {"wrong-image", true, 0, 1, 100000, true, false, 2, size},
+      {"stalled", true, 0, OTA_MAX_RESUMES + 1, 16 * 1024, false, false, OTA_MAX_RESUMES + 1,
+       (OTA_MAX_RESUMES + 1) * 16 * 1024ULL},
+  };
+  hostsim::restartReturns() = true;
+  while (WiFi.status() != WL_CONNECTED && hostsim::simMs() < 60000) loop();  // the loop task brings the link up
+  printf("\n== OTA: %u-byte image, Range resume up to %d times ==\n", (unsigned)size, OTA_MAX_RESUMES);
+  int failed = 0;
+  std::string result;
+  for (const OtaCase &c : CASES) {
+    MockWorker::Options options = opts.worker;
+    options.otaImageBytes = size;
+    options.otaRange = c.range;
+    options.otaBytesPerSec = c.bytesPerSec;
+    options.otaDrops = c.drops;
+    options.otaDropAfter = c.dropAfter;
+    options.otaWrongImage = c.wrongImage;
+    MockWorker* worker = new MockWorker();  // left running, like the sim's own
+    if (!worker->start(options)) {
+      fprintf(stderr, "mock Worker failed to start\n");
+      return (int)(sizeof(CASES) / sizeof(CASES[0]));
+    }
+    hostsim::serverAddress().port = worker->port();
+    {
+      std::lock_guard<std::mutex> lock(server.mutex());
+      server.reset();  // the keep-alive socket still points at the previous case's Worker
+    }
+    remove("update.bin");
+    uint32_t restartsBefore = hostsim::restarts();
+    uint32_t startedMs = millis();
+    checkForOtaUpdate();
+    uint32_t elapsedMs = millis() - startedMs;
+    bool installed = hostsim::restarts() != restartsBefore;
+    bool imageOk = !installed || fileEquals("update.bin", worker->otaImage());
+    MockWorker::Stats s = worker->stats();
+    bool ok = installed == c.installs && imageOk && s.otaDownloads == c.downloads && s.otaBodyBytes == c.servedBytes;
+    if (!ok) failed++;
+    printf("OTA %-12s %-9s %u download(s), %u resumed with Range, %llu B served, %.1f s%s\n", c.name,
+           installed ? (imageOk ? "installed" : "CORRUPT") : "rejected", s.otaDownloads, s.otaRanged,
+           (unsigned long long)s.otaBodyBytes, elapsedMs / 1000.0, ok ? "" : "  <-- unexpected");
+    char field[64];
+    snprintf(field, sizeof(field), " %s=%s/%u", c.name, installed ? "installed" : "rejected", s.otaDownloads);
+    result += field;
+  }
+  printf("RESULT bench=ota%s failed=%d\n", result.c_str(), failed);
+  return failed;
+}
+
+int main(int argc, char** argv) {
+  SimOptions opts;
+  if (!parseArgs(argc, argv, opts)) {
+    usage();
+    return 2;
+  }
+
+  const TraceProfile* profile = opts.tracePath ? nullptr : findTraceProfile(opts.profile);
+  if (!opts.tracePath && !profile) {
+    fprintf(stderr, "unknown profile %s\n", opts.profile);
+    usage();
+    return 2;
+  }
+  TraceProfile resized;
+  if (profile && opts.badges) {
+    resized = *profile;
+    resized.badges = opts.badges;
+    profile = &resized;
+  }
+  if (opts.writeTracePath) {
+    FILE* out = fopen(opts.writeTracePath, "w");
+    if (!out || !profile) {
+      fprintf(stderr, "cannot write %s\n", opts.writeTracePath);
+      return 1;
+    }
+    SyntheticTrace trace(*profile);
+    writeTraceCsv(trace, out);
+    fclose(out);
+    return 0;
+  }
+
+  AdvertSource* source;
+  SyntheticTrace* synthetic = nullptr;
+  uint64_t traceUs = 0;
+  if (profile) {
+    synthetic = new SyntheticTrace(*profile);
+    traceUs = synthetic->durationUs();
+    source = synthetic;
+  } else {
+    CsvTrace* trace = new CsvTrace();
+    if (!trace->open(opts.tracePath)) {
+      fprintf(stderr, "cannot open %s\n", opts.tracePath);
+      return 1;
+    }
+    source = trace;
+  }
+  if (opts.benchMatcher) {
+    // Start once badges are arriving, so matches are part of the mix
+    uint64_t skipUs = profile ? (profile->arrivalStartSec + profile->arrivalSpreadSec / 2) * 1000000ULL : 0;
+    benchMatcher(*source, profile ? profile->name : opts.tracePath, skipUs);
+    return 0;
+  }
+  if (opts.benchWire) return benchWire(*source, profile ? profile->name : opts.tracePath) ? 0 : 1;
+  hostsim::timeScale() = opts.speed > 0 ? opts.speed : opts.ota ? OTA_SIM_SPEED : (profile ? profile->defaultSpeed : 1.0);
+  hostsim::serialEnabled() = opts.verbose;
+  hostsim::wallClock().driftPpm = opts.clockDriftPpm;
+  hostsim::bootMillis() = opts.bootMillis;
+  hostsim::wallClock().sntp = !opts.noSntp;
+
+  // Journal, allowlist.bin and update.bin go to a scratch directory, so every run starts empty
+  char workDir[] = "/tmp/scanner-sim-XXXXXX";
+  if (!mkdtemp(workDir) || chdir(workDir) != 0) {
+    fprintf(stderr, "cannot create a work directory\n");
+    return 1;
+  }
+
+  MockWorker* worker = nullptr;
+  hostsim::ServerAddress &target = hostsim::serverAddress();
+  if (opts.workerAddr) {
+    unsigned port = 0;
+    if (sscanf(opts.workerAddr, "%63[^:]:%u", target.host, &port) != 2) {
+      usage();
+      return 2;
+    }
+    target.port = (uint16_t)port;
+  } else {
+    worker = new MockWorker();
+    if (!worker->start(opts.worker)) {
+      fprintf(stderr, "mock Worker failed to start\n");
+      return 1;
+    }
+    target.port = worker->port();
+  }
+  const char* traceName = profile ? profile->name : opts.tracePath;
+  printf("Replaying %s at %.1fx into Scanner.cpp (work dir %s)\n", traceName, hostsim::timeScale(), workDir);
+  fflush(stdout);
+
+  if (opts.warmBoot) {
+    Preferences prefs;
+    prefs.begin(WIFI_NVS_NAMESPACE, false);
+    prefs.putBytes("bssid", WiFi.BSSID(), 6);
+    prefs.putUChar("channel", (uint8_t)WiFi.channel());
+    prefs.end();
+  }
+  if (opts.staticIp) {
+    WIFI_STATIC_IP = "192.168.1.60";
+    WIFI_GATEWAY = "192.168.1.1";
+    WIFI_SUBNET = "255.255.255.0";
+  }
+  uint32_t bootMs = hostsim::simMs();
+  setup();
+  if (opts.ota) {
+    int failed = runOtaCases(opts);
+    fflush(stdout);
+    _Exit(failed ? 1 : 0);
+  }
+  uint64_t originUs = hostsim::nowUs();
+  std::thread radioThread(radioLoop, source, originUs);
+
+  uint64_t drainUntil = 0;
+  for (;;) {
+    uint64_t traceNow = hostsim::nowUs() - originUs;
+    if (opts.outageSec) {
+      uint64_t from = opts.outageStartSec * 1000000ULL;
+      hostsim::wifiUp() = traceNow < from || traceNow >= from + opts.outageSec * 1000000ULL;
+    }
+    if (traceDone && !drainUntil) {
+      if (!traceUs) traceUs = traceNow;
+      drainUntil = hostsim::nowUs() + opts.drainSec * 1000000ULL;
+    }
+    if (drainUntil && hostsim::nowUs() >= drainUntil) break;
+    loop();
+  }
+
+  radioStop = true;
+  radioThread.join();
+  report(traceName, hostsim::timeScale(), traceUs, worker, opts, bootMs, originUs, synthetic);
+  fflush(stdout);
+  // The network task never returns; skip static destructors it may still be using
+  _Exit(0);
+}
@@ -0,0 +1,95 @@
+// Scan timing shared by the host BLE stand-ins (BLEDevice.h for Bluedroid, NimBLEDevice.h for
+// NimBLE). There is no radio: ScannerSim.cpp replays an advert trace and asks the scan the
+// firmware brought up (activeScan()) whether each advert would have been heard (a scan period
+// is running and the advert falls inside the scan window of the current interval), then has
+// the stand-in build its library's advert object and hand it to the registered callbacks the
+// way that library does. The libraries' own costs (result lists, parsing) are not modelled.
+#pragma once
+#include <Arduino.h>
+#include <functional>
+#include <mutex>
+
+namespace hostsim {
+
+class SimScan {
+ public:
+  virtual ~SimScan() {}
+
+  void setInterval(uint16_t intervalMs) { intervalMs_ = intervalMs ? intervalMs : 1; }
+  void setWindow(uint16_t windowMs) { windowMs_ = windowMs; }
+
+  void stop() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    endUs_ = 0;
+  }
+
+  // Simulated time the first scan started (0: none yet)
+  uint64_t firstStartUs() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return firstStartUs_;
+  }
+
+  // --- Host side, driven by the simulated radio ---
+
+  // Would an advert sent at simUs be heard? (inScan says whether a scan was running at all)
+  bool hears(uint64_t simUs, bool &inScan) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    inScan = endUs_ && simUs >= startUs_ && simUs < endUs_;
+    if (!inScan) return false;
+    return (simUs - startUs_) % (intervalMs_ * 1000ULL) < windowMs_ * 1000ULL;
+  }
+
+  // End of the running scan, or 0
+  uint64_t endUs() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return endUs_;
+  }
+
+  // Finish the running scan if its duration has passed and report completion
+  void expire(uint64_t simUs) {
+    std::function<void()> onComplete;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!endUs_ || simUs < endUs_) return;
+      endUs_ = 0;
+      onComplete = onComplete_;
+    }
+    if (onComplete) onComplete();
+  }
+
+  // Build the library's object for an advert (addr as printed, most significant byte first),
+  // outside the timed callback; false if no callbacks are registered
+  virtual bool prepare(const uint8_t addr[6], int rssi, const uint8_t* payload, size_t len) = 0;
+  // Hand the prepared advert to the callbacks with the library's calling convention
+  virtual void dispatch() = 0;
+
+ protected:
+  // Non-blocking scan for duration seconds; onComplete runs on the radio thread afterwards
+  bool startFor(uint32_t duration, std::function<void()> onComplete) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (endUs_) return false;
+    startUs_ = hostsim::nowUs();
+    if (!firstStartUs_) firstStartUs_ = startUs_;
+    endUs_ = startUs_ + duration * 1000000ULL;
+    onComplete_ = std::move(onComplete);
+    return true;
+  }
+
+  std::mutex mutex_;
+
+ private:
+  uint32_t intervalMs_ = 100;
+  uint32_t windowMs_ = 100;
+  uint64_t startUs_ = 0;
+  uint64_t firstStartUs_ = 0;
+  uint64_t endUs_ = 0;
+  std::function<void()> onComplete_;
+};
+
+// The scan of whichever stack the firmware initialised
+inline SimScan*& activeScan() {
+  static SimScan* scan = nullptr;
+  return scan;
+}
+
+}  // namespace hostsim
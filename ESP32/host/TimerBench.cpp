@@ -0,0 +1,368 @@
+// TimerBench: presence expiry at fleet scale, the TimerWheel against the per-second sweep it
+// replaced. Thousands of badges come and go over a few hours (stays of 20-90 min, short
+// gaps and lunch-length absences, a sighting every 1.5-4.5 s while visible); each
+// implementation replays the same sightings at Scanner.cpp's 100 ms loop tick with the
+// same rules: a badge not seen for PRESENCE_TIMEOUT_SECONDS departs and goes away, an away
+// badge that stays out past lunchBreakMaxSec is checked out.
+//   sweep      the old sweepPresence(): every second, look at every slot
+//   one-level  the previous single-level wheel (64 buckets), kept here for reference; a
+//              lunch timer sits in its bucket and is skipped every 64 s until it is due
+//   two-level  TimerWheel.h
+// For each it reports the CPU time spent expiring (the whole run and per simulated
+// second), the cost of arming a timer per sighting, and how late a departure fires
+// after the 30 s of silence actually ran out (p50 and max).
+// Then it replays 1,000 badges across millis()'s 49.7-day wrap, with seconds from
+// UptimeClock (DeviceClock.h) as Scanner.cpp counts them, and across a wrap of the wheel's
+// own 32-bit tick count; both must fire exactly what the run from boot fires.
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -Wall -Wextra -IESP32/host ESP32/host/TimerBench.cpp -o timer-bench
+//   ./timer-bench                      # 1,000 and 5,000 badges over 4 hours
+//   ./timer-bench --badges 8000 --hours 8
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+#include "../DeviceClock.h"
+#include "../TimerWheel.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static const uint32_t LOOP_TICK_MS = 100;              // Scanner.cpp
+static const uint32_t SWEEP_INTERVAL_MS = 1000;        // the old PRESENCE_SWEEP_INTERVAL_MS
+static const uint32_t SWEEP_PHASE_MS = 500;            // the sweep ran off millis(), not on second edges
+static const uint32_t PRESENCE_TIMEOUT_SECONDS = 30;   // Scanner.cpp
+static const uint32_t LUNCH_BREAK_MAX_SECONDS = 7200;  // Sessions.h default
+
+// ---------------------------------------------------------------------------
+// The single-level wheel as it was before the outer level was added
+// ---------------------------------------------------------------------------
+template <size_t Slots, size_t Buckets = 64>
+class OneLevelWheel {
+ public:
+  static const uint16_t NONE = 0xFFFF;
+
+  OneLevelWheel() {
+    for (size_t i = 0; i < Buckets; i++) heads_[i] = NONE;
+    for (size_t i = 0; i < Slots; i++) next_[i] = prev_[i] = NONE;
+  }
+
+  void schedule(size_t slot, uint32_t deadline) {
+    if (deadline < tick_) deadline = tick_;
+    if (armed_[slot]) {
+      if (deadline_[slot] == deadline) return;
+      unlink(slot);
+    }
+    deadline_[slot] = deadline;
+    link(slot, deadline % Buckets);
+  }
+
+  uint16_t popExpired(uint32_t now) {
+    if (now > tick_ + Buckets) tick_ = now - Buckets;
+    for (;;) {
+      size_t bucket = tick_ % Buckets;
+      for (uint16_t s = heads_[bucket]; s != NONE; s = next_[s]) {
+        if (deadline_[s] <= now) {
+          unlink(s);
+          return s;
+        }
+      }
+      if (tick_ >= now) return NONE;
+      tick_++;
+    }
+  }
+
+ private:
+  void link(size_t slot, size_t bucket) {
+    prev_[slot] = NONE;
+    next_[slot] = heads_[bucket];
+    if (heads_[bucket] != NONE) prev_[heads_[bucket]] = (uint16_t)slot;
+    heads_[bucket] = (uint16_t)slot;
+    armed_[slot] = true;
+  }
+
+  void unlink(size_t slot) {
+    size_t bucket = deadline_[slot] % Buckets;
+    if (prev_[slot] != NONE) next_[prev_[slot]] = next_[slot];
+    else heads_[bucket] = next_[slot];
+    if (next_[slot] != NONE) prev_[next_[slot]] = prev_[slot];
+    next_[slot] = prev_[slot] = NONE;
+    armed_[slot] = false;
+  }
+
+  uint16_t heads_[Buckets];
+  uint16_t next_[Slots];
+  uint16_t prev_[Slots];
+  uint32_t deadline_[Slots] = {};
+  bool armed_[Slots] = {};
+  uint32_t tick_ = 0;
+};
+
+// ---------------------------------------------------------------------------
+// Badge movements: one sighting stream shared by every implementation
+// ---------------------------------------------------------------------------
+struct Sighting {
+  uint32_t atMs;
+  uint32_t badge;
+};
+
+static std::vector<Sighting> planSightings(uint32_t badges, uint32_t hours, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<uint32_t> interval(1500, 4500);
+  std::uniform_int_distribution<uint32_t> stay(20 * 60, 90 * 60);
+  std::uniform_int_distribution<uint32_t> shortGap(60, 20 * 60);
+  std::uniform_int_distribution<uint32_t> longGap(60 * 60, 150 * 60);
+  std::uniform_int_distribution<uint32_t> start(0, 30 * 60);
+  std::uniform_int_distribution<uint32_t> pct(0, 99);
+  uint64_t endMs = (uint64_t)hours * 3600 * 1000;
+  std::vector<Sighting> out;
+  for (uint32_t b = 0; b < badges; b++) {
+    uint64_t t = (uint64_t)start(rng) * 1000;
+    while (t < endMs) {
+      uint64_t leave = t + (uint64_t)stay(rng) * 1000;
+      for (; t < leave && t < endMs; t += interval(rng)) out.push_back({(uint32_t)t, b});
+      t += (uint64_t)(pct(rng) < 30 ? longGap(rng) : shortGap(rng)) * 1000;
+    }
+  }
+  std::sort(out.begin(), out.end(), [](const Sighting &a, const Sighting &b) {
+    return a.atMs != b.atMs ? a.atMs < b.atMs : a.badge < b.badge;
+  });
+  return out;
+}
+
+struct Badge {
+  uint32_t lastSeenMs = 0;
+  uint32_t lastSeen = 0;  // seconds, as PresenceEntry keeps it
+  uint32_t awaySince = 0;
+  bool present = false;
+  bool away = false;
+};
+
+struct RunStats {
+  double expiryMs = 0;
+  double sightingNs = 0;
+  uint32_t departures = 0;
+  uint32_t checkouts = 0;
+  std::vector<uint32_t> lateMs;
+};
+
+// Marks a departure or lunch checkout; shared so every implementation applies the same rules
+static void depart(Badge &b, uint32_t nowMs, RunStats &st) {
+  st.lateMs.push_back(nowMs - (b.lastSeenMs + PRESENCE_TIMEOUT_SECONDS * 1000));
+  st.departures++;
+  b.present = false;
+  b.away = true;
+  b.awaySince = b.lastSeen;
+}
+
+static void checkout(Badge &b, RunStats &st) {
+  st.checkouts++;
+  b.away = false;
+}
+
+static void see(Badge &b, uint32_t nowMs, uint32_t nowSec) {
+  b.lastSeenMs = nowMs;
+  b.lastSeen = nowSec;
+  b.present = true;
+  b.away = false;
+}
+
+// What the clocks read: millis() starts at bootMs, and the seconds an implementation sees are
+// UptimeClock's plus secOffset (both 0: a run from boot)
+struct Timebase {
+  uint32_t bootMs = 0;
+  uint32_t secOffset = 0;
+};
+
+// Drives one implementation through the plan; Impl supplies onSighting() and expire()
+template <typename Impl>
+static RunStats replay(Impl &impl, std::vector<Badge> &table, const std::vector<Sighting> &plan, uint32_t hours,
+                       Timebase base = Timebase()) {
+  RunStats st;
+  UptimeClock uptime;
+  uint32_t endMs = hours * 3600 * 1000 + (LUNCH_BREAK_MAX_SECONDS + 60) * 1000;
+  size_t next = 0;
+  double sightingNs = 0;
+  for (uint32_t now = 0; now <= endMs; now += LOOP_TICK_MS) {
+    uint32_t nowMs = base.bootMs + now;
+    uint32_t nowSec = uptime.seconds(nowMs) + base.secOffset;
+    size_t first = next;
+    Clock::time_point t0 = Clock::now();
+    for (; next < plan.size() && plan[next].atMs <= now; next++) {
+      Badge &b = table[plan[next].badge];
+      see(b, nowMs, nowSec);
+      impl.onSighting(plan[next].badge, b);
+    }
+    Clock::time_point t1 = Clock::now();
+    if (next > first) sightingNs += std::chrono::duration<double, std::nano>(t1 - t0).count();
+    impl.expire(table, nowMs, nowSec, st);
+    st.expiryMs += std::chrono::duration<double, std::milli>(Clock::now() - t1).count();
+  }
+  st.sightingNs = plan.empty() ? 0 : sightingNs / plan.size();
+  return st;
+}
+
+template <size_t Slots>
+struct SweepImpl {
+  uint32_t lastSweepMs = SWEEP_PHASE_MS - SWEEP_INTERVAL_MS;
+  void onSighting(uint32_t, const Badge &) {}
+  void expire(std::vector<Badge> &table, uint32_t nowMs, uint32_t nowSec, RunStats &st) {
+    if (nowMs - lastSweepMs < SWEEP_INTERVAL_MS) return;
+    lastSweepMs = nowMs;
+    for (size_t i = 0; i < Slots; i++) {  // removeIf looked at every slot of the table
+      Badge &b = table[i];
+      if (b.present && nowSec - b.lastSeen > PRESENCE_TIMEOUT_SECONDS) depart(b, nowMs, st);
+      else if (b.away && nowSec - b.awaySince > LUNCH_BREAK_MAX_SECONDS) checkout(b, st);
+    }
+  }
+};
+
+// Same rules as presenceDeadlineLocked()/expirePresence() in Scanner.cpp
+template <typename Wheel>
+struct WheelImpl {
+  Wheel wheel;
+  void onSighting(uint32_t badge, const Badge &b) { wheel.schedule(badge, b.lastSeen + PRESENCE_TIMEOUT_SECONDS + 1); }
+  void expire(std::vector<Badge> &table, uint32_t nowMs, uint32_t nowSec, RunStats &st) {
+    for (uint16_t s = wheel.popExpired(nowSec); s != Wheel::NONE; s = wheel.popExpired(nowSec)) {
+      Badge &b = table[s];
+      if (b.present) {
+        depart(b, nowMs, st);
+        wheel.schedule(s, b.awaySince + LUNCH_BREAK_MAX_SECONDS + 1);
+      } else if (b.away) {
+        checkout(b, st);
+      }
+    }
+  }
+};
+
+static uint32_t percentileOf(std::vector<uint32_t> v, double q) {
+  if (v.empty()) return 0;
+  size_t idx = (size_t)(q / 100.0 * (v.size() - 1));
+  std::nth_element(v.begin(), v.begin() + idx, v.end());
+  return v[idx];
+}
+
+static void printRow(const char* name, const RunStats &st, uint32_t hours) {
+  uint32_t simSeconds = hours * 3600 + LUNCH_BREAK_MAX_SECONDS + 60;
+  printf("  %-10s expiry %9.1f ms total (%7.2f us per simulated second), %5.1f ns/sighting, "
+         "late p50 %4u ms max %4u ms\n",
+         name, st.expiryMs, st.expiryMs * 1000.0 / simSeconds, st.sightingNs, percentileOf(st.lateMs, 50),
+         st.lateMs.empty() ? 0 : *std::max_element(st.lateMs.begin(), st.lateMs.end()));
+}
+
+// Slots is the table the scanner would need for this many badges (3/4 load)
+template <size_t Slots>
+static bool runSize(uint32_t badges, uint32_t hours, uint32_t seed) {
+  std::vector<Sighting> plan = planSightings(badges, hours, seed);
+  printf("Badges %u (%zu slots), %u h at %u ms ticks, %zu sightings\n", badges, Slots, hours, LOOP_TICK_MS, plan.size());
+
+  std::vector<Badge> table(Slots);
+  SweepImpl<Slots> sweep;
+  RunStats swept = replay(sweep, table, plan, hours);
+  printRow("sweep", swept, hours);
+
+  table.assign(Slots, Badge());
+  std::unique_ptr<WheelImpl<OneLevelWheel<Slots>>> one(new WheelImpl<OneLevelWheel<Slots>>());
+  RunStats single = replay(*one, table, plan, hours);
+  printRow("one-level", single, hours);
+
+  table.assign(Slots, Badge());
+  std::unique_ptr<WheelImpl<TimerWheel<Slots>>> two(new WheelImpl<TimerWheel<Slots>>());
+  RunStats wheeled = replay(*two, table, plan, hours);
+  printRow("two-level", wheeled, hours);
+
+  bool same = swept.departures == wheeled.departures && swept.checkouts == wheeled.checkouts &&
+              single.departures == wheeled.departures && single.checkouts == wheeled.checkouts;
+  printf("  %u departures, %u lunch checkouts%s\n", wheeled.departures, wheeled.checkouts,
+         same ? "" : " (MISMATCH between implementations)");
+  printf("RESULT badges=%u sweep_ms=%.1f one_level_ms=%.1f two_level_ms=%.1f sweep_late_max_ms=%u "
+         "two_level_late_max_ms=%u departures=%u checkouts=%u\n",
+         badges, swept.expiryMs, single.expiryMs, wheeled.expiryMs,
+         swept.lateMs.empty() ? 0 : *std::max_element(swept.lateMs.begin(), swept.lateMs.end()),
+         wheeled.lateMs.empty() ? 0 : *std::max_element(wheeled.lateMs.begin(), wheeled.lateMs.end()),
+         wheeled.departures, wheeled.checkouts);
+  return same;
+}
+
+static bool runBadges(uint32_t badges, uint32_t hours, uint32_t seed) {
+  if (badges <= 768) return runSize<1024>(badges, hours, seed);
+  if (badges <= 1536) return runSize<2048>(badges, hours, seed);
+  if (badges <= 3072) return runSize<4096>(badges, hours, seed);
+  if (badges <= 6144) return runSize<8192>(badges, hours, seed);
+  if (badges <= 12288) return runSize<16384>(badges, hours, seed);
+  fprintf(stderr, "at most 12288 badges\n");
+  return false;
+}
+
+// The wheel from boot against the same plan with millis() wrapping an hour and six minutes
+// in (bootMs a whole number of seconds, so every second edge falls where it did) and with
+// the wheel's tick count wrapping an hour in. Returns false unless all three agree.
+static bool runWrap(uint32_t seed) {
+  const uint32_t badges = 1000, hours = 4;
+  typedef TimerWheel<1024> Wheel;
+  std::vector<Sighting> plan = planSightings(badges, hours, seed);
+  printf("Wrap: %u badges, %u h\n", badges, hours);
+  Timebase bases[3];
+  bases[1].bootMs = 4291000000u;  // millis() wraps at 4294967.296 s
+  bases[2].secOffset = 0u - 3600;
+  const char* names[3] = {"from boot", "millis wrap", "tick wrap"};
+  RunStats runs[3];
+  for (int i = 0; i < 3; i++) {
+    std::vector<Badge> table(1024);
+    std::unique_ptr<WheelImpl<Wheel>> impl(new WheelImpl<Wheel>());
+    runs[i] = replay(*impl, table, plan, hours, bases[i]);
+    std::sort(runs[i].lateMs.begin(), runs[i].lateMs.end());  // same-tick timers may pop in another order
+    uint32_t lateMax = runs[i].lateMs.empty() ? 0 : *std::max_element(runs[i].lateMs.begin(), runs[i].lateMs.end());
+    printf("  %-11s %u departures, %u lunch checkouts, late p50 %4u ms max %4u ms\n", names[i], runs[i].departures,
+           runs[i].checkouts, percentileOf(runs[i].lateMs, 50), lateMax);
+  }
+  bool same = true;
+  for (int i = 1; i < 3; i++) {
+    same = same && runs[i].departures == runs[0].departures && runs[i].checkouts == runs[0].checkouts &&
+           runs[i].lateMs == runs[0].lateMs;
+  }
+  printf("  %s\n", same ? "every timer fired as from boot" : "MISMATCH across the wrap");
+  printf("RESULT wrap=%d departures=%u checkouts=%u millis_wrap_departures=%u tick_wrap_departures=%u\n", same ? 1 : 0,
+         runs[0].departures, runs[0].checkouts, runs[1].departures, runs[2].departures);
+  return same;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: timer-bench [--badges N] [--hours H] [--seed S]\n"
+          "  without --badges, runs 1000 and 5000 badges\n");
+}
+
+int main(int argc, char** argv) {
+  uint32_t badges = 0;
+  uint32_t hours = 4;
+  uint32_t seed = 1;
+  for (int i = 1; i < argc; i++) {
+    const char* a = argv[i];
+    if (i + 1 >= argc) {
+      usage();
+      return 2;
+    }
+    if (!strcmp(a, "--badges")) badges = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(a, "--hours")) hours = (uint32_t)atoi(argv[++i]);
+    else if (!strcmp(a, "--seed")) seed = (uint32_t)atoi(argv[++i]);
+    else {
+      usage();
+      return 2;
+    }
+  }
+  bool ok = true;
+  if (badges) {
+    ok = runBadges(badges, hours, seed);
+  } else {
+    ok = runBadges(1000, hours, seed) && ok;
+    ok = runBadges(5000, hours, seed) && ok;
+  }
+  ok = runWrap(seed) && ok;
+  return ok ? 0 : 1;
+}
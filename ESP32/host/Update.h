@@ -0,0 +1,55 @@
+// Host stand-in for the Arduino Update library: the "partition" is a file next to the
+// journal (update.bin), so an OTA run in the simulator leaves the image it wrote behind.
+#pragma once
+#include <Arduino.h>
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+
+class UpdateClass {
+ public:
+  bool begin(size_t size) {
+    abort();
+    file_ = fopen("update.bin", "wb");
+    size_ = size;
+    written_ = 0;
+    error_ = file_ ? 0 : 1;
+    return file_ != nullptr;
+  }
+
+  size_t write(uint8_t* data, size_t len) {
+    if (!file_ || written_ + len > size_) {
+      error_ = 2;
+      return 0;
+    }
+    size_t n = fwrite(data, 1, len, file_);
+    written_ += n;
+    return n;
+  }
+
+  bool end(bool evenIfRemaining = false) {
+    if (!file_) return false;
+    fclose(file_);
+    file_ = nullptr;
+    finished_ = evenIfRemaining || written_ == size_;
+    if (!finished_) error_ = 3;
+    return finished_;
+  }
+
+  void abort() {
+    if (file_) fclose(file_);
+    file_ = nullptr;
+    finished_ = false;
+  }
+
+  bool isFinished() { return finished_; }
+  uint8_t getError() { return error_; }
+
+ private:
+  FILE* file_ = nullptr;
+  size_t size_ = 0;
+  size_t written_ = 0;
+  bool finished_ = false;
+  uint8_t error_ = 0;
+};
+
+inline UpdateClass Update;
@@ -0,0 +1,281 @@
+// Host stand-in for the Arduino WiFi library: WiFiClient is a plain POSIX TCP socket.
+// Every connect() goes to hostsim::serverAddress() (the mock Worker, or --worker) whatever
+// host Scanner.cpp asks for, and hostsim::wifiUp() simulates the access point dropping out.
+// Joining takes simulated time like on the ESP32: an all-channel scan unless begin() is
+// given the BSSID and channel, then association, then DHCP unless config() set a static IP.
+// As in the core, a dropped station rejoins by itself (full scan) unless setAutoReconnect(false).
+#pragma once
+#include <Arduino.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+enum wl_status_t { WL_IDLE_STATUS = 0, WL_NO_SSID_AVAIL = 1, WL_CONNECTED = 3, WL_CONNECT_FAILED = 4, WL_DISCONNECTED = 6 };
+enum wifi_mode_t { WIFI_OFF = 0, WIFI_STA = 1 };
+
+namespace hostsim {
+
+struct ServerAddress {
+  char host[64] = "127.0.0.1";
+  uint16_t port = 0;  // 0: use whatever port Scanner.cpp asked for
+};
+
+inline ServerAddress &serverAddress() {
+  static ServerAddress address;
+  return address;
+}
+
+inline std::atomic<bool> &wifiUp() {
+  static std::atomic<bool> up{true};
+  return up;
+}
+
+// The station has joined (and has an address); sockets need this as well as wifiUp()
+inline std::atomic<bool> &associated() {
+  static std::atomic<bool> joined{false};
+  return joined;
+}
+
+// Simulated join phases, ms (typical ESP32 figures)
+static const uint32_t WIFI_SCAN_MS = 2500;   // active scan of all 13 channels
+static const uint32_t WIFI_JOIN_MS = 300;    // probe, auth and association on a known channel
+static const uint32_t WIFI_DHCP_MS = 800;
+
+}  // namespace hostsim
+
+class IPAddress {
+ public:
+  IPAddress() {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : octets_{a, b, c, d} {}
+  bool fromString(const char* s) {
+    unsigned a, b, c, d;
+    if (!s || sscanf(s, "%u.%u.%u.%u", &a, &b, &c, &d) != 4 || a > 255 || b > 255 || c > 255 || d > 255) return false;
+    *this = IPAddress((uint8_t)a, (uint8_t)b, (uint8_t)c, (uint8_t)d);
+    return true;
+  }
+  String toString() const {
+    char s[16];
+    snprintf(s, sizeof(s), "%u.%u.%u.%u", octets_[0], octets_[1], octets_[2], octets_[3]);
+    return s;
+  }
+
+ private:
+  uint8_t octets_[4] = {127, 0, 0, 1};
+};
+
+class WiFiClient {
+ public:
+  WiFiClient() {}
+  WiFiClient(const WiFiClient &) = delete;
+  WiFiClient &operator=(const WiFiClient &) = delete;
+  ~WiFiClient() { stop(); }
+
+  int connect(const char* host, uint16_t port, int32_t timeoutMs = 3000) {
+    stop();
+    if (!hostsim::wifiUp() || !hostsim::associated()) return 0;
+    const hostsim::ServerAddress &target = hostsim::serverAddress();
+    char service[8];
+    snprintf(service, sizeof(service), "%u", (unsigned)(target.port ? target.port : port));
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    if (getaddrinfo(target.host[0] ? target.host : host, service, &hints, &res) != 0 || !res) return 0;
+
+    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd >= 0) {
+      fcntl(fd, F_SETFL, O_NONBLOCK);
+      int rc = ::connect(fd, res->ai_addr, res->ai_addrlen);
+      if (rc != 0 && errno == EINPROGRESS) {
+        pollfd p = {fd, POLLOUT, 0};
+        int err = 0;
+        socklen_t errLen = sizeof(err);
+        if (poll(&p, 1, realMs(timeoutMs)) == 1 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errLen) == 0 && err == 0) {
+          rc = 0;
+        }
+      }
+      if (rc == 0) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fd_ = fd;
+      } else {
+        ::close(fd);
+      }
+    }
+    freeaddrinfo(res);
+    return fd_ >= 0 ? 1 : 0;
+  }
+
+  // Open, and the peer has not closed it (unread data still counts as connected)
+  uint8_t connected() {
+    if (fd_ < 0) return 0;
+    if (!hostsim::wifiUp()) {
+      stop();
+      return 0;
+    }
+    char c;
+    ssize_t n = recv(fd_, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n > 0 || (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))) return 1;
+    stop();
+    return 0;
+  }
+
+  int available() {
+    if (fd_ < 0) return 0;
+    int n = 0;
+    return ioctl(fd_, FIONREAD, &n) == 0 ? n : 0;
+  }
+
+  // Non-blocking: whatever has arrived, up to len; -1 if nothing
+  int read(uint8_t* buf, size_t len) {
+    if (fd_ < 0) return -1;
+    ssize_t n = recv(fd_, buf, len, MSG_DONTWAIT);
+    return n > 0 ? (int)n : -1;
+  }
+
+  int read() {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+  }
+
+  // Blocking up to the stream timeout; returns the bytes read (short on timeout/close)
+  size_t readBytes(uint8_t* buf, size_t len) {
+    size_t got = 0;
+    uint64_t deadline = hostsim::nowUs() + timeoutMs_ * 1000ULL;
+    while (got < len && fd_ >= 0) {
+      ssize_t n = recv(fd_, buf + got, len - got, MSG_DONTWAIT);
+      if (n > 0) {
+        got += (size_t)n;
+        continue;
+      }
+      if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) break;
+      uint64_t now = hostsim::nowUs();
+      if (now >= deadline) break;
+      pollfd p = {fd_, POLLIN, 0};
+      poll(&p, 1, realMs((int32_t)((deadline - now + 999) / 1000)));
+    }
+    return got;
+  }
+  size_t readBytes(char* buf, size_t len) { return readBytes((uint8_t*)buf, len); }
+
+  size_t write(const uint8_t* buf, size_t len) {
+    size_t sent = 0;
+    while (sent < len && fd_ >= 0) {
+      ssize_t n = send(fd_, buf + sent, len - sent, MSG_NOSIGNAL);
+      if (n > 0) {
+        sent += (size_t)n;
+      } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        pollfd p = {fd_, POLLOUT, 0};
+        if (poll(&p, 1, realMs((int32_t)timeoutMs_)) != 1) break;
+      } else {
+        break;
+      }
+    }
+    return sent;
+  }
+
+  void setTimeout(uint32_t ms) { timeoutMs_ = ms; }
+
+  void stop() {
+    if (fd_ >= 0) ::close(fd_);
+    fd_ = -1;
+  }
+
+ private:
+  // Simulated milliseconds -> real poll() timeout
+  static int realMs(int32_t simMs) {
+    double ms = simMs / hostsim::timeScale();
+    return ms < 1 ? 1 : (int)ms;
+  }
+
+  int fd_ = -1;
+  uint32_t timeoutMs_ = 1000;
+};
+
+class WiFiClass {
+ public:
+  void mode(wifi_mode_t) {}
+  void persistent(bool) {}
+  void setAutoReconnect(bool on) { autoReconnect_ = on; }
+
+  bool config(IPAddress local, IPAddress, IPAddress, IPAddress = IPAddress()) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    staticIp_ = true;
+    ip_ = local;
+    return true;
+  }
+
+  void begin(const char*, const char*, int32_t channel = 0, const uint8_t* bssid = nullptr, bool connect = true) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (connect) startJoin(channel > 0 && bssid != nullptr);
+  }
+
+  bool disconnect(bool = false, bool = false) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    joining_ = false;
+    noAp_ = false;
+    setLinked(false);
+    return true;
+  }
+
+  // A join completes once its phases have elapsed, if the AP is there at that point
+  // (otherwise WL_NO_SSID_AVAIL, after the scan or the probe on the known channel)
+  wl_status_t status() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool apUp = hostsim::wifiUp();
+    if (linked_ && !apUp) {
+      setLinked(false);
+      if (autoReconnect_) startJoin(false);
+    }
+    if (joining_ && (int32_t)(millis() - joinDoneMs_) >= 0) {
+      if (apUp) {
+        joining_ = false;
+        setLinked(true);
+      } else if (autoReconnect_) {
+        startJoin(false);  // the core keeps trying
+      } else {
+        joining_ = false;
+        noAp_ = true;
+      }
+    }
+    if (linked_) return WL_CONNECTED;
+    return noAp_ ? WL_NO_SSID_AVAIL : WL_DISCONNECTED;
+  }
+
+  IPAddress localIP() { return ip_; }
+  String macAddress() { return "02:00:00:00:00:01"; }
+  uint8_t* BSSID() { return bssid_; }
+  int32_t channel() { return 6; }
+
+ private:
+  void startJoin(bool known) {
+    joining_ = true;
+    noAp_ = false;
+    setLinked(false);
+    joinDoneMs_ = millis() + (known ? 0 : hostsim::WIFI_SCAN_MS) + hostsim::WIFI_JOIN_MS + (staticIp_ ? 0 : hostsim::WIFI_DHCP_MS);
+  }
+
+  void setLinked(bool linked) {
+    linked_ = linked;
+    hostsim::associated() = linked;
+  }
+
+  std::mutex mutex_;
+  bool autoReconnect_ = true;
+  bool staticIp_ = false;
+  bool joining_ = false;
+  bool linked_ = false;
+  bool noAp_ = false;
+  uint32_t joinDoneMs_ = 0;
+  IPAddress ip_ = IPAddress(192, 168, 1, 77);
+  uint8_t bssid_[6] = {0x02, 0x00, 0x00, 0x00, 0x0A, 0x01};
+};
+
+inline WiFiClass WiFi;
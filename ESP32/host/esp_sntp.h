@@ -0,0 +1,71 @@
+// Host stand-in for ESP-IDF's SNTP client (esp_sntp.h) and the core's configTime(). Once
+// configTime() is called, a thread answers a request whenever the station is up: right
+// away, then every sntp_set_sync_interval() ms (every 15 s while the link is down), handing
+// the sync callback hostsim::trueEpochMs(). The simulated clock is the scanner's crystal;
+// hostsim::wallClock().driftPpm makes real time run that much faster than it.
+#pragma once
+#include <Arduino.h>
+#include <WiFi.h>
+#include <sys/time.h>
+
+typedef void (*sntp_sync_time_cb_t)(struct timeval* tv);
+
+namespace hostsim {
+
+struct WallClock {
+  uint64_t originMs = 1767600000000ULL;  // Unix time at simulated time 0 (2026-01-05 08:00 UTC)
+  double driftPpm = 0;                   // --clock-drift
+  bool sntp = true;                      // --no-sntp: the server never answers
+};
+
+inline WallClock &wallClock() {
+  static WallClock clock;
+  return clock;
+}
+
+// Unix ms when the simulated clock reads simUs
+inline uint64_t trueEpochMs(uint64_t simUs) {
+  return wallClock().originMs + (uint64_t)(simUs / 1000.0 * (1.0 + wallClock().driftPpm * 1e-6));
+}
+
+struct SntpClient {
+  std::atomic<sntp_sync_time_cb_t> callback{nullptr};
+  std::atomic<uint32_t> intervalMs{3600 * 1000};
+  std::atomic<uint32_t> syncs{0};
+};
+
+inline SntpClient &sntpClient() {
+  static SntpClient client;
+  return client;
+}
+
+static const uint32_t SNTP_RETRY_MS = 15000;
+static const uint32_t SNTP_ROUND_TRIP_MS = 40;
+
+inline void sntpLoop() {
+  for (;;) {
+    if (!wallClock().sntp || !wifiUp() || !associated()) {
+      delay(SNTP_RETRY_MS);
+      continue;
+    }
+    delay(SNTP_ROUND_TRIP_MS);
+    uint64_t ms = trueEpochMs(nowUs());
+    struct timeval tv;
+    tv.tv_sec = (time_t)(ms / 1000);
+    tv.tv_usec = (suseconds_t)(ms % 1000 * 1000);
+    sntpClient().syncs++;
+    if (sntp_sync_time_cb_t cb = sntpClient().callback.load()) cb(&tv);
+    delay(sntpClient().intervalMs.load());
+  }
+}
+
+}  // namespace hostsim
+
+inline void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback) { hostsim::sntpClient().callback = callback; }
+inline void sntp_set_sync_interval(uint32_t intervalMs) { hostsim::sntpClient().intervalMs = intervalMs; }
+
+// Time zone and server are ignored; the first call starts the client
+inline void configTime(long, int, const char*, const char* = nullptr, const char* = nullptr) {
+  static std::once_flag started;
+  std::call_once(started, [] { std::thread(hostsim::sntpLoop).detach(); });
+}
@@ -0,0 +1,12 @@
+-- Break thresholds for sessions computed on the scanners (ESP32/Sessions.h), served on
+-- GET /api/esp32/session-config. One row: an absence up to short_break_max_seconds is a
+-- short break, up to lunch_break_max_seconds a lunch break, anything longer a checkout.
+CREATE TABLE session_settings (
+  id INTEGER PRIMARY KEY CHECK (id = 1),
+  short_break_max_seconds INTEGER NOT NULL,
+  lunch_break_max_seconds INTEGER NOT NULL,
+  updated_at DATETIME DEFAULT CURRENT_TIMESTAMP
+);
+
+-- The Attendance page already calls a gap of 10 minutes or more a lunch break
+INSERT INTO session_settings (id, short_break_max_seconds, lunch_break_max_seconds) VALUES (1, 600, 7200);
@@ -0,0 +1,9 @@
+-- Scanner time and sequence numbers: device_observed_at is when the scanner saw the badge
+-- by its SNTP-disciplined clock (recorded_at is set from it when it is plausible), and
+-- (device_id, device_seq) identifies an event, so a retried or replayed upload is a no-op
+ALTER TABLE attendance_records ADD COLUMN device_id TEXT;
+ALTER TABLE attendance_records ADD COLUMN device_seq INTEGER;
+ALTER TABLE attendance_records ADD COLUMN device_observed_at TEXT;
+
+-- Rows from the dashboard and older firmware leave both NULL, which SQLite never treats as equal
+CREATE UNIQUE INDEX idx_attendance_device_seq ON attendance_records(device_id, device_seq);
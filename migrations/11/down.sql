@@ -0,0 +1,4 @@
+DROP INDEX idx_attendance_device_seq;
+ALTER TABLE attendance_records DROP COLUMN device_observed_at;
+ALTER TABLE attendance_records DROP COLUMN device_seq;
+ALTER TABLE attendance_records DROP COLUMN device_id;
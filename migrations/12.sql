@@ -0,0 +1,111 @@
+-- Detection hot path: what /api/esp32/detect used to work out with a join, a LOWER(name)
+-- scan and an ORDER BY recorded_at DESC query per sighting, kept up to date by triggers.
+
+-- Every key a scanner can report for an employee: 'hex:' || employee_details.hex_value and
+-- 'name:' || LOWER(employees.name) (hex that decodes to the name). Inactive employees keep
+-- their keys; lookups join employees and check is_active.
+CREATE TABLE employee_lookup (
+  lookup_key TEXT NOT NULL,
+  employee_id INTEGER NOT NULL,
+  PRIMARY KEY (lookup_key, employee_id)
+);
+
+CREATE INDEX idx_employee_lookup_employee_id ON employee_lookup(employee_id);
+
+INSERT OR IGNORE INTO employee_lookup (lookup_key, employee_id)
+SELECT 'hex:' || hex_value, employee_id FROM employee_details WHERE hex_value IS NOT NULL;
+
+INSERT OR IGNORE INTO employee_lookup (lookup_key, employee_id)
+SELECT 'name:' || LOWER(name), id FROM employees;
+
+CREATE TRIGGER trg_employees_lookup_insert AFTER INSERT ON employees
+BEGIN
+  INSERT OR IGNORE INTO employee_lookup (lookup_key, employee_id) VALUES ('name:' || LOWER(NEW.name), NEW.id);
+END;
+
+CREATE TRIGGER trg_employees_lookup_rename AFTER UPDATE OF name ON employees
+BEGIN
+  DELETE FROM employee_lookup WHERE lookup_key = 'name:' || LOWER(OLD.name) AND employee_id = OLD.id;
+  INSERT OR IGNORE INTO employee_lookup (lookup_key, employee_id) VALUES ('name:' || LOWER(NEW.name), NEW.id);
+END;
+
+CREATE TRIGGER trg_employees_lookup_delete AFTER DELETE ON employees
+BEGIN
+  DELETE FROM employee_lookup WHERE employee_id = OLD.id;
+END;
+
+CREATE TRIGGER trg_employee_details_lookup_insert AFTER INSERT ON employee_details
+WHEN NEW.hex_value IS NOT NULL
+BEGIN
+  INSERT OR IGNORE INTO employee_lookup (lookup_key, employee_id) VALUES ('hex:' || NEW.hex_value, NEW.employee_id);
+END;
+
+CREATE TRIGGER trg_employee_details_lookup_update AFTER UPDATE OF hex_value, employee_id ON employee_details
+BEGIN
+  DELETE FROM employee_lookup WHERE lookup_key = 'hex:' || OLD.hex_value AND employee_id = OLD.employee_id;
+  INSERT OR IGNORE INTO employee_lookup (lookup_key, employee_id)
+  SELECT 'hex:' || NEW.hex_value, NEW.employee_id WHERE NEW.hex_value IS NOT NULL;
+END;
+
+CREATE TRIGGER trg_employee_details_lookup_delete AFTER DELETE ON employee_details
+BEGIN
+  DELETE FROM employee_lookup WHERE lookup_key = 'hex:' || OLD.hex_value AND employee_id = OLD.employee_id;
+END;
+
+-- Each employee's most recent attendance record (latest recorded_at), which the duplicate
+-- check-in/checkout rules compare against
+CREATE TABLE employee_last_state (
+  employee_id INTEGER PRIMARY KEY,
+  attendance_id INTEGER NOT NULL,
+  status TEXT NOT NULL,
+  recorded_at TIMESTAMP NOT NULL
+);
+
+-- Recomputing an employee's last record after a delete or edit
+CREATE INDEX idx_attendance_employee_recorded ON attendance_records(employee_id, recorded_at);
+
+INSERT INTO employee_last_state (employee_id, attendance_id, status, recorded_at)
+SELECT employee_id, id, status, recorded_at FROM (
+  SELECT employee_id, id, status, recorded_at,
+    ROW_NUMBER() OVER (PARTITION BY employee_id ORDER BY recorded_at DESC, id DESC) AS rn
+  FROM attendance_records
+) WHERE rn = 1;
+
+-- A late upload (older recorded_at) is history, not the employee's current state
+CREATE TRIGGER trg_attendance_last_state_insert AFTER INSERT ON attendance_records
+BEGIN
+  INSERT INTO employee_last_state (employee_id, attendance_id, status, recorded_at)
+  VALUES (NEW.employee_id, NEW.id, NEW.status, NEW.recorded_at)
+  ON CONFLICT (employee_id) DO UPDATE SET
+    attendance_id = excluded.attendance_id,
+    status = excluded.status,
+    recorded_at = excluded.recorded_at
+  WHERE excluded.recorded_at >= employee_last_state.recorded_at;
+END;
+
+CREATE TRIGGER trg_attendance_last_state_update AFTER UPDATE OF employee_id, status, recorded_at ON attendance_records
+BEGIN
+  DELETE FROM employee_last_state WHERE employee_id IN (OLD.employee_id, NEW.employee_id);
+  INSERT INTO employee_last_state (employee_id, attendance_id, status, recorded_at)
+  SELECT employee_id, id, status, recorded_at FROM (
+    SELECT employee_id, id, status, recorded_at,
+      ROW_NUMBER() OVER (PARTITION BY employee_id ORDER BY recorded_at DESC, id DESC) AS rn
+    FROM attendance_records
+    WHERE employee_id IN (OLD.employee_id, NEW.employee_id)
+  ) WHERE rn = 1;
+END;
+
+CREATE TRIGGER trg_attendance_last_state_delete AFTER DELETE ON attendance_records
+WHEN OLD.id = (SELECT attendance_id FROM employee_last_state WHERE employee_id = OLD.employee_id)
+BEGIN
+  DELETE FROM employee_last_state WHERE employee_id = OLD.employee_id;
+  INSERT INTO employee_last_state (employee_id, attendance_id, status, recorded_at)
+  SELECT employee_id, id, status, recorded_at FROM attendance_records
+  WHERE employee_id = OLD.employee_id
+  ORDER BY recorded_at DESC, id DESC LIMIT 1;
+END;
+
+CREATE TRIGGER trg_employees_last_state_delete AFTER DELETE ON employees
+BEGIN
+  DELETE FROM employee_last_state WHERE employee_id = OLD.id;
+END;
@@ -0,0 +1,14 @@
+DROP TRIGGER trg_employees_last_state_delete;
+DROP TRIGGER trg_attendance_last_state_delete;
+DROP TRIGGER trg_attendance_last_state_update;
+DROP TRIGGER trg_attendance_last_state_insert;
+DROP INDEX idx_attendance_employee_recorded;
+DROP TABLE employee_last_state;
+DROP TRIGGER trg_employee_details_lookup_delete;
+DROP TRIGGER trg_employee_details_lookup_update;
+DROP TRIGGER trg_employee_details_lookup_insert;
+DROP TRIGGER trg_employees_lookup_delete;
+DROP TRIGGER trg_employees_lookup_rename;
+DROP TRIGGER trg_employees_lookup_insert;
+DROP INDEX idx_employee_lookup_employee_id;
+DROP TABLE employee_lookup;
@@ -0,0 +1,14 @@
+-- Scanner heartbeats: one row per POST /api/esp32/heartbeat, pruned after 30 days
+CREATE TABLE device_heartbeats (
+  id INTEGER PRIMARY KEY AUTOINCREMENT,
+  device_id TEXT NOT NULL,
+  firmware_version TEXT,
+  uptime_seconds INTEGER,
+  free_heap_min INTEGER,
+  largest_block_min INTEGER,
+  payload TEXT NOT NULL,
+  received_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP
+);
+
+CREATE INDEX idx_device_heartbeats_device_received ON device_heartbeats(device_id, received_at);
+CREATE INDEX idx_device_heartbeats_received ON device_heartbeats(received_at);
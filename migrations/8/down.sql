@@ -0,0 +1,3 @@
+DROP INDEX idx_device_heartbeats_received;
+DROP INDEX idx_device_heartbeats_device_received;
+DROP TABLE device_heartbeats;
@@ -0,0 +1,14 @@
+-- Tenant companies sharing the scanners: each advertises its own UUID, scanners match all
+-- active tenants (GET /api/esp32/tenants) and attendance records carry the matched tenant's
+-- UUID in company_uuid
+CREATE TABLE tenants (
+  id INTEGER PRIMARY KEY AUTOINCREMENT,
+  name TEXT NOT NULL,
+  uuid TEXT NOT NULL UNIQUE,
+  is_active INTEGER NOT NULL DEFAULT 1,
+  created_at DATETIME DEFAULT CURRENT_TIMESTAMP,
+  updated_at DATETIME DEFAULT CURRENT_TIMESTAMP
+);
+
+-- The company UUID every scanner has matched so far
+INSERT INTO tenants (name, uuid) VALUES ('Thumbstack', 'D7E1A3F4');
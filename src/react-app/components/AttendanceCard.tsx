@@ -8,6 +8,10 @@ interface AttendanceCardProps {
 
 export default function AttendanceCard({ record, statusSuffix }: AttendanceCardProps) {
   const isCheckIn = record.status === 'checkin';
+  const isBreak = record.status === 'short_break' || record.status === 'lunch_break';
+  const label = isBreak
+    ? (record.status === 'short_break' ? 'Short Break' : 'Lunch Break')
+    : isCheckIn ? 'Check In' : 'Check Out';
   
   const formatTime = (timestamp: string) => {
     const date = new Date(timestamp);
@@ -33,9 +37,9 @@ export default function AttendanceCard({ record, statusSuffix }: AttendanceCardP
         {/* Employee Info */}
         <div className="flex items-center space-x-4">
           <div className={`w-12 h-12 rounded-full flex items-center justify-center ${
-            isCheckIn ? 'bg-green-100' : 'bg-red-100'
+            isBreak ? 'bg-amber-100' : isCheckIn ? 'bg-green-100' : 'bg-red-100'
           }`}>
-            <User className={`w-6 h-6 ${isCheckIn ? 'text-green-600' : 'text-red-600'}`} />
+            <User className={`w-6 h-6 ${isBreak ? 'text-amber-600' : isCheckIn ? 'text-green-600' : 'text-red-600'}`} />
           </div>
           
           <div>
@@ -50,11 +54,13 @@ export default function AttendanceCard({ record, statusSuffix }: AttendanceCardP
 
         {/* Status Badge */}
         <div className={`px-3 py-1 rounded-full text-sm font-medium ${
-          isCheckIn 
+          isBreak
+            ? 'bg-amber-100 text-amber-700 border border-amber-200'
+            : isCheckIn 
             ? 'bg-green-100 text-green-700 border border-green-200' 
             : 'bg-red-100 text-red-700 border border-red-200'
         }`}>
-          {isCheckIn ? 'Check In' : 'Check Out'}{statusSuffix ? ` (${statusSuffix})` : ''}
+          {label}{statusSuffix ? ` (${statusSuffix})` : ''}
         </div>
       </div>
 
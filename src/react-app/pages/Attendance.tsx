@@ -60,6 +60,9 @@ export default function Attendance() {
         } else if (r.status === 'checkout') {
           lastCheckoutTs = ts;
           lastCheckoutId = r.id;
+        } else {
+          // A whole break classified by the scanner, starting when the badge left
+          out[r.id] = { statusSuffix: formatDuration(r.break_duration_seconds ?? 0) };
         }
       }
       if (firstCheckinId != null) {
@@ -284,6 +287,8 @@ export default function Attendance() {
               <option value="">All Status</option>
               <option value="checkin">Check In</option>
               <option value="checkout">Check Out</option>
+              <option value="short_break">Short Break</option>
+              <option value="lunch_break">Lunch Break</option>
             </select>
           </div>
 
@@ -587,8 +592,12 @@ function DailySummaryTable({ records, onSelect }: { records: ReturnType<typeof u
       } else if (r.status === 'checkout') {
         lastCheckoutTs = ts;
         lastSeenCheckoutTs = ts;
+      } else {
+        // Break segments carry their length; the badge is back in by the time one is recorded
+        breakCount += 1;
+        totalBreakSec += r.break_duration_seconds ?? 0;
       }
-      lastEventStatus = r.status;
+      lastEventStatus = r.status === 'checkout' ? 'checkout' : 'checkin';
     }
     // Compute worked time; for current day and if last event is a checkin, show running time until now.
     let worked = 0;
@@ -46,7 +46,7 @@ export const AttendanceRecordSchema = z.object({
   employee_id: z.number(),
   company_uuid: z.string(),
   hex_value: z.string(), // Employee name in hex format
-  status: z.enum(['checkin', 'checkout']),
+  status: z.enum(['checkin', 'checkout', 'short_break', 'lunch_break']),
   recorded_at: z.string(), // ISO timestamp
   day_of_week: z.string().optional(), // Monday, Tuesday, etc.
   date: z.string().optional(), // YYYY-MM-DD
@@ -105,10 +105,90 @@ export const UpdateEmployeeSchema = z.object({
   is_active: z.number().int().optional(),
 });
 
-// ESP32 detection schema - hex value is required; optional action for checkout
-export const ESP32DetectionSchema = z.object({
+// Where an event comes from (ESP32/DeviceClock.h): seq is the scanner's per-device sequence
+// number, unique across reboots, so (device_id, seq) identifies a retried or replayed event.
+// observed_at_ms is when the scanner saw the badge (Unix ms, SNTP time), age_ms how long
+// before the request by its uptime clock. All are absent from older firmware.
+const ESP32EventStampSchema = z.object({
+  seq: z.number().int().min(0).max(0xffffffff).optional(),  // 0: unsequenced
+  observed_at_ms: z.number().int().positive().optional(),
+  age_ms: z.number().int().nonnegative().optional(),
+});
+
+const ESP32DeviceIdSchema = z.string().min(1).max(32);
+
+// ESP32 detection schema - hex value is required; optional action for checkout.
+// tenant is the id of the tenant whose UUID matched (0 or absent: the default company)
+export const ESP32DetectionSchema = ESP32EventStampSchema.extend({
   hex_value: z.string(),
   action: z.enum(['checkin', 'checkout']).optional(),
+  tenant: z.number().int().min(0).max(65535).optional(),
+  device_id: ESP32DeviceIdSchema.optional(),  // single /api/esp32/detect requests only
+});
+
+// ESP32 batched detections - one request per scan cycle
+// Capped so every IN (...) query stays under D1's 100 bound-parameter limit
+export const ESP32BatchDetectionSchema = z.object({
+  device_id: ESP32DeviceIdSchema.optional(),
+  events: z.array(ESP32DetectionSchema.omit({ device_id: true })).min(1).max(64),
+});
+
+// ESP32 session segments (ESP32/Sessions.h): checkins, checkouts and breaks the scanner has
+// already classified. age_ms is how long before the request it happened by the scanner's
+// clock (a held-back checkout or a break starts when the badge left), duration_s the break length.
+export const ESP32SessionEventSchema = ESP32EventStampSchema.extend({
+  hex_value: z.string(),
+  action: z.enum(['checkin', 'checkout', 'short_break', 'lunch_break']),
+  tenant: z.number().int().min(0).max(65535).optional(),
+  duration_s: z.number().int().nonnegative().optional(),
+});
+
+// Same cap as ESP32BatchDetectionSchema
+export const ESP32SessionBatchSchema = z.object({
+  device_id: ESP32DeviceIdSchema.optional(),
+  events: z.array(ESP32SessionEventSchema).min(1).max(64),
+});
+
+// Break thresholds the scanners classify absences with (seconds)
+export const SessionSettingsSchema = z.object({
+  short_break_max_seconds: z.number().int().min(60).max(3600),
+  lunch_break_max_seconds: z.number().int().min(60).max(24 * 3600),
+}).refine(s => s.lunch_break_max_seconds >= s.short_break_max_seconds, {
+  message: 'lunch_break_max_seconds must be at least short_break_max_seconds',
+});
+
+// ESP32 heartbeat - cumulative counters since boot, so a lost heartbeat costs nothing
+// but resolution. Histograms are bucket counts (bucket i = [2^(i-1), 2^i) microseconds).
+const HeartbeatHistogramSchema = z.array(z.number().int().nonnegative()).max(32);
+
+export const ESP32HeartbeatSchema = z.object({
+  device_id: z.string().min(1).max(32),
+  firmware_version: z.string().max(32),
+  uptime_s: z.number().int().nonnegative(),
+  counters: z.record(z.string(), z.number().int().nonnegative()),
+  heap: z.object({
+    free_min: z.number().int().nonnegative(),
+    free_max: z.number().int().nonnegative(),
+    block_min: z.number().int().nonnegative(),
+    block_max: z.number().int().nonnegative(),
+  }),
+  // Link counters and readiness times in ms (ESP32/WifiLink.h); absent from older firmware
+  wifi: z.record(z.string(), z.number().int().nonnegative()).optional(),
+  // SNTP syncs, measured drift (ppm), error at the last sync (ms) and the next sequence number
+  clock: z.record(z.string(), z.number().int()).optional(),
+  // BLE stack the firmware was built with (ESP32/Radio.h) and the free heap once it was up
+  radio: z.object({
+    backend: z.string().max(16),
+    heap_after_init: z.number().int().nonnegative(),
+  }).optional(),
+  hist: z.record(z.string(), HeartbeatHistogramSchema),
+});
+
+// Tenant company - UUID as 4-16 bytes of hex, dashes allowed (stored uppercase without them)
+export const CreateTenantSchema = z.object({
+  name: z.string().min(1),
+  uuid: z.string().transform(s => s.replace(/-/g, '').toUpperCase())
+    .pipe(z.string().regex(/^([0-9A-F]{2}){4,16}$/, 'UUID must be 4-16 bytes of hex')),
 });
 
 // Attendance statistics schema
@@ -122,6 +202,11 @@ export const AttendanceStatsSchema = z.object({
 export type CreateEmployeeRequest = z.infer<typeof CreateEmployeeSchema>;
 export type UpdateEmployeeRequest = z.infer<typeof UpdateEmployeeSchema>;
 export type ESP32DetectionRequest = z.infer<typeof ESP32DetectionSchema>;
+export type ESP32BatchDetectionRequest = z.infer<typeof ESP32BatchDetectionSchema>;
+export type ESP32SessionBatchRequest = z.infer<typeof ESP32SessionBatchSchema>;
+export type SessionSettings = z.infer<typeof SessionSettingsSchema>;
+export type ESP32HeartbeatRequest = z.infer<typeof ESP32HeartbeatSchema>;
+export type CreateTenantRequest = z.infer<typeof CreateTenantSchema>;
 export type AttendanceStats = z.infer<typeof AttendanceStatsSchema>;
 
 // Employee validation helpers
@@ -6,14 +6,23 @@ import { getCookie, setCookie } from "hono/cookie";
 import { 
   CreateEmployeeSchema, 
   UpdateEmployeeSchema,
-  ESP32DetectionSchema
+  ESP32DetectionSchema,
+  ESP32BatchDetectionSchema,
+  ESP32HeartbeatSchema,
+  ESP32SessionBatchSchema,
+  SessionSettingsSchema,
+  CreateTenantSchema
 } from "@/shared/types";
+import type { ESP32BatchDetectionRequest, ESP32SessionBatchRequest, SessionSettings } from "@/shared/types";
+import { applyDeltaPatch, buildDeltaPatch } from "./otaDelta";
 
 // Define Env type locally for Worker bindings
 type Env = {
   DB: D1Database;
   // R2 bucket is optional; when not bound, OTA endpoints return 501
   R2_BUCKET?: R2Bucket;
+  // "1": report each API request's D1 traffic in response headers (load testing only)
+  D1_QUERY_STATS?: string;
 };
 
 const AUTH_COOKIE = "AA_AUTH";
@@ -154,6 +163,128 @@ async function getAuthenticatedUserFromCookie(c: Context<{ Bindings: Env; Variab
 // Enable CORS for ESP32 requests
 app.use("/api/*", cors());
 
+// D1 traffic of one request: every first/all/run/raw/exec call is a round trip of one
+// statement, a batch() one round trip of many
+type D1Stats = { roundTrips: number; statements: number };
+
+// The same database, counting what goes through it. Statements are wrapped as they are
+// prepared and bound; batch() is handed the originals.
+function countingD1(db: D1Database, stats: D1Stats): D1Database {
+  const originals = new WeakMap<object, D1PreparedStatement>();
+  const wrap = (stmt: D1PreparedStatement): D1PreparedStatement => {
+    const counted = new Proxy(stmt, {
+      get(target, prop) {
+        if (prop === 'bind') {
+          return (...values: unknown[]) => wrap(target.bind(...values));
+        }
+        if (prop === 'first' || prop === 'all' || prop === 'run' || prop === 'raw') {
+          return (...args: unknown[]) => {
+            stats.roundTrips++;
+            stats.statements++;
+            return (target[prop] as (...a: unknown[]) => unknown).apply(target, args);
+          };
+        }
+        const value = Reflect.get(target, prop, target);
+        return typeof value === 'function' ? value.bind(target) : value;
+      },
+    });
+    originals.set(counted, stmt);
+    return counted;
+  };
+  return new Proxy(db, {
+    get(target, prop) {
+      if (prop === 'prepare') return (query: string) => wrap(target.prepare(query));
+      if (prop === 'batch') {
+        return (statements: D1PreparedStatement[]) => {
+          stats.roundTrips++;
+          stats.statements += statements.length;
+          return target.batch(statements.map(stmt => originals.get(stmt) ?? stmt));
+        };
+      }
+      if (prop === 'exec') {
+        return (query: string) => {
+          stats.roundTrips++;
+          stats.statements++;
+          return target.exec(query);
+        };
+      }
+      const value = Reflect.get(target, prop, target);
+      return typeof value === 'function' ? value.bind(target) : value;
+    },
+  });
+}
+
+// With D1_QUERY_STATS=1 (e.g. `wrangler dev --var D1_QUERY_STATS:1`), every API response
+// carries X-D1-Round-Trips and X-D1-Statements; the fleet load generator
+// (ESP32/host/FleetLoad.cpp) reads them. The bindings object is shared by every request in
+// the isolate, so the counting database goes on a per-request copy of it.
+app.use("/api/*", async (c, next) => {
+  if (c.env.D1_QUERY_STATS !== '1') return next();
+  const stats: D1Stats = { roundTrips: 0, statements: 0 };
+  c.env = { ...c.env, DB: countingD1(c.env.DB, stats) };
+  await next();
+  c.res.headers.set('X-D1-Round-Trips', String(stats.roundTrips));
+  c.res.headers.set('X-D1-Statements', String(stats.statements));
+});
+
+// Least recently used entries go first once capacity is reached, and each entry expires
+// after its own TTL. Module state lives as long as the isolate and is never shared between
+// isolates, so what is cached here only saves D1 work; it never decides an outcome alone.
+class LruCache<K, V> {
+  private readonly entries = new Map<K, { value: V; expires: number }>();
+
+  constructor(private readonly capacity: number) {}
+
+  get(key: K, nowMs: number): V | undefined {
+    const entry = this.entries.get(key);
+    if (!entry) return undefined;
+    this.entries.delete(key);
+    if (entry.expires <= nowMs) return undefined;
+    this.entries.set(key, entry);  // most recently used last
+    return entry.value;
+  }
+
+  set(key: K, value: V, ttlMs: number, nowMs: number) {
+    this.entries.delete(key);
+    this.entries.set(key, { value, expires: nowMs + ttlMs });
+    if (this.entries.size > this.capacity) this.entries.delete(this.entries.keys().next().value as K);
+  }
+
+  delete(key: K) {
+    this.entries.delete(key);
+  }
+
+  clear() {
+    this.entries.clear();
+  }
+}
+
+// Detection hot path: hex value -> active employee (null: none) and tenant id -> UUID (null:
+// unknown or deactivated). A badge registered elsewhere is found once its miss expires; an
+// edit made through another isolate is caught by the guarded insert (see recordDetections).
+const EMPLOYEE_CACHE_ENTRIES = 4096;
+const EMPLOYEE_CACHE_TTL_MS = 5 * 60 * 1000;
+const EMPLOYEE_MISS_TTL_MS = 60 * 1000;
+const TENANT_CACHE_TTL_MS = 5 * 60 * 1000;
+
+type CachedEmployee = EmployeeRow & { lookup_key: string };  // the employee_lookup key it was found by
+
+const employeeCache = new LruCache<string, CachedEmployee | null>(EMPLOYEE_CACHE_ENTRIES);
+const tenantUuidCache = new LruCache<number, string | null>(256);
+
+// Employee and tenant edits drop this isolate's cached lookups once they have gone through
+const dropCachedLookups: MiddlewareHandler<{ Bindings: Env; Variables: AppVariables }> = async (c, next) => {
+  await next();
+  if (c.req.method !== 'GET') {
+    employeeCache.clear();
+    tenantUuidCache.clear();
+  }
+};
+app.use("/api/employees", dropCachedLookups);
+app.use("/api/employees/*", dropCachedLookups);
+app.use("/api/tenants", dropCachedLookups);
+app.use("/api/tenants/*", dropCachedLookups);
+
 // Simple auth middleware and endpoints
 const authMiddleware: MiddlewareHandler<{ Bindings: Env; Variables: AppVariables }> = async (c, next) => {
   const user = await getAuthenticatedUserFromCookie(c);
@@ -713,90 +844,92 @@ app.post("/api/employees", authMiddleware, zValidator("json", CreateEmployeeSche
     }
   });
 
-// ESP32 detection endpoint - now searches by hex value in employee_details
-app.post("/api/esp32/detect", zValidator("json", ESP32DetectionSchema), async (c) => {
-  const { hex_value, action } = c.req.valid("json");
-  const db = c.env.DB;
+type AttendanceStatus = 'checkin' | 'checkout' | 'short_break' | 'lunch_break';
 
-  // First try to find employee by direct hex value match (details table)
-  let employee = await db.prepare(`
-    SELECT e.id, e.name, e.uuid, ed.role, ed.department, ed.emp_id
-    FROM employees e
-    JOIN employee_details ed ON e.id = ed.employee_id
-    WHERE ed.hex_value = ? AND e.is_active = 1
-  `).bind(hex_value).first() as unknown as EmployeeRow;
+// Breaks happen while checked in, so for the duplicate rules they count as a checkin
+function presenceOf(status: string): 'checkin' | 'checkout' {
+  return status === 'checkout' ? 'checkout' : 'checkin';
+}
 
-  // If not found by direct hex match, try converting hex to string and searching by name
-  if (!employee) {
-    const employeeName = hexToString(hex_value);
+// Which scanner reported an event, its sequence number and its own stamp (ESP32/DeviceClock.h)
+type DeviceStamp = { device_id?: string; seq?: number; observed_at_ms?: number; age_ms?: number };
 
-    if (!employeeName) {
-      return c.json({ error: "Invalid hex value - cannot convert to employee name" }, 400);
-    }
+// An event is sequenced when it names its scanner and a nonzero sequence number
+function isSequenced(stamp: DeviceStamp): stamp is DeviceStamp & { device_id: string; seq: number } {
+  return !!stamp.device_id && !!stamp.seq;
+}
 
-    employee = await db.prepare(`
-      SELECT e.id, e.name, e.uuid, ed.role, ed.department, ed.emp_id
-      FROM employees e
-      LEFT JOIN employee_details ed ON e.id = ed.employee_id
-      WHERE LOWER(e.name) = LOWER(?) AND e.is_active = 1
-    `).bind(employeeName).first() as unknown as EmployeeRow;
-  }
-
-  if (!employee) {
-    return c.json({ 
-      error: "Employee not found", 
-      details: `No active employee found with hex value '${hex_value}'`
-    }, 404);
-  }
-
-  // Determine event type; default to checkin if not provided
-  const status: 'checkin' | 'checkout' = (action === 'checkout' ? 'checkout' : 'checkin');
-  const now = new Date();
-
-  // Check the employee's most recent attendance record (regardless of time)
-  const lastRecord = await db.prepare(`
-    SELECT status FROM attendance_records 
-    WHERE employee_id = ? 
-    ORDER BY recorded_at DESC LIMIT 1
-  `).bind(employee.id).first<{ status: string }>();
-
-  // Block consecutive check-ins: if last record was check-in and new request is also check-in, reject
-  if (lastRecord && lastRecord.status === 'checkin' && status === 'checkin') {
-    return c.json({ 
-      success: false, 
-      error: "Duplicate check-in blocked",
-      message: `Employee ${employee.name} is already checked in. Please checkout first.`
-    }, 400);
-  }
-
-  // Block consecutive checkouts: if last record was checkout and new request is also checkout, reject
-  if (lastRecord && lastRecord.status === 'checkout' && status === 'checkout') {
-    return c.json({ 
-      success: false, 
-      error: "Duplicate checkout blocked",
-      message: `Employee ${employee.name} is already checked out. Please checkin first.`
-    }, 400);
-  }
-
-  // Additional dedupe: ignore if a same-status event exists in last 60 seconds (for rapid duplicates)
-  const recent = await db.prepare(`
-    SELECT id FROM attendance_records 
-    WHERE employee_id = ? AND status = ? 
-      AND datetime(recorded_at) >= datetime(? , '-60 seconds')
-    ORDER BY recorded_at DESC LIMIT 1
-  `).bind(employee.id, status, now.toISOString()).first();
-  if (recent) {
-    return c.json({ success: true, deduped: true });
-  }
-
-  // Insert attendance (populate both uuid and company_uuid with constant value)
-  const result = await db.prepare(`
+// An age beyond this comes from an event journaled before a reboot (the scanner's clock
+// restarted), so without a device time it is stamped on arrival instead
+const EVENT_MAX_AGE_MS = 24 * 60 * 60 * 1000;
+// Device times this far ahead of the Worker or behind it are a clock that never synced
+const OBSERVED_MAX_AHEAD_MS = 5 * 60 * 1000;
+const OBSERVED_MAX_BEHIND_MS = 7 * 24 * 60 * 60 * 1000;
+
+// When an event happened (ms): the scanner's SNTP time if it is plausible, else now - age_ms,
+// else arrival
+function eventTime(stamp: DeviceStamp, now: Date): number {
+  const observed = stamp.observed_at_ms;
+  if (observed && observed <= now.getTime() + OBSERVED_MAX_AHEAD_MS && observed >= now.getTime() - OBSERVED_MAX_BEHIND_MS) {
+    return observed;
+  }
+  const age = stamp.age_ms ?? 0;
+  return age <= EVENT_MAX_AGE_MS ? now.getTime() - age : now.getTime();
+}
+
+// Values for the attendance INSERT below, in column order (uuid and company_uuid both carry
+// the matched tenant's UUID)
+function attendanceValues(employeeId: number, hexValue: string, status: AttendanceStatus, now: Date, companyUuid: string, breakDurationSeconds: number | null, stamp: DeviceStamp): unknown[] {
+  return [
+    employeeId,
+    companyUuid,
+    companyUuid,
+    hexValue,
+    status,
+    breakDurationSeconds,
+    stamp.device_id ?? null,
+    isSequenced(stamp) ? stamp.seq : null,
+    stamp.observed_at_ms ? new Date(stamp.observed_at_ms).toISOString() : null,
+    now.toISOString(),
+    now.toLocaleDateString('en-US', { weekday: 'long' }),
+    now.toISOString().split('T')[0],
+    now.toTimeString().split(' ')[0],
+    now.toLocaleDateString('en-US', { month: 'long' }),
+    now.getFullYear()
+  ];
+}
+
+// A detection that passed the checks done in the Worker, to be written if D1 still agrees
+type DetectionWrite = {
+  index: number;
+  employee: CachedEmployee;
+  action: AttendanceStatus;
+  recordedAt: Date;
+  companyUuid: string;
+  breakDurationSeconds: number | null;
+  stamp: DeviceStamp & { hex_value: string };
+};
+
+// The detection rules, checked by D1 as the row is written: the employee is still active and
+// behind the lookup key it was resolved by, a checkin or checkout is not what their last
+// record already says (a break counts as checked in; a break itself is never a duplicate)
+// and, for unsequenced events, no record with this status is less than 60 seconds old.
+// RETURNING id says whether the row went in.
+function prepareGuardedDetectionInsert(db: D1Database, write: DetectionWrite): D1PreparedStatement {
+  const { employee, action, recordedAt, stamp } = write;
+  const sequenced = isSequenced(stamp);
+  const presence = action === 'checkin' || action === 'checkout';
+  return db.prepare(`
     INSERT INTO attendance_records (
       employee_id,
       uuid,
       company_uuid,
       hex_value,
       status,
+      break_duration_seconds,
+      device_id,
+      device_seq,
+      device_observed_at,
       recorded_at,
       day_of_week,
       date,
@@ -804,43 +937,695 @@ app.post("/api/esp32/detect", zValidator("json", ESP32DetectionSchema), async (c
       month,
       year
     )
-    VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)
+    SELECT ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?
+    WHERE EXISTS (
+        SELECT 1 FROM employee_lookup l JOIN employees e ON e.id = l.employee_id
+        WHERE l.lookup_key = ? AND l.employee_id = ? AND e.is_active = 1
+      )
+      ${presence ? `AND NOT EXISTS (
+        SELECT 1 FROM employee_last_state
+        WHERE employee_id = ? AND (CASE status WHEN 'checkout' THEN 'checkout' ELSE 'checkin' END) = ?
+      )` : ''}
+      ${sequenced ? '' : `AND NOT EXISTS (
+        SELECT 1 FROM attendance_records
+        WHERE employee_id = ? AND status = ?
+          AND datetime(recorded_at) >= datetime(? , '-60 seconds')
+      )`}
+    ON CONFLICT (device_id, device_seq) DO NOTHING
+    RETURNING id
   `).bind(
+    ...attendanceValues(employee.id, stamp.hex_value, action, recordedAt, write.companyUuid, write.breakDurationSeconds, stamp),
+    employee.lookup_key,
     employee.id,
-    COMPANY_UUID,
-    COMPANY_UUID,
-    hex_value,
-    status,
-    now.toISOString(),
-    now.toLocaleDateString('en-US', { weekday: 'long' }),
-    now.toISOString().split('T')[0],
-    now.toTimeString().split(' ')[0],
-    now.toLocaleDateString('en-US', { month: 'long' }),
-    now.getFullYear()
-  ).run();
-  
-  if (result.success) {
-    const response = { 
-      success: true, 
-      employee_name: employee.name,
-      employee_role: employee.role,
-  employee_department: employee.department,
-      employee_emp_id: employee.emp_id,
-      status: status,
-      recorded_at: now.toISOString(),
-      timestamp_details: {
-        day: now.toLocaleDateString('en-US', { weekday: 'long' }),
-        date: now.toISOString().split('T')[0],
-        time: now.toTimeString().split(' ')[0],
-        month: now.toLocaleDateString('en-US', { month: 'long' }),
-        year: now.getFullYear()
-      }
-    };
-    
-    console.log(`✅ Attendance recorded: ${employee.name} (${employee.role}) - ${status} at ${now.toISOString()}`);
-    return c.json(response);
+    ...(presence ? [employee.id, action] : []),
+    ...(sequenced ? [] : [employee.id, action, recordedAt.toISOString()])
+  );
+}
+
+// What the guarded insert will see, read just before it in the same batch, so a skipped
+// row can be told apart (already delivered, stale lookup, duplicate or recent) without
+// another round trip
+function prepareDetectionCheck(db: D1Database, write: DetectionWrite): D1PreparedStatement {
+  const { employee, stamp } = write;
+  return db.prepare(`
+    SELECT
+      EXISTS (SELECT 1 FROM attendance_records WHERE device_id = ? AND device_seq = ?) AS seen,
+      EXISTS (
+        SELECT 1 FROM employee_lookup l JOIN employees e ON e.id = l.employee_id
+        WHERE l.lookup_key = ? AND l.employee_id = ? AND e.is_active = 1
+      ) AS mapped,
+      (SELECT status FROM employee_last_state WHERE employee_id = ?) AS last_status
+  `).bind(
+    isSequenced(stamp) ? stamp.device_id : null,
+    isSequenced(stamp) ? stamp.seq : null,
+    employee.lookup_key,
+    employee.id,
+    employee.id
+  );
+}
+
+// ESP32 detection endpoint - matches the hex value in employee_details, else the name it decodes to
+// Binary requests carry exactly one record and are answered by the batch rules
+app.post("/api/esp32/detect", wireEvents(1), zValidator("json", ESP32DetectionSchema), async (c) => {
+  const detection = c.req.valid("json");
+  const { hex_value } = detection;
+  const [{ result, employee, recordedAt }] = await recordDetections(c.env.DB, [detection], new Date(), detection.device_id);
+
+  switch (result.status) {
+    case 'invalid':
+      return c.json({ error: "Invalid hex value - cannot convert to employee name" }, 400);
+    case 'not_found':
+      return c.json({ 
+        error: "Employee not found", 
+        details: `No active employee found with hex value '${hex_value}'`
+      }, 404);
+    // A retry or replay of an event this scanner already delivered, or (older firmware, which
+    // sends no sequence number) a same-status event within the last 60 seconds
+    case 'deduped':
+      return c.json({ success: true, deduped: true });
+    // Consecutive check-ins (a break counts as checked in) or consecutive checkouts
+    case 'duplicate':
+      return result.action === 'checkin'
+        ? c.json({ 
+            success: false, 
+            error: "Duplicate check-in blocked",
+            message: `Employee ${employee!.name} is already checked in. Please checkout first.`
+          }, 400)
+        : c.json({ 
+            success: false, 
+            error: "Duplicate checkout blocked",
+            message: `Employee ${employee!.name} is already checked out. Please checkin first.`
+          }, 400);
+    case 'error':
+      return c.json({ error: "Failed to record attendance" }, 500);
+  }
+
+  const now = recordedAt!;
+  const response = { 
+    success: true, 
+    employee_name: employee!.name,
+    employee_role: employee!.role,
+    employee_department: employee!.department,
+    employee_emp_id: employee!.emp_id,
+    status: result.action,
+    recorded_at: now.toISOString(),
+    timestamp_details: {
+      day: now.toLocaleDateString('en-US', { weekday: 'long' }),
+      date: now.toISOString().split('T')[0],
+      time: now.toTimeString().split(' ')[0],
+      month: now.toLocaleDateString('en-US', { month: 'long' }),
+      year: now.getFullYear()
+    }
+  };
+
+  console.log(`✅ Attendance recorded: ${employee!.name} (${employee!.role}) - ${result.action} at ${now.toISOString()}`);
+  return c.json(response);
+});
+
+// Lowercase ASCII only, matching SQLite's LOWER()
+function asciiLower(str: string): string {
+  return str.replace(/[A-Z]/g, ch => ch.toLowerCase());
+}
+
+function sqlPlaceholders(count: number): string {
+  return Array(count).fill('?').join(', ');
+}
+
+// UUIDs of the tenants the scanner tagged events with; tenant 0 (untagged) and ids that are
+// unknown or deactivated fall back to COMPANY_UUID at the call site. Served from
+// tenantUuidCache where it can be, one query for the rest.
+async function loadTenantUuids(db: D1Database, tenantIds: number[]): Promise<Map<number, string>> {
+  const uuids = new Map<number, string>();
+  const nowMs = Date.now();
+  const ids: number[] = [];
+  for (const id of Array.from(new Set(tenantIds.filter(id => id > 0)))) {
+    const cached = tenantUuidCache.get(id, nowMs);
+    if (cached === undefined) ids.push(id);
+    else if (cached) uuids.set(id, cached);
+  }
+  if (ids.length === 0) return uuids;
+  const rows = await db.prepare(`
+    SELECT id, uuid FROM tenants WHERE id IN (${sqlPlaceholders(ids.length)}) AND is_active = 1
+  `).bind(...ids).all<{ id: number; uuid: string }>();
+  for (const row of rows.results || []) uuids.set(row.id, row.uuid);
+  for (const id of ids) tenantUuidCache.set(id, uuids.get(id) ?? null, TENANT_CACHE_TTL_MS, nowMs);
+  return uuids;
+}
+
+type BatchDetectionResult = {
+  index: number;
+  hex_value: string;
+  action: AttendanceStatus;
+  status: 'recorded' | 'deduped' | 'duplicate' | 'not_found' | 'invalid' | 'error';
+  employee_name?: string;
+};
+
+type ResolvedEmployees = {
+  employeeByHex: Map<string, CachedEmployee>;
+  invalidHex: Set<string>;       // neither a known hex value nor hex for a name
+  tenantUuids: Map<number, string>;
+};
+
+// employee_lookup keys per IN (...) query, under D1's 100 bound-parameter limit
+const LOOKUP_KEYS_PER_QUERY = 96;
+
+// Resolve every distinct hex value, from employeeCache where it can be. The rest take one
+// round trip: their 'hex:' and 'name:' keys (migrations/12.sql) in employee_lookup, a direct
+// hex match winning over the name, alongside the tenant UUIDs.
+async function resolveEmployees(db: D1Database, events: Array<{ hex_value: string; tenant?: number }>): Promise<ResolvedEmployees> {
+  const nowMs = Date.now();
+  const employeeByHex = new Map<string, CachedEmployee>();
+  const invalidHex = new Set<string>();
+  const keysByHex = new Map<string, string[]>();
+  for (const hex of Array.from(new Set(events.map(ev => ev.hex_value)))) {
+    const employeeName = hexToString(hex);
+    const cached = employeeCache.get(hex, nowMs);
+    if (cached) {
+      employeeByHex.set(hex, cached);
+    } else if (cached === null) {
+      if (!employeeName) invalidHex.add(hex);
+    } else {
+      keysByHex.set(hex, employeeName ? [`hex:${hex}`, `name:${asciiLower(employeeName)}`] : [`hex:${hex}`]);
+    }
+  }
+
+  const keys = Array.from(new Set(Array.from(keysByHex.values()).flat()));
+  const lookups: D1PreparedStatement[] = [];
+  for (let i = 0; i < keys.length; i += LOOKUP_KEYS_PER_QUERY) {
+    const chunk = keys.slice(i, i + LOOKUP_KEYS_PER_QUERY);
+    lookups.push(db.prepare(`
+      SELECT l.lookup_key, e.id, e.name, e.uuid, ed.role, ed.department, ed.emp_id
+      FROM employee_lookup l
+      JOIN employees e ON e.id = l.employee_id
+      LEFT JOIN employee_details ed ON e.id = ed.employee_id
+      WHERE l.lookup_key IN (${sqlPlaceholders(chunk.length)}) AND e.is_active = 1
+    `).bind(...chunk));
+  }
+  const [found, tenantUuids] = await Promise.all([
+    lookups.length > 0 ? db.batch<CachedEmployee>(lookups) : Promise.resolve([] as D1Result<CachedEmployee>[]),
+    loadTenantUuids(db, events.map(ev => ev.tenant ?? 0)),
+  ]);
+
+  // Names need not be unique; any active employee with the name will do, as before
+  const employeeByKey = new Map<string, CachedEmployee>();
+  for (const result of found) {
+    for (const row of result.results || []) {
+      if (!employeeByKey.has(row.lookup_key)) employeeByKey.set(row.lookup_key, row);
+    }
+  }
+  for (const [hex, hexKeys] of keysByHex) {
+    const employee = hexKeys.map(key => employeeByKey.get(key)).find(Boolean) ?? null;
+    employeeCache.set(hex, employee, employee ? EMPLOYEE_CACHE_TTL_MS : EMPLOYEE_MISS_TTL_MS, nowMs);
+    if (employee) employeeByHex.set(hex, employee);
+    else if (hexKeys.length === 1) invalidHex.add(hex);
+  }
+  return { employeeByHex, invalidHex, tenantUuids };
+}
+
+type DetectionOutcome = {
+  result: BatchDetectionResult;
+  employee?: CachedEmployee;  // whenever the hex value resolved
+  recordedAt?: Date;          // when recorded
+};
+
+// A detection (no action: a checkin) or a session segment (which may be a break)
+type DetectionEvent = Omit<ESP32SessionBatchRequest['events'][number], 'action'> & { action?: AttendanceStatus };
+
+// Apply the detection rules to events, in order, with one D1 round trip once the hex values
+// are cached: for each event a check and a guarded insert (prepareGuardedDetectionInsert),
+// all in a single batch(), which D1 runs as one transaction in request order. A typical
+// detection is therefore one write, with no reads ahead of it. An event whose cached
+// employee no longer holds is resolved again from D1 once (retryStale).
+// Events deviceId already delivered (by sequence number) are answered as deduped.
+async function recordDetections(db: D1Database, events: DetectionEvent[], now: Date, deviceId?: string, retryStale = true): Promise<DetectionOutcome[]> {
+  const outcomes = events.map((ev, index): DetectionOutcome => ({
+    result: {
+      index,
+      hex_value: ev.hex_value,
+      action: ev.action ?? 'checkin',
+      status: 'not_found',
+    },
+  }));
+  const { employeeByHex, invalidHex, tenantUuids } = await resolveEmployees(db, events);
+
+  const writes: DetectionWrite[] = [];
+  for (const outcome of outcomes) {
+    const { result } = outcome;
+    const employee = employeeByHex.get(result.hex_value);
+    if (!employee) {
+      result.status = invalidHex.has(result.hex_value) ? 'invalid' : 'not_found';
+      continue;
+    }
+    outcome.employee = employee;
+    const ev = events[result.index];
+    const stamp: DeviceStamp & { hex_value: string } = { ...ev, device_id: deviceId };
+    const isBreak = result.action === 'short_break' || result.action === 'lunch_break';
+    writes.push({
+      index: result.index,
+      employee,
+      action: result.action,
+      // Offset each record by a millisecond so events stamped alike keep request order
+      recordedAt: new Date(eventTime(stamp, now) + writes.length),
+      companyUuid: tenantUuids.get(ev.tenant ?? 0) ?? COMPANY_UUID,
+      breakDurationSeconds: isBreak ? ev.duration_s ?? 0 : null,
+      stamp,
+    });
+  }
+  if (writes.length === 0) return outcomes;
+
+  let answers: D1Result<Record<string, unknown>>[];
+  try {
+    answers = await db.batch<Record<string, unknown>>(
+      writes.flatMap(write => [prepareDetectionCheck(db, write), prepareGuardedDetectionInsert(db, write)]));
+  } catch (error) {
+    // D1 batches run as one transaction, so nothing from this request was written
+    console.error('Detection insert failed:', error);
+    for (const write of writes) outcomes[write.index].result.status = 'error';
+    return outcomes;
+  }
+
+  const stale: DetectionWrite[] = [];
+  writes.forEach((write, i) => {
+    const outcome = outcomes[write.index];
+    const check = answers[2 * i].results?.[0] as { seen: number; mapped: number; last_status: string | null } | undefined;
+    if ((answers[2 * i + 1].results || []).length > 0) {
+      outcome.result.status = 'recorded';
+      outcome.result.employee_name = write.employee.name;
+      outcome.recordedAt = write.recordedAt;
+    } else if (check?.seen) {
+      outcome.result.status = 'deduped';
+    } else if (!check?.mapped) {
+      stale.push(write);
+    } else if (check.last_status && presenceOf(check.last_status) === write.action) {
+      outcome.result.status = 'duplicate';
+    } else {
+      outcome.result.status = 'deduped';
+    }
+  });
+
+  // Employees edited through another isolate since this one cached them
+  for (const write of stale) employeeCache.delete(write.stamp.hex_value);
+  if (stale.length > 0 && retryStale) {
+    const retried = await recordDetections(db, stale.map(write => events[write.index]), now, deviceId, false);
+    stale.forEach((write, i) => {
+      outcomes[write.index] = { ...retried[i], result: { ...retried[i].result, index: write.index } };
+    });
   } else {
-    return c.json({ error: "Failed to record attendance" }, 500);
+    for (const write of stale) outcomes[write.index] = { result: { ...outcomes[write.index].result, status: 'not_found' } };
+  }
+  return outcomes;
+}
+
+// Apply the detection rules to a batch of events, in order (recordDetections)
+async function processDetections(db: D1Database, events: ESP32BatchDetectionRequest['events'], now: Date, deviceId?: string): Promise<BatchDetectionResult[]> {
+  const results = (await recordDetections(db, events, now, deviceId)).map(outcome => outcome.result);
+  const recorded = results.filter(r => r.status === 'recorded').length;
+  const failed = results.filter(r => r.status === 'error').length;
+  console.log(`✅ Batch detection: ${events.length} events, ${recorded} recorded, ${failed} to retry`);
+  return results;
+}
+
+// Record session segments the scanner has already classified (ESP32/Sessions.h), in order,
+// by the detection rules (recordDetections). Each event is stamped when it happened
+// (eventTime); a break lands as one row with its duration. The duplicate rules treat a
+// break as a checkin, so a break following a checkin is recorded and a checkin following
+// a break is not.
+async function processSessions(db: D1Database, events: ESP32SessionBatchRequest['events'], now: Date, deviceId?: string): Promise<BatchDetectionResult[]> {
+  const results = (await recordDetections(db, events, now, deviceId)).map(outcome => outcome.result);
+  const recorded = results.filter(r => r.status === 'recorded').length;
+  const failed = results.filter(r => r.status === 'error').length;
+  console.log(`✅ Sessions: ${events.length} events, ${recorded} recorded, ${failed} to retry`);
+  return results;
+}
+
+// Binary uploads from the scanner (layout in ESP32/WireFormat.h), negotiated by Content-Type
+const WIRE_EVENTS_CONTENT_TYPE = 'application/vnd.autoattend.events';
+const WIRE_ACK_CONTENT_TYPE = 'application/vnd.autoattend.ack';
+const WIRE_STATUS: Record<BatchDetectionResult['status'], number> = {
+  recorded: 0,
+  deduped: 1,
+  duplicate: 2,
+  not_found: 3,
+  invalid: 4,
+  error: 5,
+};
+
+const WIRE_ACTIONS: AttendanceStatus[] = ['checkin', 'checkout', 'short_break', 'lunch_break'];
+
+type WireEvent = { hex_value: string; action: AttendanceStatus; tenant: number; seq: number; age_ms?: number; duration_s?: number; observed_at_ms?: number };
+
+const WIRE_RECORD_HEADER_LEN = [0, 11, 13, 17, 25];
+
+// Decode an events frame; null if it is malformed.
+// Version 1 records have no tenant (11-byte header); version 2 adds it before len (13 bytes);
+// version 3 adds the break actions, durationSec before len (17 bytes) and reads the second
+// field as the event's age rather than the scanner's uptime. Version 4 puts the scanner's
+// MAC after the frame header and observedMs (u64) after the age (25 bytes); only its
+// sequence numbers are persistent, so only it names a device.
+function decodeWireEvents(buf: Uint8Array): { version: number; device?: string; events: WireEvent[] } | null {
+  if (buf.length < 4 || buf[0] !== 0x41 || buf[1] !== 0x45 || buf[2] < 1 || buf[2] > 4) return null;
+  const version = buf[2];
+  const headerLen = WIRE_RECORD_HEADER_LEN[version];
+  const view = new DataView(buf.buffer, buf.byteOffset, buf.byteLength);
+  const events: WireEvent[] = [];
+  let pos = 4;
+  let device: string | undefined;
+  if (version === 4) {
+    if (buf.length < 10) return null;
+    device = Array.from(buf.subarray(4, 10), b => b.toString(16).padStart(2, '0').toUpperCase()).join(':');
+    pos = 10;
+  }
+  for (let i = 0; i < buf[3]; i++) {
+    if (pos + headerLen > buf.length) return null;
+    const fields = version === 4 ? pos + 8 : pos;  // past observedMs
+    const action = buf[fields + 8];
+    const encoding = buf[fields + 9];
+    const tenant = version === 1 ? 0 : view.getUint16(fields + 10, true);
+    const len = buf[pos + headerLen - 1];
+    if (action > (version >= 3 ? 3 : 1) || encoding > 2 || len === 0 || pos + headerLen + len > buf.length) return null;
+    const payload = buf.subarray(pos + headerLen, pos + headerLen + len);
+    // 0 = uppercase hex, 1 = lowercase hex, 2 = the string itself
+    let hexValue = encoding === 2
+      ? new TextDecoder().decode(payload)
+      : Array.from(payload, b => b.toString(16).padStart(2, '0')).join('');
+    if (encoding === 0) hexValue = hexValue.toUpperCase();
+    const event: WireEvent = { hex_value: hexValue, action: WIRE_ACTIONS[action], tenant, seq: view.getUint32(pos, true) };
+    if (version >= 3) {
+      event.age_ms = view.getUint32(pos + 4, true);
+      event.duration_s = view.getUint32(fields + 12, true);
+    }
+    if (version === 4) {
+      // 0: the scanner's clock had not synced yet
+      const observed = view.getUint32(pos + 8, true) + view.getUint32(pos + 12, true) * 2 ** 32;
+      if (observed > 0) event.observed_at_ms = observed;
+    }
+    events.push(event);
+    pos += headerLen + len;
+  }
+  return pos === buf.length ? { version, device, events } : null;
+}
+
+// The ack echoes the frame's version
+function encodeWireAck(version: number, results: Array<Pick<BatchDetectionResult, 'status'>>): Uint8Array {
+  const ack = new Uint8Array(4 + results.length);
+  ack.set([0x41, 0x4b, version, results.length]);
+  results.forEach((r, i) => { ack[4 + i] = WIRE_STATUS[r.status]; });
+  return ack;
+}
+
+// Handles binary detect (or, with sessions, session) requests, answering with a binary ack,
+// and passes JSON through
+function wireEvents(maxEvents: number, sessions: boolean = false): MiddlewareHandler<{ Bindings: Env; Variables: AppVariables }> {
+  return async (c, next) => {
+    if (!c.req.header('Content-Type')?.startsWith(WIRE_EVENTS_CONTENT_TYPE)) return next();
+    const frame = decodeWireEvents(new Uint8Array(await c.req.arrayBuffer()));
+    if (!frame || frame.events.length > maxEvents) return c.json({ error: 'Invalid events frame' }, 400);
+    let results: Array<Pick<BatchDetectionResult, 'status'>>;
+    if (sessions) {
+      const parsed = ESP32SessionBatchSchema.safeParse({ device_id: frame.device, events: frame.events });
+      if (!parsed.success) return c.json({ error: 'Invalid events frame' }, 400);
+      results = await processSessions(c.env.DB, parsed.data.events, new Date(), parsed.data.device_id);
+    } else {
+      // The detect endpoints take checkins and checkouts only
+      const parsed = ESP32BatchDetectionSchema.safeParse({ device_id: frame.device, events: frame.events });
+      if (!parsed.success) return c.json({ error: 'Invalid events frame' }, 400);
+      results = await processDetections(c.env.DB, parsed.data.events, new Date(), parsed.data.device_id);
+    }
+    return new Response(encodeWireAck(frame.version, results), { headers: { 'Content-Type': WIRE_ACK_CONTENT_TYPE } });
+  };
+}
+
+// ESP32 batched detection endpoint - one request per scan cycle.
+// "accepted" lists indices that were recorded or deduped; "retry" lists indices that hit a
+// server-side error so the scanner can resend just those.
+app.post("/api/esp32/detect/batch", wireEvents(64), zValidator("json", ESP32BatchDetectionSchema), async (c) => {
+  const { device_id, events } = c.req.valid("json");
+  const results = await processDetections(c.env.DB, events, new Date(), device_id);
+  const accepted = results.filter(r => r.status === 'recorded' || r.status === 'deduped').map(r => r.index);
+  const retry = results.filter(r => r.status === 'error').map(r => r.index);
+  return c.json({ success: true, accepted, retry, results });
+});
+
+// ESP32 session upload - checkins, held-back checkouts and whole breaks classified on the
+// scanner (ESP32/Sessions.h). Answers like /api/esp32/detect/batch.
+app.post("/api/esp32/sessions", wireEvents(64, true), zValidator("json", ESP32SessionBatchSchema), async (c) => {
+  const { device_id, events } = c.req.valid("json");
+  const results = await processSessions(c.env.DB, events, new Date(), device_id);
+  const accepted = results.filter(r => r.status === 'recorded' || r.status === 'deduped').map(r => r.index);
+  const retry = results.filter(r => r.status === 'error').map(r => r.index);
+  return c.json({ success: true, accepted, retry, results });
+});
+
+// Break thresholds, falling back to the scanners' built-in defaults
+async function loadSessionSettings(db: D1Database): Promise<SessionSettings> {
+  const row = await db.prepare(`
+    SELECT short_break_max_seconds, lunch_break_max_seconds FROM session_settings WHERE id = 1
+  `).first<SessionSettings>();
+  return row ?? { short_break_max_seconds: 600, lunch_break_max_seconds: 7200 };
+}
+
+// Public: break thresholds for the scanners,
+// 'S' 'C' | version=1 | 0 | shortBreakMaxSec u32 | lunchBreakMaxSec u32 (little-endian).
+// Polled with If-None-Match like the allowlist.
+app.get("/api/esp32/session-config", async (c) => {
+  const settings = await loadSessionSettings(c.env.DB);
+  const etag = `"sc-${settings.short_break_max_seconds}-${settings.lunch_break_max_seconds}"`;
+  if (c.req.header("If-None-Match") === etag) {
+    return new Response(null, { status: 304, headers: { 'ETag': etag } });
+  }
+  const body = new Uint8Array(12);
+  const view = new DataView(body.buffer);
+  body.set([0x53, 0x43, 1, 0]);
+  view.setUint32(4, settings.short_break_max_seconds, true);
+  view.setUint32(8, settings.lunch_break_max_seconds, true);
+  return new Response(body, {
+    headers: {
+      'Content-Type': 'application/vnd.autoattend.session-config',
+      'Content-Length': String(body.length),
+      'ETag': etag,
+      'Cache-Control': 'no-cache',
+    },
+  });
+});
+
+// Break thresholds (protected routes); scanners pick a change up on their next config poll
+app.get("/api/session-settings", authMiddleware, async (c) => {
+  return c.json(await loadSessionSettings(c.env.DB));
+});
+
+app.put("/api/session-settings", authMiddleware, zValidator("json", SessionSettingsSchema), async (c) => {
+  const settings = c.req.valid("json");
+  await c.env.DB.prepare(`
+    INSERT INTO session_settings (id, short_break_max_seconds, lunch_break_max_seconds, updated_at)
+    VALUES (1, ?, ?, CURRENT_TIMESTAMP)
+    ON CONFLICT(id) DO UPDATE SET
+      short_break_max_seconds = excluded.short_break_max_seconds,
+      lunch_break_max_seconds = excluded.lunch_break_max_seconds,
+      updated_at = CURRENT_TIMESTAMP
+  `).bind(settings.short_break_max_seconds, settings.lunch_break_max_seconds).run();
+  return c.json({ success: true, ...settings });
+});
+
+// Scanner heartbeat - performance counters and stage histograms (ESP32/Telemetry.h).
+// Kept for HEARTBEAT_RETENTION_DAYS; older rows are pruned on the way in.
+const HEARTBEAT_RETENTION_DAYS = 30;
+
+app.post("/api/esp32/heartbeat", zValidator("json", ESP32HeartbeatSchema), async (c) => {
+  const hb = c.req.valid("json");
+  const db = c.env.DB;
+  try {
+    await db.batch([
+      db.prepare(`
+        INSERT INTO device_heartbeats
+          (device_id, firmware_version, uptime_seconds, free_heap_min, largest_block_min, payload)
+        VALUES (?, ?, ?, ?, ?, ?)
+      `).bind(hb.device_id, hb.firmware_version, hb.uptime_s, hb.heap.free_min, hb.heap.block_min, JSON.stringify(hb)),
+      db.prepare(`DELETE FROM device_heartbeats WHERE received_at < datetime('now', ?)`)
+        .bind(`-${HEARTBEAT_RETENTION_DAYS} days`),
+    ]);
+    return c.json({ success: true });
+  } catch (error) {
+    console.error('Heartbeat error:', error);
+    return c.json({ success: false, error: 'Failed to record heartbeat' }, 500);
+  }
+});
+
+// Recent heartbeats, newest first, optionally for one scanner (protected route)
+app.get("/api/esp32/heartbeats", authMiddleware, async (c) => {
+  const deviceId = c.req.query("device_id");
+  const limit = Math.min(parseInt(c.req.query("limit") || "50") || 50, 500);
+  let query = `
+    SELECT id, device_id, firmware_version, uptime_seconds, free_heap_min, largest_block_min, payload, received_at
+    FROM device_heartbeats
+  `;
+  const params: Array<string | number> = [];
+  if (deviceId) {
+    query += ` WHERE device_id = ?`;
+    params.push(deviceId);
+  }
+  query += ` ORDER BY received_at DESC, id DESC LIMIT ?`;
+  params.push(limit);
+
+  const result = await c.env.DB.prepare(query).bind(...params).all<{ payload: string }>();
+  const rows = (result.results || []).map(row => ({ ...row, payload: JSON.parse(row.payload) }));
+  return c.json(rows);
+});
+
+// Scanner allowlist (ESP32/Allowlist.h): one FNV-1a key per way a payload can resolve to an
+// active employee - the decoded hex_value, and the name the detect endpoints fall back to.
+// Both sides fold ASCII case before hashing, matching LOWER() in the name lookup.
+const ALLOWLIST_VERSION = 1;
+const ALLOWLIST_MAX_KEYS = 16384;
+
+function allowlistHash(bytes: Uint8Array): number {
+  let h = 2166136261;
+  for (let b of bytes) {
+    if (b >= 0x41 && b <= 0x5a) b += 0x20;
+    h = Math.imul(h ^ b, 16777619) >>> 0;
+  }
+  return h;
+}
+
+function hexToBytes(hex: string): Uint8Array | null {
+  if (hex.length === 0 || hex.length % 2 !== 0 || !/^[0-9a-fA-F]+$/.test(hex)) return null;
+  const bytes = new Uint8Array(hex.length / 2);
+  for (let i = 0; i < bytes.length; i++) bytes[i] = parseInt(hex.substr(i * 2, 2), 16);
+  return bytes;
+}
+
+// Public: binary allowlist, 'A' 'L' | version | 0 | count u32 | sorted keys u32 (little-endian).
+// Scanners poll it with If-None-Match, so an unchanged roster costs a 304.
+app.get("/api/esp32/allowlist", async (c) => {
+  const rows = await c.env.DB.prepare(`
+    SELECT e.name, ed.hex_value
+    FROM employees e
+    LEFT JOIN employee_details ed ON e.id = ed.employee_id
+    WHERE e.is_active = 1
+  `).all<{ name: string; hex_value: string | null }>();
+
+  const encoder = new TextEncoder();
+  const keys = new Set<number>();
+  for (const row of rows.results || []) {
+    const hexBytes = row.hex_value ? hexToBytes(row.hex_value) : null;
+    if (hexBytes) keys.add(allowlistHash(hexBytes));
+    if (row.name) keys.add(allowlistHash(encoder.encode(row.name)));
+  }
+  if (keys.size > ALLOWLIST_MAX_KEYS) {
+    return c.json({ error: `Allowlist too large (${keys.size} keys)` }, 500);
+  }
+  const sorted = Array.from(keys).sort((a, b) => a - b);
+
+  const body = new Uint8Array(8 + sorted.length * 4);
+  const view = new DataView(body.buffer);
+  body.set([0x41, 0x4c, ALLOWLIST_VERSION, 0]);
+  view.setUint32(4, sorted.length, true);
+  sorted.forEach((key, i) => view.setUint32(8 + i * 4, key, true));
+
+  const etag = `"al-${sorted.length}-${allowlistHash(body).toString(16)}"`;
+  if (c.req.header("If-None-Match") === etag) {
+    return new Response(null, { status: 304, headers: { 'ETag': etag } });
+  }
+  return new Response(body, {
+    headers: {
+      'Content-Type': 'application/vnd.autoattend.allowlist',
+      'Content-Length': String(body.length),
+      'ETag': etag,
+      'Cache-Control': 'no-cache',
+    },
+  });
+});
+
+// Scanner tenant list (ESP32/Tenants.h): the UUIDs of every active tenant with its id, which
+// the scanner echoes back in each detection so the record gets that tenant's company_uuid.
+const TENANTS_VERSION = 1;
+const TENANTS_MAX = 256;
+
+// Public: binary tenant list, 'T' 'N' | version | 0 | count u32 | (id u16 | len u8 | uuid[len]) * count.
+// Polled with If-None-Match like the allowlist.
+app.get("/api/esp32/tenants", async (c) => {
+  const rows = await c.env.DB.prepare(`
+    SELECT id, uuid FROM tenants WHERE is_active = 1 ORDER BY id ASC
+  `).all<{ id: number; uuid: string }>();
+
+  const entries: { id: number; uuid: Uint8Array }[] = [];
+  for (const row of rows.results || []) {
+    const uuid = hexToBytes(row.uuid);
+    if (!uuid || uuid.length < 4 || uuid.length > 16 || row.id > 0xffff) continue;
+    entries.push({ id: row.id, uuid });
+  }
+  if (entries.length > TENANTS_MAX) {
+    return c.json({ error: `Too many tenants (${entries.length})` }, 500);
+  }
+
+  const body = new Uint8Array(8 + entries.reduce((n, e) => n + 3 + e.uuid.length, 0));
+  const view = new DataView(body.buffer);
+  body.set([0x54, 0x4e, TENANTS_VERSION, 0]);
+  view.setUint32(4, entries.length, true);
+  let pos = 8;
+  for (const entry of entries) {
+    view.setUint16(pos, entry.id, true);
+    body[pos + 2] = entry.uuid.length;
+    body.set(entry.uuid, pos + 3);
+    pos += 3 + entry.uuid.length;
+  }
+
+  const etag = `"tn-${entries.length}-${allowlistHash(body).toString(16)}"`;
+  if (c.req.header("If-None-Match") === etag) {
+    return new Response(null, { status: 304, headers: { 'ETag': etag } });
+  }
+  return new Response(body, {
+    headers: {
+      'Content-Type': 'application/vnd.autoattend.tenants',
+      'Content-Length': String(body.length),
+      'ETag': etag,
+      'Cache-Control': 'no-cache',
+    },
+  });
+});
+
+// Active tenants (protected route)
+app.get("/api/tenants", authMiddleware, async (c) => {
+  const result = await c.env.DB.prepare(`
+    SELECT id, name, uuid, is_active, created_at, updated_at FROM tenants WHERE is_active = 1 ORDER BY id ASC
+  `).all();
+  return c.json(result.results || []);
+});
+
+// Add a tenant, or reactivate one that was deactivated with the same UUID (protected route)
+app.post("/api/tenants", authMiddleware, zValidator("json", CreateTenantSchema), async (c) => {
+  const { name, uuid } = c.req.valid("json");
+  const db = c.env.DB;
+
+  try {
+    const existing = await db.prepare(`SELECT id, is_active FROM tenants WHERE uuid = ?`)
+      .bind(uuid).first<{ id: number; is_active: number }>();
+    if (existing?.is_active) {
+      return c.json({ error: `A tenant with UUID ${uuid} already exists` }, 409);
+    }
+    if (existing) {
+      await db.prepare(`UPDATE tenants SET name = ?, is_active = 1, updated_at = CURRENT_TIMESTAMP WHERE id = ?`)
+        .bind(name, existing.id).run();
+      return c.json({ id: existing.id, name, uuid, is_active: 1 });
+    }
+    const result = await db.prepare(`INSERT INTO tenants (name, uuid) VALUES (?, ?)`).bind(name, uuid).run();
+    return c.json({ id: result.meta.last_row_id, name, uuid, is_active: 1 }, 201);
+  } catch (error) {
+    console.error('Create tenant error:', error);
+    return c.json({ error: 'Failed to create tenant' }, 400);
+  }
+});
+
+// Soft delete (deactivate) tenant; scanners drop its UUID at their next tenant sync
+app.delete("/api/tenants/:id", authMiddleware, async (c) => {
+  const tenantId = parseInt(c.req.param("id"));
+  try {
+    const result = await c.env.DB.prepare(`UPDATE tenants SET is_active = 0, updated_at = CURRENT_TIMESTAMP WHERE id = ?`)
+      .bind(tenantId).run();
+    if (!result.success) return c.json({ error: 'Failed to deactivate tenant' }, 400);
+    return c.json({ success: true });
+  } catch (error) {
+    console.error('Delete tenant error:', error);
+    return c.json({ error: 'Failed to delete tenant' }, 400);
   }
 });
 
@@ -882,6 +1667,7 @@ app.get("/api/attendance", authMiddleware, async (c) => {
       ar.company_uuid,
       ar.hex_value,
       ar.status,
+      ar.break_duration_seconds,
       ar.recorded_at,
       ar.day_of_week,
       ar.date,
@@ -952,6 +1738,7 @@ app.get("/api/employees/:id/attendance", authMiddleware, async (c) => {
       ar.company_uuid,
       ar.hex_value,
       ar.status,
+      ar.break_duration_seconds,
       ar.recorded_at,
       ar.day_of_week,
       ar.date,
@@ -1041,6 +1828,7 @@ app.get('/api/attendance/export', authMiddleware, async (c) => {
       ar.company_uuid,
       ar.hex_value,
       ar.status,
+      ar.break_duration_seconds,
       ar.recorded_at,
       ar.day_of_week,
       ar.date,
@@ -1089,7 +1877,7 @@ app.get('/api/attendance/export', authMiddleware, async (c) => {
 
   const result = await db.prepare(query).bind(...params).all();
   const rows = (result.results || []) as Array<{
-    date: string; time: string; employee_name: string; employee_role: string | null; employee_department: string | null; status: string; hex_value: string; employee_emp_id: string | null;
+    date: string; time: string; employee_name: string; employee_role: string | null; employee_department: string | null; status: string; break_duration_seconds: number | null; hex_value: string; employee_emp_id: string | null;
   }>;
 
   // Compute break annotations similar to UI (group by employee+date)
@@ -1102,6 +1890,11 @@ app.get('/api/attendance/export', authMiddleware, async (c) => {
     byKey.set(key, list);
   });
   const annotations: Record<string, { breakType?: string; breakDuration?: string; first?: boolean; last?: boolean }> = {};
+  const format = (seconds: number) => {
+    const s = Math.max(0, Math.floor(seconds));
+    const m = Math.floor(s / 60); const rem = s % 60;
+    if (m === 0) return `${rem}s`; if (rem === 0) return `${m}m`; return `${m}m ${rem}s`;
+  };
   for (const [, list] of byKey) {
     const sorted = list.slice().sort((a,b) => new Date(a.time ? `${a.date}T${a.time}` : a.date).getTime() - new Date(b.time ? `${b.date}T${b.time}` : b.date).getTime());
     let lastCheckoutTs: number | null = null;
@@ -1114,17 +1907,18 @@ app.get('/api/attendance/export', authMiddleware, async (c) => {
         if (firstCheckinId == null) firstCheckinId = idKey;
         if (lastCheckoutTs != null) {
           const diff = (ts - lastCheckoutTs) / 1000;
-          const format = (seconds: number) => {
-            const s = Math.max(0, Math.floor(seconds));
-            const m = Math.floor(s / 60); const rem = s % 60;
-            if (m === 0) return `${rem}s`; if (rem === 0) return `${m}m`; return `${m}m ${rem}s`;
-          };
           if (diff < 5*60) annotations[idKey] = { breakType: 'Short break', breakDuration: format(diff) };
           else if (diff >= 10*60) annotations[idKey] = { breakType: 'Lunch break', breakDuration: format(diff) };
           else annotations[idKey] = { breakType: 'Break', breakDuration: format(diff) };
         }
       } else if (r.status === 'checkout') {
         lastCheckoutTs = ts; lastCheckoutId = idKey;
+      } else {
+        // Break segments from the scanners (ESP32/Sessions.h) carry their own length
+        annotations[idKey] = {
+          breakType: r.status === 'short_break' ? 'Short break' : 'Lunch break',
+          breakDuration: format(r.break_duration_seconds ?? 0),
+        };
       }
     }
     if (firstCheckinId) annotations[firstCheckinId] = { ...(annotations[firstCheckinId] || {}), first: true };
@@ -1167,6 +1961,9 @@ app.get('/api/attendance/export', authMiddleware, async (c) => {
 // OTA Endpoints (R2-backed)
 // ==========================
 
+// Publish a delta only if it is at most this fraction of the full image
+const DELTA_MAX_RATIO = 0.5;
+
 // Public: manifest describing latest firmware
 app.get('/api/ota/manifest', async (c) => {
   const r2 = c.env.R2_BUCKET;
@@ -1178,9 +1975,30 @@ app.get('/api/ota/manifest', async (c) => {
   if (!data.download_url && data.key) {
     data.download_url = `/api/ota/download?key=${encodeURIComponent(data.key)}`;
   }
+  if (!data.delta_download_url && data.delta_key) {
+    data.delta_download_url = `/api/ota/download?key=${encodeURIComponent(data.delta_key)}`;
+  }
   return c.json(data);
 });
 
+// Parse a single "bytes=start-[end]" or "bytes=-suffix" range against an object size.
+// Returns null when the header should be ignored (malformed, multiple ranges).
+function parseByteRange(header: string, size: number): { offset: number; length: number } | 'unsatisfiable' | null {
+  const m = /^bytes=(\d*)-(\d*)$/.exec(header.trim());
+  if (!m || (m[1] === '' && m[2] === '')) return null;
+  if (m[1] === '') {
+    const suffix = Number(m[2]);
+    if (suffix === 0) return 'unsatisfiable';
+    const length = Math.min(suffix, size);
+    return { offset: size - length, length };
+  }
+  const start = Number(m[1]);
+  if (start >= size) return 'unsatisfiable';
+  const end = m[2] === '' ? size - 1 : Math.min(Number(m[2]), size - 1);
+  if (end < start) return null;
+  return { offset: start, length: end - start + 1 };
+}
+
 // Public: stream firmware from R2
 app.get('/api/ota/download', async (c) => {
   const r2 = c.env.R2_BUCKET;
@@ -1194,6 +2012,37 @@ app.get('/api/ota/download', async (c) => {
     downloadKey = data.key;
   }
   if (!downloadKey) return c.json({ error: 'Missing key' }, 400);
+
+  // Resumable downloads: honour a single "Range: bytes=..." request
+  const rangeHeader = c.req.header('Range');
+  if (rangeHeader) {
+    const head = await r2.head(downloadKey);
+    if (!head) return c.json({ error: 'Firmware not found' }, 404);
+    const range = parseByteRange(rangeHeader, head.size);
+    if (range === 'unsatisfiable') {
+      return new Response(null, {
+        status: 416,
+        headers: { 'Content-Range': `bytes */${head.size}`, 'Accept-Ranges': 'bytes' }
+      });
+    }
+    if (range) {
+      const part = await r2.get(downloadKey, { range });
+      if (!part) return c.json({ error: 'Firmware not found' }, 404);
+      return new Response(part.body, {
+        status: 206,
+        headers: {
+          'Content-Type': 'application/octet-stream',
+          'Content-Length': String(range.length),
+          'Content-Range': `bytes ${range.offset}-${range.offset + range.length - 1}/${head.size}`,
+          'Accept-Ranges': 'bytes',
+          'ETag': head.httpEtag,
+          'Content-Disposition': 'attachment; filename="firmware.bin"'
+        }
+      });
+    }
+    // Malformed or multi-range requests fall through to the full object
+  }
+
   const obj = await r2.get(downloadKey);
   if (!obj) return c.json({ error: 'Firmware not found' }, 404);
   return new Response(obj.body, {
@@ -1201,6 +2050,8 @@ app.get('/api/ota/download', async (c) => {
     headers: {
       'Content-Type': 'application/octet-stream',
       'Content-Length': String(obj.size || 0),
+      'Accept-Ranges': 'bytes',
+      'ETag': obj.httpEtag,
       'Content-Disposition': 'attachment; filename="firmware.bin"'
     }
   });
@@ -1229,13 +2080,37 @@ app.post('/api/ota/upload', authMiddleware, async (c) => {
     }
   });
 
-  const manifest = {
+  const manifest: Record<string, string | number> = {
     version,
     key,
     size,
     sha256,
     uploaded_at: new Date().toISOString(),
   };
+
+  // Delta from the previously published image, so scanners already running it only
+  // download what changed. Skipped when it would not save at least DELTA_MAX_RATIO.
+  const previousManifest = await r2.get('ota/manifest.json');
+  if (previousManifest) {
+    const previous = JSON.parse(await previousManifest.text());
+    const previousImage = previous.key && previous.version !== version ? await r2.get(previous.key) : null;
+    if (previousImage) {
+      const base = new Uint8Array(await previousImage.arrayBuffer());
+      const baseHash = new Uint8Array(await crypto.subtle.digest('SHA-256', base));
+      const target = new Uint8Array(buf);
+      const patch = buildDeltaPatch(base, target, baseHash, new Uint8Array(hash));
+      const roundTrip = applyDeltaPatch(base, patch);
+      const verified =
+        roundTrip !== null && roundTrip.length === target.length && roundTrip.every((b, i) => b === target[i]);
+      if (verified && patch.length <= size * DELTA_MAX_RATIO) {
+        const deltaKey = `ota/delta-${previous.version}-to-${version}.bin`;
+        await r2.put(deltaKey, patch, { httpMetadata: { contentType: 'application/octet-stream' } });
+        manifest.delta_key = deltaKey;
+        manifest.delta_base_version = String(previous.version);
+        manifest.delta_size = patch.length;
+      }
+    }
+  }
   await r2.put('ota/manifest.json', JSON.stringify(manifest, null, 2), {
     httpMetadata: { contentType: 'application/json' }
   });
@@ -0,0 +1,190 @@
+// Firmware delta patches for OTA (applied on the scanner by ESP32/DeltaPatch.h).
+//
+// Format (little-endian):
+//   header  "AAD1" | baseSize u32 | newSize u32 | baseSha256[32] | newSha256[32]
+//   ops     0x01 COPY varint offset, varint length | 0x02 INSERT varint length, bytes | 0x00 END
+//
+// Matching is rsync-style: every DELTA_BLOCK-aligned block of the base image is indexed by a
+// rolling hash, the new image is scanned byte by byte, and each hit is verified and grown in
+// both directions. Rebuilt firmware mostly shifts code around, which this captures as COPYs.
+
+const DELTA_BLOCK = 32;
+const HASH_MULT = 257;
+
+// HASH_MULT^(DELTA_BLOCK-1) mod 2^32, used to drop the outgoing byte from the rolling hash
+const HASH_OUT = (() => {
+  let p = 1;
+  for (let i = 0; i < DELTA_BLOCK - 1; i++) p = Math.imul(p, HASH_MULT);
+  return p;
+})();
+
+function blockHash(data: Uint8Array, start: number): number {
+  let h = 0;
+  for (let i = 0; i < DELTA_BLOCK; i++) h = (Math.imul(h, HASH_MULT) + data[start + i]) | 0;
+  return h;
+}
+
+class PatchWriter {
+  private chunks: Uint8Array[] = [];
+  private current = new Uint8Array(64 * 1024);
+  private used = 0;
+  length = 0;
+
+  byte(b: number) {
+    if (this.used === this.current.length) this.flush();
+    this.current[this.used++] = b;
+    this.length++;
+  }
+
+  varint(v: number) {
+    while (v >= 0x80) {
+      this.byte((v & 0x7f) | 0x80);
+      v >>>= 7;
+    }
+    this.byte(v);
+  }
+
+  bytes(data: Uint8Array) {
+    for (let i = 0; i < data.length; i++) this.byte(data[i]);
+  }
+
+  u32(v: number) {
+    this.byte(v & 0xff);
+    this.byte((v >>> 8) & 0xff);
+    this.byte((v >>> 16) & 0xff);
+    this.byte((v >>> 24) & 0xff);
+  }
+
+  finish(): Uint8Array {
+    this.flush();
+    const out = new Uint8Array(this.length);
+    let offset = 0;
+    for (const chunk of this.chunks) {
+      out.set(chunk, offset);
+      offset += chunk.length;
+    }
+    return out;
+  }
+
+  private flush() {
+    if (this.used > 0) this.chunks.push(this.current.slice(0, this.used));
+    this.used = 0;
+  }
+}
+
+export function buildDeltaPatch(
+  base: Uint8Array,
+  target: Uint8Array,
+  baseSha256: Uint8Array,
+  targetSha256: Uint8Array
+): Uint8Array {
+  const out = new PatchWriter();
+  out.bytes(new TextEncoder().encode('AAD1'));
+  out.u32(base.length);
+  out.u32(target.length);
+  out.bytes(baseSha256);
+  out.bytes(targetSha256);
+
+  // First base offset for each block hash (collisions are verified byte by byte)
+  const index = new Map<number, number>();
+  for (let off = 0; off + DELTA_BLOCK <= base.length; off += DELTA_BLOCK) {
+    const h = blockHash(base, off);
+    if (!index.has(h)) index.set(h, off);
+  }
+
+  let literalStart = 0;
+  const emitLiteral = (end: number) => {
+    if (end <= literalStart) return;
+    out.byte(0x02);
+    out.varint(end - literalStart);
+    out.bytes(target.subarray(literalStart, end));
+  };
+
+  let i = 0;
+  let h = target.length >= DELTA_BLOCK ? blockHash(target, 0) : 0;
+  while (i + DELTA_BLOCK <= target.length) {
+    const candidate = index.get(h);
+    if (candidate !== undefined && blockEquals(base, candidate, target, i)) {
+      // Grow the match forwards, then backwards into the pending literal
+      let end = i + DELTA_BLOCK;
+      let baseEnd = candidate + DELTA_BLOCK;
+      while (end < target.length && baseEnd < base.length && target[end] === base[baseEnd]) {
+        end++;
+        baseEnd++;
+      }
+      let start = i;
+      let baseStart = candidate;
+      while (start > literalStart && baseStart > 0 && target[start - 1] === base[baseStart - 1]) {
+        start--;
+        baseStart--;
+      }
+      emitLiteral(start);
+      out.byte(0x01);
+      out.varint(baseStart);
+      out.varint(end - start);
+      literalStart = end;
+      i = end;
+      if (i + DELTA_BLOCK <= target.length) h = blockHash(target, i);
+      continue;
+    }
+    if (i + DELTA_BLOCK >= target.length) break;
+    h = (Math.imul(h - Math.imul(target[i], HASH_OUT), HASH_MULT) + target[i + DELTA_BLOCK]) | 0;
+    i++;
+  }
+  emitLiteral(target.length);
+  out.byte(0x00);
+  return out.finish();
+}
+
+function blockEquals(base: Uint8Array, baseOff: number, target: Uint8Array, targetOff: number): boolean {
+  for (let k = 0; k < DELTA_BLOCK; k++) {
+    if (base[baseOff + k] !== target[targetOff + k]) return false;
+  }
+  return true;
+}
+
+// Reference applier, used to check a freshly built patch before publishing it
+export function applyDeltaPatch(base: Uint8Array, patch: Uint8Array): Uint8Array | null {
+  const view = new DataView(patch.buffer, patch.byteOffset, patch.byteLength);
+  if (patch.length < 77 || new TextDecoder().decode(patch.subarray(0, 4)) !== 'AAD1') return null;
+  if (view.getUint32(4, true) !== base.length) return null;
+  const out = new Uint8Array(view.getUint32(8, true));
+  let pos = 76;
+  let produced = 0;
+  const varint = () => {
+    let v = 0;
+    let shift = 0;
+    for (;;) {
+      if (pos >= patch.length || shift > 28) throw new Error('truncated varint');
+      const b = patch[pos++];
+      v += (b & 0x7f) * 2 ** shift;
+      shift += 7;
+      if ((b & 0x80) === 0) return v;
+    }
+  };
+  try {
+    for (;;) {
+      if (pos >= patch.length) return null;
+      const op = patch[pos++];
+      if (op === 0x00) break;
+      if (op === 0x01) {
+        const offset = varint();
+        const length = varint();
+        if (offset + length > base.length || produced + length > out.length) return null;
+        out.set(base.subarray(offset, offset + length), produced);
+        produced += length;
+      } else if (op === 0x02) {
+        const length = varint();
+        if (pos + length > patch.length || produced + length > out.length) return null;
+        out.set(patch.subarray(pos, pos + length), produced);
+        pos += length;
+        produced += length;
+      } else {
+        return null;
+      }
+    }
+  } catch {
+    return null;
+  }
+  return produced === out.length && pos === patch.length ? out : null;
+}